@@ -0,0 +1,48 @@
+# Opens N connections, logs each one in, then holds them idle.
+# Connections go to 127.0.0.1-8 in turn so one client does not run out of
+# ephemeral ports. Run several with disjoint BASE values for more.
+# usage: c100k.py N PORT BASE HOLD_SECONDS
+import resource, socket, struct, sys, time
+
+TLV_LOGIN_REQUEST = 0x0001
+LOGIN_SUCCESS = 0
+
+n, port, base, hold = int(sys.argv[1]), int(sys.argv[2]), int(sys.argv[3]), float(sys.argv[4])
+soft, hard = resource.getrlimit(resource.RLIMIT_NOFILE)
+resource.setrlimit(resource.RLIMIT_NOFILE, (hard, hard))
+
+socks = []
+started = time.time()
+for i in range(n):
+    s = socket.socket()
+    s.setblocking(False)
+    try:
+        s.connect(("127.0.0.%d" % (1 + (base + i) % 8), port))
+    except BlockingIOError:
+        pass
+    socks.append(s)
+    # Pace the SYNs so the listen backlog is not overrun
+    if i % 1000 == 999:
+        time.sleep(0.05)
+
+for i, s in enumerate(socks):
+    nick = b"c%d" % (base + i)
+    v = bytes([len(nick)]) + nick
+    while True:
+        try:
+            s.send(struct.pack("!HH", TLV_LOGIN_REQUEST, len(v)) + v)
+            break
+        except (BlockingIOError, OSError):
+            time.sleep(0.01)
+
+ok = 0
+for s in socks:
+    s.setblocking(True)
+    s.settimeout(60)
+    try:
+        h = s.recv(64)
+        ok += len(h) >= 5 and h[4] == LOGIN_SUCCESS
+    except OSError:
+        pass
+print("client %d: %d/%d logged in after %.1f s" % (base, ok, n, time.time() - started), flush=True)
+time.sleep(hold)
@@ -0,0 +1,157 @@
+// The unbounded leaderboard checked against a brute-force reference, then
+// insert, update and rank-query times with PLAYERS ranked, next to the cost
+// of one DRAM miss on the same machine.
+// Build from the repository root:
+//     cc -O2 -Iinclude bench/leaderboard_bench.c src/leaderboard.c src/tlv.c
+//        src/text_validate.c src/shared_arena.c -lpthread -o leaderboard_bench
+// usage: leaderboard_bench [PLAYERS]
+#include "leaderboard.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define CHECK_PLAYERS   3000
+#define CHECK_RESULTS   30000
+#define CHECK_EVERY     97
+#define ROUNDS          1000000
+#define CHASE_SLOTS     (32u << 20)     // 256 MB of indexes, far past the LLC
+#define CHASE_STEPS     5000000
+
+// A player's best result in the reference, arrival breaks ties
+struct best {
+    uint8_t  score;
+    uint32_t time_seconds;
+    uint32_t arrival;
+    int      has;
+};
+
+static double now_s(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int ahead(const struct best *a, const struct best *b) {
+    if (a->score != b->score) {
+        return a->score > b->score;
+    }
+    if (a->time_seconds != b->time_seconds) {
+        return a->time_seconds < b->time_seconds;
+    }
+    return a->arrival <= b->arrival;
+}
+
+static int check(void) {
+    static struct leaderboard board;
+    static struct best reference[CHECK_PLAYERS];
+    char nick[MAX_NICK_LENGTH];
+
+    srand(7);
+    leaderboard_init(&board);
+    for (uint32_t i = 0; i < CHECK_RESULTS; i++) {
+        int player = rand() % CHECK_PLAYERS;
+        struct best result = { rand() % 11, rand() % 100, i, 1 };
+        struct best *held = &reference[player];
+
+        snprintf(nick, sizeof(nick), "p%d", player);
+        int better = !held->has || result.score > held->score ||
+                     (result.score == held->score && result.time_seconds < held->time_seconds);
+        if ((leaderboard_insert(&board, nick, result.score, result.time_seconds) >= 0) != better) {
+            printf("result %u: kept/dropped differs from the reference\n", i);
+            return -1;
+        }
+        if (better) {
+            *held = result;
+        }
+        if (i % CHECK_EVERY != 0) {
+            continue;
+        }
+
+        int asked = rand() % CHECK_PLAYERS;
+        uint32_t total, want = 0, players = 0;
+        snprintf(nick, sizeof(nick), "p%d", asked);
+        uint32_t rank = leaderboard_rank(&board, nick, NULL, &total);
+        for (int j = 0; j < CHECK_PLAYERS; j++) {
+            if (reference[j].has) {
+                players++;
+                want += reference[asked].has && ahead(&reference[j], &reference[asked]);
+            }
+        }
+        if (rank != want || total != players) {
+            printf("result %u: rank %u of %u, reference %u of %u\n", i, rank, total, want, players);
+            return -1;
+        }
+    }
+    printf("%d results over %d players match the reference (%u ranked)\n",
+           CHECK_RESULTS, CHECK_PLAYERS, leaderboard_count(&board));
+    leaderboard_destroy(&board);
+    return 0;
+}
+
+// Dependent loads through a random cycle: every step misses the caches
+static void dram_miss(void) {
+    uint32_t *next = malloc(CHASE_SLOTS * sizeof(*next));
+    uint32_t at = 0;
+
+    if (!next) {
+        return;
+    }
+    for (uint32_t i = 0; i < CHASE_SLOTS; i++) {
+        next[i] = i;
+    }
+    // Sattolo's shuffle leaves one cycle through every slot
+    for (uint32_t i = CHASE_SLOTS - 1; i > 0; i--) {
+        uint32_t j = (((uint32_t)rand() << 16) ^ (uint32_t)rand()) % i;
+        uint32_t swap = next[i];
+        next[i] = next[j];
+        next[j] = swap;
+    }
+    double started = now_s();
+    for (int i = 0; i < CHASE_STEPS; i++) {
+        at = next[at];
+    }
+    printf("one DRAM miss: %.0f ns (%u)\n", (now_s() - started) / CHASE_STEPS * 1e9, at % 2);
+    free(next);
+}
+
+int main(int argc, char **argv) {
+    int players = argc > 1 ? atoi(argv[1]) : 1000000;
+    static struct leaderboard board;
+    char nick[MAX_NICK_LENGTH];
+    uint64_t ranks = 0;
+
+    if (check() < 0) {
+        return 1;
+    }
+    dram_miss();
+
+    leaderboard_init(&board);
+    double started = now_s();
+    for (int i = 0; i < players; i++) {
+        snprintf(nick, sizeof(nick), "player%d", i);
+        if (leaderboard_insert(&board, nick, rand() % 11, rand() % 3600) < 0) {
+            fprintf(stderr, "out of memory\n");
+            return 1;
+        }
+    }
+    printf("%d players: insert %.1f us\n", players, (now_s() - started) / players * 1e6);
+
+    // Most of these do not beat the player's best and change nothing
+    started = now_s();
+    for (int i = 0; i < ROUNDS; i++) {
+        snprintf(nick, sizeof(nick), "player%d", rand() % players);
+        leaderboard_insert(&board, nick, rand() % 11, rand() % 3600);
+    }
+    printf("  update best %.1f us\n", (now_s() - started) / ROUNDS * 1e6);
+
+    started = now_s();
+    for (int i = 0; i < ROUNDS; i++) {
+        snprintf(nick, sizeof(nick), "player%d", rand() % players);
+        ranks += leaderboard_rank(&board, nick, NULL, NULL);
+    }
+    printf("  rank query %.1f us (%llu)\n", (now_s() - started) / ROUNDS * 1e6,
+           (unsigned long long)(ranks % 2));
+    leaderboard_destroy(&board);
+    return 0;
+}
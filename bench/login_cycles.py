@@ -0,0 +1,15 @@
+# Sequential connect, login, close cycles, each under a new nick.
+# usage: login_cycles.py PORT [CYCLES]
+import sys, time
+from tlv import LOGIN_SUCCESS, conn, login
+
+port = int(sys.argv[1])
+cycles = int(sys.argv[2]) if len(sys.argv) > 2 else 7000
+ok = 0
+started = time.time()
+for i in range(cycles):
+    s = conn(port)
+    t, v = login(s, "churn%d" % i)
+    ok += len(v) > 0 and v[0] == LOGIN_SUCCESS
+    s.close()
+print("%d/%d logins succeeded in %.2f s" % (ok, cycles, time.time() - started))
@@ -0,0 +1,112 @@
+// Login storm against the nick registry, next to the flat array it replaced.
+// Build from the repository root:
+//     cc -O2 -Iinclude bench/nick_registry_bench.c src/nick_registry.c src/shared_arena.c -lpthread
+#include "nick_registry.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define HELD_NICKS      5000
+#define SCAN_ROUNDS     20
+#define CLAIM_ROUNDS    200
+#define STORM_THREADS   4
+#define STORM_ROUNDS    50
+
+// The array of logged-in nicks used before the registry, full after 5000 logins
+static char     old_nicks[HELD_NICKS][33];
+static int      old_count;
+
+static struct nick_registry registry;
+
+static int old_taken(const char *nick) {
+    for ( int i = 0; i < old_count; i++ ) {
+        if ( strcmp(old_nicks[i], nick) == 0 ) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static double now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Each thread claims its own STORM_ROUNDS * HELD_NICKS nicks
+static void *storm(void *arg) {
+    long id = (long)arg;
+    char nick[32];
+
+    for ( int round = 0; round < STORM_ROUNDS; round++ ) {
+        for ( int i = 0; i < HELD_NICKS; i++ ) {
+            snprintf(nick, sizeof(nick), "t%ld_user%d", id, i);
+            nick_registry_claim(&registry, nick, i);
+        }
+    }
+    return NULL;
+}
+
+int main(void) {
+    char        nick[32];
+    int         hits = 0;
+    double      started;
+    pthread_t   threads[STORM_THREADS];
+
+    // Steady state of the old array: full, and every new name scans all of it
+    for ( int i = 0; i < HELD_NICKS; i++ ) {
+        snprintf(old_nicks[old_count++], sizeof(old_nicks[0]), "user%d", i);
+    }
+    started = now_ns();
+    for ( int round = 0; round < SCAN_ROUNDS; round++ ) {
+        for ( int i = 0; i < HELD_NICKS; i++ ) {
+            snprintf(nick, sizeof(nick), "new%d", i);
+            hits += old_taken(nick);
+        }
+    }
+    printf("linear scan, %d held: %.0f ns per login\n", HELD_NICKS,
+           (now_ns() - started) / (SCAN_ROUNDS * (double)HELD_NICKS));
+
+    if ( nick_registry_init(&registry) < 0 ) {
+        fprintf(stderr, "nick_registry_init failed\n");
+        return 1;
+    }
+    for ( int i = 0; i < HELD_NICKS; i++ ) {
+        snprintf(nick, sizeof(nick), "user%d", i);
+        nick_registry_claim(&registry, nick, i);
+    }
+    started = now_ns();
+    for ( int round = 0; round < CLAIM_ROUNDS; round++ ) {
+        for ( int i = 0; i < HELD_NICKS; i++ ) {
+            snprintf(nick, sizeof(nick), "new%d", i);
+            nick_registry_claim(&registry, nick, 100000 + i);
+            nick_registry_release(&registry, nick, 100000 + i);
+        }
+    }
+    printf("registry, %d held: %.0f ns per claim plus release\n", HELD_NICKS,
+           (now_ns() - started) / (CLAIM_ROUNDS * (double)HELD_NICKS));
+
+    // The harness's own share of the figure above
+    started = now_ns();
+    for ( int round = 0; round < CLAIM_ROUNDS; round++ ) {
+        for ( int i = 0; i < HELD_NICKS; i++ ) {
+            snprintf(nick, sizeof(nick), "new%d", i);
+        }
+    }
+    printf("  of which snprintf: %.0f ns\n", (now_ns() - started) / (CLAIM_ROUNDS * (double)HELD_NICKS));
+
+    started = now_ns();
+    for ( long t = 0; t < STORM_THREADS; t++ ) {
+        pthread_create(&threads[t], NULL, storm, (void *)t);
+    }
+    for ( int t = 0; t < STORM_THREADS; t++ ) {
+        pthread_join(threads[t], NULL);
+    }
+    printf("%d threads x %d claims: %.0f ns per claim of wall time, %u held\n",
+           STORM_THREADS, STORM_ROUNDS * HELD_NICKS,
+           (now_ns() - started) / (STORM_THREADS * (double)STORM_ROUNDS * HELD_NICKS),
+           nick_registry_count(&registry));
+    return hits != 0;
+}
@@ -0,0 +1,9 @@
+#!/bin/sh
+# Prints the summed PSS of all running server processes, in bytes
+total=0
+for pid in $(pgrep -x server); do
+    # A process may exit between pgrep and the read
+    kb=$(awk '/^Pss:/ {print $2}' /proc/$pid/smaps_rollup 2>/dev/null)
+    total=$((total + ${kb:-0}))
+done
+echo $((total * 1024))
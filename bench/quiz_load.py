@@ -0,0 +1,26 @@
+# Concurrent clients each taking tests: login under a new nick, answer the
+# ten test questions, close. Prints completed tests per second.
+# usage: quiz_load.py PORT [CLIENTS] [TESTS_PER_CLIENT]
+import sys, time
+from concurrent.futures import ThreadPoolExecutor
+from tlv import MODE_TEST, conn, login, question, answer
+
+TEST_QUESTION_COUNT = 10
+
+port = int(sys.argv[1])
+clients = int(sys.argv[2]) if len(sys.argv) > 2 else 16
+tests = int(sys.argv[3]) if len(sys.argv) > 3 else 25
+
+def run(client):
+    for test in range(tests):
+        s = conn(port)
+        login(s, "load%d_%d" % (client, test))
+        for index in range(TEST_QUESTION_COUNT):
+            t, v, qid = question(s, MODE_TEST, index)
+            answer(s, qid, 0)
+        s.close()
+
+started = time.time()
+with ThreadPoolExecutor(clients) as pool:
+    list(pool.map(run, range(clients)))
+print("%.0f tests/s" % (clients * tests / (time.time() - started)))
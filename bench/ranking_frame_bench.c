@@ -0,0 +1,114 @@
+// Cost of serving REQUEST_RANKING from the cached frame, next to the copy,
+// bubble sort and encode of 100 results that every request used to do.
+// Build from the repository root:
+//     cc -O2 -Iinclude bench/ranking_frame_bench.c src/leaderboard.c src/tlv.c
+//        src/text_validate.c src/shared_arena.c -lpthread -o ranking_frame_bench
+#include "leaderboard.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define PLAYERS         100     // MAX_RANKINGS before unbounded rankings
+#define CHECK_PLAYERS   3000
+#define COPY_ROUNDS     1000000
+#define SORT_ROUNDS     20000
+#define INSERT_ROUNDS   1000000
+
+static double now_s(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int by_rank(const void *a, const void *b) {
+    const struct score_entry *x = a, *y = b;
+    if (x->score != y->score) {
+        return y->score - x->score;
+    }
+    return (x->time_seconds > y->time_seconds) - (x->time_seconds < y->time_seconds);
+}
+
+// What REQUEST_RANKING did before the cached frame
+static size_t old_ranking(uint8_t *frame, const struct score_entry *results) {
+    struct score_entry sorted[PLAYERS];
+    char nicks[LEADERBOARD_TOP][MAX_NICK_LENGTH];
+    uint8_t scores[LEADERBOARD_TOP];
+    uint32_t times[LEADERBOARD_TOP];
+
+    memcpy(sorted, results, sizeof(sorted));
+    for (int i = 0; i < PLAYERS - 1; i++) {
+        for (int j = 0; j < PLAYERS - 1 - i; j++) {
+            if (by_rank(&sorted[j], &sorted[j + 1]) > 0) {
+                struct score_entry swap = sorted[j];
+                sorted[j] = sorted[j + 1];
+                sorted[j + 1] = swap;
+            }
+        }
+    }
+    for (int i = 0; i < LEADERBOARD_TOP; i++) {
+        memcpy(nicks[i], sorted[i].nick, MAX_NICK_LENGTH);
+        scores[i] = sorted[i].score;
+        times[i] = sorted[i].time_seconds;
+    }
+    return tlv_create_ranking_data(frame, LEADERBOARD_TOP, nicks, scores, times);
+}
+
+int main(void) {
+    static struct leaderboard board;
+    static struct score_entry reference[CHECK_PLAYERS], page[CHECK_PLAYERS];
+    uint8_t frame[LEADERBOARD_FRAME_SIZE];
+    char nick[MAX_NICK_LENGTH];
+    double started;
+
+    // Order against a qsort reference, one result per player
+    srand(3);
+    leaderboard_init(&board);
+    for (int i = 0; i < CHECK_PLAYERS; i++) {
+        snprintf(reference[i].nick, sizeof(reference[i].nick), "p%d", i);
+        reference[i].score = rand() % 11;
+        reference[i].time_seconds = rand() % 600;
+        leaderboard_insert(&board, reference[i].nick, reference[i].score, reference[i].time_seconds);
+    }
+    qsort(reference, CHECK_PLAYERS, sizeof(reference[0]), by_rank);
+    uint32_t shown = leaderboard_page(&board, 0, CHECK_PLAYERS, page, NULL);
+    for (uint32_t i = 0; i < shown; i++) {
+        if (page[i].score != reference[i].score || page[i].time_seconds != reference[i].time_seconds) {
+            printf("order differs from qsort at rank %u\n", i + 1);
+            return 1;
+        }
+    }
+    printf("order of %u results matches qsort\n", shown);
+    leaderboard_destroy(&board);
+
+    leaderboard_init(&board);
+    for (int i = 0; i < PLAYERS; i++) {
+        leaderboard_insert(&board, reference[i].nick, reference[i].score, reference[i].time_seconds);
+    }
+    started = now_s();
+    for (int i = 0; i < COPY_ROUNDS; i++) {
+        leaderboard_copy_frame(&board, frame);
+        __asm__ volatile("" : : "r"(frame) : "memory");
+    }
+    printf("leaderboard_copy_frame, %d players: %.0f ns per request\n",
+           PLAYERS, (now_s() - started) / COPY_ROUNDS * 1e9);
+
+    started = now_s();
+    for (int i = 0; i < SORT_ROUNDS; i++) {
+        old_ranking(frame, reference);
+        __asm__ volatile("" : : "r"(frame) : "memory");
+    }
+    printf("copy + bubble sort + encode, %d results: %.1f us per request\n",
+           PLAYERS, (now_s() - started) / SORT_ROUNDS * 1e6);
+
+    // Results of the players already ranked, most of them not their best
+    started = now_s();
+    for (int i = 0; i < INSERT_ROUNDS; i++) {
+        snprintf(nick, sizeof(nick), "p%d", rand() % PLAYERS);
+        leaderboard_insert(&board, nick, rand() % 11, rand() % 600);
+    }
+    printf("leaderboard_insert, %d players: %.0f ns\n", PLAYERS, (now_s() - started) / INSERT_ROUNDS * 1e9);
+    leaderboard_destroy(&board);
+    return 0;
+}
@@ -0,0 +1,98 @@
+// Recovery time and group commit throughput of the score log.
+// Build from the repository root:
+//     cc -O2 -Iinclude bench/score_log_bench.c src/score_log.c src/question_bank.c src/quiz.c
+//        src/question_stats.c src/leaderboard.c src/ranking_window.c src/stats_counters.c
+//        src/search_index.c src/roaring_bitmap.c src/question_selector.c src/text_validate.c
+//        src/tlv.c src/shared_arena.c src/async_log.c -lcjson -lpthread -o score_log_bench
+// usage: score_log_bench DIR EVENTS CHUNK [PLAYERS]
+//     Recovers DIR into the "questions" bank and prints what it holds, then
+//     appends EVENTS results over PLAYERS nicks and waits until they are
+//     durable after every CHUNK of them. CHUNK 0 only recovers.
+#include "score_log.h"
+#include "question_bank.h"
+#include "leaderboard.h"
+#include "stats_counters.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define BANK_FILE   "resources/questions.json"
+
+static double now_s(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Same summary as wal_replay.py prints for the raw log
+static void summarize(struct question_bank *bank) {
+    static const char *probes[] = { "p1", "p77", "p999" };
+    struct score_entry top[3], best;
+    struct server_stats stats;
+    uint32_t total;
+
+    stats_collect(&bank->stats, &stats);
+    printf("tests=%u total=%u best=%u/%u %s players=%u\n", stats.tests_completed, stats.total_score,
+           stats.best_score, stats.best_time, stats.best_player, leaderboard_count(&bank->leaderboard));
+    uint32_t shown = leaderboard_page(&bank->leaderboard, 0, 3, top, NULL);
+    for (uint32_t i = 0; i < shown; i++) {
+        printf("%s %u %u\n", top[i].nick, top[i].score, top[i].time_seconds);
+    }
+    for (int i = 0; i < 3; i++) {
+        uint32_t rank = leaderboard_rank(&bank->leaderboard, probes[i], &best, &total);
+        if (rank > 0) {
+            printf("%s rank %u %u %u\n", probes[i], rank, best.score, best.time_seconds);
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc < 4) {
+        fprintf(stderr, "usage: %s DIR EVENTS CHUNK [PLAYERS]\n", argv[0]);
+        return 2;
+    }
+    const char *dir = argv[1];
+    long events = atol(argv[2]);
+    long chunk = atol(argv[3]);
+    long players = argc > 4 ? atol(argv[4]) : 1000000;
+
+    if (bank_load_file("questions", BANK_FILE) < 0) {
+        fprintf(stderr, "cannot load %s\n", BANK_FILE);
+        return 1;
+    }
+    double started = now_s();
+    long replayed = score_log_recover(dir);
+    if (replayed < 0) {
+        fprintf(stderr, "cannot recover %s\n", dir);
+        return 1;
+    }
+    struct question_bank *bank = bank_find("questions");
+    printf("recovered %ld logged events in %.2f s\n", replayed, now_s() - started);
+    summarize(bank);
+    if (chunk <= 0) {
+        return 0;
+    }
+
+    if (score_log_start() < 0) {
+        fprintf(stderr, "cannot open the log in %s\n", dir);
+        return 1;
+    }
+    char nick[32];
+    double queued = 0;
+    srand(1);
+    started = now_s();
+    for (long i = 0; i < events; ) {
+        double t = now_s();
+        for (long j = 0; j < chunk && i < events; j++, i++) {
+            snprintf(nick, sizeof(nick), "p%ld", rand() % players);
+            score_log_append("questions", nick, rand() % 11, rand() % 3600);
+        }
+        queued += now_s() - t;
+        score_log_flush();
+    }
+    double elapsed = now_s() - started;
+    printf("%ld events, %ld per sync: append %.0f ns per event, %.0f durable events/s\n",
+           events, chunk, queued / events * 1e9, events / elapsed);
+    return 0;
+}
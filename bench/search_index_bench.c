@@ -0,0 +1,130 @@
+// Build and AND-query times of the search index on synthetic documents,
+// checked against a brute-force scan.
+// Build from the repository root:
+//     cc -O2 -Iinclude bench/search_index_bench.c src/search_index.c -o search_index_bench
+// usage: search_index_bench [DOCUMENTS]
+#include "search_index.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define WORDS_PER_DOC   6
+#define VOCABULARY      2000
+#define ROUNDS          200
+#define FIRST_PAGE      256
+
+// Words of one document; every third one also contains "common"
+struct document {
+    uint16_t words[WORDS_PER_DOC];
+};
+
+static const char *queries[] = {
+    "w1900 common", "w1900 w3", "w3 w17", "w3 w17 common", "common", "w3",
+};
+
+static double now_s(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int has_term(const struct document *doc, uint32_t d, const char *term) {
+    if (strcmp(term, "common") == 0) {
+        return d % 3 == 0;
+    }
+    int word = atoi(term + 1);
+    for (int k = 0; k < WORDS_PER_DOC; k++) {
+        if (doc->words[k] == word) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Documents matching every term of the query, in order
+static int brute_force(const struct document *docs, uint32_t count, const char *query, uint32_t *out) {
+    char terms[4][16];
+    int nterms = 0, found = 0;
+
+    char copy[64];
+    snprintf(copy, sizeof(copy), "%s", query);
+    for (char *t = strtok(copy, " "); t && nterms < 4; t = strtok(NULL, " ")) {
+        snprintf(terms[nterms++], sizeof(terms[0]), "%s", t);
+    }
+    for (uint32_t d = 0; d < count; d++) {
+        int match = 1;
+        for (int t = 0; t < nterms && match; t++) {
+            match = has_term(&docs[d], d, terms[t]);
+        }
+        if (match) {
+            out[found++] = d;
+        }
+    }
+    return found;
+}
+
+int main(int argc, char **argv) {
+    uint32_t count = argc > 1 ? (uint32_t)atol(argv[1]) : 1000000;
+    struct document *docs = malloc(count * sizeof(*docs));
+    uint32_t *results = malloc(count * sizeof(*results));
+    uint32_t *expected = malloc(count * sizeof(*expected));
+    SearchIndex idx;
+    char text[128];
+    int failed = 0;
+
+    if (!docs || !results || !expected) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    // Zipf-like: small word numbers are far more frequent
+    srand(1);
+    search_index_init(&idx);
+    double started = now_s();
+    for (uint32_t d = 0; d < count; d++) {
+        int len = 0;
+        for (int k = 0; k < WORDS_PER_DOC; k++) {
+            docs[d].words[k] = rand() % (1 + rand() % VOCABULARY);
+            len += snprintf(text + len, sizeof(text) - len, "w%u ", docs[d].words[k]);
+        }
+        snprintf(text + len, sizeof(text) - len, "%s", d % 3 == 0 ? "common" : "");
+        if (search_index_add(&idx, d, text) < 0) {
+            fprintf(stderr, "out of memory\n");
+            return 1;
+        }
+    }
+    double built = now_s();
+    if (search_index_finalize(&idx) < 0) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    printf("%u documents: build %.2f s, finalize %.2f s, postings %.1f MB\n",
+           count, built - started, now_s() - built, idx.postings_len / 1e6);
+
+    for (size_t q = 0; q < sizeof(queries) / sizeof(queries[0]); q++) {
+        int found = 0, first = 0;
+
+        started = now_s();
+        for (int r = 0; r < ROUNDS; r++) {
+            found = search_index_query(&idx, queries[q], results, (int)count);
+        }
+        double all = (now_s() - started) / ROUNDS;
+        started = now_s();
+        for (int r = 0; r < ROUNDS; r++) {
+            first = search_index_query(&idx, queries[q], results, FIRST_PAGE);
+        }
+        double page = (now_s() - started) / ROUNDS;
+
+        search_index_query(&idx, queries[q], results, (int)count);
+        int want = brute_force(docs, count, queries[q], expected);
+        int ok = found == want && memcmp(results, expected, found * sizeof(*results)) == 0;
+        failed |= !ok;
+        printf("%-14s %7d docs %8.1f us, first %d %6.1f us  %s\n", queries[q], found, all * 1e6,
+               first, page * 1e6, ok ? "ok" : "MISMATCH");
+    }
+
+    search_index_free(&idx);
+    return failed;
+}
@@ -0,0 +1,43 @@
+# Minimal TLV client for the load tools: 2-byte type, 2-byte length, value
+import socket, struct
+
+TLV_LOGIN_REQUEST = 0x0001
+TLV_REQUEST_QUESTION = 0x0003
+TLV_QUESTION_DATA = 0x0004
+TLV_ANSWER_SUBMIT = 0x0005
+LOGIN_SUCCESS = 0
+MODE_TEST = 1
+
+def conn(port, host="127.0.0.1"):
+    s = socket.create_connection((host, port))
+    s.settimeout(3)
+    return s
+
+def send(s, t, v=b""):
+    s.sendall(struct.pack("!HH", t, len(v)) + v)
+
+def recv(s):
+    h = b""
+    while len(h) < 4:
+        h += s.recv(4 - len(h))
+    t, l = struct.unpack("!HH", h)
+    v = b""
+    while len(v) < l:
+        v += s.recv(l - len(v))
+    return t, v
+
+def login(s, nick):
+    send(s, TLV_LOGIN_REQUEST, bytes([len(nick)]) + nick.encode())
+    return recv(s)
+
+def question(s, mode, index):
+    send(s, TLV_REQUEST_QUESTION, bytes([mode, index]))
+    t, v = recv(s)
+    if t != TLV_QUESTION_DATA:
+        return t, v, None
+    qid, = struct.unpack("!I", v[:4])
+    return t, v, qid
+
+def answer(s, qid, a):
+    send(s, TLV_ANSWER_SUBMIT, struct.pack("!IB", qid, a))
+    return recv(s)
@@ -0,0 +1,40 @@
+# Writes UTF-8 test cases with Python's decoder as the reference verdict.
+# Record: u32 length (little endian), u8 0 valid / 255 invalid, bytes.
+# usage: utf8_cases.py OUT [COUNT] [SEED]
+import random, struct, sys
+
+out = open(sys.argv[1], "wb")
+count = int(sys.argv[2]) if len(sys.argv) > 2 else 200000
+random.seed(int(sys.argv[3]) if len(sys.argv) > 3 else 7)
+
+valid = [b"a", b"Z", b" ", "ł".encode(), "ą".encode(), "€".encode(), "𝄞".encode(),
+         "\U0010ffff".encode(), b"\xed\x9f\xbf", b"\xee\x80\x80"]
+broken = [b"\xc0\xaf",              # overlong 2-byte
+          b"\xe0\x80\xaf",          # overlong 3-byte
+          b"\xf0\x80\x80\xaf",      # overlong 4-byte
+          b"\xed\xa0\x80",          # surrogate
+          b"\xf4\x90\x80\x80",      # above U+10FFFF
+          b"\x80", b"\xff",         # stray continuation, never a lead
+          b"\xe2\x82", b"\xf0\x9f"] # cut off
+
+def record(data):
+    try:
+        data.decode("utf-8")
+        verdict = 0
+    except UnicodeDecodeError:
+        verdict = 255
+    out.write(struct.pack("<IB", len(data), verdict))
+    out.write(data)
+
+# Lengths around the 16- and 32-byte blocks of the vector kernels
+lengths = [0, 1, 2, 3, 5, 15, 16, 17, 31, 32, 33, 63, 64, 65, 100, 300]
+for i in range(count):
+    n = random.choice(lengths)
+    if random.random() < 0.5:
+        data = b"".join(random.choice(valid) for _ in range(n))
+        if data and random.random() < 0.5:
+            k = random.randrange(len(data) + 1)
+            data = data[:k] + random.choice(valid + broken) + data[k:]
+    else:
+        data = bytes(random.randrange(256) for _ in range(n % 40))
+    record(data)
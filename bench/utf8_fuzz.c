@@ -0,0 +1,84 @@
+// Differential check of the UTF-8 kernels against the verdicts of utf8_cases.py,
+// and of the nick kernel against the character class it implements.
+// Build from the repository root, the second time for the portable kernel:
+//     cc -O2 -Iinclude bench/utf8_fuzz.c -o utf8_fuzz
+//     cc -O2 -Iinclude -U__SSE2__ bench/utf8_fuzz.c -o utf8_fuzz_scalar
+#include "../src/text_validate.c"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define MAX_CASE    (1 << 20)
+
+static int mismatches;
+
+static void check(const char *kernel, int got, int expected, uint32_t len) {
+    if (got != expected && mismatches++ < 10) {
+        printf("%s: %d, expected %d, for a case of %u bytes\n", kernel, got, expected, len);
+    }
+}
+
+static int nick_reference(const char *nick, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        char c = nick[i];
+        if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+              c == '_' || c == '-')) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    static uint8_t  data[MAX_CASE];
+    uint32_t        len;
+    int             verdict;
+    long            cases = 0;
+
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s CASES\n", argv[0]);
+        return 2;
+    }
+    FILE *file = fopen(argv[1], "rb");
+    if (!file) {
+        perror(argv[1]);
+        return 2;
+    }
+    printf("kernel: %s\n", text_validate_impl());
+
+    while (fread(&len, 4, 1, file) == 1 && (verdict = fgetc(file)) != EOF) {
+        int expected = verdict == 0 ? 0 : -1;
+        if (len > MAX_CASE || fread(data, 1, len, file) != len) {
+            fprintf(stderr, "%s: truncated case\n", argv[1]);
+            return 2;
+        }
+        cases++;
+#ifdef TEXT_VALIDATE_X86
+        if (__builtin_cpu_supports("avx2")) {
+            check("avx2", utf8_avx2(data, len), expected, len);
+        }
+        check("sse2", utf8_sse2(data, len), expected, len);
+#else
+        check("scalar", utf8_scalar(data, len), expected, len);
+#endif
+        check("by character", utf8_scalar_until(data, len, 0, len) == SIZE_MAX ? -1 : 0, expected, len);
+    }
+    fclose(file);
+
+    // Every byte value at every position of nicks up to two registers and a bit
+    char nick[40];
+    for (size_t n = 0; n <= 34; n++) {
+        for (size_t pos = 0; pos < n; pos++) {
+            for (int c = 0; c < 256; c++) {
+                memset(nick, 'k', n);
+                nick[pos] = (char)c;
+                int got = text_validate_nick(nick, n);
+                if (got != nick_reference(nick, n) && mismatches++ < 10) {
+                    printf("nick: %d for byte 0x%02x at %zu of %zu\n", got, c, pos, n);
+                }
+            }
+        }
+    }
+
+    printf("%ld cases, %d mismatches\n", cases, mismatches);
+    return mismatches != 0;
+}
@@ -0,0 +1,24 @@
+# Writes a raw score log (generation 1, no snapshot) of random results in
+# the "questions" bank, in the format described in src/score_log.c.
+# usage: wal_gen.py DIR EVENTS PLAYERS
+import random, struct, sys, zlib
+
+WAL_MAGIC = 0x4C415751
+FORMAT_VERSION = 1
+RECORD_SCORE = 1
+
+directory, events, players = sys.argv[1], int(sys.argv[2]), int(sys.argv[3])
+random.seed(1)
+bank = b"questions"
+with open(directory + "/scores.wal", "wb") as f:
+    f.write(struct.pack("<IIQ", WAL_MAGIC, FORMAT_VERSION, 1))
+    records = []
+    for i in range(events):
+        nick = b"p%d" % random.randrange(players)
+        body = struct.pack("<BBBBI", RECORD_SCORE, len(bank), len(nick),
+                           random.randrange(11), random.randrange(3600)) + bank + nick
+        records.append(struct.pack("<I", zlib.crc32(body)) + body)
+        if len(records) == 100000:
+            f.write(b"".join(records))
+            records = []
+    f.write(b"".join(records))
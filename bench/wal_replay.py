@@ -0,0 +1,33 @@
+# Independent replay of a raw score log written by wal_gen.py. Prints the
+# same summary as score_log_bench after recovering it.
+# usage: wal_replay.py DIR
+import struct, sys
+
+data = open(sys.argv[1] + "/scores.wal", "rb").read()
+pos = 16
+best, arrival = {}, {}
+tests = total = arrivals = 0
+best_result = (0, 0, "N/A")
+while pos + 12 <= len(data):
+    crc, kind, bank_len, nick_len, score, seconds = struct.unpack_from("<IBBBBI", data, pos)
+    nick = data[pos + 12 + bank_len:pos + 12 + bank_len + nick_len].decode()
+    pos += 12 + bank_len + nick_len
+    tests += 1
+    total += score
+    if score > best_result[0] or (score == best_result[0] and (best_result[1] == 0 or seconds < best_result[1])):
+        best_result = (score, seconds, nick)
+    old = best.get(nick)
+    if old is None or score > old[0] or (score == old[0] and seconds < old[1]):
+        best[nick] = (score, seconds)
+        arrival[nick] = arrivals
+        arrivals += 1
+
+print("tests=%d total=%d best=%d/%d %s players=%d" % (tests, total % 2**32, best_result[0], best_result[1],
+                                                       best_result[2], len(best)))
+order = sorted(best, key=lambda k: (-best[k][0], best[k][1], arrival[k]))
+for nick in order[:3]:
+    print(nick, *best[nick])
+rank = {nick: i + 1 for i, nick in enumerate(order)}
+for nick in ["p1", "p77", "p999"]:
+    if nick in rank:
+        print(nick, "rank", rank[nick], *best[nick])
@@ -0,0 +1,81 @@
+#ifndef ASYNC_LOG_H
+#define ASYNC_LOG_H
+
+#include <stdint.h>
+#include <syslog.h>
+
+/**
+ * Asynchronous logger for the request path
+ *
+ * async_log() takes the same arguments as syslog(), but it neither formats
+ * the message nor writes it. It stores the format pointer, a timestamp and
+ * the raw arguments as a compact binary entry in a ring owned by the calling
+ * thread (single producer, single consumer, no lock). A background thread
+ * drains every ring, formats the entries and passes them to syslog() or
+ * appends them to a log file.
+ *
+ * A full ring never blocks the caller: the entry is dropped and counted.
+ * Messages above the current level are filtered before anything else, and
+ * the level can be changed at runtime (the server maps SIGUSR1/SIGUSR2 to
+ * more/less verbose).
+ *
+ * Restrictions: the format must be a string literal (only its pointer is
+ * kept), '*' widths are not supported, and string arguments are truncated
+ * to 255 bytes. Before async_log_start() messages go to syslog() directly.
+ *
+ * Usage:
+ * @code
+ *     daemon_init(...);
+ *     async_log_start(NULL);          // or a file path
+ *     async_log(LOG_INFO, "User %s disconnected (fd=%d)", nick, fd);
+ * @endcode
+ */
+
+#define ASYNC_LOG_RING_SIZE     1024    // Entries per thread, power of two
+#define ASYNC_LOG_ENTRY_SIZE    256     // Bytes per entry, arguments included
+#define ASYNC_LOG_MAX_THREADS   16      // Threads beyond this log synchronously
+#define ASYNC_LOG_POLL_MS       10      // Consumer sleep when every ring is empty
+
+/**
+ * Start the consumer thread
+ * @param path Log file to append to, NULL to forward to syslog
+ * @return 0 on success, -1 on error (logging stays synchronous)
+ */
+int async_log_start(const char *path);
+
+/**
+ * Record a message
+ * @param priority syslog priority (LOG_ERR, LOG_INFO, ...)
+ * @param format printf format, a string literal
+ */
+void async_log(int priority, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+/**
+ * Set the least important priority that is still recorded
+ *
+ * Async-signal-safe.
+ *
+ * @param level LOG_EMERG .. LOG_DEBUG
+ */
+void async_log_set_level(int level);
+
+/**
+ * Current level
+ * @return Least important priority recorded
+ */
+int async_log_level(void);
+
+/**
+ * Entries dropped because a ring was full
+ * @return Dropped entries since start
+ */
+uint64_t async_log_dropped(void);
+
+/**
+ * Wait (at most a second) until everything recorded so far is written
+ *
+ * For exit paths; the event loop never calls it.
+ */
+void async_log_flush(void);
+
+#endif // ASYNC_LOG_H
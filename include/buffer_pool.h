@@ -0,0 +1,51 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <stddef.h>
+
+/**
+ * Size-class pool of connection buffers
+ *
+ * A connection borrows a buffer only while it holds a partial frame or
+ * output the socket did not accept, and returns it once drained, so idle
+ * connections own no buffer memory at all. Buffers come in power-of-two
+ * classes from BUFFER_POOL_MIN to BUFFER_POOL_MAX bytes; each class keeps
+ * up to BUFFER_POOL_CACHE bytes of returned buffers for reuse and hands
+ * the rest back to the allocator.
+ *
+ * The pool belongs to one event loop and is not locked.
+ */
+
+#define BUFFER_POOL_MIN         256
+#define BUFFER_POOL_CLASSES     10                  // 256 B to 128 KB
+#define BUFFER_POOL_MAX         ((size_t)BUFFER_POOL_MIN << (BUFFER_POOL_CLASSES - 1))
+#define BUFFER_POOL_CACHE       (1024 * 1024)       // Returned bytes kept per class
+
+/**
+ * Borrow a buffer
+ * @param size Bytes needed, at most BUFFER_POOL_MAX
+ * @param capacity Set to the size of the buffer, at least size
+ * @return Buffer, NULL if size is too large or memory runs out
+ */
+void *buffer_pool_get(size_t size, size_t *capacity);
+
+/**
+ * Return a buffer
+ * @param buffer Buffer from buffer_pool_get(), NULL is ignored
+ * @param capacity Its capacity as returned by buffer_pool_get()
+ */
+void buffer_pool_put(void *buffer, size_t capacity);
+
+/**
+ * Bytes in buffers currently borrowed
+ * @return Bytes in use
+ */
+size_t buffer_pool_in_use(void);
+
+/**
+ * Bytes in returned buffers kept for reuse
+ * @return Cached bytes
+ */
+size_t buffer_pool_cached(void);
+
+#endif // BUFFER_POOL_H
@@ -4,13 +4,16 @@
 #include <stdint.h>
 #include <sys/types.h>
 
+#define RANKING_PAGE_SIZE 10    // Ranking entries shown per page
+
 /**
  * Send LOGIN_REQUEST and receive LOGIN_RESPONSE
  * @param sockfd Socket file descriptor
  * @param nick User nickname
+ * @param bank Question bank name (empty for the server default)
  * @return 0 on success, -1 on error
  */
-int client_login(int sockfd, const char *nick);
+int client_login(int sockfd, const char *nick, const char *bank);
 
 /**
  * Request a question from server
@@ -21,6 +24,15 @@ int client_login(int sockfd, const char *nick);
  */
 int client_request_question(int sockfd, uint8_t mode, uint8_t question_index);
 
+/**
+ * Request a question matching a tag filter from server
+ * @param sockfd Socket file descriptor
+ * @param mode Question mode (MODE_RANDOM or MODE_TEST)
+ * @param filter Tag filter: "a+b" requires all tags, "a,b" accepts any tag
+ * @return 0 on success, -1 on error
+ */
+int client_request_question_filtered(int sockfd, uint8_t mode, const char *filter);
+
 /**
  * Submit an answer to server
  * @param sockfd Socket file descriptor
@@ -28,7 +40,7 @@ int client_request_question(int sockfd, uint8_t mode, uint8_t question_index);
  * @param answer_id Selected answer ID
  * @return 0 on success, -1 on error
  */
-int client_submit_answer(int sockfd, uint16_t question_id, uint8_t answer_id);
+int client_submit_answer(int sockfd, uint32_t question_id, uint8_t answer_id);
 
 /**
  * Receive and display question, get user answer, submit and show result
@@ -38,11 +50,25 @@ int client_submit_answer(int sockfd, uint16_t question_id, uint8_t answer_id);
 int client_handle_single_question(int sockfd);
 
 /**
- * Request and display user rankings
+ * Request and display one page of the rankings
  * @param sockfd Socket file descriptor
+ * @param mode RANKING_OFFSET (from offset) or RANKING_AROUND (around the logged in player)
+ * @param offset Entries to skip (RANKING_OFFSET)
+ * @param window RANKING_WINDOW_* (all time, today, this week, this term)
+ * @param first_rank Output: rank of the first entry shown, 0 if none
+ * @param total Output: number of ranked players
  * @return 0 on success, -1 on error
  */
-int client_request_ranking(int sockfd);
+int client_request_ranking_page(int sockfd, uint8_t mode, uint32_t offset, uint8_t window,
+                                uint32_t *first_rank, uint32_t *total);
+
+/**
+ * Request and display the rank of a player
+ * @param sockfd Socket file descriptor
+ * @param nick Player nickname (empty for the logged in player)
+ * @return 0 on success, -1 on error
+ */
+int client_request_rank(int sockfd, const char *nick);
 
 /**
  * Request and display server information
@@ -51,4 +77,33 @@ int client_request_ranking(int sockfd);
  */
 int client_request_server_info(int sockfd);
 
+/**
+ * Search questions by keywords and display the matching question IDs
+ * @param sockfd Socket file descriptor
+ * @param query Words that must all appear in a question or its answers
+ * @return 0 on success, -1 on error
+ */
+int client_search_questions(int sockfd, const char *query);
+
+/**
+ * Request and display latency percentiles per message type
+ *
+ * The server answers only connections from its own host.
+ *
+ * @param sockfd Socket file descriptor
+ * @return 0 on success, -1 on error
+ */
+int client_request_latency(int sockfd);
+
+/**
+ * Request and display answer statistics of every question in a bank
+ *
+ * The server answers only connections from its own host.
+ *
+ * @param sockfd Socket file descriptor
+ * @param bank Question bank name, NULL for the default bank
+ * @return 0 on success, -1 on error
+ */
+int client_request_question_stats(int sockfd, const char *bank);
+
 #endif // CLIENT_UTILS_H
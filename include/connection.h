@@ -0,0 +1,116 @@
+#ifndef CONNECTION_H
+#define CONNECTION_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include "buffer_pool.h"
+#include "server_types.h"
+
+/**
+ * Framing and output queueing of client connections
+ *
+ * Each client fd has a small struct connection. Received bytes are
+ * framed in place: complete TLV frames are handed to the caller straight
+ * from its receive buffer, and only the tail of an incomplete frame is
+ * copied into a buffer from the buffer pool, kept until the frame is
+ * complete. A response the socket does not accept at once is queued in a
+ * pooled buffer and flushed on EPOLLOUT. Buffers go back to the pool as
+ * soon as they are drained, so a connection waiting for its next request
+ * holds no buffer.
+ *
+ * Sent bytes are counted (STATS_BYTES_OUT) when send() accepts them, and
+ * the flush latency of a response is recorded when its last byte does.
+ * Where each queued response ends is kept in a pooled array of
+ * CONNECTION_MAX_MARKS marks; responses queued beyond that share the
+ * last mark, its type and its time.
+ *
+ * Usage:
+ * @code
+ *     connection_table_init(epollfd, max_fds);
+ *     ...
+ *     // EPOLLIN
+ *     uint8_t scratch[CONNECTION_SCRATCH_SIZE + CONNECTION_FRAME_SLACK];
+ *     ssize_t n = connection_receive(fd, scratch, handle_message);
+ *     // EPOLLOUT
+ *     connection_flush(fd);
+ *     // Before close()
+ *     connection_release(fd);
+ * @endcode
+ */
+
+#define CONNECTION_SCRATCH_SIZE     16384   // Bytes read per receive
+#define CONNECTION_FRAME_SLACK      64      // Readable bytes after every frame value
+#define CONNECTION_MAX_OUTPUT       (128 * 1024)    // Queued output before the client is dropped
+#define CONNECTION_MAX_MARKS        (BUFFER_POOL_MIN / sizeof(struct output_mark))
+
+// A queued response, recorded by latency_flushed() once its last byte is sent
+struct output_mark {
+    uint64_t ready_ns;          // latency_now() when it was ready
+    uint32_t end;               // Offset in wbuf just past its last byte
+    uint16_t type;              // Message type of the request it answers
+    uint16_t count;             // Responses it stands for, more than 1 once the marks ran out
+};
+
+/**
+ * Called for every complete frame
+ * @param fd Connection
+ * @param type Message type
+ * @param value Payload, followed by at least CONNECTION_FRAME_SLACK readable bytes
+ * @param length Payload length
+ */
+typedef void (*connection_frame_handler)(int fd, uint16_t type, const uint8_t *value, uint16_t length);
+
+/**
+ * Allocate the table for descriptors below max_fds
+ * @param epollfd Event loop in which EPOLLOUT is armed for queued output
+ * @param max_fds Descriptor limit of the process
+ * @return 0 on success, -1 if out of memory
+ */
+int connection_table_init(int epollfd, int max_fds);
+
+/**
+ * Receive once and hand over every complete frame
+ * @param fd Connection
+ * @param scratch CONNECTION_SCRATCH_SIZE + CONNECTION_FRAME_SLACK bytes
+ * @param on_frame Called for each complete frame
+ * @return Bytes received, 0 when the peer closed, -1 on error (errno EAGAIN
+ *         when there was nothing to read)
+ */
+ssize_t connection_receive(int fd, uint8_t *scratch, connection_frame_handler on_frame);
+
+/**
+ * Send, queueing what the socket does not accept
+ *
+ * When the queue would exceed CONNECTION_MAX_OUTPUT or no buffer is left,
+ * the connection is shut down and the event loop sees it hang up.
+ *
+ * @param fd Connection
+ * @param data Bytes to send, one response
+ * @param length Number of bytes
+ * @param type Message type of the request it answers, for latency_flushed()
+ * @param ready_ns latency_now() when the response was ready
+ * @return length if sent or queued, -1 on error
+ */
+ssize_t connection_send(int fd, const void *data, size_t length, uint16_t type, uint64_t ready_ns);
+
+/**
+ * Send queued output; EPOLLOUT is disarmed once it is drained
+ * @param fd Connection
+ * @return 1 when nothing is left, 0 if output is still queued, -1 on error
+ */
+int connection_flush(int fd);
+
+/**
+ * Return the buffers of a connection that is being closed
+ * @param fd Connection
+ */
+void connection_release(int fd);
+
+/**
+ * Size of the table
+ * @return Descriptors the table covers, 0 before connection_table_init()
+ */
+int connection_table_size(void);
+
+#endif // CONNECTION_H
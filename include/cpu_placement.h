@@ -0,0 +1,91 @@
+#ifndef CPU_PLACEMENT_H
+#define CPU_PLACEMENT_H
+
+#include <stdint.h>
+
+/**
+ * CPU and memory placement of the event loops ("reactors")
+ *
+ * A reactor is the event loop of the single-process server or of one
+ * pre-forked worker. With a CPU list (`-c 2-5`) reactor i runs on the i-th
+ * listed CPU (wrapping around when there are more reactors than CPUs) and
+ * its memory policy becomes MPOL_LOCAL, so the connection tables it
+ * allocates after pinning come from the NUMA node of that CPU. Helper
+ * threads (logger, score log writer, ranking janitor, discovery) run on
+ * the remaining allowed CPUs, or anywhere when the list takes them all.
+ *
+ * Steering gives each worker its own SO_REUSEPORT listener and attaches a
+ * classic BPF program to the group that picks the listener of the worker
+ * pinned to the CPU that received the connection; the accepted socket is
+ * then handled on the core that processed its packets. Connections that
+ * arrive on a CPU without a reactor are spread by the usual hash.
+ *
+ * Requests are counted per reactor for the metrics exporter.
+ */
+
+#define CPU_PLACEMENT_MAX_CPUS  1024
+
+/**
+ * Parse the CPU list of the reactors
+ * @param list Comma separated CPUs and ranges, e.g. "0,2-5"
+ * @return Number of CPUs, -1 if the list is malformed or names a CPU the
+ *         process may not run on
+ */
+int cpu_placement_parse(const char *list);
+
+/**
+ * Allocate the per-reactor counters; after shared_arena_init() when pre-forked
+ * @param reactors Number of event loops
+ * @return 0 on success, -1 if out of memory
+ */
+int cpu_placement_init(int reactors);
+
+/**
+ * CPU a reactor is pinned to
+ * @param reactor Reactor index
+ * @return CPU number, -1 without a CPU list
+ */
+int cpu_placement_cpu(int reactor);
+
+/**
+ * Pin the calling thread to the CPU of a reactor and prefer memory of its node
+ * @param reactor Reactor index
+ * @return The CPU, -1 without a CPU list or if pinning failed
+ */
+int cpu_placement_pin_reactor(int reactor);
+
+/**
+ * Move the calling thread off the reactor CPUs; threads it creates inherit this
+ * @return 0 on success or without a CPU list, -1 on error
+ */
+int cpu_placement_pin_helpers(void);
+
+/**
+ * Steer connections to the reactor on the CPU that received them
+ * @param listeners Listening sockets of one SO_REUSEPORT group, in the
+ *        order they started listening; listener i belongs to reactor i
+ * @param count Number of listeners
+ * @return 0 on success, -1 without a CPU list or on error
+ */
+int cpu_placement_steer(const int *listeners, int count);
+
+/**
+ * Count a request handled by a reactor
+ * @param reactor Reactor index
+ */
+void cpu_placement_count_request(int reactor);
+
+/**
+ * Requests handled by a reactor
+ * @param reactor Reactor index
+ * @return Requests since start
+ */
+uint64_t cpu_placement_requests(int reactor);
+
+/**
+ * Number of reactors given to cpu_placement_init()
+ * @return Reactors, 0 before initialization
+ */
+int cpu_placement_reactors(void);
+
+#endif // CPU_PLACEMENT_H
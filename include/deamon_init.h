@@ -52,4 +52,16 @@
 
 int daemon_init(const char *pname, int facility, uid_t uid, int socket);
 
+/**
+ * Daemonize like daemon_init(), keeping several descriptors open
+ *
+ * @param pname Program name used for syslog
+ * @param facility Syslog facility
+ * @param uid UID to switch to
+ * @param keep File descriptors to keep open
+ * @param nkeep Number of descriptors in keep
+ * @return 0 on success, -1 on failure
+ */
+int daemon_init_keep(const char *pname, int facility, uid_t uid, const int *keep, int nkeep);
+
 #endif // DEAMON_INIT_H
@@ -0,0 +1,152 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include "tlv.h"
+
+/**
+ * Request latency histograms
+ *
+ * Every received message is counted by type, and two phases are timed:
+ *   LATENCY_PHASE_HANDLE  recv() returned -> response ready
+ *   LATENCY_PHASE_FLUSH   response ready  -> its last byte accepted by send(),
+ *                         on EPOLLOUT if connection_send() had to queue it
+ * Requests that get no response (malformed, ignored) are not counted.
+ *
+ * Histograms are log-linear like HdrHistogram: every power of two is
+ * split into LATENCY_SUB_BUCKETS linear buckets, so any value is kept
+ * within 1/16 (6.25%) of itself from 1 ns to about 18 minutes. Recording
+ * is a bit scan, a shift and two increments on fixed arrays; nothing is
+ * allocated. The duration of every event loop iteration is kept in one
+ * more histogram.
+ *
+ * Each worker records into its own tables, which latency_init() places
+ * in the shared arena when pre-forked; the readers below sum the tables
+ * of all workers, so any worker reports figures of the whole server.
+ * Tables are written by one reactor and read without a lock: a summary
+ * may miss requests recorded while it was being taken.
+ *
+ * Usage:
+ * @code
+ *     uint64_t received = latency_now();   // right after recv()
+ *     latency_begin(type, received);
+ *     ...
+ *     latency_send(fd, response, len);     // instead of send()
+ * @endcode
+ */
+
+#define LATENCY_SUB_BITS     4
+#define LATENCY_SUB_BUCKETS  (1 << LATENCY_SUB_BITS)
+#define LATENCY_MAX_BITS     40         // Values from 2^40 ns (~18 min) share the top bucket
+#define LATENCY_BUCKETS      ((LATENCY_MAX_BITS - LATENCY_SUB_BITS + 1) * LATENCY_SUB_BUCKETS)
+#define LATENCY_TYPES        32         // Message types tracked (0 .. LATENCY_TYPES - 1)
+
+struct latency_histogram {
+    uint64_t count;
+    uint64_t sum;                   // Of all values, for averages
+    uint64_t max;
+    uint64_t buckets[LATENCY_BUCKETS];
+};
+
+/**
+ * Allocate the tables of every worker, before forking
+ * @param workers Worker processes, 1 when not pre-forked
+ * @return 0 on success, -1 if out of memory
+ */
+int latency_init(int workers);
+
+/**
+ * Record into the tables of one worker, after forking
+ * @param worker Worker index
+ */
+void latency_set_worker(int worker);
+
+/**
+ * Monotonic clock in nanoseconds
+ * @return Current time
+ */
+uint64_t latency_now(void);
+
+/**
+ * Add a value to a histogram
+ * @param hist Histogram
+ * @param value_ns Latency in nanoseconds
+ */
+void latency_record(struct latency_histogram *hist, uint64_t value_ns);
+
+/**
+ * Value at a quantile
+ * @param hist Histogram
+ * @param quantile Quantile between 0 and 1 (0.99 = p99)
+ * @return Highest value of the bucket holding the quantile (never above
+ *         the recorded maximum), 0 if the histogram is empty
+ */
+uint64_t latency_value_at(const struct latency_histogram *hist, double quantile);
+
+/**
+ * Start timing a request
+ * @param type Message type
+ * @param received_ns latency_now() taken when the message was received
+ */
+void latency_begin(uint16_t type, uint64_t received_ns);
+
+/**
+ * Send the response to the current request; records the handle phase, and
+ * the flush phase once the response has left (see latency_flushed())
+ * @param fd Socket
+ * @param buffer Response
+ * @param length Response length
+ * @return Result of connection_send()
+ */
+ssize_t latency_send(int fd, const void *buffer, size_t length);
+
+/**
+ * Record the flush phase of a response whose last byte was just sent
+ * @param type Message type of the request it answers
+ * @param ready_ns latency_now() when the response was ready
+ */
+void latency_flushed(uint16_t type, uint64_t ready_ns);
+
+/**
+ * Record how long one event loop iteration took
+ * @param duration_ns From epoll_wait() returning to the end of the iteration
+ */
+void latency_record_loop(uint64_t duration_ns);
+
+/**
+ * Histogram of one message type and phase, summed over all workers
+ * @param type Message type (below LATENCY_TYPES)
+ * @param phase LATENCY_PHASE_HANDLE or LATENCY_PHASE_FLUSH
+ * @param out Output: histogram
+ */
+void latency_histogram_of(uint16_t type, int phase, struct latency_histogram *out);
+
+/**
+ * Histogram of event loop iterations, summed over all workers
+ * @param out Output: histogram
+ */
+void latency_loop_histogram(struct latency_histogram *out);
+
+/**
+ * Moving average of event loop iterations, weighting the last one by 1/16
+ * @return Nanoseconds; may be read from any thread
+ */
+uint64_t latency_loop_average(void);
+
+/**
+ * Messages received of one type, answered or not, by all workers
+ * @param type Message type (below LATENCY_TYPES)
+ * @return Count
+ */
+uint64_t latency_request_count(uint16_t type);
+
+/**
+ * Summarize every histogram that has values, summed over all workers
+ * @param out Output array
+ * @param max Size of the output array
+ * @return Number of summaries written
+ */
+int latency_summarize(struct latency_summary *out, int max);
+
+#endif // LATENCY_H
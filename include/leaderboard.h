@@ -0,0 +1,152 @@
+#ifndef LEADERBOARD_H
+#define LEADERBOARD_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "server_types.h"
+#include "tlv.h"
+
+/**
+ * Leaderboard of finished knowledge tests
+ *
+ * Every player has one entry, their best result. Entries are ordered by
+ * score descending, then time ascending, then arrival, in an indexable
+ * skip list: each link stores how many entries it jumps over, so insert,
+ * removal and "what is my rank" are all O(log n) with no upper limit on
+ * the number of players. A hash table maps nicks to their entry.
+ *
+ * The RANKING_DATA frame for the top LEADERBOARD_TOP entries is encoded
+ * once and cached; it is rebuilt only when a result lands in the top, so
+ * serving a ranking request is a copy of a ready frame. Deeper pages are
+ * located by rank through the spans and copied entry by entry.
+ */
+
+#define LEADERBOARD_TOP         10
+#define LEADERBOARD_MAX_LEVEL   32
+#define LEADERBOARD_FRAME_SIZE  (TLV_HEADER_SIZE + 1 + LEADERBOARD_TOP * (1 + MAX_NICK_LENGTH + 1 + 4))
+
+struct leaderboard_node;
+
+struct leaderboard_link {
+    struct leaderboard_node *next;
+    uint32_t span;                  // Entries passed when following the link
+};
+
+struct leaderboard_node {
+    struct score_entry entry;
+    uint64_t seq;                   // Arrival order, breaks ties
+    int level;
+    struct leaderboard_link links[];
+};
+
+struct leaderboard {
+    struct leaderboard_node *head;  // Sentinel with LEADERBOARD_MAX_LEVEL links
+    int level;                      // Levels in use
+    uint32_t count;                 // Players with a result
+    uint64_t next_seq;
+    uint32_t rng;                   // xorshift state for node levels
+
+    struct leaderboard_node **slots; // Nick -> entry, open addressing
+    uint32_t slot_count;            // Power of two
+
+    uint8_t frame[LEADERBOARD_FRAME_SIZE];  // Encoded RANKING_DATA of the top entries
+    size_t frame_len;
+
+    pthread_mutex_t mutex;
+};
+
+/**
+ * Initialize an empty leaderboard
+ * @param board Leaderboard to initialize
+ * @return 0 on success, -1 on allocation error
+ */
+int leaderboard_init(struct leaderboard *board);
+
+/**
+ * Release all entries of the leaderboard
+ * @param board Leaderboard
+ */
+void leaderboard_destroy(struct leaderboard *board);
+
+/**
+ * Record a result; it replaces the player's entry if it is their best
+ * @param board Leaderboard
+ * @param nick Player nickname
+ * @param score Correct answers
+ * @param time_seconds Test duration
+ * @return Position of the player's new entry (0 = best), -1 if their
+ *         earlier result is better or on allocation error
+ */
+int leaderboard_insert(struct leaderboard *board, const char *nick,
+                       uint8_t score, uint32_t time_seconds);
+
+/**
+ * Fill an empty leaderboard from results already in rank order
+ *
+ * Builds the skip list by appending, O(n) instead of n inserts; used to
+ * restore rankings at startup.
+ *
+ * @param board Empty leaderboard
+ * @param entries Best result of each player, best first
+ * @param count Number of entries
+ * @return 0 on success, -1 on allocation error
+ */
+int leaderboard_load(struct leaderboard *board, const struct score_entry *entries, uint32_t count);
+
+/**
+ * Look up the rank of a player
+ * @param board Leaderboard
+ * @param nick Player nickname
+ * @param best Output: best result of the player (may be NULL)
+ * @param total Output: number of ranked players (may be NULL)
+ * @return Rank (1 = best), 0 if the player has no result
+ */
+uint32_t leaderboard_rank(struct leaderboard *board, const char *nick,
+                          struct score_entry *best, uint32_t *total);
+
+/**
+ * Copy a page of the leaderboard
+ *
+ * The first entry is found through the link spans in O(log n), so the
+ * cost of a page does not depend on how deep it is.
+ *
+ * @param board Leaderboard
+ * @param offset Entries to skip (0 = start at the best)
+ * @param limit Maximum number of entries
+ * @param entries Output array of at least limit entries
+ * @param total Output: number of ranked players (may be NULL)
+ * @return Number of entries copied
+ */
+uint32_t leaderboard_page(struct leaderboard *board, uint32_t offset, uint32_t limit,
+                          struct score_entry *entries, uint32_t *total);
+
+/**
+ * Copy a page of the leaderboard centered on a player
+ * @param board Leaderboard
+ * @param nick Player nickname
+ * @param limit Maximum number of entries
+ * @param entries Output array of at least limit entries
+ * @param first_rank Output: rank of the first entry, 0 if the player has no result
+ * @param total Output: number of ranked players (may be NULL)
+ * @return Number of entries copied
+ */
+uint32_t leaderboard_around(struct leaderboard *board, const char *nick, uint32_t limit,
+                            struct score_entry *entries, uint32_t *first_rank, uint32_t *total);
+
+/**
+ * Number of ranked players
+ * @param board Leaderboard
+ * @return Player count
+ */
+uint32_t leaderboard_count(struct leaderboard *board);
+
+/**
+ * Copy the cached RANKING_DATA frame
+ * @param board Leaderboard
+ * @param buffer Output buffer of at least LEADERBOARD_FRAME_SIZE bytes
+ * @return Length of the frame
+ */
+size_t leaderboard_copy_frame(struct leaderboard *board, uint8_t *buffer);
+
+#endif // LEADERBOARD_H
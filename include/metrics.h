@@ -0,0 +1,80 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <time.h>
+
+/**
+ * OpenMetrics (Prometheus) exporter
+ *
+ * Serves GET /metrics over HTTP/1.0 on a port bound to 127.0.0.1, from
+ * the server's own epoll loop: no thread, no blocking call. Exposed:
+ * connections, bytes in/out, requests and latency summaries per message
+ * type, event loop iteration times, and per bank its version, question
+ * count, ranked players, finished tests and questions asked.
+ *
+ * The exposition is rendered at most once per METRICS_MAX_AGE_MS into a
+ * buffer that is kept between scrapes; a scrape in between costs one
+ * send(). A response the socket cannot take at once is copied for that
+ * scraper and finished on EPOLLOUT.
+ *
+ * One worker serves the port for all pre-forked workers. Counters and
+ * latency tables already live in the shared arena; what a worker keeps
+ * to itself (pooled buffer bytes, dropped log entries) it copies with
+ * metrics_publish() into its slot there, and the slots are summed.
+ *
+ * Usage:
+ * @code
+ *     metrics_init(workers);               // before forking
+ *     int metricsfd = metrics_start(epollfd, 9100, start_time);
+ *     ...
+ *     // in the event loop, before handling client sockets
+ *     if (metrics_handle_event(epollfd, fd, events)) continue;
+ *     ...
+ *     metrics_publish(worker);             // at the end of every iteration
+ * @endcode
+ */
+
+#define METRICS_MAX_CLIENTS     8       // Concurrent scrapes, the oldest is dropped beyond
+#define METRICS_MAX_AGE_MS      1000    // Scrapes within this reuse the rendered text
+#define METRICS_REQUEST_SIZE    2048    // Longest HTTP request header accepted
+
+/**
+ * Allocate the slots of every worker, before forking
+ * @param workers Worker processes, 1 when not pre-forked
+ * @return 0 on success, -1 if out of memory
+ */
+int metrics_init(int workers);
+
+/**
+ * Copy this worker's buffer pool and log figures into its slot
+ * @param worker Worker index
+ */
+void metrics_publish(int worker);
+
+/**
+ * Clear the slot of a worker that exited: its buffers are gone, its
+ * dropped log entries are kept in the total
+ * @param worker Worker index
+ */
+void metrics_worker_exited(int worker);
+
+/**
+ * Open the exporter port and add it to the event loop
+ * @param epollfd Event loop
+ * @param port TCP port on 127.0.0.1
+ * @param start_time Server start, exported as networkexam_start_time_seconds
+ * @return Listening socket, -1 on error
+ */
+int metrics_start(int epollfd, uint16_t port, time_t start_time);
+
+/**
+ * Handle an event if it belongs to the exporter
+ * @param epollfd Event loop
+ * @param fd Descriptor of the event
+ * @param events epoll event mask
+ * @return 1 if the descriptor is the exporter's (event handled), 0 otherwise
+ */
+int metrics_handle_event(int epollfd, int fd, uint32_t events);
+
+#endif // METRICS_H
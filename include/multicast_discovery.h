@@ -20,19 +20,106 @@
 #include	<netdb.h>
 #include	<sys/utsname.h>
 #include	<linux/un.h>
+#include    <stdint.h>
 
 #define MAXLINE 1024
 #define SA      struct sockaddr
-#define IPV6 1
+
+/**
+ * Binary announcement, version 1 (all fields in network byte order):
+ *
+ *   offset  size  field
+ *    0      2     magic "NX"
+ *    2      1     version (1)
+ *    3      1     flags (0)
+ *    4      8     server id, stable for a host and port
+ *    12     2     TCP port
+ *    14     16    IPv6 address (IPv4-mapped for IPv4)
+ *    30     4     open connections
+ *    34     4     connection limit
+ *    38     4     moving average of the event loop time, microseconds
+ *    42     8     version of the default question bank
+ *
+ * Later versions only append fields, so a receiver reads what it knows
+ * and skips the rest. Old servers send the text "SERVER:ip:port", which
+ * discovery_decode() still accepts.
+ */
+#define DISCOVERY_PORT          9999
+#define DISCOVERY_GROUP_V4      "239.0.0.1"
+#define DISCOVERY_GROUP_V6      "ff02::4e58"    // Link-local scope; ff05::4e58 reaches the site
+#define DISCOVERY_GROUPS        DISCOVERY_GROUP_V4 "," DISCOVERY_GROUP_V6
+#define DISCOVERY_MAX_GROUPS    4
+#define DISCOVERY_MAX_INTERFACES 8
+#define DISCOVERY_HOPS          8           // IPv6 hop limit; the group's scope bounds it further
+#define DISCOVERY_MAGIC         0x4E58      // "NX"
+#define DISCOVERY_VERSION       1
+#define DISCOVERY_V1_SIZE       50
+#define DISCOVERY_INTERVAL      5           // Seconds between announcements
+#define DISCOVERY_WINDOW_MS     (DISCOVERY_INTERVAL * 1000 + 500)   // Hears every server once
+#define DISCOVERY_QUERY_WINDOW_MS 100       // Answers to a DISCOVER_REQUEST arrive within it
+#define DISCOVERY_REPLY_DELAY_MS 20         // Servers answer after a random delay up to this
+#define DISCOVERY_REPLY_RATE    2000        // Answers per second; further requests wait for the announcement
+#define DISCOVERY_BATCH         64          // Datagrams per recvmmsg()/sendmmsg()
+#define DISCOVERY_MAX_PENDING   1024        // Requesters waiting for the next batch of answers
+#define DISCOVERY_MAX_SERVERS   32
+#define DISCOVERY_PROBE_MS      1000        // Time allowed for a TCP connect probe
+#define DISCOVERY_FULL_COST_US  20000       // Cost of a full server, as extra RTT
+
+/**
+ * @brief A server as announced, binary or legacy
+ */
+struct discovery_info {
+    uint8_t version;            /**< Announcement version, 0 for a legacy text announcement */
+    uint64_t server_id;         /**< Stable id of the server (0 if legacy) */
+    char ip[INET6_ADDRSTRLEN];  /**< Server IP address */
+    uint16_t port;              /**< Server TCP port */
+    uint32_t connections;       /**< Open connections (0 if legacy) */
+    uint32_t max_connections;   /**< Connection limit (0 if legacy or unknown) */
+    uint32_t loop_latency_us;   /**< Moving average of the event loop time (0 if legacy) */
+    uint64_t bank_version;      /**< Version of the default question bank (0 if legacy) */
+    uint32_t rtt_us;            /**< TCP connect time measured by discovery_rank(), 0 if unreachable */
+    char source[INET6_ADDRSTRLEN];  /**< Address the announcement came from */
+    uint32_t scope_id;          /**< Interface it came in on, for link-local addresses */
+};
+
+/**
+ * @brief Fills in the load figures of the next announcement
+ *
+ * Called from the announcement thread; sets connections, max_connections,
+ * loop_latency_us and bank_version.
+ */
+typedef void (*discovery_load_fn)(struct discovery_info *info);
 
 /**
  * @brief Structure holding server information for discovery announcement
  */
 typedef struct {
-    char *ip;    /**< Server IP address */
-    int port;    /**< Server port number */
+    char *ip;                   /**< Server IP address */
+    int port;                   /**< Server port number */
+    uint64_t server_id;         /**< Stable id announced with every message */
+    discovery_load_fn load;     /**< Current load, NULL to announce none */
 } server_info_t;
 
+/**
+ * @brief Encodes a binary announcement
+ *
+ * @param buffer Output, at least DISCOVERY_V1_SIZE bytes
+ * @param size Size of buffer
+ * @param info Server to announce; version is ignored, DISCOVERY_VERSION is sent
+ * @return Length of the announcement, -1 if buffer is too small or ip is invalid
+ */
+ssize_t discovery_encode(uint8_t *buffer, size_t size, const struct discovery_info *info);
+
+/**
+ * @brief Decodes an announcement, binary or legacy "SERVER:ip:port"
+ *
+ * @param buffer Received datagram
+ * @param length Its length
+ * @param info Filled in on success; fields a legacy server does not send are 0
+ * @return 0 on success, -1 if the datagram is not an announcement
+ */
+int discovery_decode(const uint8_t *buffer, size_t length, struct discovery_info *info);
+
 /**
  * @brief Creates a UDP socket for sending multicast messages
  * 
@@ -62,6 +149,16 @@ int snd_udp_socket(const char *serv, int port, SA **saptr, socklen_t *lenp);
  */
 int mcast_join(int sockfd, const SA *grp, socklen_t grplen, const char *ifname, unsigned int ifindex);
 
+/**
+ * @brief Sets the interface multicast datagrams are sent from
+ *
+ * @param sockfd Socket descriptor (must be UDP socket)
+ * @param ifname Name of the network interface, or NULL when ifindex is given
+ * @param ifindex Interface index, or 0 to use ifname
+ * @return 0 on success, -1 on error (sets errno)
+ */
+int mcast_set_if(int sockfd, const char *ifname, unsigned int ifindex);
+
 /**
  * @brief Sets or disables multicast loopback on a socket
  * 
@@ -84,11 +181,28 @@ int mcast_set_loop(int sockfd, int onoff);
  */
 int sockfd_to_family(int sockfd);
 
+/**
+ * @brief Sets the groups and interface used for announcing and listening
+ *
+ * Without it, DISCOVERY_GROUPS is used on every up, multicast-capable
+ * interface that has an address of the group's family. Link-local IPv6
+ * groups (ff02::) are joined and announced on each such interface.
+ *
+ * @param groups Comma-separated IPv4 and IPv6 multicast groups, NULL to keep them
+ * @param ifname Interface to use alone, NULL or "" for all
+ * @return 0 on success, -1 (errno EINVAL or ENODEV) if a group or the interface is invalid
+ */
+int discovery_configure(const char *groups, const char *ifname);
+
 /**
  * @brief Thread function that periodically announces server presence via multicast
  * 
- * This function runs in a separate thread and broadcasts the server's IP address
- * and port to the multicast group 239.0.0.1:9999 every 5 seconds.
+ * This function runs in a separate thread and broadcasts a binary announcement
+ * with the server's address, port and load to every discovery group, on each
+ * interface, every DISCOVERY_INTERVAL seconds. In between it answers
+ * DISCOVER_REQUEST: requests received within a random delay of up to
+ * DISCOVERY_REPLY_DELAY_MS are answered together, one answer per requester,
+ * at most DISCOVERY_REPLY_RATE a second, with recvmmsg()/sendmmsg().
  * 
  * @param arg Pointer to server_info_t structure containing server IP and port
  * @return NULL (runs indefinitely)
@@ -96,28 +210,48 @@ int sockfd_to_family(int sockfd);
 void* discovery_announce(void* arg);
 
 /**
- * @brief Discovers a server on the network using multicast
- * 
- * Listens on the multicast group 239.0.0.1:9999 for server announcements.
- * Blocks until a server announcement is received, then extracts the server's
- * IP address and port.
- * 
- * @param server_ip Buffer to store discovered server IP address (must be at least INET_ADDRSTRLEN bytes)
- * @param server_port Pointer to store discovered server port number
+ * @brief Collects the servers answering a request or announcing themselves during a window
+ *
+ * Multicasts a DISCOVER_REQUEST to every group first; servers answer by
+ * unicast within DISCOVERY_REPLY_DELAY_MS. Every server is kept once, by
+ * server id (legacy servers by address), with its latest load.
+ *
+ * @param servers Output array
+ * @param max_servers Its size; servers heard beyond it are ignored
+ * @param window_ms How long to listen, DISCOVERY_QUERY_WINDOW_MS for the answers,
+ *        DISCOVERY_WINDOW_MS to also hear servers that only announce
+ * @return Number of servers, -1 if the group cannot be joined
+ */
+int discover_servers(struct discovery_info *servers, int max_servers, int window_ms);
+
+/**
+ * @brief Probes and orders servers, best first
+ *
+ * Measures the RTT of every server with a parallel TCP connect and sorts by
+ * RTT + loop time + DISCOVERY_FULL_COST_US scaled by the share of the
+ * connection limit in use. Legacy servers count as idle.
+ *
+ * @param servers Servers from discover_servers(), reordered in place
+ * @param count Number of servers
+ * @param probe_timeout_ms Time allowed for the probes
+ * @return Number of reachable servers, now at the front of the array
  */
-void discover_server(char *server_ip, int *server_port);
+int discovery_rank(struct discovery_info *servers, int count, int probe_timeout_ms);
 
 /**
  * @brief Initialize and start multicast discovery announcement service
  * 
  * Starts a background thread that periodically broadcasts server presence
- * via multicast to 239.0.0.1:9999 every 5 seconds, allowing clients to auto-discover the server.
+ * and load to the discovery groups every DISCOVERY_INTERVAL seconds,
+ * allowing clients to auto-discover the server and pick a lightly loaded one.
  * The IP address is copied internally, so the caller's buffer can be freed after this call.
+ * The server id is derived from the host name and the port.
  * 
  * @param ip Server IP address to announce (e.g., "192.168.1.5")
  * @param port Server port to announce
+ * @param load Called before every announcement for the load figures, or NULL
  * @return 0 on success, -1 on error
  */
-int start_discovery_service(const char *ip, int port);
+int start_discovery_service(const char *ip, int port, discovery_load_fn load);
 
 #endif // MULTICAST_DISCOVERY
@@ -0,0 +1,116 @@
+#ifndef NICK_REGISTRY_H
+#define NICK_REGISTRY_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include "tlv.h"
+
+/**
+ * Nicknames of logged in users
+ *
+ * A hash set with open addressing, split into NICK_REGISTRY_SHARDS shards
+ * by the top bits of the nick's hash. Each shard is a linear probing table
+ * behind its own mutex, so reactors logging in different users rarely
+ * wait for each other. A lookup compares the stored hash before the
+ * string and usually touches one slot. Removal shifts the following
+ * entries back instead of leaving tombstones, so tables do not degrade
+ * under a login/disconnect churn.
+ *
+ * Every nick is owned by the connection that claimed it and is released
+ * when that connection closes. A nick is known by its first
+ * MAX_NICK_LENGTH - 1 characters, as in the leaderboard.
+ *
+ * Pre-forked workers share one registry in the shared arena. An owner is
+ * then NICK_OWNER(worker, fd), and the nicks of a worker that died are
+ * released together with nick_registry_release_group().
+ *
+ * Usage:
+ * @code
+ *     nick_registry_init(server_nicks);
+ *     if (nick_registry_claim(server_nicks, nick, connfd) == 0) { ... }
+ *     nick_registry_release(server_nicks, nick, connfd);      // on close
+ * @endcode
+ */
+
+#define NICK_REGISTRY_SHARDS        16      // Power of two
+#define NICK_REGISTRY_MIN_SLOTS     64      // Initial slots per shard, power of two
+#define NICK_REGISTRY_CACHE_LINE    64
+
+#define NICK_OWNER_FD_BITS          20
+#define NICK_OWNER(group, fd)       ((group) << NICK_OWNER_FD_BITS | (fd))     // fd below 1 << 20
+#define NICK_OWNER_GROUP(owner)     ((owner) >> NICK_OWNER_FD_BITS)
+
+struct nick_slot {
+    uint32_t hash;                  // Hash of the nick, valid if owner >= 0
+    int32_t owner;                  // Connection holding the nick, -1 if free
+    char nick[MAX_NICK_LENGTH];
+};
+
+struct nick_shard {
+    _Alignas(NICK_REGISTRY_CACHE_LINE) pthread_mutex_t mutex;
+    struct nick_slot *slots;
+    uint32_t mask;                  // Slot count - 1
+    uint32_t count;                 // Used slots, at most half of them
+};
+
+struct nick_registry {
+    struct nick_shard shards[NICK_REGISTRY_SHARDS];
+};
+
+/**
+ * Registry of the nicks in use, allocated at startup (in the shared arena
+ * when pre-forked)
+ */
+extern struct nick_registry *server_nicks;
+
+/**
+ * Initialize an empty registry
+ * @param registry Registry
+ * @return 0 on success, -1 on error
+ */
+int nick_registry_init(struct nick_registry *registry);
+
+/**
+ * Claim a nick for a connection
+ *
+ * Claiming a nick the same connection already holds succeeds.
+ *
+ * @param registry Registry
+ * @param nick Nickname
+ * @param owner Connection (fd) claiming it
+ * @return 0 if claimed, 1 if another connection holds it, -1 on error
+ */
+int nick_registry_claim(struct nick_registry *registry, const char *nick, int owner);
+
+/**
+ * Release a nick held by a connection
+ * @param registry Registry
+ * @param nick Nickname
+ * @param owner Connection that claimed it; nicks of other owners are kept
+ */
+void nick_registry_release(struct nick_registry *registry, const char *nick, int owner);
+
+/**
+ * Release every nick whose owner belongs to a group
+ * @param registry Registry
+ * @param group Group passed to NICK_OWNER(), e.g. a worker that exited
+ * @return Number of nicks released
+ */
+uint32_t nick_registry_release_group(struct nick_registry *registry, int group);
+
+/**
+ * Check whether a nick is held
+ * @param registry Registry
+ * @param nick Nickname
+ * @return Owning connection, -1 if the nick is free
+ */
+int nick_registry_owner(struct nick_registry *registry, const char *nick);
+
+/**
+ * Number of nicks held
+ * @param registry Registry
+ * @return Nicks in use
+ */
+uint32_t nick_registry_count(struct nick_registry *registry);
+
+#endif // NICK_REGISTRY_H
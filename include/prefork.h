@@ -0,0 +1,66 @@
+#ifndef PREFORK_H
+#define PREFORK_H
+
+#include <stdint.h>
+
+/**
+ * Pre-forked worker processes
+ *
+ * The master binds the listening socket and loads everything shared
+ * (question banks, rankings, statistics, the nick registry in the shared
+ * arena), then forks the workers. Each worker runs its own event loop on
+ * the inherited listener; EPOLLEXCLUSIVE wakes one of them per burst of
+ * connections. A fault in one worker takes down only its connections.
+ *
+ * The master runs no threads, so forking a replacement never copies a
+ * lock held by another thread. It loops on a housekeeping callback (the
+ * score log writer, the ranking window janitor), reaps workers that exited
+ * and forks a new one in the same slot. Workers die with the master.
+ *
+ * Usage:
+ * @code
+ *     shared_arena_init(SHARED_ARENA_SIZE);       // before loading shared state
+ *     ...
+ *     int worker = prefork_start(4, housekeeping, worker_exited);
+ *     // Only workers get here
+ * @endcode
+ */
+
+#define PREFORK_MAX_WORKERS     64
+#define PREFORK_RESTART         (-2)    // Returned to the master when the shared state is poisoned
+
+/**
+ * Fork the workers and supervise them
+ *
+ * In the master this function does not return: it calls housekeeping in
+ * a loop, restarts workers that exit and, on SIGTERM or SIGINT, stops the
+ * workers and exits. The exception is a worker that died holding a shared
+ * lock (shared_arena_poisoned()): the master then stops all workers and
+ * returns PREFORK_RESTART so the caller can rebuild the shared state.
+ *
+ * @param workers Number of workers, 1 to PREFORK_MAX_WORKERS
+ * @param housekeeping Called by the master about once a second with
+ *        final = 0, when it may block for up to a second (NULL to sleep
+ *        instead); once more with final = 1 after the workers stopped,
+ *        skipped when the arena is poisoned
+ * @param worker_exited Called by the master with the index of a worker
+ *        that exited, before the replacement is forked (may be NULL)
+ * @return In a worker: its index, 0 to workers - 1. In the master: -1 if
+ *         the shared state cannot be allocated or no worker can be forked,
+ *         PREFORK_RESTART once the workers were stopped over a poisoned arena
+ */
+int prefork_start(int workers, void (*housekeeping)(int final), void (*worker_exited)(int worker));
+
+/**
+ * Number of workers that were restarted after exiting
+ * @return Restarts since start, 0 when not pre-forked
+ */
+uint64_t prefork_restarts(void);
+
+/**
+ * Number of workers
+ * @return Workers, 0 when not pre-forked
+ */
+int prefork_workers(void);
+
+#endif // PREFORK_H
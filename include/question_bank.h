@@ -0,0 +1,99 @@
+#ifndef QUESTION_BANK_H
+#define QUESTION_BANK_H
+
+#include <pthread.h>
+#include "leaderboard.h"
+#include "question_selector.h"
+#include "question_stats.h"
+#include "quiz.h"
+#include "ranking_window.h"
+#include "server_types.h"
+#include "stats_counters.h"
+#include "tlv.h"
+
+/**
+ * Named question banks
+ *
+ * One server process can serve many exam variants. Each bank is a JSON
+ * question file loaded once at startup; it owns its questions, tag index,
+ * rankings, test statistics and the training weights of its players. Banks are plain data - they share the
+ * server's event loop and need no threads of their own.
+ *
+ * Banks are kept sorted by name so a lookup at login is a binary search.
+ * A directory of banks is parsed by several threads at startup; once the
+ * server runs, the set of banks never changes.
+ */
+
+#define MAX_BANK_NAME       32
+#define BANK_LOAD_THREADS   8       // Most threads parsing a bank directory
+
+struct question_bank {
+    char name[MAX_BANK_NAME];          // File name without the .json suffix
+    QuizDatabase db;
+
+    struct leaderboard leaderboard;    // Finished tests, best first
+    struct ranking_window windows[RANKING_WINDOWS];  // Today, this week, this term
+                                                     // ([RANKING_WINDOW_ALL] is leaderboard)
+
+    struct stats_counters stats;       // Test statistics of this bank
+
+    struct question_counters *question_stats;  // Answers per question, by position in db
+
+    SelectorStore selectors;           // Training weights per player
+};
+
+/**
+ * Leaderboard of a bank for a time window
+ * @param bank Question bank
+ * @param window RANKING_WINDOW_*
+ * @param now Current time, a window that ended is rolled over
+ * @return Leaderboard, NULL if the window is unknown
+ */
+struct leaderboard *bank_leaderboard(struct question_bank *bank, int window, time_t now);
+
+/**
+ * Load every *.json file in a directory as a bank named after the file
+ *
+ * Files are parsed in parallel, on up to BANK_LOAD_THREADS threads (no
+ * more than there are cores); the calling thread is one of them.
+ *
+ * @param dirpath Directory with question files
+ * @return Number of banks loaded, -1 on error
+ */
+int bank_load_directory(const char *dirpath);
+
+/**
+ * Load a single question file as a bank
+ * @param name Bank name
+ * @param filepath Path to the JSON question file
+ * @return 0 on success, -1 on error
+ */
+int bank_load_file(const char *name, const char *filepath);
+
+/**
+ * Find a bank by name
+ * @param name Bank name, NULL or empty for the default bank
+ * @return Pointer to bank, NULL if not found
+ */
+struct question_bank *bank_find(const char *name);
+
+/**
+ * Default bank (first by name), used when a client does not pick one
+ * @return Pointer to bank, NULL if no bank is loaded
+ */
+struct question_bank *bank_default(void);
+
+/**
+ * Number of loaded banks
+ * @return Bank count
+ */
+int bank_count(void);
+
+/**
+ * Get bank by position (banks are sorted by name)
+ * @param index Position, 0 to bank_count() - 1
+ * @return Pointer to bank, NULL if out of range
+ */
+struct question_bank *bank_at(int index);
+
+#endif // QUESTION_BANK_H
@@ -0,0 +1,118 @@
+#ifndef QUESTION_SELECTOR_H
+#define QUESTION_SELECTOR_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include "tlv.h"
+
+/**
+ * Adaptive question selection for training mode
+ *
+ * Every question has a spaced-repetition level per user (Leitner box):
+ *   0 - never answered, 1 - answered wrong, 2..7 - answered correctly
+ *   one or more times in a row. Lower levels get higher weights, so
+ *   mastered questions come back rarely and missed ones come back soon.
+ *
+ * The most recently asked questions are put on a short cooldown (weight 0)
+ * so the same question is not drawn twice in a row. The cooldown counts
+ * draws, not time: it is the only recency signal.
+ *
+ * State per user is a 4-bit level per question, a cooldown bitset and a
+ * Fenwick tree over the weight sums of 64-question blocks. A draw walks the
+ * tree in O(log n) and then scans a single block.
+ *
+ * A bank keeps the state of its players in a SelectorStore keyed by nick,
+ * in the shared arena when pre-forked, so it survives reconnects and a
+ * reconnect to another worker. The store lock is held while a selector is
+ * used, since the nick's owner may move between workers.
+ */
+
+#define SELECTOR_LEVELS         8   // Leitner boxes 0..7
+#define SELECTOR_BLOCK          64  // Questions per Fenwick tree leaf
+#define SELECTOR_COOLDOWN       4   // Recently asked questions held back
+
+typedef struct {
+    int num_questions;
+    int num_blocks;
+    uint8_t *levels;        // Two 4-bit levels per byte
+    uint64_t *cooling;      // Bitset of questions on cooldown
+    uint32_t *tree;         // Fenwick tree of block weights (1-based)
+    uint32_t total;         // Sum of all weights
+    int cooldown[SELECTOR_COOLDOWN];  // Ring of cooling question indices
+    int cooldown_pos;
+} QuestionSelector;
+
+typedef struct SelectorEntry {
+    char nick[MAX_NICK_LENGTH];
+    QuestionSelector sel;
+} SelectorEntry;
+
+typedef struct {
+    pthread_mutex_t mutex;
+    int num_questions;      // Bank size every selector is built for
+    SelectorEntry **slots;  // Nick -> state, open addressing, NULL until first use
+    uint32_t slot_count;    // Power of two
+    uint32_t count;         // Players with state
+} SelectorStore;
+
+/**
+ * Initialize selector state for a question bank
+ * @param sel Selector to initialize
+ * @param num_questions Number of questions in the bank
+ * @return 0 on success, -1 on allocation error
+ */
+int selector_init(QuestionSelector *sel, int num_questions);
+
+/**
+ * Release memory owned by the selector
+ * @param sel Selector to free
+ */
+void selector_free(QuestionSelector *sel);
+
+/**
+ * Draw the next question, weighted by level, and put it on cooldown
+ * @param sel Selector state
+ * @return Question index (0-based), -1 if the bank is empty
+ */
+int selector_next(QuestionSelector *sel);
+
+/**
+ * Update the level of a question after it was answered
+ * @param sel Selector state
+ * @param index Question index (0-based)
+ * @param correct 1 if answered correctly, 0 otherwise
+ */
+void selector_record(QuestionSelector *sel, int index, int correct);
+
+/**
+ * Initialize an empty store; nothing is allocated until the first draw
+ * @param store Store to initialize
+ * @param num_questions Number of questions in the bank
+ */
+void selector_store_init(SelectorStore *store, int num_questions);
+
+/**
+ * Release every selector in the store
+ * @param store Store to free
+ */
+void selector_store_destroy(SelectorStore *store);
+
+/**
+ * Draw the next question for a player, creating their state on first use
+ * @param store Store of the player's bank
+ * @param nick Player, empty for a client that did not log in
+ * @return Question index (0-based), -1 without a nick, on an empty bank
+ *         or on allocation error
+ */
+int selector_store_next(SelectorStore *store, const char *nick);
+
+/**
+ * Update the level of a question a player answered
+ * @param store Store of the player's bank
+ * @param nick Player; nothing is recorded if they have no state
+ * @param index Question index (0-based)
+ * @param correct 1 if answered correctly, 0 otherwise
+ */
+void selector_store_record(SelectorStore *store, const char *nick, int index, int correct);
+
+#endif // QUESTION_SELECTOR_H
@@ -0,0 +1,78 @@
+#ifndef QUESTION_STATS_H
+#define QUESTION_STATS_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include "quiz.h"
+#include "tlv.h"
+
+/**
+ * Answer statistics per question
+ *
+ * Each bank keeps one 32-byte record per question in a flat array, in
+ * question file order, so a question's record is found by its position in
+ * the bank like the training weights. Two records share a cache line. A
+ * question sent costs one increment and an answer two: the chosen option
+ * and the response time. Correct answers are not counted separately; they
+ * are the count of the correct option.
+ *
+ * Only the event loop writes the counters. The score log thread reads
+ * them for the periodic dump file, so they are atomics updated with a
+ * relaxed load and store (no locked instruction). A reader may see one
+ * field of a record an answer ahead of another. Pre-forked workers share
+ * the counters of a bank and add with a locked instruction instead.
+ */
+
+#define QUESTION_STATS_FILE             "question_stats.csv"
+#define QUESTION_STATS_DUMP_INTERVAL    60      // Seconds between dumps (when answers came in)
+
+struct question_counters {
+    _Atomic uint32_t asked;                         // Times the question was sent
+    _Atomic uint32_t chosen[MAX_ANSWERS_PER_Q];     // Answers per option
+    _Atomic uint64_t response_us;                   // Sum of question -> answer times
+};
+
+/**
+ * Allocate zeroed counters for a bank
+ * @param count Number of questions
+ * @return Cache line aligned array, NULL on error (shared_free() it)
+ */
+struct question_counters *question_stats_alloc(int count);
+
+/**
+ * Count a question that was sent to a client
+ * @param counters Record of the question
+ */
+void question_stats_asked(struct question_counters *counters);
+
+/**
+ * Count an answer to a question that was sent
+ * @param counters Record of the question
+ * @param answer_index 0-based answer option, out of range answers are ignored
+ * @param response_ns Time from sending the question to receiving the answer
+ */
+void question_stats_answered(struct question_counters *counters, int answer_index, uint64_t response_ns);
+
+/**
+ * Read the counters of a question
+ * @param counters Record of the question
+ * @param question Question the record belongs to
+ * @param out Output: summary in host byte order
+ */
+void question_stats_read(struct question_counters *counters, const Question *question,
+                         struct question_summary *out);
+
+/**
+ * Sum of all counters of all banks, to tell whether a new dump is worth writing
+ * @return Questions sent plus answers received
+ */
+uint64_t question_stats_total(void);
+
+/**
+ * Write the statistics of every bank as CSV, replacing the file atomically
+ * @param path Output file
+ * @return Number of questions written, -1 on error
+ */
+long question_stats_dump(const char *path);
+
+#endif // QUESTION_STATS_H
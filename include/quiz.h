@@ -3,11 +3,16 @@
 
 #include <stdint.h>
 #include <cjson/cJSON.h>
+#include "roaring_bitmap.h"
+#include "search_index.h"
 
-#define MAX_QUESTIONS 200
 #define MAX_QUESTION_TEXT 1024
 #define MAX_ANSWER_TEXT 256
 #define MAX_ANSWERS_PER_Q 4
+#define MAX_TAGS 64
+#define MAX_TAG_NAME 32
+#define MAX_TAGS_PER_Q 8
+#define MAX_SEARCH_RESULTS 256
 
 typedef struct {
     int id;
@@ -15,11 +20,18 @@ typedef struct {
     char odpowiedzi[MAX_ANSWERS_PER_Q][MAX_ANSWER_TEXT];
     int num_odpowiedzi;
     int poprawna;  // 1-based index (from JSON)
+    uint8_t tags[MAX_TAGS_PER_Q];  // Tag IDs (index into tag_names)
+    int num_tags;
 } Question;
 
 typedef struct {
-    Question questions[MAX_QUESTIONS];
+    Question *questions;  // Allocated to fit the question file
     int count;
+    char tag_names[MAX_TAGS][MAX_TAG_NAME];  // Lowercase tag names
+    int tag_count;
+    RoaringBitmap tag_index[MAX_TAGS];       // Tag ID -> question indices
+    SearchIndex search;                      // Words of questions and answers -> question indices
+    uint64_t version;                        // FNV-1a of the question file, changes with its content
 } QuizDatabase;
 
 /**
@@ -30,6 +42,12 @@ typedef struct {
  */
 int quiz_load_questions(QuizDatabase *db, const char *filepath);
 
+/**
+ * Release questions, tag index and search index owned by the database
+ * @param db Quiz database
+ */
+void quiz_free_questions(QuizDatabase *db);
+
 /**
  * Get random question from database
  * @param db Quiz database
@@ -37,6 +55,43 @@ int quiz_load_questions(QuizDatabase *db, const char *filepath);
  */
 Question* quiz_get_random_question(QuizDatabase *db);
 
+/**
+ * Find a tag by name (case-insensitive)
+ * @param db Quiz database
+ * @param name Tag name
+ * @return Tag ID, -1 if no question has this tag
+ */
+int quiz_find_tag(const QuizDatabase *db, const char *name);
+
+/**
+ * Get random question matching a tag filter
+ *
+ * Combines the per-tag bitmaps (intersection or union) and picks a random
+ * rank in the result, so the cost depends on the tag bitmaps and not on
+ * the number of questions in the bank.
+ *
+ * @param db Quiz database
+ * @param match_all 1 to require all tags (AND), 0 to accept any tag (OR)
+ * @param tag_ids Tag IDs from quiz_find_tag()
+ * @param num_tags Number of tag IDs
+ * @return Pointer to random matching question, NULL if none matches
+ */
+Question* quiz_get_random_tagged_question(QuizDatabase *db, int match_all,
+                                          const int *tag_ids, int num_tags);
+
+/**
+ * Find questions containing every word of a query
+ *
+ * Matching ignores case and Polish diacritics ("maska" finds "Maską").
+ *
+ * @param db Quiz database
+ * @param query Words to search for
+ * @param ids Output: IDs of matching questions, in question file order
+ * @param max_ids Capacity of ids, at most MAX_SEARCH_RESULTS are returned
+ * @return Number of IDs written, -1 if the query has no searchable word
+ */
+int quiz_search_questions(const QuizDatabase *db, const char *query, int *ids, int max_ids);
+
 /**
  * Get question by ID
  * @param db Quiz database
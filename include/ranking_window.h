@@ -0,0 +1,107 @@
+#ifndef RANKING_WINDOW_H
+#define RANKING_WINDOW_H
+
+#include <stdatomic.h>
+#include <time.h>
+#include "leaderboard.h"
+
+/**
+ * Leaderboards of a time window: today, this week, this term
+ *
+ * Each bank keeps one leaderboard per window next to its all-time one.
+ * When a window ends, its board is replaced by an empty one without work
+ * on the event loop. A janitor thread prepares the empty board well
+ * before the boundary. The reactor swaps the two pointers on the first
+ * use after the boundary and hands the old board back to the janitor,
+ * which frees it. Destroying a board with a day's worth of players
+ * never happens between two client requests.
+ *
+ * Pre-forked workers share the windows. Whichever worker first sees the
+ * boundary rolls over, under the janitor mutex; the others see the new
+ * board through the window's end time, published after it. The master
+ * process does the janitor's work with ranking_window_service() and
+ * frees a retired board only RANKING_WINDOW_GRACE seconds after the
+ * swap, when no worker can still be inside a request that read it.
+ *
+ * Windows follow the server's local time (midnight, Monday 00:00, term
+ * start dates), so daylight saving changes move the boundaries with the
+ * clock. Windowed rankings are kept in memory only; after a restart they
+ * start empty while the all-time ranking is recovered from the score log.
+ *
+ * Usage:
+ * @code
+ *     ranking_window_set_terms("10-01,02-20");        // optional
+ *     ranking_window_init(&bank->windows[RANKING_WINDOW_DAY], RANKING_WINDOW_DAY, time(NULL));
+ *     daemon_init(...);
+ *     ranking_window_start();                         // janitor thread
+ *     struct leaderboard *today = ranking_window_board(&bank->windows[RANKING_WINDOW_DAY],
+ *                                                      RANKING_WINDOW_DAY, time(NULL));
+ * @endcode
+ */
+
+#define RANKING_WINDOW_MAX_TERMS        8
+#define RANKING_WINDOW_DEFAULT_TERMS    "10-01,02-20"   // Winter and summer semester
+#define RANKING_WINDOW_GRACE            5               // Seconds before a shared retired board is freed
+
+struct ranking_window {
+    _Atomic(struct leaderboard *) current;  // Results of the window in progress
+    struct leaderboard *next;               // Empty board for the next window, guarded by the janitor
+    _Atomic time_t start, end;              // Window of current, [start, end)
+};
+
+/**
+ * Set the dates terms start on, every year
+ * @param spec Comma separated MM-DD dates, e.g. "10-01,02-20"
+ * @return 0 on success, -1 if the list is malformed
+ */
+int ranking_window_set_terms(const char *spec);
+
+/**
+ * Create the board of the current window and the one of the next
+ * @param w Window to initialize
+ * @param window RANKING_WINDOW_DAY, RANKING_WINDOW_WEEK or RANKING_WINDOW_TERM
+ * @param now Current time
+ * @return 0 on success, -1 on error
+ */
+int ranking_window_init(struct ranking_window *w, int window, time_t now);
+
+/**
+ * Release the boards of a window
+ *
+ * Must not race with a rollover of the same window; meant for cleanup
+ * when a bank fails to load.
+ *
+ * @param w Window initialized with ranking_window_init()
+ */
+void ranking_window_destroy(struct ranking_window *w);
+
+/**
+ * Board of the window containing now, rolling over if the window ended
+ *
+ * Called from the event loop (of every worker when pre-forked).
+ *
+ * @param w Window
+ * @param window RANKING_WINDOW_* the window was initialized with
+ * @param now Current time
+ * @return Leaderboard of the current window
+ */
+struct leaderboard *ranking_window_board(struct ranking_window *w, int window, time_t now);
+
+/**
+ * Start the janitor thread that prepares and frees window boards
+ *
+ * Without it rollovers still work, but happen on the caller's thread.
+ *
+ * @return 0 on success, -1 on error
+ */
+int ranking_window_start(void);
+
+/**
+ * Do one round of the janitor's work on the calling thread
+ *
+ * For the master of pre-forked workers, which runs no threads: call it
+ * every second or so instead of ranking_window_start().
+ */
+void ranking_window_service(void);
+
+#endif // RANKING_WINDOW_H
@@ -0,0 +1,106 @@
+#ifndef ROARING_BITMAP_H
+#define ROARING_BITMAP_H
+
+#include <stdint.h>
+
+/**
+ * Compressed bitmap of 32-bit integers (roaring-style)
+ *
+ * Values are split by their high 16 bits into containers. A container
+ * holds the low 16 bits either as a sorted uint16_t array (sparse, up to
+ * ROARING_ARRAY_MAX values) or as a 65536-bit bitmap (dense). Set
+ * operations work container by container and pick the cheapest
+ * representation for the result.
+ *
+ * Example:
+ * @code
+ *     RoaringBitmap a, b, both;
+ *     roaring_init(&a); roaring_init(&b); roaring_init(&both);
+ *     roaring_add(&a, 3); roaring_add(&b, 3); roaring_add(&b, 7);
+ *     roaring_and(&a, &b, &both);          // {3}
+ *     uint32_t v;
+ *     roaring_select(&both, 0, &v);        // v == 3
+ * @endcode
+ */
+
+#define ROARING_ARRAY_MAX       4096
+#define ROARING_BITMAP_WORDS    1024    // 65536 bits
+
+typedef struct {
+    uint16_t key;           // High 16 bits of every value in the container
+    uint8_t is_bitmap;      // 1 if words[] is used, 0 if array[] is used
+    uint32_t cardinality;
+    uint32_t capacity;      // Allocated length of array[]
+    uint16_t *array;        // Sorted low 16 bits (sparse container)
+    uint64_t *words;        // Bitmap of low 16 bits (dense container)
+} RoaringContainer;
+
+typedef struct {
+    RoaringContainer *containers;   // Sorted by key
+    int count;
+    int capacity;
+} RoaringBitmap;
+
+/**
+ * Initialize an empty bitmap
+ * @param bm Bitmap to initialize
+ */
+void roaring_init(RoaringBitmap *bm);
+
+/**
+ * Release memory owned by the bitmap and leave it empty
+ * @param bm Bitmap to free
+ */
+void roaring_free(RoaringBitmap *bm);
+
+/**
+ * Add a value to the bitmap
+ * @param bm Bitmap
+ * @param value Value to add
+ * @return 0 on success, -1 on allocation error
+ */
+int roaring_add(RoaringBitmap *bm, uint32_t value);
+
+/**
+ * Check whether a value is in the bitmap
+ * @param bm Bitmap
+ * @param value Value to look up
+ * @return 1 if present, 0 otherwise
+ */
+int roaring_contains(const RoaringBitmap *bm, uint32_t value);
+
+/**
+ * Number of values in the bitmap
+ * @param bm Bitmap
+ * @return Cardinality
+ */
+uint32_t roaring_cardinality(const RoaringBitmap *bm);
+
+/**
+ * Intersection: out = a AND b (out must be initialized and distinct from a, b)
+ * @return 0 on success, -1 on allocation error
+ */
+int roaring_and(const RoaringBitmap *a, const RoaringBitmap *b, RoaringBitmap *out);
+
+/**
+ * Union: out = a OR b (out must be initialized and distinct from a, b)
+ * @return 0 on success, -1 on allocation error
+ */
+int roaring_or(const RoaringBitmap *a, const RoaringBitmap *b, RoaringBitmap *out);
+
+/**
+ * Copy src into dst (dst must be initialized and distinct from src)
+ * @return 0 on success, -1 on allocation error
+ */
+int roaring_copy(const RoaringBitmap *src, RoaringBitmap *dst);
+
+/**
+ * Find the value with the given rank (0 = smallest)
+ * @param bm Bitmap
+ * @param rank Rank of the value, less than roaring_cardinality()
+ * @param value Output: value at that rank
+ * @return 0 on success, -1 if rank is out of range
+ */
+int roaring_select(const RoaringBitmap *bm, uint32_t rank, uint32_t *value);
+
+#endif // ROARING_BITMAP_H
@@ -0,0 +1,99 @@
+#ifndef SCORE_LOG_H
+#define SCORE_LOG_H
+
+#include <stdint.h>
+
+/**
+ * Durable rankings and test statistics
+ *
+ * Every finished test is appended to a write-ahead log (scores.wal) in the
+ * data directory. Records carry a CRC32, so a torn or corrupted tail is
+ * detected and cut off at recovery.
+ *
+ * The reactor never touches the disk: score_log_append() encodes the
+ * record into a pending buffer and returns. A background writer thread
+ * takes everything that accumulated, writes it with one write() and one
+ * fdatasync() (group commit), and applies it to its own compact copy of
+ * the per-bank state. Once a second it also logs the question counters
+ * of banks that moved, and once a QUESTION_STATS_DUMP_INTERVAL it
+ * rewrites the per-question answer statistics (question_stats.csv) if
+ * they moved. From that copy it periodically writes a snapshot
+ * (scores.snap) and starts a new log generation, which bounds recovery
+ * time without ever locking the live leaderboards for long.
+ *
+ * Pre-forked workers queue into a buffer in the shared arena and the
+ * master process runs the writer between supervising them
+ * (score_log_open() and score_log_run_once() instead of a thread).
+ *
+ * Crash safety of the rotation: the snapshot records the log generation
+ * it covers; a log of the same or an older generation is skipped at
+ * recovery, so no event is applied twice. Nothing is appended to a log
+ * once a snapshot covers it: until the next generation is in place,
+ * batches stay queued and are not acknowledged.
+ *
+ * Usage:
+ * @code
+ *     score_log_recover("/var/lib/networkexam");  // before daemon_init()
+ *     daemon_init(...);
+ *     score_log_start();                          // writer thread
+ *     score_log_append("cisco", "ala", 9, 312);
+ * @endcode
+ */
+
+#define SCORE_LOG_SNAPSHOT_EVENTS   100000      // Snapshot after this many events (and at least
+                                                // as many as there are ranked players)
+#define SCORE_LOG_SNAPSHOT_INTERVAL 300         // ... or this many seconds with new events
+#define SCORE_LOG_MAX_PENDING       (16 << 20)  // Bytes queued before events are dropped
+
+/**
+ * Load the snapshot and replay the log into the loaded question banks
+ *
+ * Must run after the banks are loaded and before any thread is started.
+ * Results of banks that are not loaded are kept and written back.
+ *
+ * @param dir Data directory (absolute path, it must stay valid after chdir)
+ * @return Number of events replayed from the log, -1 on error
+ */
+long score_log_recover(const char *dir);
+
+/**
+ * Open the log for appending and start the writer thread
+ * @return 0 on success, -1 on error
+ */
+int score_log_start(void);
+
+/**
+ * Open the log for appending without a writer thread
+ *
+ * The caller runs the writer with score_log_run_once(). With the shared
+ * arena active the queue is placed in it, so processes forked afterwards
+ * can append.
+ *
+ * @return 0 on success, -1 on error
+ */
+int score_log_open(void);
+
+/**
+ * One round of the writer: wait up to a second for events, write them,
+ * then snapshot and dump statistics when due
+ * @param wait 0 to write only what is queued already, e.g. at shutdown
+ */
+void score_log_run_once(int wait);
+
+/**
+ * Queue a finished test for the log (never blocks on I/O)
+ * @param bank Question bank name
+ * @param nick Player nickname
+ * @param score Correct answers
+ * @param time_seconds Test duration
+ */
+void score_log_append(const char *bank, const char *nick, uint8_t score, uint32_t time_seconds);
+
+/**
+ * Wait until every event queued so far is on disk
+ *
+ * Meant for shutdown and tools; the reactor never calls it.
+ */
+void score_log_flush(void);
+
+#endif // SCORE_LOG_H
@@ -0,0 +1,119 @@
+#ifndef SEARCH_INDEX_H
+#define SEARCH_INDEX_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Full-text inverted index over question and answer texts
+ *
+ * Text is split into terms on ASCII punctuation and whitespace. Terms are
+ * lowercased and Polish diacritics are folded to ASCII. A final vowel is
+ * dropped from longer words as a light stemmer for Polish case endings, so
+ * "Maska", "maskę" and "maską" all find the same questions.
+ *
+ * Every term maps to a posting list: the sorted indices of the documents
+ * (questions) containing it. Lists are stored in blocks of
+ * SEARCH_BLOCK_SIZE documents, delta + varint encoded. A skip table keeps
+ * the first document of each block, so an AND query walks the rarest list
+ * and gallops through the skip tables of the others, decoding only the
+ * blocks that can contain a match.
+ *
+ * Example:
+ * @code
+ *     SearchIndex idx;
+ *     search_index_init(&idx);
+ *     search_index_add(&idx, 0, "Maska podsieci 255.255.255.0");
+ *     search_index_finalize(&idx);
+ *     uint32_t docs[10];
+ *     int n = search_index_query(&idx, "maska", docs, 10);   // n == 1, docs[0] == 0
+ * @endcode
+ */
+
+#define SEARCH_BLOCK_SIZE       128  // Documents per compressed block
+#define SEARCH_MAX_TERM         32   // Longer terms are truncated
+#define SEARCH_MIN_TERM         2    // Shorter terms are not indexed
+#define SEARCH_STEM_MIN         5    // Shorter words keep their last vowel
+#define SEARCH_MAX_QUERY_TERMS  8
+
+typedef struct {
+    uint32_t name;          // Offset of the term in the string arena
+    uint32_t doc_count;     // Documents containing the term
+    uint32_t first_block;   // First entry in the skip tables
+    uint32_t num_blocks;
+    uint32_t last_doc;      // Last document added (build phase)
+} SearchTerm;
+
+typedef struct {
+    // Term dictionary: open addressing hash table of indices into terms[]
+    SearchTerm *terms;
+    uint32_t term_count;
+    uint32_t term_capacity;
+    int32_t *slots;
+    uint32_t slot_count;    // Power of two
+
+    char *strings;          // Term names, NUL terminated
+    size_t strings_len;
+    size_t strings_cap;
+
+    // Compressed postings and per-block skip tables
+    uint8_t *postings;
+    size_t postings_len;
+    uint32_t *block_first;  // First document of each block
+    uint32_t *block_offset; // Offset of each block in postings[]
+    uint32_t block_count;
+
+    // (document, term) pairs in document order, only until search_index_finalize()
+    uint32_t *build_docs;
+    uint32_t *build_terms;
+    size_t build_len;
+    size_t build_cap;
+} SearchIndex;
+
+/**
+ * Initialize an empty index
+ * @param idx Index to initialize
+ */
+void search_index_init(SearchIndex *idx);
+
+/**
+ * Release memory owned by the index
+ * @param idx Index to free
+ */
+void search_index_free(SearchIndex *idx);
+
+/**
+ * Add text of a document; documents must be added in increasing order
+ * @param idx Index (before search_index_finalize())
+ * @param doc Document number
+ * @param text UTF-8 text
+ * @return 0 on success, -1 on allocation error
+ */
+int search_index_add(SearchIndex *idx, uint32_t doc, const char *text);
+
+/**
+ * Compress the posting lists; no documents can be added afterwards
+ * @param idx Index
+ * @return 0 on success, -1 on allocation error
+ */
+int search_index_finalize(SearchIndex *idx);
+
+/**
+ * Find documents containing every term of the query
+ * @param idx Finalized index
+ * @param query UTF-8 query, terms separated by spaces or punctuation
+ * @param docs Output: matching documents in increasing order
+ * @param max_docs Capacity of docs
+ * @return Number of documents written, -1 if the query has no usable term
+ */
+int search_index_query(const SearchIndex *idx, const char *query, uint32_t *docs, int max_docs);
+
+/**
+ * Split text into folded terms (exposed for query parsing and diagnostics)
+ * @param text UTF-8 text, advanced past the returned term
+ * @param term Output buffer of at least SEARCH_MAX_TERM + 1 bytes
+ * @return Length of the term, 0 when the text is exhausted
+ */
+size_t search_next_term(const char **text, char *term);
+
+#endif // SEARCH_INDEX_H
@@ -5,11 +5,6 @@
 #include <stdint.h>
 #include <time.h>
 
-#define RBUF_SIZE 8192
-#define WBUF_SIZE 8192
-
-enum parse_state { READ_HEADER, READ_VALUE };
-
 // Player score entry
 struct score_entry {
     char nick[32];
@@ -17,6 +12,22 @@ struct score_entry {
     uint32_t time_seconds;
 };
 
+// Per-connection quiz session, scored by the server
+struct quiz_session {
+    bool test_active;            // Knowledge test in progress
+    uint8_t test_answered;       // Test questions answered so far
+    uint8_t test_correct;        // Correct test answers so far
+    struct timespec test_start;  // Monotonic time of the first test question
+    uint8_t training_answered;   // Training questions answered (saturating)
+    uint8_t training_correct;    // Correct training answers (saturating)
+    bool has_pending;            // A question was sent and awaits an answer
+    uint8_t pending_mode;        // Mode the pending question was requested in
+    uint32_t pending_question;   // ID of the pending question
+    uint32_t pending_index;      // Its position in the bank (IDs may repeat)
+    uint64_t pending_sent;       // Monotonic ns when it was sent (latency_now())
+    struct question_bank *bank;  // Bank picked at login (NULL = default)
+};
+
 // Server statistics
 struct server_stats {
     time_t start_time;           // Server start timestamp
@@ -30,18 +41,17 @@ struct server_stats {
     char best_player[32];        // Nick of best player
 };
 
+// Buffers of a client connection, borrowed from the buffer pool only while in use
 struct connection {
-    int fd;
-    bool is_listener;
-    uint8_t rbuf[RBUF_SIZE];
-    size_t rlen; // bytes in buffer
-    size_t rpos;
-    uint8_t wbuf[WBUF_SIZE];
-    size_t wlen;
-    size_t wpos;
-    enum parse_state state;
-    uint16_t tlv_type;
-    uint16_t tlv_len;
+    uint8_t *rbuf;               // Received bytes of an incomplete frame, NULL when none
+    uint32_t rlen;               // Bytes in rbuf
+    uint32_t rcap;               // Capacity of rbuf
+    uint8_t *wbuf;               // Output the socket did not accept yet, NULL when none
+    uint32_t wpos;               // First byte of wbuf still to send
+    uint32_t wlen;               // Bytes in wbuf
+    uint32_t wcap;               // Capacity of wbuf
+    uint32_t nmarks;             // Responses in marks
+    struct output_mark *marks;   // Where each queued response ends, NULL when none
 };
 
 #endif // SERVER_TYPES_H
@@ -16,16 +16,20 @@
 #include "tlv.h"
 
 #define BUFFER_SIZE 4096
-#define MAX_ACTIVE_NICKS 5000
 
 /**
  * Handle LOGIN_REQUEST from client and send LOGIN_RESPONSE
+ *
+ * On success the nickname is held in server_nicks by owner until the
+ * connection releases it.
+ *
  * @param connfd Client connection file descriptor
+ * @param owner Registry owner of the connection (connfd, or NICK_OWNER() when pre-forked)
  * @param buffer Buffer containing parsed nickname
  * @param nick_out Output buffer to store the nickname (must be at least MAX_NICK_LENGTH)
  * @return 0 on success, -1 on error
  */
-int server_handle_login(int connfd, const uint8_t *buffer, char *nick_out);
+int server_handle_login(int connfd, int owner, const uint8_t *buffer, char *nick_out);
 
 /**
  * Validate nickname (length and allowed characters)
@@ -0,0 +1,127 @@
+#ifndef SHARED_ARENA_H
+#define SHARED_ARENA_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <time.h>
+
+/**
+ * Memory and locks shared by the worker processes of a pre-forked server
+ *
+ * The arena is one anonymous MAP_SHARED mapping created before the question
+ * banks are loaded. Workers forked afterwards see it at the same address,
+ * so structures built from pointers (leaderboards, the nick registry, bank
+ * statistics) work unchanged in every process as long as they are
+ * allocated here.
+ *
+ * Allocation uses power-of-two size classes with one free list each and a
+ * bump pointer, under one lock; it serves the allocations of shared
+ * structures (a new player, a grown table), not every request. Every block
+ * is 64-byte aligned.
+ * Pages are only backed by memory once touched.
+ *
+ * Locks in shared structures are process-shared and robust: if a worker
+ * dies holding one, the next process to lock it takes it over
+ * (shared_mutex_lock() marks it consistent) instead of waiting forever.
+ * The structure it guarded may then hold a half-finished update, so the
+ * take-over also marks the whole arena poisoned; the pre-fork master
+ * checks shared_arena_poisoned() and starts the server over.
+ *
+ * Without shared_arena_init() every function falls back to the ordinary
+ * heap and process-private locks, so code written against this API serves
+ * the single-process server unchanged.
+ */
+
+#define SHARED_ARENA_SIZE       (1UL << 30)     // Address space reserved for the arena
+#define SHARED_ARENA_ALIGN      64
+
+/**
+ * Map the arena; must run before anything is allocated from it
+ * @param size Bytes to reserve
+ * @return 0 on success, -1 on error
+ */
+int shared_arena_init(size_t size);
+
+/**
+ * Whether the arena is in use
+ * @return 1 after shared_arena_init(), 0 otherwise
+ */
+int shared_arena_active(void);
+
+/**
+ * Whether a process died holding a lock in the arena
+ * @return 1 once any shared lock was taken over, 0 otherwise
+ */
+int shared_arena_poisoned(void);
+
+/**
+ * Bytes handed out from the arena so far, free lists included
+ * @return Used bytes, 0 without an arena
+ */
+size_t shared_arena_used(void);
+
+/**
+ * Allocate from the arena (malloc() without one)
+ * @param size Bytes
+ * @return Memory, 64-byte aligned in the arena, NULL on error
+ */
+void *shared_malloc(size_t size);
+
+/**
+ * Allocate 64-byte aligned memory from the arena (aligned_alloc() without one)
+ * @param size Bytes
+ * @return Cache line aligned memory, NULL on error
+ */
+void *shared_aligned_alloc(size_t size);
+
+/**
+ * Allocate zeroed memory from the arena (calloc() without one)
+ * @param count Number of elements
+ * @param size Bytes per element
+ * @return Memory, 64-byte aligned in the arena, NULL on error
+ */
+void *shared_calloc(size_t count, size_t size);
+
+/**
+ * Resize an allocation (realloc() without an arena)
+ * @param ptr Memory from shared_malloc(), or NULL
+ * @param size New size in bytes
+ * @return Resized memory, NULL on error (ptr stays valid)
+ */
+void *shared_realloc(void *ptr, size_t size);
+
+/**
+ * Release memory from shared_malloc() and friends
+ * @param ptr Memory to release, NULL is ignored
+ */
+void shared_free(void *ptr);
+
+/**
+ * Initialize a mutex, process-shared and robust when the arena is active
+ * @param mutex Mutex inside shared memory
+ * @return 0 on success, an error number otherwise
+ */
+int shared_mutex_init(pthread_mutex_t *mutex);
+
+/**
+ * Initialize a condition variable, process-shared when the arena is active
+ * @param cond Condition variable inside shared memory
+ * @return 0 on success, an error number otherwise
+ */
+int shared_cond_init(pthread_cond_t *cond);
+
+/**
+ * Lock a mutex, taking it over (and poisoning the arena) if its owner died
+ * @param mutex Mutex initialized with shared_mutex_init()
+ */
+void shared_mutex_lock(pthread_mutex_t *mutex);
+
+/**
+ * Wait on a condition variable with a timeout, taking the mutex over if its owner died
+ * @param cond Condition variable initialized with shared_cond_init()
+ * @param mutex Locked mutex
+ * @param deadline Absolute CLOCK_REALTIME time, NULL to wait without a timeout
+ */
+void shared_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex, const struct timespec *deadline);
+
+#endif // SHARED_ARENA_H
@@ -5,6 +5,7 @@
 #include <string.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <stdint.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
@@ -27,4 +28,20 @@ int set_socket_options(int sockfd);
 
 int set_nonblocking(int fd);
 
+#define LISTEN_FDS_START    3   // First socket passed by a service manager
+
+/**
+ * @brief Take the listening socket passed by a service manager.
+ *
+ * Implements the receiving side of systemd socket activation: if
+ * LISTEN_PID names this process and LISTEN_FDS is at least 1, fd 3 is an
+ * already bound and listening socket. Connections queue on it in the
+ * kernel while the server is still starting. The LISTEN_* variables are
+ * removed from the environment.
+ *
+ * @param port Output: port the socket is bound to
+ * @return Socket (an IPv6 listener), -1 if none was passed or it is unusable
+ */
+int inherited_listener(uint16_t *port);
+
 #endif // SOCK_OPTIONS_H
@@ -0,0 +1,120 @@
+#ifndef STATS_COUNTERS_H
+#define STATS_COUNTERS_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include "server_types.h"
+
+/**
+ * Server statistics without a shared lock
+ *
+ * Counters are split into STATS_SHARDS shards of one cache line each.
+ * Every thread adds to its own shard with relaxed atomics, so updates
+ * made on different cores never touch the same line. Reading a counter
+ * sums the shards; reads are rare (SERVER_INFO, the score log) while
+ * updates happen on every connection, question and test.
+ *
+ * The best result is three fields that must be read together. It is
+ * published with a sequence lock: a reader copies it and retries if a
+ * writer was active meanwhile, so readers never block and never see a
+ * nick from one result next to the score of another. Writers only come
+ * with a better result and take a mutex among themselves.
+ *
+ * Pre-forked workers share counters placed in the shared arena; each
+ * worker starts handing out shards at its own index so their threads do
+ * not share lines either.
+ */
+
+#define STATS_SHARDS        16      // Threads beyond this share shards
+#define STATS_CACHE_LINE    64
+
+enum stats_counter {
+    STATS_TOTAL_CONNECTIONS,        // Connections since start
+    STATS_ACTIVE_CONNECTIONS,       // Open connections (added to and subtracted from)
+    STATS_TESTS_COMPLETED,
+    STATS_QUESTIONS_ASKED,
+    STATS_TOTAL_SCORE,              // Sum of all test scores
+    STATS_BYTES_IN,                 // Bytes received from clients
+    STATS_BYTES_OUT,                // Bytes of responses accepted by send()
+    STATS_COUNTERS
+};
+
+struct stats_shard {
+    _Alignas(STATS_CACHE_LINE) _Atomic uint64_t values[STATS_COUNTERS];
+};
+
+struct stats_best {
+    _Alignas(STATS_CACHE_LINE) _Atomic uint32_t seq;  // Odd while being written
+    _Atomic uint64_t result;        // score << 32 | time_seconds
+    _Atomic uint64_t player[4];     // Nick, MAX_NICK_LENGTH bytes
+    pthread_mutex_t writer;         // Serializes writers only
+};
+
+struct stats_counters {
+    struct stats_shard shards[STATS_SHARDS];
+    struct stats_best best;
+};
+
+/**
+ * Server-wide counters: connections and traffic (test counters are per bank);
+ * allocated at startup, in the shared arena when pre-forked
+ */
+extern struct stats_counters *server_counters;
+
+/**
+ * Initialize counters to zero and the best result to "N/A"
+ * @param counters Counters (must be STATS_CACHE_LINE aligned)
+ */
+void stats_init(struct stats_counters *counters);
+
+/**
+ * Start handing out shards at another index, for a freshly forked worker
+ * @param first Shard of the worker's first thread (taken modulo STATS_SHARDS)
+ */
+void stats_set_first_shard(unsigned first);
+
+/**
+ * Add to a counter in the calling thread's shard
+ * @param counters Counters
+ * @param counter Counter to change
+ * @param delta Amount, negative to subtract
+ */
+void stats_add(struct stats_counters *counters, enum stats_counter counter, int64_t delta);
+
+/**
+ * Current value of a counter, summed over all shards
+ * @param counters Counters
+ * @param counter Counter to read
+ * @return Counter value
+ */
+uint64_t stats_read(struct stats_counters *counters, enum stats_counter counter);
+
+/**
+ * Publish a result if it beats the best one (higher score, then shorter time)
+ * @param counters Counters
+ * @param score Correct answers
+ * @param time_seconds Test duration
+ * @param nick Player nickname
+ */
+void stats_offer_best(struct stats_counters *counters, uint8_t score,
+                      uint32_t time_seconds, const char *nick);
+
+/**
+ * Read all counters and the best result
+ * @param counters Counters
+ * @param out Output: statistics (start_time is left untouched)
+ */
+void stats_collect(struct stats_counters *counters, struct server_stats *out);
+
+/**
+ * Overwrite the test counters and best result with restored values
+ *
+ * Not safe against concurrent updates; meant for startup.
+ *
+ * @param counters Counters
+ * @param in Statistics to restore
+ */
+void stats_restore(struct stats_counters *counters, const struct server_stats *in);
+
+#endif // STATS_COUNTERS_H
@@ -0,0 +1,47 @@
+#ifndef TEXT_VALIDATE_H
+#define TEXT_VALIDATE_H
+
+#include <stddef.h>
+
+/**
+ * Validation of protocol and question bank text
+ *
+ * Every string read from the network or a question file is checked to be
+ * well-formed UTF-8 (RFC 3629: no overlong forms, no surrogates, nothing
+ * above U+10FFFF), and nicknames to use only a-z, A-Z, 0-9, '_' and '-'.
+ * The nick check does not depend on the locale, unlike isalnum().
+ *
+ * On x86-64 the checks use vector instructions:
+ * - UTF-8 with AVX2 (chosen at runtime) classifies 32 bytes at a time
+ *   with three nibble lookup tables and checks where multi-byte sequences
+ *   must continue (Keiser & Lemire, "Validating UTF-8 in less than one
+ *   instruction per byte").
+ * - Without AVX2, SSE2 skips runs of ASCII 16 bytes at a time and checks
+ *   the other characters one by one.
+ * - Nicks fit in two SSE2 registers and are checked with range compares.
+ * Other architectures use the scalar code.
+ */
+
+/**
+ * Check that a byte string is well-formed UTF-8
+ * @param data Bytes to check (need not be NUL-terminated)
+ * @param len Number of bytes
+ * @return 0 if valid, -1 if not
+ */
+int text_validate_utf8(const void *data, size_t len);
+
+/**
+ * Check the characters of a nickname
+ * @param nick Nickname (need not be NUL-terminated)
+ * @param len Number of bytes, the length limit is left to the caller
+ * @return 0 if every byte is a-z, A-Z, 0-9, '_' or '-', -1 if not
+ */
+int text_validate_nick(const char *nick, size_t len);
+
+/**
+ * Name of the UTF-8 implementation in use, for the startup log
+ * @return "avx2", "sse2" or "scalar"
+ */
+const char *text_validate_impl(void);
+
+#endif // TEXT_VALIDATE_H
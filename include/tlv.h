@@ -27,6 +27,10 @@
  *         char nick[64];
  *         tlv_parse_login_request(buffer + 4, nick, sizeof(nick));
  *     }
+ *
+ * Parse functions reject string fields that are not well-formed UTF-8,
+ * and nicknames to look up (REQUEST_RANK, REQUEST_RANKING) with characters
+ * a login would not accept.
  */
 
 #include <stdint.h>
@@ -49,16 +53,60 @@
 #define TLV_RANKING_DATA        0x0009
 #define TLV_REQUEST_SERVER_INFO 0x000A
 #define TLV_SERVER_INFO_DATA    0x000B
+#define TLV_ERROR               0x000C
+#define TLV_SEARCH_QUESTIONS    0x000D
+#define TLV_SEARCH_RESULTS      0x000E
+#define TLV_REQUEST_RANK        0x000F
+#define TLV_RANK_DATA           0x0010
+#define TLV_RANKING_PAGE        0x0011
+#define TLV_REQUEST_LATENCY     0x0012
+#define TLV_LATENCY_DATA        0x0013
+#define TLV_REQUEST_QUESTION_STATS 0x0014
+#define TLV_QUESTION_STATS      0x0015
+#define TLV_DISCOVER_REQUEST    0x0016  // UDP, multicast to the discovery groups
+#define TLV_DISCOVER_RESPONSE   0x0017  // UDP, unicast to the requester
 
 // Login response status codes
 #define LOGIN_SUCCESS           0
 #define LOGIN_ERROR_NICK_TAKEN  1
 #define LOGIN_ERROR_INVALID     2
+#define LOGIN_ERROR_UNKNOWN_BANK 3
 
 // Question modes
 #define MODE_RANDOM             0
 #define MODE_TEST               1
 
+// Tag filter operators (REQUEST_QUESTION)
+#define TAG_FILTER_NONE         0
+#define TAG_FILTER_ALL          1  // Question must have every tag (AND)
+#define TAG_FILTER_ANY          2  // Question must have at least one tag (OR)
+
+// Ranking request modes (REQUEST_RANKING)
+#define RANKING_TOP             0  // Top players as RANKING_DATA (same as no payload)
+#define RANKING_OFFSET          1  // RANKING_PAGE starting at an offset
+#define RANKING_AROUND          2  // RANKING_PAGE centered on a player
+
+// Ranking windows (REQUEST_RANKING), in local time of the server
+#define RANKING_WINDOW_ALL      0  // All-time ranking (same as no window byte)
+#define RANKING_WINDOW_DAY      1  // Since midnight
+#define RANKING_WINDOW_WEEK     2  // Since Monday 00:00
+#define RANKING_WINDOW_TERM     3  // Since the start of the term
+#define RANKING_WINDOWS         4
+
+// Error codes (ERROR)
+#define ERROR_NO_QUESTIONS      1
+#define ERROR_INVALID_QUERY     2
+#define ERROR_NOT_PERMITTED     3
+
+// Latency phases (LATENCY_DATA)
+#define LATENCY_PHASE_HANDLE    0  // Message received -> response ready
+#define LATENCY_PHASE_FLUSH     1  // Response ready -> last byte accepted by send()
+#define LATENCY_PHASES          2
+#define LATENCY_QUANTILES       4  // p50, p90, p99, p999
+
+// Number of questions in a knowledge test
+#define TEST_QUESTION_COUNT     10
+
 // Maximum sizes
 #define MAX_NICK_LENGTH         32
 #define MAX_MESSAGE_LENGTH      128
@@ -66,6 +114,14 @@
 #define MAX_ANSWER_LENGTH       256
 #define MAX_ANSWERS             4
 #define MAX_RANKINGS            100
+#define MAX_RANKING_PAGE        50
+#define MAX_LATENCY_SUMMARIES   64
+#define MAX_QUESTION_STATS_PAGE 64
+#define MAX_TAG_LENGTH          32
+#define MAX_BANK_NAME_LENGTH    32
+#define MAX_FILTER_TAGS         8
+#define MAX_SEARCH_QUERY_LENGTH 128
+#define MAX_SEARCH_IDS          256
 
 // Basic TLV header
 struct tlv_header {
@@ -78,6 +134,7 @@ struct tlv_header {
 struct login_request {
     uint8_t nick_length;
     char nick[];
+    // Optional question bank: uint8_t bank_length, char bank[]
 } __attribute__((packed));
 
 // LOGIN_RESPONSE (0x0002)
@@ -91,11 +148,14 @@ struct login_response {
 struct request_question {
     uint8_t mode;
     uint8_t question_index;
+    // Optional tag filter:
+    //   uint8_t filter_op (TAG_FILTER_*), uint8_t num_tags,
+    //   then num_tags blocks of: uint8_t tag_length, char tag[]
 } __attribute__((packed));
 
-// QUESTION_DATA (0x0004)
+// QUESTION_DATA (0x0004), question ids are 32-bit like in SEARCH_RESULTS
 struct question_data {
-    uint16_t question_id;
+    uint32_t question_id;
     uint8_t num_answers;
     uint16_t question_length;
     // Followed by: char question_text[]
@@ -110,13 +170,13 @@ struct answer_data {
 
 // ANSWER_SUBMIT (0x0005)
 struct answer_submit {
-    uint16_t question_id;
+    uint32_t question_id;
     uint8_t answer_id;
 } __attribute__((packed));
 
 // ANSWER_RESULT (0x0006)
 struct answer_result {
-    uint16_t question_id;
+    uint32_t question_id;
     uint8_t is_correct;
     uint8_t correct_answer_id;
     uint8_t test_mode;
@@ -124,8 +184,115 @@ struct answer_result {
     uint8_t correct_count;
 } __attribute__((packed));
 
+// REQUEST_RANKING (0x0008), the payload is optional
+struct request_ranking {
+    uint8_t mode;               // RANKING_*
+    uint32_t offset;            // RANKING_OFFSET: entries to skip
+    uint8_t limit;              // Entries per page, at most MAX_RANKING_PAGE
+    uint8_t nick_length;        // RANKING_AROUND: player, 0 = the requester
+    char nick[];
+    // Optionally followed by uint8_t window (RANKING_WINDOW_*, default all-time)
+} __attribute__((packed));
+
+// ERROR (0x000C)
+struct error_message {
+    uint8_t code;
+    uint8_t message_length;
+    char message[];
+} __attribute__((packed));
+
+// SEARCH_QUESTIONS (0x000D)
+struct search_questions {
+    uint16_t max_results;
+    uint8_t query_length;
+    char query[];
+} __attribute__((packed));
+
+// SEARCH_RESULTS (0x000E)
+struct search_results {
+    uint16_t count;
+    uint32_t question_ids[];
+} __attribute__((packed));
+
+// REQUEST_RANK (0x000F)
+struct request_rank {
+    uint8_t nick_length;        // 0 = rank of the requesting player
+    char nick[];
+} __attribute__((packed));
+
+// RANK_DATA (0x0010)
+struct rank_data {
+    uint32_t rank;              // 1 = best, 0 = no result yet
+    uint32_t total;             // Number of ranked players
+    uint8_t score;              // Best result of the player
+    uint32_t time_seconds;
+    uint8_t nick_length;
+    char nick[];
+} __attribute__((packed));
+
+// RANKING_PAGE (0x0011)
+struct ranking_page {
+    uint32_t first_rank;        // Rank of the first entry (1 = best), 0 if the page is empty
+    uint32_t total;             // Number of ranked players
+    uint8_t count;
+    // Followed by count entries as in RANKING_DATA:
+    //   uint8_t nick_length, char nick[], uint8_t score, uint32_t time_seconds
+} __attribute__((packed));
+
+// LATENCY_DATA (0x0013), only served to local connections
+struct latency_data {
+    uint8_t count;
+    // Followed by count entries of:
+    //   uint16_t type, uint8_t phase (LATENCY_PHASE_*), uint64_t count,
+    //   uint64_t p50_ns, p90_ns, p99_ns, p999_ns, max_ns
+} __attribute__((packed));
+
+// One LATENCY_DATA entry in host byte order
+struct latency_summary {
+    uint16_t type;
+    uint8_t phase;
+    uint64_t count;
+    uint64_t quantiles_ns[LATENCY_QUANTILES];
+    uint64_t max_ns;
+};
+
+// REQUEST_QUESTION_STATS (0x0014), only served to local connections
+struct request_question_stats {
+    uint32_t offset;            // Position of the first question in the bank
+    uint8_t limit;              // 0 or above MAX_QUESTION_STATS_PAGE = MAX_QUESTION_STATS_PAGE
+    uint8_t bank_length;        // 0 = bank of the session (or the default bank)
+    char bank[];
+} __attribute__((packed));
+
+// QUESTION_STATS (0x0015)
+struct question_stats_page {
+    uint32_t total;             // Questions in the bank
+    uint32_t offset;            // Position of the first entry
+    uint8_t count;
+    // Followed by count entries of:
+    //   uint32_t id, uint8_t num_answers, uint8_t correct_answer (0-based),
+    //   uint32_t asked, uint32_t mean_response_ms, uint32_t chosen[MAX_ANSWERS]
+} __attribute__((packed));
+
+// One QUESTION_STATS entry in host byte order
+struct question_summary {
+    uint32_t id;
+    uint8_t num_answers;
+    uint8_t correct_answer;
+    uint32_t asked;             // Times the question was sent
+    uint32_t mean_response_ms;  // Mean time to answer, 0 if never answered
+    uint32_t chosen[MAX_ANSWERS]; // Answers per option, their sum is the answer count
+};
+
 // Function prototypes
 
+/**
+ * Name of a message type, for logs and monitoring
+ * @param type Message type
+ * @return Constant name, "UNKNOWN" for types this build does not know
+ */
+const char *tlv_type_name(uint16_t type);
+
 /**
  * Create TLV LOGIN_REQUEST message
  * @param buffer Output buffer
@@ -134,6 +301,15 @@ struct answer_result {
  */
 ssize_t tlv_create_login_request(uint8_t *buffer, const char *nick);
 
+/**
+ * Create TLV LOGIN_REQUEST message selecting a question bank
+ * @param buffer Output buffer
+ * @param nick User nickname
+ * @param bank Question bank name (empty for the server default)
+ * @return Total message length in bytes, -1 on error
+ */
+ssize_t tlv_create_login_request_bank(uint8_t *buffer, const char *nick, const char *bank);
+
 /**
  * Create TLV LOGIN_RESPONSE message
  * @param buffer Output buffer
@@ -152,6 +328,19 @@ ssize_t tlv_create_login_response(uint8_t *buffer, uint8_t status, const char *m
  */
 ssize_t tlv_create_request_question(uint8_t *buffer, uint8_t mode, uint8_t question_index);
 
+/**
+ * Create TLV REQUEST_QUESTION message with a tag filter
+ * @param buffer Output buffer
+ * @param mode Question mode (MODE_RANDOM or MODE_TEST)
+ * @param question_index Question index (0-9 for test mode)
+ * @param filter_op TAG_FILTER_ALL or TAG_FILTER_ANY
+ * @param tags Array of tag names
+ * @param num_tags Number of tags (up to MAX_FILTER_TAGS)
+ * @return Total message length in bytes, -1 on error
+ */
+ssize_t tlv_create_request_question_filtered(uint8_t *buffer, uint8_t mode, uint8_t question_index,
+                                             uint8_t filter_op, const char **tags, uint8_t num_tags);
+
 /**
  * Create TLV QUESTION_DATA message
  * @param buffer Output buffer
@@ -161,7 +350,7 @@ ssize_t tlv_create_request_question(uint8_t *buffer, uint8_t mode, uint8_t quest
  * @param num_answers Number of answers
  * @return Total message length in bytes, -1 on error
  */
-ssize_t tlv_create_question_data(uint8_t *buffer, uint16_t question_id,
+ssize_t tlv_create_question_data(uint8_t *buffer, uint32_t question_id,
                                   const char *question_text,
                                   const char **answers, uint8_t num_answers);
 
@@ -172,7 +361,7 @@ ssize_t tlv_create_question_data(uint8_t *buffer, uint16_t question_id,
  * @param answer_id Selected answer ID (0-3)
  * @return Total message length in bytes
  */
-ssize_t tlv_create_answer_submit(uint8_t *buffer, uint16_t question_id, uint8_t answer_id);
+ssize_t tlv_create_answer_submit(uint8_t *buffer, uint32_t question_id, uint8_t answer_id);
 
 /**
  * Create TLV ANSWER_RESULT message
@@ -185,7 +374,7 @@ ssize_t tlv_create_answer_submit(uint8_t *buffer, uint16_t question_id, uint8_t
  * @param correct_count Number of correct answers
  * @return Total message length in bytes
  */
-ssize_t tlv_create_answer_result(uint8_t *buffer, uint16_t question_id, 
+ssize_t tlv_create_answer_result(uint8_t *buffer, uint32_t question_id,
                                   uint8_t is_correct, uint8_t correct_answer_id,
                                   uint8_t test_mode, uint8_t questions_answered,
                                   uint8_t correct_count);
@@ -208,6 +397,16 @@ int tlv_parse_header(const uint8_t *buffer, uint16_t *type, uint16_t *length);
  */
 int tlv_parse_login_request(const uint8_t *buffer, char *nick, size_t nick_size);
 
+/**
+ * Parse the optional question bank of a LOGIN_REQUEST message
+ * @param buffer Input buffer (after header)
+ * @param length Length of the value field
+ * @param bank Output buffer for bank name (empty if not present)
+ * @param bank_size Size of bank buffer
+ * @return 0 on success, -1 on error
+ */
+int tlv_parse_login_bank(const uint8_t *buffer, uint16_t length, char *bank, size_t bank_size);
+
 /**
  * Parse LOGIN_RESPONSE message
  * @param buffer Input buffer (after header)
@@ -229,6 +428,18 @@ int tlv_parse_login_response(const uint8_t *buffer, uint8_t *status,
 int tlv_parse_request_question(const uint8_t *buffer, uint8_t *mode, 
                                 uint8_t *question_index);
 
+/**
+ * Parse the optional tag filter of a REQUEST_QUESTION message
+ * @param buffer Input buffer (after header)
+ * @param length Length of the value field
+ * @param filter_op Output: TAG_FILTER_NONE if the request has no filter
+ * @param tags Output: array of tag names
+ * @param num_tags Output: number of tags
+ * @return 0 on success, -1 on error
+ */
+int tlv_parse_question_filter(const uint8_t *buffer, uint16_t length, uint8_t *filter_op,
+                              char tags[][MAX_TAG_LENGTH], uint8_t *num_tags);
+
 /**
  * Parse ANSWER_SUBMIT message
  * @param buffer Input buffer (after header)
@@ -236,7 +447,7 @@ int tlv_parse_request_question(const uint8_t *buffer, uint8_t *mode,
  * @param answer_id Output: answer ID
  * @return 0 on success, -1 on error
  */
-int tlv_parse_answer_submit(const uint8_t *buffer, uint16_t *question_id, 
+int tlv_parse_answer_submit(const uint8_t *buffer, uint32_t *question_id,
                              uint8_t *answer_id);
 
 /**
@@ -250,13 +461,15 @@ int tlv_parse_answer_submit(const uint8_t *buffer, uint16_t *question_id,
  * @param correct_count Output: correct answers count
  * @return 0 on success, -1 on error
  */
-int tlv_parse_answer_result(const uint8_t *buffer, uint16_t *question_id,
+int tlv_parse_answer_result(const uint8_t *buffer, uint32_t *question_id,
                              uint8_t *is_correct, uint8_t *correct_answer_id,
                              uint8_t *test_mode, uint8_t *questions_answered,
                              uint8_t *correct_count);
 
 /**
  * Create SUBMIT_SCORE message
+ * @note Deprecated: the server scores tests from ANSWER_SUBMIT messages and
+ *       ignores SUBMIT_SCORE. Kept for protocol compatibility.
  * @param buffer Output buffer
  * @param score Score (0-10)
  * @param time_seconds Time in seconds
@@ -280,6 +493,35 @@ int tlv_parse_submit_score(const uint8_t *buffer, uint8_t *score, uint32_t *time
  */
 ssize_t tlv_create_request_ranking(uint8_t *buffer);
 
+/**
+ * Create REQUEST_RANKING message for one page of the ranking
+ * @param buffer Output buffer
+ * @param mode RANKING_TOP, RANKING_OFFSET or RANKING_AROUND
+ * @param offset Entries to skip (RANKING_OFFSET)
+ * @param limit Entries per page
+ * @param nick Player to center on (RANKING_AROUND, empty for the requester)
+ * @param window RANKING_WINDOW_* the ranking covers
+ * @return Length of message on success, -1 on error
+ */
+ssize_t tlv_create_request_ranking_page(uint8_t *buffer, uint8_t mode, uint32_t offset,
+                                        uint8_t limit, const char *nick, uint8_t window);
+
+/**
+ * Parse REQUEST_RANKING message
+ * @param buffer Input buffer (after header)
+ * @param length Length of value field (0 = RANKING_TOP)
+ * @param mode Output: RANKING_* mode
+ * @param offset Output: entries to skip
+ * @param limit Output: entries per page
+ * @param nick Output buffer for nickname (empty if not given)
+ * @param nick_size Size of nick buffer
+ * @param window Output: RANKING_WINDOW_* (RANKING_WINDOW_ALL if not given)
+ * @return 0 on success, -1 on error
+ */
+int tlv_parse_request_ranking(const uint8_t *buffer, size_t length, uint8_t *mode,
+                              uint32_t *offset, uint8_t *limit, char *nick, size_t nick_size,
+                              uint8_t *window);
+
 /**
  * Create RANKING_DATA message
  * @param buffer Output buffer
@@ -359,4 +601,232 @@ int tlv_parse_server_info_data(const uint8_t *buffer, uint32_t *uptime_seconds,
                                 uint8_t *best_score, uint32_t *best_time,
                                 char *best_player, uint16_t *port);
 
+/**
+ * Create ERROR message
+ * @param buffer Output buffer
+ * @param code Error code (ERROR_*)
+ * @param message Human-readable description
+ * @return Length of message on success, -1 on error
+ */
+ssize_t tlv_create_error(uint8_t *buffer, uint8_t code, const char *message);
+
+/**
+ * Parse ERROR message
+ * @param buffer Input buffer (after header)
+ * @param code Output: error code
+ * @param message Output buffer for message
+ * @param msg_size Size of message buffer
+ * @return 0 on success, -1 on error
+ */
+int tlv_parse_error(const uint8_t *buffer, uint8_t *code, char *message, size_t msg_size);
+
+/**
+ * Create SEARCH_QUESTIONS message
+ * @param buffer Output buffer
+ * @param query Words that must all appear in a question or its answers
+ * @param max_results Maximum number of question IDs to return
+ * @return Length of message on success, -1 on error
+ */
+ssize_t tlv_create_search_questions(uint8_t *buffer, const char *query, uint16_t max_results);
+
+/**
+ * Parse SEARCH_QUESTIONS message
+ * @param buffer Input buffer (after header)
+ * @param length Length of value field
+ * @param query Output buffer for query
+ * @param query_size Size of query buffer
+ * @param max_results Output: maximum number of question IDs to return
+ * @return 0 on success, -1 on error
+ */
+int tlv_parse_search_questions(const uint8_t *buffer, size_t length, char *query,
+                               size_t query_size, uint16_t *max_results);
+
+/**
+ * Create SEARCH_RESULTS message
+ * @param buffer Output buffer
+ * @param ids Matching question IDs
+ * @param count Number of IDs (at most MAX_SEARCH_IDS)
+ * @return Length of message on success, -1 on error
+ */
+ssize_t tlv_create_search_results(uint8_t *buffer, const int *ids, int count);
+
+/**
+ * Parse SEARCH_RESULTS message
+ * @param buffer Input buffer (after header)
+ * @param length Length of value field
+ * @param ids Output: question IDs (MAX_SEARCH_IDS entries)
+ * @param count Output: number of IDs
+ * @return 0 on success, -1 on error
+ */
+int tlv_parse_search_results(const uint8_t *buffer, size_t length, int *ids, int *count);
+
+/**
+ * Create REQUEST_RANK message
+ * @param buffer Output buffer
+ * @param nick Player to look up (empty for the requesting player)
+ * @return Length of message on success, -1 on error
+ */
+ssize_t tlv_create_request_rank(uint8_t *buffer, const char *nick);
+
+/**
+ * Parse REQUEST_RANK message
+ * @param buffer Input buffer (after header)
+ * @param length Length of value field
+ * @param nick Output buffer for nickname (empty if not given)
+ * @param nick_size Size of nick buffer
+ * @return 0 on success, -1 on error
+ */
+int tlv_parse_request_rank(const uint8_t *buffer, size_t length, char *nick, size_t nick_size);
+
+/**
+ * Create RANK_DATA message
+ * @param buffer Output buffer
+ * @param rank Rank of the player (1 = best, 0 = no result)
+ * @param total Number of ranked players
+ * @param score Best score of the player
+ * @param time_seconds Time of the best score
+ * @param nick Player nickname
+ * @return Length of message on success, -1 on error
+ */
+ssize_t tlv_create_rank_data(uint8_t *buffer, uint32_t rank, uint32_t total,
+                             uint8_t score, uint32_t time_seconds, const char *nick);
+
+/**
+ * Parse RANK_DATA message
+ * @param buffer Input buffer (after header)
+ * @param length Length of value field
+ * @param rank Output: rank of the player (1 = best, 0 = no result)
+ * @param total Output: number of ranked players
+ * @param score Output: best score
+ * @param time_seconds Output: time of the best score
+ * @param nick Output buffer for nickname
+ * @param nick_size Size of nick buffer
+ * @return 0 on success, -1 on error
+ */
+int tlv_parse_rank_data(const uint8_t *buffer, size_t length, uint32_t *rank, uint32_t *total,
+                        uint8_t *score, uint32_t *time_seconds, char *nick, size_t nick_size);
+
+/**
+ * Create RANKING_PAGE message
+ * @param buffer Output buffer
+ * @param first_rank Rank of the first entry (0 if the page is empty)
+ * @param total Number of ranked players
+ * @param count Number of entries
+ * @param nicks Array of nicknames
+ * @param scores Array of scores
+ * @param times Array of times in seconds
+ * @return Length of message on success, -1 on error
+ */
+ssize_t tlv_create_ranking_page(uint8_t *buffer, uint32_t first_rank, uint32_t total,
+                                uint8_t count, const char nicks[][MAX_NICK_LENGTH],
+                                const uint8_t *scores, const uint32_t *times);
+
+/**
+ * Parse RANKING_PAGE message
+ * @param buffer Input buffer (after header)
+ * @param length Length of value field
+ * @param first_rank Output: rank of the first entry
+ * @param total Output: number of ranked players
+ * @param count Output: number of entries (at most MAX_RANKING_PAGE)
+ * @param nicks Output: array of nicknames
+ * @param scores Output: array of scores
+ * @param times Output: array of times
+ * @return 0 on success, -1 on error
+ */
+int tlv_parse_ranking_page(const uint8_t *buffer, size_t length, uint32_t *first_rank,
+                           uint32_t *total, uint8_t *count, char nicks[][MAX_NICK_LENGTH],
+                           uint8_t *scores, uint32_t *times);
+
+/**
+ * Create REQUEST_LATENCY message
+ * @param buffer Output buffer
+ * @return Length of message on success, -1 on error
+ */
+ssize_t tlv_create_request_latency(uint8_t *buffer);
+
+/**
+ * Create LATENCY_DATA message
+ * @param buffer Output buffer
+ * @param count Number of entries (at most MAX_LATENCY_SUMMARIES)
+ * @param entries Latency summaries
+ * @return Length of message on success, -1 on error
+ */
+ssize_t tlv_create_latency_data(uint8_t *buffer, uint8_t count, const struct latency_summary *entries);
+
+/**
+ * Parse LATENCY_DATA message
+ * @param buffer Input buffer (after header)
+ * @param length Length of value field
+ * @param count Output: number of entries
+ * @param entries Output array of MAX_LATENCY_SUMMARIES entries
+ * @return 0 on success, -1 on error
+ */
+int tlv_parse_latency_data(const uint8_t *buffer, size_t length, uint8_t *count,
+                           struct latency_summary *entries);
+
+/**
+ * Create REQUEST_QUESTION_STATS message
+ * @param buffer Output buffer
+ * @param bank Question bank name, NULL or empty for the session's bank
+ * @param offset Position of the first question
+ * @param limit Maximum number of questions (at most MAX_QUESTION_STATS_PAGE)
+ * @return Length of message on success, -1 on error
+ */
+ssize_t tlv_create_request_question_stats(uint8_t *buffer, const char *bank,
+                                          uint32_t offset, uint8_t limit);
+
+/**
+ * Parse REQUEST_QUESTION_STATS message
+ * @param buffer Input buffer (after header)
+ * @param length Length of value field
+ * @param offset Output: position of the first question
+ * @param limit Output: maximum number of questions, clamped to 1..MAX_QUESTION_STATS_PAGE
+ * @param bank Output: bank name, empty if none was given
+ * @param bank_size Size of the bank buffer
+ * @return 0 on success, -1 on error
+ */
+int tlv_parse_request_question_stats(const uint8_t *buffer, size_t length, uint32_t *offset,
+                                     uint8_t *limit, char *bank, size_t bank_size);
+
+/**
+ * Create QUESTION_STATS message
+ * @param buffer Output buffer
+ * @param total Number of questions in the bank
+ * @param offset Position of the first entry
+ * @param count Number of entries (at most MAX_QUESTION_STATS_PAGE)
+ * @param entries Question statistics
+ * @return Length of message on success, -1 on error
+ */
+ssize_t tlv_create_question_stats(uint8_t *buffer, uint32_t total, uint32_t offset,
+                                  uint8_t count, const struct question_summary *entries);
+
+/**
+ * Parse QUESTION_STATS message
+ * @param buffer Input buffer (after header)
+ * @param length Length of value field
+ * @param total Output: number of questions in the bank
+ * @param offset Output: position of the first entry
+ * @param count Output: number of entries
+ * @param entries Output array of MAX_QUESTION_STATS_PAGE entries
+ * @return 0 on success, -1 on error
+ */
+int tlv_parse_question_stats(const uint8_t *buffer, size_t length, uint32_t *total,
+                             uint32_t *offset, uint8_t *count, struct question_summary *entries);
+
+/**
+ * Create DISCOVER_REQUEST message, a datagram asking every server to answer
+ * @param buffer Output buffer
+ * @return Length of message on success, -1 on error
+ */
+ssize_t tlv_create_discover_request(uint8_t *buffer);
+
+/**
+ * Create DISCOVER_RESPONSE message
+ * @param buffer Output buffer, TLV_HEADER_SIZE + length bytes
+ * @param announcement Binary announcement of the server (see multicast_discovery.h)
+ * @param length Its length
+ * @return Length of message on success, -1 on error
+ */
+ssize_t tlv_create_discover_response(uint8_t *buffer, const uint8_t *announcement, uint16_t length);
+
 #endif // TLV_H
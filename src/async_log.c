@@ -0,0 +1,399 @@
+#include "async_log.h"
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define RING_MASK       (ASYNC_LOG_RING_SIZE - 1)
+#define ENTRY_HEADER    20
+#define ARGS_SIZE       (ASYNC_LOG_ENTRY_SIZE - ENTRY_HEADER)
+#define MAX_MESSAGE     1024
+
+// One message: the format and its arguments as they were passed
+struct log_entry {
+    const char *format;
+    uint64_t time_ns;               // CLOCK_REALTIME when recorded
+    uint8_t priority;
+    uint8_t truncated;              // Arguments did not fit, the message is cut
+    uint16_t length;                // Bytes used in args
+    uint8_t args[ARGS_SIZE];        // Integers and doubles as 8 bytes, strings as u8 length + bytes
+};
+
+// Ring of one producer thread; head and tail on their own cache lines
+struct log_ring {
+    _Alignas(64) _Atomic uint64_t head;    // Written by the producer
+    _Atomic uint64_t dropped;
+    _Alignas(64) _Atomic uint64_t tail;    // Written by the consumer
+    struct log_entry entries[ASYNC_LOG_RING_SIZE];
+};
+
+static struct {
+    _Atomic int level;
+    _Atomic int running;
+    FILE *file;                     // NULL = syslog
+
+    pthread_mutex_t mutex;          // Guards ring registration
+    struct log_ring *rings[ASYNC_LOG_MAX_THREADS];
+    _Atomic int ring_count;
+} logger = {
+    .level = LOG_INFO,
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static _Thread_local struct log_ring *thread_ring;
+static _Thread_local int thread_ring_failed;
+
+// Skip a conversion specification; p points after '%', returns the conversion character
+static const char *parse_spec(const char *p, char *length, char *conv) {
+    while (*p && strchr("-+ #0'", *p)) p++;
+    while (*p >= '0' && *p <= '9') p++;
+    if (*p == '.') {
+        p++;
+        while (*p >= '0' && *p <= '9') p++;
+    }
+
+    *length = 0;
+    if (*p == 'h' || *p == 'l') {
+        *length = *p++;
+        if (*p == *length) {
+            *length = *length == 'l' ? 'q' : 'H';  // ll, hh
+            p++;
+        }
+    } else if (*p && strchr("zjtL", *p)) {
+        *length = *p++;
+    }
+    *conv = *p;
+    return p;
+}
+
+static struct log_ring *ring_of_thread(void) {
+    if (thread_ring || thread_ring_failed) {
+        return thread_ring;
+    }
+
+    struct log_ring *ring = aligned_alloc(64, sizeof(*ring));
+    pthread_mutex_lock(&logger.mutex);
+    int count = atomic_load_explicit(&logger.ring_count, memory_order_relaxed);
+    if (ring && count < ASYNC_LOG_MAX_THREADS) {
+        memset(ring, 0, sizeof(*ring));
+        logger.rings[count] = ring;
+        atomic_store_explicit(&logger.ring_count, count + 1, memory_order_release);
+        thread_ring = ring;
+    } else {
+        free(ring);
+        thread_ring_failed = 1;
+    }
+    pthread_mutex_unlock(&logger.mutex);
+    return thread_ring;
+}
+
+// Copy the arguments the format refers to into the entry
+static void encode_args(struct log_entry *e, const char *format, va_list ap) {
+    size_t pos = 0;
+    e->truncated = 0;
+
+    for (const char *p = format; *p; p++) {
+        if (*p != '%') {
+            continue;
+        }
+        char length, conv;
+        p = parse_spec(p + 1, &length, &conv);
+        if (conv == '%') {
+            continue;
+        }
+        if (conv == '\0') {
+            break;
+        }
+
+        if (conv == 's') {
+            const char *s = va_arg(ap, const char *);
+            if (!s) {
+                s = "(null)";
+            }
+            size_t n = strlen(s);
+            if (pos + 1 >= ARGS_SIZE) {
+                e->truncated = 1;
+                break;
+            }
+            size_t room = ARGS_SIZE - pos - 1;
+            if (n > room) n = room;
+            if (n > 255) n = 255;
+            e->args[pos++] = (uint8_t)n;
+            memcpy(e->args + pos, s, n);
+            pos += n;
+            continue;
+        }
+
+        if (pos + 8 > ARGS_SIZE) {
+            e->truncated = 1;
+            break;
+        }
+        uint64_t value;
+        if (strchr("di", conv)) {
+            int64_t v = length == 'l' ? va_arg(ap, long) : length == 'q' ? va_arg(ap, long long) :
+                        length == 'z' ? (int64_t)va_arg(ap, size_t) : length == 'j' ? va_arg(ap, intmax_t) :
+                        length == 't' ? va_arg(ap, ptrdiff_t) : va_arg(ap, int);
+            value = (uint64_t)v;
+        } else if (strchr("uoxXc", conv)) {
+            value = length == 'l' ? va_arg(ap, unsigned long) : length == 'q' ? va_arg(ap, unsigned long long) :
+                    length == 'z' ? va_arg(ap, size_t) : length == 'j' ? (uint64_t)va_arg(ap, uintmax_t) :
+                    length == 't' ? (uint64_t)va_arg(ap, ptrdiff_t) : va_arg(ap, unsigned int);
+        } else if (conv == 'p') {
+            value = (uintptr_t)va_arg(ap, void *);
+        } else if (strchr("feEgGaAF", conv)) {
+            double d = length == 'L' ? (double)va_arg(ap, long double) : va_arg(ap, double);
+            memcpy(&value, &d, 8);
+        } else {
+            // %n or unknown: nothing sensible to record
+            e->truncated = 1;
+            break;
+        }
+        memcpy(e->args + pos, &value, 8);
+        pos += 8;
+    }
+    e->length = (uint16_t)pos;
+}
+
+void async_log(int priority, const char *format, ...) {
+    if ((priority & LOG_PRIMASK) > atomic_load_explicit(&logger.level, memory_order_relaxed)) {
+        return;
+    }
+
+    va_list ap;
+    va_start(ap, format);
+    struct log_ring *ring = atomic_load_explicit(&logger.running, memory_order_relaxed) ?
+                            ring_of_thread() : NULL;
+    if (!ring) {
+        vsyslog(priority, format, ap);
+        va_end(ap);
+        return;
+    }
+
+    // Only this thread moves head; the consumer moves tail
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    if (head - atomic_load_explicit(&ring->tail, memory_order_acquire) >= ASYNC_LOG_RING_SIZE) {
+        atomic_store_explicit(&ring->dropped,
+                              atomic_load_explicit(&ring->dropped, memory_order_relaxed) + 1,
+                              memory_order_relaxed);
+        va_end(ap);
+        return;
+    }
+
+    struct log_entry *e = &ring->entries[head & RING_MASK];
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    e->format = format;
+    e->time_ns = (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+    e->priority = (uint8_t)(priority & LOG_PRIMASK);
+    encode_args(e, format, ap);
+    va_end(ap);
+
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+// Format an entry the way printf would have
+static size_t format_entry(const struct log_entry *e, char *out, size_t size) {
+    size_t len = 0, pos = 0;
+    char spec[32];
+
+#define APPEND(...) do { \
+        int n_ = snprintf(out + len, size - len, __VA_ARGS__); \
+        if (n_ > 0) len += (size_t)n_ < size - len ? (size_t)n_ : size - len - 1; \
+    } while (0)
+
+    for (const char *p = e->format; *p && len + 1 < size; p++) {
+        if (*p != '%') {
+            out[len++] = *p;
+            continue;
+        }
+
+        char length, conv;
+        const char *end = parse_spec(p + 1, &length, &conv);
+        if (conv == '\0') {
+            break;
+        }
+        size_t spec_len = (size_t)(end - p) + 1;
+        if (spec_len >= sizeof(spec)) {
+            break;
+        }
+        memcpy(spec, p, spec_len);
+        spec[spec_len] = '\0';
+        p = end;
+
+        if (conv == '%') {
+            out[len++] = '%';
+            continue;
+        }
+
+        if (conv == 's') {
+            if (pos >= e->length) {
+                goto truncated;
+            }
+            char s[256];
+            size_t n = e->args[pos++];
+            memcpy(s, e->args + pos, n);
+            s[n] = '\0';
+            pos += n;
+            APPEND(spec, s);
+            continue;
+        }
+
+        if (pos + 8 > e->length) {
+            goto truncated;
+        }
+        uint64_t v;
+        memcpy(&v, e->args + pos, 8);
+        pos += 8;
+
+        if (strchr("di", conv)) {
+            if (length == 'l') APPEND(spec, (long)v);
+            else if (length == 'q') APPEND(spec, (long long)v);
+            else if (length == 'z') APPEND(spec, (size_t)v);
+            else if (length == 'j') APPEND(spec, (intmax_t)v);
+            else if (length == 't') APPEND(spec, (ptrdiff_t)v);
+            else APPEND(spec, (int)v);
+        } else if (strchr("uoxXc", conv)) {
+            if (length == 'l') APPEND(spec, (unsigned long)v);
+            else if (length == 'q') APPEND(spec, (unsigned long long)v);
+            else if (length == 'z') APPEND(spec, (size_t)v);
+            else if (length == 'j') APPEND(spec, (uintmax_t)v);
+            else if (length == 't') APPEND(spec, (ptrdiff_t)v);
+            else APPEND(spec, (unsigned int)v);
+        } else if (conv == 'p') {
+            APPEND(spec, (void *)(uintptr_t)v);
+        } else {
+            double d;
+            memcpy(&d, &v, 8);
+            if (length == 'L') APPEND(spec, (long double)d);
+            else APPEND(spec, d);
+        }
+    }
+    if (e->truncated) {
+        goto truncated;
+    }
+    out[len] = '\0';
+    return len;
+
+truncated:
+    out[len] = '\0';
+    APPEND(" [truncated]");
+    return len;
+#undef APPEND
+}
+
+static void write_entry(const struct log_entry *e) {
+    char message[MAX_MESSAGE];
+    size_t len = format_entry(e, message, sizeof(message));
+    while (len > 0 && message[len - 1] == '\n') {
+        message[--len] = '\0';
+    }
+
+    if (!logger.file) {
+        syslog(e->priority, "%s", message);
+        return;
+    }
+
+    static const char *names[] = { "EMERG", "ALERT", "CRIT", "ERR", "WARNING", "NOTICE", "INFO", "DEBUG" };
+    time_t seconds = (time_t)(e->time_ns / 1000000000u);
+    struct tm tm;
+    char stamp[32];
+    localtime_r(&seconds, &tm);
+    strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &tm);
+    fprintf(logger.file, "%s.%03u %-7s %s\n", stamp, (unsigned)(e->time_ns / 1000000u % 1000u),
+            names[e->priority & LOG_PRIMASK], message);
+}
+
+// Drain every ring once; returns the number of entries written
+static size_t drain(void) {
+    size_t written = 0;
+    int count = atomic_load_explicit(&logger.ring_count, memory_order_acquire);
+    for (int i = 0; i < count; i++) {
+        struct log_ring *ring = logger.rings[i];
+        uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        for (; tail != head; tail++) {
+            write_entry(&ring->entries[tail & RING_MASK]);
+            written++;
+        }
+        atomic_store_explicit(&ring->tail, tail, memory_order_release);
+    }
+    if (written > 0 && logger.file) {
+        fflush(logger.file);
+    }
+    return written;
+}
+
+static void *consumer_thread(void *arg) {
+    (void)arg;
+    for (;;) {
+        if (drain() == 0) {
+            struct timespec pause = { 0, ASYNC_LOG_POLL_MS * 1000000L };
+            nanosleep(&pause, NULL);
+        }
+    }
+    return NULL;
+}
+
+int async_log_start(const char *path) {
+    if (path) {
+        logger.file = fopen(path, "ae");
+        if (!logger.file) {
+            return -1;
+        }
+    }
+
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, consumer_thread, NULL) != 0) {
+        if (logger.file) {
+            fclose(logger.file);
+            logger.file = NULL;
+        }
+        return -1;
+    }
+    pthread_detach(tid);
+    atomic_store(&logger.running, 1);
+    return 0;
+}
+
+void async_log_set_level(int level) {
+    if (level < LOG_EMERG) level = LOG_EMERG;
+    if (level > LOG_DEBUG) level = LOG_DEBUG;
+    atomic_store_explicit(&logger.level, level, memory_order_relaxed);
+}
+
+int async_log_level(void) {
+    return atomic_load_explicit(&logger.level, memory_order_relaxed);
+}
+
+uint64_t async_log_dropped(void) {
+    uint64_t dropped = 0;
+    int count = atomic_load_explicit(&logger.ring_count, memory_order_acquire);
+    for (int i = 0; i < count; i++) {
+        dropped += atomic_load_explicit(&logger.rings[i]->dropped, memory_order_relaxed);
+    }
+    return dropped;
+}
+
+void async_log_flush(void) {
+    for (int tries = 0; tries < 100; tries++) {
+        int pending = 0;
+        int count = atomic_load_explicit(&logger.ring_count, memory_order_acquire);
+        for (int i = 0; i < count; i++) {
+            struct log_ring *ring = logger.rings[i];
+            if (atomic_load_explicit(&ring->head, memory_order_acquire) !=
+                atomic_load_explicit(&ring->tail, memory_order_acquire)) {
+                pending = 1;
+            }
+        }
+        if (!pending) {
+            return;
+        }
+        struct timespec pause = { 0, ASYNC_LOG_POLL_MS * 1000000L };
+        nanosleep(&pause, NULL);
+    }
+}
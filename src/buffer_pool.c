@@ -0,0 +1,69 @@
+#include "buffer_pool.h"
+#include <stdlib.h>
+
+// Returned buffers are linked through their first bytes
+struct free_buffer {
+    struct free_buffer *next;
+};
+
+static struct free_buffer *free_lists[BUFFER_POOL_CLASSES];
+static size_t cached[BUFFER_POOL_CLASSES];
+static size_t in_use = 0;
+static size_t cached_total = 0;
+
+static int size_class(size_t size) {
+    int c = 0;
+    while (c < BUFFER_POOL_CLASSES && ((size_t)BUFFER_POOL_MIN << c) < size) {
+        c++;
+    }
+    return c;
+}
+
+void *buffer_pool_get(size_t size, size_t *capacity) {
+    int c = size_class(size);
+    if (c == BUFFER_POOL_CLASSES) {
+        return NULL;
+    }
+    size_t class_size = (size_t)BUFFER_POOL_MIN << c;
+
+    void *buffer = free_lists[c];
+    if (buffer) {
+        free_lists[c] = free_lists[c]->next;
+        cached[c] -= class_size;
+        cached_total -= class_size;
+    } else {
+        buffer = malloc(class_size);
+        if (!buffer) {
+            return NULL;
+        }
+    }
+    in_use += class_size;
+    *capacity = class_size;
+    return buffer;
+}
+
+void buffer_pool_put(void *buffer, size_t capacity) {
+    if (!buffer) {
+        return;
+    }
+    int c = size_class(capacity);
+    in_use -= capacity;
+    if (cached[c] + capacity > BUFFER_POOL_CACHE) {
+        free(buffer);
+        return;
+    }
+
+    struct free_buffer *node = buffer;
+    node->next = free_lists[c];
+    free_lists[c] = node;
+    cached[c] += capacity;
+    cached_total += capacity;
+}
+
+size_t buffer_pool_in_use(void) {
+    return in_use;
+}
+
+size_t buffer_pool_cached(void) {
+    return cached_total;
+}
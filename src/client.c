@@ -8,6 +8,7 @@
 #include <stdio.h>
 #include <errno.h>
 #include <time.h>
+#include <poll.h>
 #include "client_utils.h"
 #include "multicast_discovery.h"
 #include "tlv.h"
@@ -16,31 +17,19 @@
 #define SA struct sockaddr
 #define MAXLINE 1024
 
-int main(int argc, char **argv)
-{
+// Servers found by discovery, best first; the ones after the current are failover targets
+static struct discovery_info candidates[DISCOVERY_MAX_SERVERS];
+static int candidate_count = 0;
+static int current_candidate = 0;
+
+// Connected socket, -1 on error; scope_id is the interface of a link-local address
+static int connect_to(const char *server_ip, int port, uint32_t scope_id) {
     int                     sockfd;
     struct sockaddr_in6     servaddr;
-    char server_ip          [INET_ADDRSTRLEN];
-    int                     port;
-
-    if ( argc == 2 && strcmp(argv[1], "--discover") == 0 ) {
-        printf("Searching for server...\n");
-        // Multicast discovery, search for a server IP and port
-        discover_server(server_ip, &port);
-    } else if ( argc == 3) {
-        // Manually specifying arguments
-        strcpy(server_ip, argv[1]);
-        port = atoi(argv[2]);
-    } else {
-        fprintf(stderr, "usage: %s <IPaddress> <Port> OR %s --discover\n", argv[0], argv[0]);
-        return 1;
-    }
-
-    menu_display_banner();
 
     if ( (sockfd = socket(AF_INET6, SOCK_STREAM, 0)) < 0 ) {
         fprintf(stderr, "socket error: %s\n", strerror(errno));
-        return 1;
+        return -1;
     }
 
     memset(&servaddr, 0, sizeof(servaddr));
@@ -48,12 +37,17 @@ int main(int argc, char **argv)
     servaddr.sin6_port = htons(port);
 
     // Try IPv6 first, if it fails try IPv4-mapped-IPv6
-    if ( inet_pton(AF_INET6, server_ip, &servaddr.sin6_addr) <= 0 ) {
+    if ( inet_pton(AF_INET6, server_ip, &servaddr.sin6_addr) > 0 ) {
+        if ( IN6_IS_ADDR_LINKLOCAL(&servaddr.sin6_addr) ) {
+            servaddr.sin6_scope_id = scope_id;
+        }
+    } else {
         // Probably IPv4 address, convert to IPv4-mapped-IPv6
         struct in_addr ipv4_addr;
         if ( inet_pton(AF_INET, server_ip, &ipv4_addr) <= 0 ) {
             fprintf(stderr,"inet_pton error for %s : %s \n", server_ip, strerror(errno));
-            return 1;
+            close(sockfd);
+            return -1;
         }
         // Map IPv4 to IPv6: ::ffff:x.x.x.x
         memset(&servaddr.sin6_addr, 0, sizeof(servaddr.sin6_addr));
@@ -64,8 +58,125 @@ int main(int argc, char **argv)
 
     if ( connect(sockfd, (SA*)&servaddr, sizeof(servaddr)) < 0 ) {
         fprintf(stderr,"connect error : %s \n", strerror(errno));
+        close(sockfd);
+        return -1;
+    }
+    return sockfd;
+}
+
+// Connect to the best candidate from current_candidate on; -1 when none is left
+static int connect_to_candidate(void) {
+    for ( ; current_candidate < candidate_count; current_candidate++ ) {
+        struct discovery_info *server = &candidates[current_candidate];
+        int sockfd = connect_to(server->ip, server->port, server->scope_id);
+        if ( sockfd >= 0 ) {
+            return sockfd;
+        }
+    }
+    return -1;
+}
+
+// The server closed the connection or it broke while we waited for the user
+static int connection_lost(int sockfd) {
+    struct pollfd pfd = { .fd = sockfd, .events = POLLIN };
+    if ( poll(&pfd, 1, 0) <= 0 ) {
+        return 0;
+    }
+    if ( pfd.revents & (POLLHUP | POLLERR) ) {
+        return 1;
+    }
+    char byte;
+    return recv(sockfd, &byte, 1, MSG_PEEK | MSG_DONTWAIT) == 0;
+}
+
+// Move the session to the next server that accepts it; -1 when none is left
+static int fail_over(int sockfd, const char *nick, const char *bank) {
+    close(sockfd);
+    for ( current_candidate++; ; current_candidate++ ) {
+        sockfd = connect_to_candidate();
+        if ( sockfd < 0 ) {
+            return -1;
+        }
+        printf("Switched to server %s:%d\n", candidates[current_candidate].ip,
+               candidates[current_candidate].port);
+        if ( client_login(sockfd, nick, bank) == 0 ) {
+            return sockfd;
+        }
+        close(sockfd);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int                     sockfd;
+    char server_ip          [INET6_ADDRSTRLEN];
+    int                     port = 0;
+
+    if ( argc >= 2 && argc <= 5 && strcmp(argv[1], "--discover") == 0 ) {
+        // Groups and interface as the servers were given them, both families by default
+        if ( argc >= 4 && discovery_configure(argv[3], argc == 5 ? argv[4] : NULL) < 0 ) {
+            fprintf(stderr, "invalid discovery %s: %s\n", errno == ENODEV ? "interface" : "groups",
+                    errno == ENODEV ? argv[4] : argv[3]);
+            return 1;
+        }
+        // Ask the servers and collect answers and announcements, then rank every server heard
+        int window_ms = argc >= 3 ? atoi(argv[2]) : DISCOVERY_QUERY_WINDOW_MS;
+        printf("Searching for servers for %d ms...\n", window_ms);
+        int heard = discover_servers(candidates, DISCOVERY_MAX_SERVERS, window_ms);
+        if ( heard == 0 && argc == 2 ) {
+            // Servers from before DISCOVER_REQUEST only announce themselves
+            printf("No answer, waiting for announcements...\n");
+            heard = discover_servers(candidates, DISCOVERY_MAX_SERVERS, DISCOVERY_WINDOW_MS);
+        }
+        candidate_count = heard > 0 ? discovery_rank(candidates, heard, DISCOVERY_PROBE_MS) : 0;
+        if ( candidate_count == 0 ) {
+            fprintf(stderr, "No reachable server found\n");
+            return 1;
+        }
+        for ( int i = 0; i < candidate_count; i++ ) {
+            const struct discovery_info *found = &candidates[i];
+            if ( found->version > 0 ) {
+                printf("%d. Server %016llx at %s:%d, %u/%u connections, loop %u us, rtt %u us\n",
+                       i + 1, (unsigned long long)found->server_id, found->ip, found->port,
+                       found->connections, found->max_connections, found->loop_latency_us,
+                       found->rtt_us);
+            } else {
+                printf("%d. Server at %s:%d, rtt %u us\n", i + 1, found->ip, found->port, found->rtt_us);
+            }
+        }
+    } else if ( argc == 3 || (argc == 4 && strcmp(argv[3], "--latency") == 0) ||
+                ((argc == 4 || argc == 5) && strcmp(argv[3], "--question-stats") == 0) ) {
+        // Manually specifying arguments
+        strcpy(server_ip, argv[1]);
+        port = atoi(argv[2]);
+    } else {
+        fprintf(stderr, "usage: %s <IPaddress> <Port> [--latency | --question-stats [bank]] OR %s --discover [window_ms [groups [interface]]]\n",
+                argv[0], argv[0]);
         return 1;
     }
+    // Operator requests print a report instead of starting a session
+    const char *admin_request = argc >= 4 && candidate_count == 0 ? argv[3] : NULL;
+
+    if ( !admin_request ) {
+        menu_display_banner();
+    }
+
+    sockfd = candidate_count > 0 ? connect_to_candidate() : connect_to(server_ip, port, 0);
+    if ( sockfd < 0 ) {
+        return 1;
+    }
+    if ( candidate_count > 0 ) {
+        printf("Connected to server %s:%d\n", candidates[current_candidate].ip,
+               candidates[current_candidate].port);
+    }
+
+    // Operator views of the server's request latencies and answer statistics, no login needed
+    if ( admin_request ) {
+        int rc = strcmp(admin_request, "--latency") == 0 ? client_request_latency(sockfd)
+                 : client_request_question_stats(sockfd, argc == 5 ? argv[4] : NULL);
+        close(sockfd);
+        return rc < 0 ? 1 : 0;
+    }
 
     
     char nick[MAX_NICK_LENGTH + 1];
@@ -76,7 +187,17 @@ int main(int argc, char **argv)
         return 1;
     }
 
-    if ( client_login(sockfd, nick) < 0 ) {
+    menu_clear_input_buffer();
+
+    // Servers can host several exams, each with its own questions and ranking
+    char bank[MAX_BANK_NAME_LENGTH];
+    printf("Enter question bank (Enter for default): ");
+    if ( fgets(bank, sizeof(bank), stdin) == NULL ) {
+        bank[0] = '\0';
+    }
+    bank[strcspn(bank, "\n")] = '\0';
+
+    if ( client_login(sockfd, nick, bank) < 0 ) {
         close(sockfd);
         return 1;
     }
@@ -89,22 +210,39 @@ int main(int argc, char **argv)
         int choice = menu_display_and_get_choice();
         
         if (choice < 0) {
-            printf("Invalid choice. Please enter a number between 1 and 7.\n");
+            printf("Invalid choice. Please enter a number between 1 and 6.\n");
             continue;
         }
+
+        // The server may have gone away while the menu waited
+        if (connection_lost(sockfd)) {
+            printf("\nConnection to server lost.\n");
+            if ((sockfd = fail_over(sockfd, nick, bank)) < 0) {
+                fprintf(stderr, "No server left to fail over to\n");
+                return 1;
+            }
+        }
         
         switch (choice) {
             case 1:
                 printf("\n====== Training Mode - Random Question ======\n");
+                // Optional tag filter, e.g. "os+linux" (all) or "hardware,web" (any)
+                char filter[256];
+                printf("Tags (e.g. networking, os+linux, hardware,web) or Enter for any: ");
+                if (fgets(filter, sizeof(filter), stdin) == NULL) {
+                    filter[0] = '\0';
+                }
+                filter[strcspn(filter, "\n")] = '\0';
+                
                 // Request random question
-                if (client_request_question(sockfd, MODE_RANDOM, 0) == 0) {
+                if (client_request_question_filtered(sockfd, MODE_RANDOM, filter) == 0) {
                     // Receive, display question, get answer, submit, show result
                     client_handle_single_question(sockfd);
                 }
                 break;
                 
             case 2:
-                printf("\n====== Knowledge Test - 10 Questions ======\n");
+                printf("\n====== Knowledge Test - %d Questions ======\n", TEST_QUESTION_COUNT);
                 printf("Starting test...\n\n");
                 // Test of 10 questions
                 int correct_count = 0;
@@ -113,8 +251,8 @@ int main(int argc, char **argv)
                 // Start timer
                 time_t start_time = time(NULL);
                 
-                for (int i = 0; i < 10; i++) {
-                    printf("\n--- Question %d/10 ---\n", i + 1);
+                for (int i = 0; i < TEST_QUESTION_COUNT; i++) {
+                    printf("\n--- Question %d/%d ---\n", i + 1, TEST_QUESTION_COUNT);
                     if (client_request_question(sockfd, MODE_TEST, i) == 0) {
                         int result = client_handle_single_question(sockfd);
                         if (result < 0) {
@@ -130,7 +268,7 @@ int main(int argc, char **argv)
                         break;
                     }
                     
-                    if (i < 9) {
+                    if (i < TEST_QUESTION_COUNT - 1) {
                         printf("\nPress Enter to continue to next question...");
                         getchar();
                     }
@@ -147,21 +285,58 @@ int main(int argc, char **argv)
                 printf("║  Time: %02d:%02d                        ║\n", elapsed_seconds / 60, elapsed_seconds % 60);
                 printf("╚═══════════════════════════════════════╝\n");
                 
-                // Submit score to server
-                if (questions_asked == 10) {
-                    uint8_t score_buffer[256];
-                    ssize_t len = tlv_create_submit_score(score_buffer, correct_count, elapsed_seconds);
-                    if (len > 0) {
-                        send(sockfd, score_buffer, len, 0);
-                        printf("\n✓ Score submitted to server!\n");
-                    }
+                // The server scores every answer and records the result itself
+                if (questions_asked == TEST_QUESTION_COUNT) {
+                    printf("\n✓ Score recorded by server!\n");
                 }
                 break;
                 
             case 3:
                 printf("\n====== User Rankings ======\n");
-                if (client_request_ranking(sockfd) < 0) {
-                    printf("Failed to retrieve rankings.\n");
+                // Browse the ranking one page at a time, starting at the top
+                uint8_t ranking_mode = RANKING_OFFSET;
+                uint8_t window = RANKING_WINDOW_ALL;
+                uint32_t offset = 0;
+                for (;;) {
+                    uint32_t first_rank, total;
+                    if (client_request_ranking_page(sockfd, ranking_mode, offset, window,
+                                                    &first_rank, &total) < 0) {
+                        printf("Failed to retrieve rankings.\n");
+                        break;
+                    }
+                    if (first_rank > 0) {
+                        offset = first_rank - 1;
+                    }
+                    
+                    printf("[n]ext page, [p]revious page, [m]y position,\n"
+                           "[a]ll time, [d]ay, [w]eek, [t]erm, Enter to return: ");
+                    char command[16];
+                    if (fgets(command, sizeof(command), stdin) == NULL) {
+                        break;
+                    }
+                    if (command[0] == 'n' && offset + RANKING_PAGE_SIZE < total) {
+                        ranking_mode = RANKING_OFFSET;
+                        offset += RANKING_PAGE_SIZE;
+                    } else if (command[0] == 'p') {
+                        ranking_mode = RANKING_OFFSET;
+                        offset = offset > RANKING_PAGE_SIZE ? offset - RANKING_PAGE_SIZE : 0;
+                    } else if (command[0] == 'm') {
+                        ranking_mode = RANKING_AROUND;
+                    } else if (command[0] == 'n') {
+                        ranking_mode = RANKING_OFFSET;
+                    } else if (strchr("adwt", command[0]) != NULL && command[0] != '\0') {
+                        // Another window starts again from its top
+                        window = command[0] == 'd' ? RANKING_WINDOW_DAY :
+                                 command[0] == 'w' ? RANKING_WINDOW_WEEK :
+                                 command[0] == 't' ? RANKING_WINDOW_TERM : RANKING_WINDOW_ALL;
+                        ranking_mode = RANKING_OFFSET;
+                        offset = 0;
+                    } else {
+                        break;
+                    }
+                }
+                if (client_request_rank(sockfd, "") < 0) {
+                    printf("Failed to retrieve your rank.\n");
                 }
                 break;
                 
@@ -173,6 +348,20 @@ int main(int argc, char **argv)
                 break;
                 
             case 5:
+                printf("\n====== Search Questions ======\n");
+                char query[256];
+                printf("Keywords (e.g. DHCP, maska podsieci): ");
+                if (fgets(query, sizeof(query), stdin) == NULL) {
+                    query[0] = '\0';
+                }
+                query[strcspn(query, "\n")] = '\0';
+                
+                if (client_search_questions(sockfd, query) < 0) {
+                    printf("Search failed.\n");
+                }
+                break;
+                
+            case 6:
                 printf("\nExiting...\n");
                 running = 0;
                 break;
@@ -1,6 +1,7 @@
 #include "client_utils.h"
 #include "tlv.h"
 #include "menu.h"
+#include "text_validate.h"
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
@@ -10,11 +11,11 @@
 #define BUFFER_SIZE 4096
 
 // Send LOGIN_REQUEST and receive LOGIN_RESPONSE
-int client_login(int sockfd, const char *nick) {
+int client_login(int sockfd, const char *nick, const char *bank) {
     uint8_t buffer[BUFFER_SIZE];
     
     // Create and send LOGIN_REQUEST
-    ssize_t len = tlv_create_login_request(buffer, nick);
+    ssize_t len = tlv_create_login_request_bank(buffer, nick, bank);
     if ( len < 0 ) {
         fprintf(stderr, "Failed to create login request\n");
         return -1;
@@ -75,8 +76,50 @@ int client_request_question(int sockfd, uint8_t mode, uint8_t question_index) {
     return 0;
 }
 
+// Request a question matching a tag filter
+int client_request_question_filtered(int sockfd, uint8_t mode, const char *filter) {
+    uint8_t buffer[BUFFER_SIZE];
+    char copy[MAX_FILTER_TAGS * MAX_TAG_LENGTH];
+    const char *tags[MAX_FILTER_TAGS];
+    uint8_t num_tags = 0;
+    
+    // "a+b" means all of the tags, "a,b" means any of them
+    uint8_t filter_op = strchr(filter, ',') ? TAG_FILTER_ANY : TAG_FILTER_ALL;
+    const char *separators = filter_op == TAG_FILTER_ANY ? ", " : "+ ";
+    
+    strncpy(copy, filter, sizeof(copy) - 1);
+    copy[sizeof(copy) - 1] = '\0';
+    
+    char *saveptr = NULL;
+    for (char *tag = strtok_r(copy, separators, &saveptr); tag != NULL;
+         tag = strtok_r(NULL, separators, &saveptr)) {
+        if (num_tags == MAX_FILTER_TAGS) {
+            fprintf(stderr, "Too many tags (max %d)\n", MAX_FILTER_TAGS);
+            return -1;
+        }
+        tags[num_tags++] = tag;
+    }
+    
+    if (num_tags == 0) {
+        return client_request_question(sockfd, mode, 0);
+    }
+    
+    ssize_t len = tlv_create_request_question_filtered(buffer, mode, 0, filter_op, tags, num_tags);
+    if ( len < 0 ) {
+        fprintf(stderr, "Failed to create question request (tag too long?)\n");
+        return -1;
+    }
+    
+    if ( send(sockfd, buffer, len, 0) != len ) {
+        fprintf(stderr, "Failed to send question request: %s\n", strerror(errno));
+        return -1;
+    }
+    
+    return 0;
+}
+
 // Submit an answer to server
-int client_submit_answer(int sockfd, uint16_t question_id, uint8_t answer_id) {
+int client_submit_answer(int sockfd, uint32_t question_id, uint8_t answer_id) {
     uint8_t buffer[BUFFER_SIZE];
     
     // Create and send ANSWER_SUBMIT
@@ -105,7 +148,7 @@ int client_submit_answer(int sockfd, uint16_t question_id, uint8_t answer_id) {
         return -1;
     }
     
-    uint16_t qid;
+    uint32_t qid;
     uint8_t is_correct, correct_answer_id, test_mode, questions_answered, correct_count;
     if ( tlv_parse_answer_result(buffer + 4, &qid, &is_correct, &correct_answer_id,
                                  &test_mode, &questions_answered, &correct_count) < 0 ) {
@@ -122,7 +165,7 @@ int client_submit_answer(int sockfd, uint16_t question_id, uint8_t answer_id) {
     
     if ( test_mode ) {
         printf("Progress: %d/%d questions, %d correct\n", 
-               questions_answered, 10, correct_count);
+               questions_answered, TEST_QUESTION_COUNT, correct_count);
     }
     
     return is_correct ? 1 : 0;
@@ -141,7 +184,21 @@ int client_handle_single_question(int sockfd) {
     
     // Parse TLV header
     uint16_t type, length;
-    if ( tlv_parse_header(buffer, &type, &length) < 0 || type != TLV_QUESTION_DATA ) {
+    if ( tlv_parse_header(buffer, &type, &length) < 0 ) {
+        fprintf(stderr, "Invalid response from server (expected QUESTION_DATA)\n");
+        return -1;
+    }
+    
+    if ( type == TLV_ERROR ) {
+        uint8_t code;
+        char message[MAX_MESSAGE_LENGTH + 1];
+        if ( tlv_parse_error(buffer + 4, &code, message, sizeof(message)) == 0 ) {
+            printf("✗ %s\n", message);
+        }
+        return -1;
+    }
+    
+    if ( type != TLV_QUESTION_DATA ) {
         fprintf(stderr, "Invalid response from server (expected QUESTION_DATA)\n");
         return -1;
     }
@@ -149,9 +206,11 @@ int client_handle_single_question(int sockfd) {
     // Parse QUESTION_DATA manually
     size_t offset = 4;  // After header
     
-    // question_id (2 bytes)
-    uint16_t question_id = ntohs(*(uint16_t*)(buffer + offset));
-    offset += 2;
+    // question_id (4 bytes)
+    uint32_t question_id;
+    memcpy(&question_id, buffer + offset, 4);
+    question_id = ntohl(question_id);
+    offset += 4;
     
     // num_answers (1 byte)
     uint8_t num_answers = buffer[offset++];
@@ -166,6 +225,10 @@ int client_handle_single_question(int sockfd) {
         fprintf(stderr, "Question text too long\n");
         return -1;
     }
+    if (text_validate_utf8(buffer + offset, question_len) < 0) {
+        fprintf(stderr, "Question text is not valid UTF-8\n");
+        return -1;
+    }
     memcpy(question_text, buffer + offset, question_len);
     question_text[question_len] = '\0';
     offset += question_len;
@@ -173,7 +236,7 @@ int client_handle_single_question(int sockfd) {
     // Display question
     printf("\n");
     printf("═══════════════════════════════════════════════════════════════════════\n");
-    printf("  QUESTION #%d\n", question_id);
+    printf("  QUESTION #%u\n", question_id);
     printf("═══════════════════════════════════════════════════════════════════════\n");
     printf("\n");
     
@@ -231,6 +294,10 @@ int client_handle_single_question(int sockfd) {
             fprintf(stderr, "Answer text too long\n");
             return -1;
         }
+        if (ans_id >= MAX_ANSWERS || text_validate_utf8(buffer + offset, ans_len) < 0) {
+            fprintf(stderr, "Invalid answer\n");
+            return -1;
+        }
         memcpy(answers[ans_id], buffer + offset, ans_len);
         answers[ans_id][ans_len] = '\0';
         offset += ans_len;
@@ -315,12 +382,13 @@ int client_handle_single_question(int sockfd) {
     return client_submit_answer(sockfd, question_id, answer_index);
 }
 
-// Request and display rankings
-int client_request_ranking(int sockfd) {
+// Request and display one page of the rankings
+int client_request_ranking_page(int sockfd, uint8_t mode, uint32_t offset, uint8_t window,
+                                uint32_t *first_rank, uint32_t *total) {
     uint8_t buffer[BUFFER_SIZE];
     
     // Create and send REQUEST_RANKING
-    ssize_t len = tlv_create_request_ranking(buffer);
+    ssize_t len = tlv_create_request_ranking_page(buffer, mode, offset, RANKING_PAGE_SIZE, "", window);
     if (len < 0) {
         fprintf(stderr, "Failed to create ranking request\n");
         return -1;
@@ -331,7 +399,7 @@ int client_request_ranking(int sockfd) {
         return -1;
     }
     
-    // Receive RANKING_DATA
+    // Receive RANKING_PAGE
     ssize_t received = recv(sockfd, buffer, sizeof(buffer), 0);
     if (received <= 0) {
         fprintf(stderr, "Failed to receive ranking data: %s\n", 
@@ -341,29 +409,40 @@ int client_request_ranking(int sockfd) {
     
     // Parse header
     uint16_t type, length;
-    if (tlv_parse_header(buffer, &type, &length) < 0 || type != TLV_RANKING_DATA) {
+    if (tlv_parse_header(buffer, &type, &length) < 0 || type != TLV_RANKING_PAGE) {
         fprintf(stderr, "Invalid response from server\n");
         return -1;
     }
     
-    // Parse ranking data
+    // Parse ranking page
     uint8_t count;
-    char nicks[MAX_RANKINGS][MAX_NICK_LENGTH];
-    uint8_t scores[MAX_RANKINGS];
-    uint32_t times[MAX_RANKINGS];
+    char nicks[MAX_RANKING_PAGE][MAX_NICK_LENGTH];
+    uint8_t scores[MAX_RANKING_PAGE];
+    uint32_t times[MAX_RANKING_PAGE];
     
-    if (tlv_parse_ranking_data(buffer + 4, &count, nicks, scores, times) < 0) {
+    if (tlv_parse_ranking_page(buffer + 4, received - 4, first_rank, total, &count,
+                               nicks, scores, times) < 0) {
         fprintf(stderr, "Failed to parse ranking data\n");
         return -1;
     }
     
     // Display rankings
     printf("\n╔════════════════════════════════════════════════════════════════╗\n");
-    printf("║                       TOP PLAYERS RANKING                      ║\n");
+    static const char *titles[RANKING_WINDOWS] = {
+        "║                       TOP PLAYERS RANKING                      ║",
+        "║                      TODAY'S TOP PLAYERS                       ║",
+        "║                     THIS WEEK'S TOP PLAYERS                    ║",
+        "║                     THIS TERM'S TOP PLAYERS                    ║",
+    };
+    printf("%s\n", titles[window < RANKING_WINDOWS ? window : RANKING_WINDOW_ALL]);
     printf("╠════════════════════════════════════════════════════════════════╣\n");
     
     if (count == 0) {
-        printf("║  No scores recorded yet.                                       ║\n");
+        if (mode == RANKING_AROUND) {
+            printf("║  You have no finished test yet.                                ║\n");
+        } else {
+            printf("║  No scores recorded yet.                                       ║\n");
+        }
     } else {
         printf("║  Rank  Nick                Score    Time                      ║\n");
         printf("╠════════════════════════════════════════════════════════════════╣\n");
@@ -372,9 +451,13 @@ int client_request_ranking(int sockfd) {
             int minutes = times[i] / 60;
             int seconds = times[i] % 60;
             
-            printf("║  %-5d %-19s %2d/10    %02d:%02d                      ║\n", 
-                   i + 1, nicks[i], scores[i], minutes, seconds);
+            printf("║  %-5u %-19s %2d/%-2d    %02d:%02d                      ║\n", 
+                   *first_rank + i, nicks[i], scores[i], TEST_QUESTION_COUNT, minutes, seconds);
         }
+        
+        printf("╠════════════════════════════════════════════════════════════════╣\n");
+        printf("║  Ranks %-6u to %-6u of %-6u                                ║\n",
+               *first_rank, *first_rank + count - 1, *total);
     }
     
     printf("╚════════════════════════════════════════════════════════════════╝\n");
@@ -382,6 +465,55 @@ int client_request_ranking(int sockfd) {
     return 0;
 }
 
+// Request and display the rank of a player
+int client_request_rank(int sockfd, const char *nick) {
+    uint8_t buffer[BUFFER_SIZE];
+    
+    // Create and send REQUEST_RANK
+    ssize_t len = tlv_create_request_rank(buffer, nick);
+    if (len < 0) {
+        fprintf(stderr, "Failed to create rank request\n");
+        return -1;
+    }
+    
+    if (send(sockfd, buffer, len, 0) != len) {
+        fprintf(stderr, "Failed to send rank request: %s\n", strerror(errno));
+        return -1;
+    }
+    
+    // Receive RANK_DATA
+    ssize_t received = recv(sockfd, buffer, sizeof(buffer), 0);
+    if (received <= 0) {
+        fprintf(stderr, "Failed to receive rank data: %s\n", 
+                received == 0 ? "Connection closed" : strerror(errno));
+        return -1;
+    }
+    
+    uint16_t type, length;
+    if (tlv_parse_header(buffer, &type, &length) < 0 || type != TLV_RANK_DATA) {
+        fprintf(stderr, "Invalid response from server\n");
+        return -1;
+    }
+    
+    uint32_t rank, total, time_seconds;
+    uint8_t score;
+    char ranked_nick[MAX_NICK_LENGTH];
+    if (tlv_parse_rank_data(buffer + 4, received - 4, &rank, &total, &score, &time_seconds,
+                            ranked_nick, sizeof(ranked_nick)) < 0) {
+        fprintf(stderr, "Failed to parse rank data\n");
+        return -1;
+    }
+    
+    if (rank == 0) {
+        printf("%s has no finished test yet (%u players ranked).\n", ranked_nick, total);
+    } else {
+        printf("%s: rank %u of %u, best %d/%d in %02u:%02u\n", ranked_nick, rank, total,
+               score, TEST_QUESTION_COUNT, time_seconds / 60, time_seconds % 60);
+    }
+    
+    return 0;
+}
+
 // Request and display server information
 int client_request_server_info(int sockfd) {
     uint8_t buffer[BUFFER_SIZE];
@@ -463,7 +595,7 @@ int client_request_server_info(int sockfd) {
     printf("║  Questions Asked:       %-6d                                 ║\n", questions_asked);
     
     if (tests_completed > 0) {
-        printf("║  Average Score:         %d/10                                   ║\n", avg_score);
+        printf("║  Average Score:         %d/%-2d                                   ║\n", avg_score, TEST_QUESTION_COUNT);
     } else {
         printf("║  Average Score:         N/A                                    ║\n");
     }
@@ -471,8 +603,8 @@ int client_request_server_info(int sockfd) {
     printf("║                                                                ║\n");
     
     if (best_score > 0) {
-        printf("║  Best Score:            %-19s %d/10 (%02d:%02d)       ║\n", 
-               best_player, best_score, best_minutes, best_secs);
+        printf("║  Best Score:            %-19s %d/%-2d (%02d:%02d)       ║\n", 
+               best_player, best_score, TEST_QUESTION_COUNT, best_minutes, best_secs);
     } else {
         printf("║  Best Score:            N/A                                    ║\n");
     }
@@ -482,3 +614,200 @@ int client_request_server_info(int sockfd) {
     
     return 0;
 }
+
+// Search questions by keywords
+int client_search_questions(int sockfd, const char *query) {
+    uint8_t buffer[BUFFER_SIZE];
+    
+    // Create and send SEARCH_QUESTIONS
+    ssize_t len = tlv_create_search_questions(buffer, query, MAX_SEARCH_IDS);
+    if (len < 0) {
+        fprintf(stderr, "Search query too long (max %d characters)\n", MAX_SEARCH_QUERY_LENGTH);
+        return -1;
+    }
+    
+    if (send(sockfd, buffer, len, 0) != len) {
+        fprintf(stderr, "Failed to send search request: %s\n", strerror(errno));
+        return -1;
+    }
+    
+    // Receive SEARCH_RESULTS
+    ssize_t received = recv(sockfd, buffer, sizeof(buffer), 0);
+    if (received <= 0) {
+        fprintf(stderr, "Failed to receive search results: %s\n", 
+                received == 0 ? "Connection closed" : strerror(errno));
+        return -1;
+    }
+    
+    uint16_t type, length;
+    if (tlv_parse_header(buffer, &type, &length) < 0) {
+        fprintf(stderr, "Invalid response from server\n");
+        return -1;
+    }
+    
+    if ( type == TLV_ERROR ) {
+        uint8_t code;
+        char message[MAX_MESSAGE_LENGTH + 1];
+        if ( tlv_parse_error(buffer + 4, &code, message, sizeof(message)) == 0 ) {
+            printf("✗ %s\n", message);
+        }
+        return -1;
+    }
+    
+    int ids[MAX_SEARCH_IDS];
+    int count;
+    if (type != TLV_SEARCH_RESULTS ||
+        tlv_parse_search_results(buffer + 4, received - 4, ids, &count) < 0) {
+        fprintf(stderr, "Failed to parse search results\n");
+        return -1;
+    }
+    
+    if (count == 0) {
+        printf("No questions match \"%s\".\n", query);
+        return 0;
+    }
+    
+    printf("Questions matching \"%s\" (%d):\n", query, count);
+    for (int i = 0; i < count; i++) {
+        printf("%s#%d", (i % 10 == 0) ? (i ? "\n  " : "  ") : " ", ids[i]);
+    }
+    printf("\n");
+    
+    return 0;
+}
+
+// Request and display latency percentiles per message type
+// Receive one whole message of an admin request, it may arrive in several segments
+static ssize_t receive_admin_response(int sockfd, uint8_t *buffer, size_t size, uint16_t *type) {
+    ssize_t received = 0;
+    uint16_t length = 0;
+    *type = 0;
+    while (received < TLV_HEADER_SIZE || received < TLV_HEADER_SIZE + length) {
+        ssize_t n = recv(sockfd, buffer + received, size - received, 0);
+        if (n <= 0) {
+            fprintf(stderr, "Failed to receive response: %s\n",
+                    n == 0 ? "Connection closed" : strerror(errno));
+            return -1;
+        }
+        received += n;
+        if (received >= TLV_HEADER_SIZE && tlv_parse_header(buffer, type, &length) < 0) {
+            break;
+        }
+    }
+    
+    if (*type == TLV_ERROR) {
+        uint8_t code;
+        char message[MAX_MESSAGE_LENGTH];
+        if (tlv_parse_error(buffer + 4, &code, message, sizeof(message)) == 0) {
+            fprintf(stderr, "Server refused: %s\n", message);
+        }
+        return -1;
+    }
+    return received;
+}
+
+int client_request_latency(int sockfd) {
+    uint8_t buffer[BUFFER_SIZE];
+    
+    // Create and send REQUEST_LATENCY
+    ssize_t len = tlv_create_request_latency(buffer);
+    if (send(sockfd, buffer, len, 0) != len) {
+        fprintf(stderr, "Failed to send latency request: %s\n", strerror(errno));
+        return -1;
+    }
+    
+    uint16_t type;
+    ssize_t received = receive_admin_response(sockfd, buffer, sizeof(buffer), &type);
+    if (received < 0) {
+        return -1;
+    }
+    if (type != TLV_LATENCY_DATA) {
+        fprintf(stderr, "Invalid response from server\n");
+        return -1;
+    }
+    
+    uint8_t count;
+    struct latency_summary entries[MAX_LATENCY_SUMMARIES];
+    if (tlv_parse_latency_data(buffer + 4, received - 4, &count, entries) < 0) {
+        fprintf(stderr, "Failed to parse latency data\n");
+        return -1;
+    }
+    
+    printf("%-20s %-7s %10s %10s %10s %10s %10s %10s\n",
+           "Message", "Phase", "Count", "p50 us", "p90 us", "p99 us", "p999 us", "max us");
+    for (int i = 0; i < count; i++) {
+        printf("%-20s %-7s %10llu %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+               tlv_type_name(entries[i].type),
+               entries[i].phase == LATENCY_PHASE_HANDLE ? "handle" : "flush",
+               (unsigned long long)entries[i].count,
+               entries[i].quantiles_ns[0] / 1000.0, entries[i].quantiles_ns[1] / 1000.0,
+               entries[i].quantiles_ns[2] / 1000.0, entries[i].quantiles_ns[3] / 1000.0,
+               entries[i].max_ns / 1000.0);
+    }
+    if (count == 0) {
+        printf("No requests timed yet.\n");
+    }
+    
+    return 0;
+}
+
+int client_request_question_stats(int sockfd, const char *bank) {
+    uint8_t buffer[BUFFER_SIZE];
+    uint32_t offset = 0, total = 0;
+    
+    printf("%6s %7s %8s %8s %9s  %s\n", "ID", "Asked", "Answered", "Correct", "Mean ms",
+           "Chosen per option (* = correct)");
+    do {
+        // One page per request, until the whole bank is listed
+        ssize_t len = tlv_create_request_question_stats(buffer, bank, offset, MAX_QUESTION_STATS_PAGE);
+        if (len < 0 || send(sockfd, buffer, len, 0) != len) {
+            fprintf(stderr, "Failed to send question statistics request\n");
+            return -1;
+        }
+        
+        uint16_t type;
+        ssize_t received = receive_admin_response(sockfd, buffer, sizeof(buffer), &type);
+        if (received < 0) {
+            return -1;
+        }
+        if (type != TLV_QUESTION_STATS) {
+            fprintf(stderr, "Invalid response from server\n");
+            return -1;
+        }
+        
+        uint32_t first;
+        uint8_t count;
+        struct question_summary entries[MAX_QUESTION_STATS_PAGE];
+        if (tlv_parse_question_stats(buffer + 4, received - 4, &total, &first, &count, entries) < 0) {
+            fprintf(stderr, "Failed to parse question statistics\n");
+            return -1;
+        }
+        
+        for (int i = 0; i < count; i++) {
+            uint32_t answered = 0;
+            for (int a = 0; a < MAX_ANSWERS; a++) {
+                answered += entries[i].chosen[a];
+            }
+            uint32_t correct = entries[i].correct_answer < MAX_ANSWERS ?
+                               entries[i].chosen[entries[i].correct_answer] : 0;
+            
+            printf("%6u %7u %8u %7.1f%% %9u ", entries[i].id, entries[i].asked, answered,
+                   answered ? 100.0 * correct / answered : 0.0, entries[i].mean_response_ms);
+            for (int a = 0; a < entries[i].num_answers && a < MAX_ANSWERS; a++) {
+                printf(" %c%c%u", 'A' + a, a == entries[i].correct_answer ? '*' : ':',
+                       entries[i].chosen[a]);
+            }
+            printf("\n");
+        }
+        
+        if (count == 0) {
+            break;
+        }
+        offset = first + count;
+    } while (offset < total);
+    
+    if (total == 0) {
+        printf("The bank has no questions.\n");
+    }
+    return 0;
+}
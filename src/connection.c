@@ -0,0 +1,261 @@
+#include "connection.h"
+#include "buffer_pool.h"
+#include "latency.h"
+#include "stats_counters.h"
+#include "tlv.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#define CLIENT_EVENTS   (EPOLLIN | EPOLLRDHUP | EPOLLERR)
+
+static struct connection *connections = NULL;
+static int table_size = 0;
+static int event_loop = -1;
+
+int connection_table_init(int epollfd, int max_fds) {
+    // Pages of the table are only backed once a descriptor that high is used
+    connections = calloc(max_fds, sizeof(*connections));
+    if (!connections) {
+        return -1;
+    }
+    table_size = max_fds;
+    event_loop = epollfd;
+    return 0;
+}
+
+int connection_table_size(void) {
+    return table_size;
+}
+
+static void watch_output(int fd, int on) {
+    struct epoll_event ev;
+    ev.events = on ? CLIENT_EVENTS | EPOLLOUT : CLIENT_EVENTS;
+    ev.data.fd = fd;
+    epoll_ctl(event_loop, EPOLL_CTL_MOD, fd, &ev);
+}
+
+// Move a buffer's bytes into a larger one; the old buffer goes back to the pool
+static uint8_t *grow(uint8_t *buffer, uint32_t used, uint32_t *capacity, size_t needed) {
+    size_t grown_capacity;
+    uint8_t *grown = buffer_pool_get(needed, &grown_capacity);
+    if (!grown) {
+        return NULL;
+    }
+    if (used > 0) {
+        memcpy(grown, buffer, used);
+    }
+    buffer_pool_put(buffer, *capacity);
+    *capacity = (uint32_t)grown_capacity;
+    return grown;
+}
+
+// Remember where a queued response ends; past the last mark it extends that one
+static void mark_output(struct connection *c, uint16_t type, uint64_t ready_ns) {
+    if (!c->marks) {
+        size_t capacity;
+        c->marks = buffer_pool_get(CONNECTION_MAX_MARKS * sizeof(*c->marks), &capacity);
+        if (!c->marks) {
+            return;  // Sent unrecorded
+        }
+    }
+    if (c->nmarks == CONNECTION_MAX_MARKS) {
+        // Fewer than CONNECTION_MAX_OUTPUT / TLV_HEADER_SIZE responses fit, count cannot wrap
+        c->marks[c->nmarks - 1].end = c->wlen;
+        c->marks[c->nmarks - 1].count++;
+        return;
+    }
+    c->marks[c->nmarks++] = (struct output_mark){ .ready_ns = ready_ns, .end = c->wlen, .type = type, .count = 1 };
+}
+
+// Record the responses whose last byte was sent
+static void flushed_marks(struct connection *c) {
+    uint32_t done = 0;
+    while (done < c->nmarks && c->marks[done].end <= c->wpos) {
+        for (uint16_t i = 0; i < c->marks[done].count; i++) {
+            latency_flushed(c->marks[done].type, c->marks[done].ready_ns);
+        }
+        done++;
+    }
+    if (done > 0) {
+        memmove(c->marks, c->marks + done, (c->nmarks - done) * sizeof(*c->marks));
+        c->nmarks -= done;
+    }
+}
+
+// Hand over complete frames; returns the bytes of an incomplete one left at the end, -1 if malformed
+static ssize_t deliver_frames(int fd, const uint8_t *data, size_t available, connection_frame_handler on_frame) {
+    while (available >= TLV_HEADER_SIZE) {
+        uint16_t type, length;
+        if (tlv_parse_header(data, &type, &length) < 0) {
+            return -1;
+        }
+        size_t frame = TLV_HEADER_SIZE + (size_t)length;
+        if (available < frame) {
+            break;
+        }
+        on_frame(fd, type, data + TLV_HEADER_SIZE, length);
+        data += frame;
+        available -= frame;
+    }
+    return (ssize_t)available;
+}
+
+ssize_t connection_receive(int fd, uint8_t *scratch, connection_frame_handler on_frame) {
+    struct connection *c = &connections[fd];
+    ssize_t received = recv(fd, scratch, CONNECTION_SCRATCH_SIZE, 0);
+    if (received <= 0) {
+        return received;
+    }
+
+    if (!c->rbuf) {
+        // Usual case: whole requests, framed straight from the scratch buffer
+        ssize_t left = deliver_frames(fd, scratch, (size_t)received, on_frame);
+        if (left < 0) {
+            errno = EPROTO;
+            return -1;
+        }
+        if (left > 0) {
+            size_t capacity;
+            c->rbuf = buffer_pool_get((size_t)left + CONNECTION_FRAME_SLACK, &capacity);
+            if (!c->rbuf) {
+                errno = ENOBUFS;
+                return -1;
+            }
+            memcpy(c->rbuf, scratch + received - left, (size_t)left);
+            c->rlen = (uint32_t)left;
+            c->rcap = (uint32_t)capacity;
+        }
+        return received;
+    }
+
+    // Complete the frame started earlier
+    size_t needed = c->rlen + (size_t)received + CONNECTION_FRAME_SLACK;
+    if (needed > c->rcap) {
+        uint8_t *grown = grow(c->rbuf, c->rlen, &c->rcap, needed);
+        if (!grown) {
+            errno = ENOBUFS;
+            return -1;
+        }
+        c->rbuf = grown;
+    }
+    memcpy(c->rbuf + c->rlen, scratch, (size_t)received);
+    c->rlen += (uint32_t)received;
+
+    ssize_t left = deliver_frames(fd, c->rbuf, c->rlen, on_frame);
+    if (left < 0) {
+        errno = EPROTO;
+        return -1;
+    }
+    if (left == 0) {
+        buffer_pool_put(c->rbuf, c->rcap);
+        c->rbuf = NULL;
+        c->rlen = 0;
+        c->rcap = 0;
+    } else {
+        memmove(c->rbuf, c->rbuf + c->rlen - left, (size_t)left);
+        c->rlen = (uint32_t)left;
+    }
+    return received;
+}
+
+ssize_t connection_send(int fd, const void *data, size_t length, uint16_t type, uint64_t ready_ns) {
+    if (fd < 0 || fd >= table_size) {
+        ssize_t n = send(fd, data, length, MSG_NOSIGNAL);
+        if (n > 0) {
+            stats_add(server_counters, STATS_BYTES_OUT, n);
+            latency_flushed(type, ready_ns);
+        }
+        return n;
+    }
+    struct connection *c = &connections[fd];
+
+    size_t sent = 0;
+    if (!c->wbuf) {
+        ssize_t n = send(fd, data, length, MSG_NOSIGNAL);
+        if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+            return -1;
+        }
+        sent = n > 0 ? (size_t)n : 0;
+        if (sent > 0) {
+            stats_add(server_counters, STATS_BYTES_OUT, (int64_t)sent);
+        }
+        if (sent == length) {
+            latency_flushed(type, ready_ns);
+            return (ssize_t)length;
+        }
+    }
+
+    // Queue the rest behind earlier output
+    size_t rest = length - sent;
+    size_t needed = c->wlen + rest;
+    if (needed > CONNECTION_MAX_OUTPUT) {
+        shutdown(fd, SHUT_RDWR);  // Not reading its responses: drop it
+        errno = ENOBUFS;
+        return -1;
+    }
+    if (needed > c->wcap) {
+        if (c->wpos > 0) {
+            memmove(c->wbuf, c->wbuf + c->wpos, c->wlen - c->wpos);
+            c->wlen -= c->wpos;
+            for (uint32_t i = 0; i < c->nmarks; i++) {
+                c->marks[i].end -= c->wpos;
+            }
+            c->wpos = 0;
+            needed = c->wlen + rest;
+        }
+        if (needed > c->wcap) {
+            uint8_t *grown = grow(c->wbuf, c->wlen, &c->wcap, needed);
+            if (!grown) {
+                shutdown(fd, SHUT_RDWR);
+                errno = ENOBUFS;
+                return -1;
+            }
+            c->wbuf = grown;
+        }
+    }
+    int was_idle = c->wlen == 0;
+    memcpy(c->wbuf + c->wlen, (const uint8_t *)data + sent, rest);
+    c->wlen += (uint32_t)rest;
+    mark_output(c, type, ready_ns);
+    if (was_idle) {
+        watch_output(fd, 1);
+    }
+    return (ssize_t)length;
+}
+
+int connection_flush(int fd) {
+    struct connection *c = &connections[fd];
+    while (c->wpos < c->wlen) {
+        ssize_t n = send(fd, c->wbuf + c->wpos, c->wlen - c->wpos, MSG_NOSIGNAL);
+        if (n < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+        }
+        c->wpos += (uint32_t)n;
+        stats_add(server_counters, STATS_BYTES_OUT, n);
+        if (c->nmarks > 0) {
+            flushed_marks(c);
+        }
+    }
+
+    buffer_pool_put(c->wbuf, c->wcap);
+    buffer_pool_put(c->marks, CONNECTION_MAX_MARKS * sizeof(*c->marks));
+    c->wbuf = NULL;
+    c->marks = NULL;
+    c->wpos = c->wlen = c->wcap = 0;
+    watch_output(fd, 0);
+    return 1;
+}
+
+void connection_release(int fd) {
+    if (fd < 0 || fd >= table_size) {
+        return;
+    }
+    struct connection *c = &connections[fd];
+    buffer_pool_put(c->rbuf, c->rcap);
+    buffer_pool_put(c->wbuf, c->wcap);
+    buffer_pool_put(c->marks, CONNECTION_MAX_MARKS * sizeof(*c->marks));
+    memset(c, 0, sizeof(*c));
+}
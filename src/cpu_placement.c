@@ -0,0 +1,173 @@
+#define _GNU_SOURCE  // CPU_SET(), pthread_setaffinity_np()
+#include "cpu_placement.h"
+#include "async_log.h"
+#include "shared_arena.h"
+#include <errno.h>
+#include <linux/filter.h>
+#include <linux/mempolicy.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// One cache line per reactor, each written by its own process only
+struct reactor_counter {
+    _Atomic uint64_t requests;
+    char pad[64 - sizeof(uint64_t)];
+};
+
+static int cpus[CPU_PLACEMENT_MAX_CPUS];
+static int cpu_count = 0;
+
+static struct reactor_counter *counters = NULL;
+static int reactor_count = 0;
+
+int cpu_placement_parse(const char *list) {
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0) {
+        return -1;
+    }
+
+    int count = 0;
+    const char *p = list;
+    while (*p != '\0') {
+        char *end;
+        long first = strtol(p, &end, 10);
+        long last = first;
+        if (end == p || first < 0) {
+            return -1;
+        }
+        if (*end == '-') {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+            if (end == p || last < first) {
+                return -1;
+            }
+        }
+        for (long cpu = first; cpu <= last; cpu++) {
+            if (cpu >= CPU_SETSIZE || !CPU_ISSET(cpu, &allowed) || count == CPU_PLACEMENT_MAX_CPUS) {
+                return -1;
+            }
+            cpus[count++] = (int)cpu;
+        }
+        if (*end == ',') {
+            end++;
+        } else if (*end != '\0') {
+            return -1;
+        }
+        p = end;
+    }
+    if (count == 0) {
+        return -1;
+    }
+    cpu_count = count;
+    return count;
+}
+
+int cpu_placement_init(int reactors) {
+    counters = shared_aligned_alloc(reactors * sizeof(*counters));
+    if (!counters) {
+        return -1;
+    }
+    memset(counters, 0, reactors * sizeof(*counters));
+    reactor_count = reactors;
+    return 0;
+}
+
+int cpu_placement_cpu(int reactor) {
+    return cpu_count > 0 ? cpus[reactor % cpu_count] : -1;
+}
+
+int cpu_placement_pin_reactor(int reactor) {
+    int cpu = cpu_placement_cpu(reactor);
+    if (cpu < 0) {
+        return -1;
+    }
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (err != 0) {
+        async_log(LOG_WARNING, "Cannot pin reactor %d to CPU %d: %s", reactor, cpu, strerror(err));
+        return -1;
+    }
+
+    // Pages first touched from now on come from this CPU's node (no-op without NUMA)
+    if (syscall(SYS_set_mempolicy, MPOL_LOCAL, NULL, 0UL) < 0 && errno != ENOSYS) {
+        async_log(LOG_WARNING, "Cannot set local memory policy: %s", strerror(errno));
+    }
+
+    unsigned int on_cpu = 0, node = 0;
+    syscall(SYS_getcpu, &on_cpu, &node, NULL);
+    async_log(LOG_INFO, "Reactor %d pinned to CPU %d (NUMA node %u)", reactor, cpu, node);
+    return cpu;
+}
+
+int cpu_placement_pin_helpers(void) {
+    if (cpu_count == 0) {
+        return 0;
+    }
+
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) < 0) {
+        return -1;
+    }
+    for (int i = 0; i < cpu_count; i++) {
+        CPU_CLR(cpus[i], &set);
+    }
+    if (CPU_COUNT(&set) == 0) {
+        return 0;  // Every CPU runs a reactor, helpers share them
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0 ? 0 : -1;
+}
+
+int cpu_placement_steer(const int *listeners, int count) {
+    if (cpu_count == 0 || count < 1) {
+        return -1;
+    }
+
+    // A = CPU that received the SYN; return the index of its reactor's listener
+    struct sock_filter code[2 * count + 2];
+    int n = 0;
+    code[n++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_CPU);
+    for (int i = 0; i < count; i++) {
+        code[n++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, cpu_placement_cpu(i), 0, 1);
+        code[n++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, i);
+    }
+    // Out of range: the kernel falls back to the hash
+    code[n++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, count);
+
+    struct sock_fprog prog = { .len = n, .filter = code };
+    if (setsockopt(listeners[0], SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog)) < 0) {
+        return -1;
+    }
+
+    // Lookups also favour a listener whose incoming CPU matches
+    for (int i = 0; i < count; i++) {
+        int cpu = cpu_placement_cpu(i);
+        setsockopt(listeners[i], SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(cpu));
+    }
+    return 0;
+}
+
+void cpu_placement_count_request(int reactor) {
+    if (counters && reactor < reactor_count) {
+        atomic_fetch_add_explicit(&counters[reactor].requests, 1, memory_order_relaxed);
+    }
+}
+
+uint64_t cpu_placement_requests(int reactor) {
+    if (!counters || reactor >= reactor_count) {
+        return 0;
+    }
+    return atomic_load_explicit(&counters[reactor].requests, memory_order_relaxed);
+}
+
+int cpu_placement_reactors(void) {
+    return reactor_count;
+}
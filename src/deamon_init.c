@@ -1,8 +1,12 @@
 #include "deamon_init.h"
 
 int daemon_init(const char *pname, int facility, uid_t uid, int socket) {
+	return daemon_init_keep(pname, facility, uid, &socket, socket >= 0 ? 1 : 0);
+}
 
-	int		i, p;
+int daemon_init_keep(const char *pname, int facility, uid_t uid, const int *keep, int nkeep) {
+
+	int		i, j, p;
 	pid_t	pid;
 
 	if ( (pid = fork()) < 0)
@@ -30,7 +34,9 @@ int daemon_init(const char *pname, int facility, uid_t uid, int socket) {
 
 	// close off file descriptors
 	for (i = 0; i < MAXFD; i++){
-		if(socket != i )
+		for (j = 0; j < nkeep && keep[j] != i; j++)
+			;
+		if (j == nkeep)
 			close(i);
 	}
 
@@ -0,0 +1,193 @@
+#include "latency.h"
+#include "connection.h"
+#include "shared_arena.h"
+#include <stdatomic.h>
+#include <string.h>
+#include <time.h>
+
+// Everything one worker records
+struct latency_tables {
+    struct latency_histogram histograms[LATENCY_TYPES][LATENCY_PHASES];
+    struct latency_histogram loop;
+    uint64_t requests[LATENCY_TYPES];
+};
+
+// Tables of every worker, in the shared arena when pre-forked; a single local set until latency_init()
+static struct latency_tables local_tables;
+static struct latency_tables *all_tables = &local_tables;
+static int table_count = 1;
+static struct latency_tables *tables = &local_tables;   // Of this worker
+
+static _Atomic uint64_t loop_average;        // Written by the reactor, read by the announcer
+
+// Request being handled
+static uint16_t current_type;
+static uint64_t current_received;
+
+// Bucket of a value: exact below LATENCY_SUB_BUCKETS, then 16 per power of two
+static unsigned bucket_index(uint64_t value) {
+    if (value < LATENCY_SUB_BUCKETS) {
+        return (unsigned)value;
+    }
+    unsigned bits = 63 - __builtin_clzll(value);
+    if (bits >= LATENCY_MAX_BITS) {
+        return LATENCY_BUCKETS - 1;
+    }
+    unsigned shift = bits - LATENCY_SUB_BITS;
+    return (shift + 1) * LATENCY_SUB_BUCKETS + (unsigned)(value >> shift) - LATENCY_SUB_BUCKETS;
+}
+
+// Highest value that falls into a bucket
+static uint64_t bucket_high(unsigned index) {
+    if (index < LATENCY_SUB_BUCKETS) {
+        return index;
+    }
+    unsigned shift = index / LATENCY_SUB_BUCKETS - 1;
+    uint64_t sub = index % LATENCY_SUB_BUCKETS + LATENCY_SUB_BUCKETS;
+    return ((sub + 1) << shift) - 1;
+}
+
+// Add the values of one histogram to another
+static void merge(struct latency_histogram *into, const struct latency_histogram *from) {
+    into->count += from->count;
+    into->sum += from->sum;
+    if (from->max > into->max) {
+        into->max = from->max;
+    }
+    for (unsigned i = 0; i < LATENCY_BUCKETS; i++) {
+        into->buckets[i] += from->buckets[i];
+    }
+}
+
+int latency_init(int workers) {
+    struct latency_tables *shared = shared_aligned_alloc(workers * sizeof(*shared));
+    if (!shared) {
+        return -1;
+    }
+    memset(shared, 0, workers * sizeof(*shared));
+    all_tables = tables = shared;
+    table_count = workers;
+    return 0;
+}
+
+void latency_set_worker(int worker) {
+    tables = &all_tables[worker % table_count];
+}
+
+uint64_t latency_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+void latency_record(struct latency_histogram *hist, uint64_t value_ns) {
+    hist->buckets[bucket_index(value_ns)]++;
+    hist->count++;
+    hist->sum += value_ns;
+    if (value_ns > hist->max) {
+        hist->max = value_ns;
+    }
+}
+
+uint64_t latency_value_at(const struct latency_histogram *hist, double quantile) {
+    if (hist->count == 0) {
+        return 0;
+    }
+
+    // Rank of the value, 1-based, rounded up
+    uint64_t rank = (uint64_t)(quantile * hist->count);
+    if ((double)rank < quantile * hist->count || rank == 0) {
+        rank++;
+    }
+
+    uint64_t seen = 0;
+    for (unsigned i = 0; i < LATENCY_BUCKETS; i++) {
+        seen += hist->buckets[i];
+        if (seen >= rank) {
+            uint64_t high = bucket_high(i);
+            return high < hist->max ? high : hist->max;
+        }
+    }
+    return hist->max;
+}
+
+void latency_begin(uint16_t type, uint64_t received_ns) {
+    current_type = type;
+    current_received = received_ns;
+    if (type < LATENCY_TYPES) {
+        tables->requests[type]++;
+    }
+}
+
+ssize_t latency_send(int fd, const void *buffer, size_t length) {
+    uint64_t handled = latency_now();
+    if (current_type < LATENCY_TYPES) {
+        latency_record(&tables->histograms[current_type][LATENCY_PHASE_HANDLE], handled - current_received);
+    }
+    return connection_send(fd, buffer, length, current_type, handled);
+}
+
+void latency_flushed(uint16_t type, uint64_t ready_ns) {
+    if (type < LATENCY_TYPES) {
+        latency_record(&tables->histograms[type][LATENCY_PHASE_FLUSH], latency_now() - ready_ns);
+    }
+}
+
+void latency_record_loop(uint64_t duration_ns) {
+    latency_record(&tables->loop, duration_ns);
+
+    uint64_t average = atomic_load_explicit(&loop_average, memory_order_relaxed);
+    average = average - average / 16 + duration_ns / 16;
+    atomic_store_explicit(&loop_average, average, memory_order_relaxed);
+}
+
+void latency_histogram_of(uint16_t type, int phase, struct latency_histogram *out) {
+    memset(out, 0, sizeof(*out));
+    for (int w = 0; w < table_count; w++) {
+        merge(out, &all_tables[w].histograms[type % LATENCY_TYPES][phase % LATENCY_PHASES]);
+    }
+}
+
+void latency_loop_histogram(struct latency_histogram *out) {
+    memset(out, 0, sizeof(*out));
+    for (int w = 0; w < table_count; w++) {
+        merge(out, &all_tables[w].loop);
+    }
+}
+
+uint64_t latency_loop_average(void) {
+    return atomic_load_explicit(&loop_average, memory_order_relaxed);
+}
+
+uint64_t latency_request_count(uint16_t type) {
+    uint64_t count = 0;
+    for (int w = 0; w < table_count; w++) {
+        count += all_tables[w].requests[type % LATENCY_TYPES];
+    }
+    return count;
+}
+
+int latency_summarize(struct latency_summary *out, int max) {
+    static const double quantiles[LATENCY_QUANTILES] = { 0.5, 0.9, 0.99, 0.999 };
+    static struct latency_histogram merged;     // Too large for the reactor's stack frame
+
+    int count = 0;
+    for (int type = 0; type < LATENCY_TYPES; type++) {
+        for (int phase = 0; phase < LATENCY_PHASES && count < max; phase++) {
+            latency_histogram_of((uint16_t)type, phase, &merged);
+            if (merged.count == 0) {
+                continue;
+            }
+
+            struct latency_summary *s = &out[count++];
+            s->type = (uint16_t)type;
+            s->phase = (uint8_t)phase;
+            s->count = merged.count;
+            for (int q = 0; q < LATENCY_QUANTILES; q++) {
+                s->quantiles_ns[q] = latency_value_at(&merged, quantiles[q]);
+            }
+            s->max_ns = merged.max;
+        }
+    }
+    return count;
+}
@@ -0,0 +1,390 @@
+#include "leaderboard.h"
+#include "shared_arena.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Does node a rank ahead of the key (score, time, seq)
+static int ranks_before(const struct leaderboard_node *a, uint8_t score,
+                        uint32_t time_seconds, uint64_t seq) {
+    if (a->entry.score != score) return a->entry.score > score;
+    if (a->entry.time_seconds != time_seconds) return a->entry.time_seconds < time_seconds;
+    return a->seq < seq;
+}
+
+static struct leaderboard_node *node_alloc(int level) {
+    return shared_calloc(1, sizeof(struct leaderboard_node) + level * sizeof(struct leaderboard_link));
+}
+
+// Geometric level distribution with p = 1/4
+static int random_level(struct leaderboard *board) {
+    int level = 1;
+    for (;;) {
+        board->rng ^= board->rng << 13;
+        board->rng ^= board->rng >> 17;
+        board->rng ^= board->rng << 5;
+        if ((board->rng & 3) != 0 || level == LEADERBOARD_MAX_LEVEL) {
+            return level;
+        }
+        level++;
+    }
+}
+
+static uint32_t hash_nick(const char *nick) {
+    uint32_t h = 2166136261u;  // FNV-1a
+    while (*nick) {
+        h ^= (unsigned char)*nick++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// Slot holding the nick, or the empty slot where it would go
+static uint32_t find_slot(const struct leaderboard *board, const char *nick) {
+    uint32_t mask = board->slot_count - 1;
+    uint32_t slot = hash_nick(nick) & mask;
+    while (board->slots[slot] && strcmp(board->slots[slot]->entry.nick, nick) != 0) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+// Double the nick table; players are never removed, so no tombstones are needed
+static int grow_slots(struct leaderboard *board) {
+    uint32_t old_count = board->slot_count;
+    struct leaderboard_node **old = board->slots;
+
+    board->slot_count = old_count * 2;
+    board->slots = shared_calloc(board->slot_count, sizeof(*board->slots));
+    if (!board->slots) {
+        board->slots = old;
+        board->slot_count = old_count;
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < old_count; i++) {
+        if (old[i]) {
+            board->slots[find_slot(board, old[i]->entry.nick)] = old[i];
+        }
+    }
+    shared_free(old);
+    return 0;
+}
+
+// Find the last node ahead of the key on every level and its position
+static void find_path(struct leaderboard *board, uint8_t score, uint32_t time_seconds, uint64_t seq,
+                      struct leaderboard_node **update, uint32_t *rank) {
+    struct leaderboard_node *x = board->head;
+    for (int i = board->level - 1; i >= 0; i--) {
+        rank[i] = (i == board->level - 1) ? 0 : rank[i + 1];
+        while (x->links[i].next && ranks_before(x->links[i].next, score, time_seconds, seq)) {
+            rank[i] += x->links[i].span;
+            x = x->links[i].next;
+        }
+        update[i] = x;
+    }
+}
+
+static void unlink_node(struct leaderboard *board, struct leaderboard_node *node) {
+    struct leaderboard_node *update[LEADERBOARD_MAX_LEVEL];
+    uint32_t rank[LEADERBOARD_MAX_LEVEL];
+    find_path(board, node->entry.score, node->entry.time_seconds, node->seq, update, rank);
+
+    for (int i = 0; i < board->level; i++) {
+        if (update[i]->links[i].next == node) {
+            update[i]->links[i].span += node->links[i].span - 1;
+            update[i]->links[i].next = node->links[i].next;
+        } else {
+            update[i]->links[i].span--;
+        }
+    }
+    while (board->level > 1 && board->head->links[board->level - 1].next == NULL) {
+        board->level--;
+    }
+    board->count--;
+}
+
+// Link a node at its place in the order, returns its position
+static uint32_t link_node(struct leaderboard *board, struct leaderboard_node *node) {
+    struct leaderboard_node *update[LEADERBOARD_MAX_LEVEL];
+    uint32_t rank[LEADERBOARD_MAX_LEVEL];
+    find_path(board, node->entry.score, node->entry.time_seconds, node->seq, update, rank);
+
+    if (node->level > board->level) {
+        for (int i = board->level; i < node->level; i++) {
+            rank[i] = 0;
+            update[i] = board->head;
+            update[i]->links[i].span = board->count;
+        }
+        board->level = node->level;
+    }
+
+    for (int i = 0; i < node->level; i++) {
+        node->links[i].next = update[i]->links[i].next;
+        update[i]->links[i].next = node;
+        node->links[i].span = update[i]->links[i].span - (rank[0] - rank[i]);
+        update[i]->links[i].span = rank[0] - rank[i] + 1;
+    }
+    for (int i = node->level; i < board->level; i++) {
+        update[i]->links[i].span++;
+    }
+
+    board->count++;
+    return rank[0];
+}
+
+// Node at a 1-based rank, found by summing link spans (mutex held)
+static struct leaderboard_node *select_node(struct leaderboard *board, uint32_t rank) {
+    struct leaderboard_node *x = board->head;
+    uint32_t traversed = 0;
+    for (int i = board->level - 1; i >= 0; i--) {
+        while (x->links[i].next && traversed + x->links[i].span <= rank) {
+            traversed += x->links[i].span;
+            x = x->links[i].next;
+        }
+        if (traversed == rank) {
+            return x;
+        }
+    }
+    return NULL;
+}
+
+// Copy up to limit entries starting at a 0-based offset (mutex held)
+static uint32_t copy_range(struct leaderboard *board, uint32_t offset, uint32_t limit,
+                           struct score_entry *entries) {
+    if (offset >= board->count) {
+        return 0;
+    }
+
+    uint32_t count = 0;
+    for (struct leaderboard_node *x = select_node(board, offset + 1);
+         x && count < limit; x = x->links[0].next) {
+        entries[count++] = x->entry;
+    }
+    return count;
+}
+
+// Encode RANKING_DATA for the top entries (mutex held)
+static void leaderboard_encode(struct leaderboard *board) {
+    char nicks[LEADERBOARD_TOP][MAX_NICK_LENGTH];
+    uint8_t scores[LEADERBOARD_TOP];
+    uint32_t times[LEADERBOARD_TOP];
+
+    int count = 0;
+    for (struct leaderboard_node *x = board->head->links[0].next;
+         x && count < LEADERBOARD_TOP; x = x->links[0].next, count++) {
+        strncpy(nicks[count], x->entry.nick, MAX_NICK_LENGTH - 1);
+        nicks[count][MAX_NICK_LENGTH - 1] = '\0';
+        scores[count] = x->entry.score;
+        times[count] = x->entry.time_seconds;
+    }
+
+    ssize_t len = tlv_create_ranking_data(board->frame, count, nicks, scores, times);
+    board->frame_len = len > 0 ? (size_t)len : 0;
+}
+
+int leaderboard_init(struct leaderboard *board) {
+    memset(board, 0, sizeof(*board));
+    board->head = node_alloc(LEADERBOARD_MAX_LEVEL);
+    board->slot_count = 1024;
+    board->slots = shared_calloc(board->slot_count, sizeof(*board->slots));
+    if (!board->head || !board->slots) {
+        shared_free(board->head);
+        shared_free(board->slots);
+        return -1;
+    }
+    board->head->level = LEADERBOARD_MAX_LEVEL;
+    board->level = 1;
+    board->rng = 2463534242u;
+    shared_mutex_init(&board->mutex);
+    leaderboard_encode(board);
+    return 0;
+}
+
+void leaderboard_destroy(struct leaderboard *board) {
+    struct leaderboard_node *x = board->head;
+    while (x) {
+        struct leaderboard_node *next = x->links[0].next;
+        shared_free(x);
+        x = next;
+    }
+    shared_free(board->slots);
+    pthread_mutex_destroy(&board->mutex);
+}
+
+int leaderboard_insert(struct leaderboard *board, const char *nick,
+                       uint8_t score, uint32_t time_seconds) {
+    shared_mutex_lock(&board->mutex);
+
+    uint32_t slot = find_slot(board, nick);
+    struct leaderboard_node *node = board->slots[slot];
+    if (node) {
+        // Keep only the player's best result; an equal one keeps its earlier place
+        if (ranks_before(node, score, time_seconds, UINT64_MAX)) {
+            pthread_mutex_unlock(&board->mutex);
+            return -1;
+        }
+        unlink_node(board, node);
+    } else {
+        if ((board->count + 1) * 2 > board->slot_count) {
+            if (grow_slots(board) < 0) {
+                pthread_mutex_unlock(&board->mutex);
+                return -1;
+            }
+            slot = find_slot(board, nick);
+        }
+
+        int level = random_level(board);
+        node = node_alloc(level);
+        if (!node) {
+            pthread_mutex_unlock(&board->mutex);
+            return -1;
+        }
+        node->level = level;
+        strncpy(node->entry.nick, nick, sizeof(node->entry.nick) - 1);
+        board->slots[slot] = node;
+    }
+
+    node->entry.score = score;
+    node->entry.time_seconds = time_seconds;
+    node->seq = board->next_seq++;
+    uint32_t position = link_node(board, node);
+
+    // Entries below the top do not change the frame
+    if (position < LEADERBOARD_TOP) {
+        leaderboard_encode(board);
+    }
+
+    pthread_mutex_unlock(&board->mutex);
+    return (int)position;
+}
+
+int leaderboard_load(struct leaderboard *board, const struct score_entry *entries, uint32_t count) {
+    struct leaderboard_node *last[LEADERBOARD_MAX_LEVEL];
+    uint32_t last_pos[LEADERBOARD_MAX_LEVEL];
+    int rc = 0;
+
+    shared_mutex_lock(&board->mutex);
+
+    for (int i = 0; i < LEADERBOARD_MAX_LEVEL; i++) {
+        last[i] = board->head;
+        last_pos[i] = 0;
+    }
+
+    for (uint32_t n = 0; n < count; n++) {
+        if ((board->count + 1) * 2 > board->slot_count && grow_slots(board) < 0) {
+            rc = -1;
+            break;
+        }
+
+        int level = random_level(board);
+        struct leaderboard_node *node = node_alloc(level);
+        if (!node) {
+            rc = -1;
+            break;
+        }
+        node->level = level;
+        node->entry = entries[n];
+        node->entry.nick[sizeof(node->entry.nick) - 1] = '\0';
+        node->seq = board->next_seq++;
+
+        // Append after the last node of every level the new node is on
+        uint32_t pos = board->count + 1;
+        for (int i = 0; i < level; i++) {
+            last[i]->links[i].next = node;
+            last[i]->links[i].span = pos - last_pos[i];
+            last[i] = node;
+            last_pos[i] = pos;
+        }
+        if (level > board->level) {
+            board->level = level;
+        }
+        board->count++;
+        board->slots[find_slot(board, node->entry.nick)] = node;
+    }
+
+    // Links at the end of a level span the remaining entries
+    for (int i = 0; i < board->level; i++) {
+        last[i]->links[i].span = board->count - last_pos[i];
+    }
+
+    leaderboard_encode(board);
+    pthread_mutex_unlock(&board->mutex);
+    return rc;
+}
+
+uint32_t leaderboard_rank(struct leaderboard *board, const char *nick,
+                          struct score_entry *best, uint32_t *total) {
+    shared_mutex_lock(&board->mutex);
+
+    uint32_t rank = 0;
+    struct leaderboard_node *node = board->slots[find_slot(board, nick)];
+    if (node) {
+        struct leaderboard_node *update[LEADERBOARD_MAX_LEVEL];
+        uint32_t path[LEADERBOARD_MAX_LEVEL];
+        find_path(board, node->entry.score, node->entry.time_seconds, node->seq, update, path);
+        rank = path[0] + 1;
+        if (best) {
+            *best = node->entry;
+        }
+    }
+    if (total) {
+        *total = board->count;
+    }
+
+    pthread_mutex_unlock(&board->mutex);
+    return rank;
+}
+
+uint32_t leaderboard_page(struct leaderboard *board, uint32_t offset, uint32_t limit,
+                          struct score_entry *entries, uint32_t *total) {
+    shared_mutex_lock(&board->mutex);
+    uint32_t count = copy_range(board, offset, limit, entries);
+    if (total) {
+        *total = board->count;
+    }
+    pthread_mutex_unlock(&board->mutex);
+    return count;
+}
+
+uint32_t leaderboard_around(struct leaderboard *board, const char *nick, uint32_t limit,
+                            struct score_entry *entries, uint32_t *first_rank, uint32_t *total) {
+    shared_mutex_lock(&board->mutex);
+
+    uint32_t count = 0;
+    *first_rank = 0;
+    struct leaderboard_node *node = board->slots[find_slot(board, nick)];
+    if (node && limit > 0) {
+        struct leaderboard_node *update[LEADERBOARD_MAX_LEVEL];
+        uint32_t path[LEADERBOARD_MAX_LEVEL];
+        find_path(board, node->entry.score, node->entry.time_seconds, node->seq, update, path);
+
+        // Center the window on the player, shifted back inside the board at either end
+        uint32_t offset = path[0] > limit / 2 ? path[0] - limit / 2 : 0;
+        if (board->count > limit && offset > board->count - limit) {
+            offset = board->count - limit;
+        }
+        count = copy_range(board, offset, limit, entries);
+        *first_rank = offset + 1;
+    }
+    if (total) {
+        *total = board->count;
+    }
+
+    pthread_mutex_unlock(&board->mutex);
+    return count;
+}
+
+uint32_t leaderboard_count(struct leaderboard *board) {
+    shared_mutex_lock(&board->mutex);
+    uint32_t count = board->count;
+    pthread_mutex_unlock(&board->mutex);
+    return count;
+}
+
+size_t leaderboard_copy_frame(struct leaderboard *board, uint8_t *buffer) {
+    shared_mutex_lock(&board->mutex);
+    size_t len = board->frame_len;
+    memcpy(buffer, board->frame, len);
+    pthread_mutex_unlock(&board->mutex);
+    return len;
+}
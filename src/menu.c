@@ -1,4 +1,5 @@
 #include "menu.h"
+#include "tlv.h"
 
 // Display application banner
 void menu_display_banner(void) {
@@ -24,12 +25,13 @@ int menu_display_and_get_choice(void) {
     printf("║         IT EXAM SYSTEM - MAIN MENU         ║\n");
     printf("╠════════════════════════════════════════════╣\n");
     printf("║  1. Training - Random question             ║\n");
-    printf("║  2. Knowledge test - Set of 10 questions   ║\n");
+    printf("║  2. Knowledge test - Set of %2d questions   ║\n", TEST_QUESTION_COUNT);
     printf("║  3. Ranking / User statistics              ║\n");
     printf("║  4. Server information                     ║\n");
-    printf("║  5. Exit                                   ║\n");
+    printf("║  5. Search questions                       ║\n");
+    printf("║  6. Exit                                   ║\n");
     printf("╚════════════════════════════════════════════╝\n");
-    printf("\nEnter your choice (1-5): ");
+    printf("\nEnter your choice (1-6): ");
     
     if (scanf("%d", &choice) != 1) {
         menu_clear_input_buffer();
@@ -38,7 +40,7 @@ int menu_display_and_get_choice(void) {
     
     menu_clear_input_buffer();  // Clear remaining newline
     
-    if (choice < 1 || choice > 5) {
+    if (choice < 1 || choice > 6) {
         return -1;  // Out of range
     }
     
@@ -0,0 +1,511 @@
+#define _GNU_SOURCE
+#include "metrics.h"
+#include "async_log.h"
+#include "latency.h"
+#include "nick_registry.h"
+#include "prefork.h"
+#include "cpu_placement.h"
+#include "buffer_pool.h"
+#include "question_bank.h"
+#include "shared_arena.h"
+#include "stats_counters.h"
+#include <errno.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+struct metrics_client {
+    int fd;                         // -1 = free slot
+    uint64_t accepted_at;
+    char request[METRICS_REQUEST_SIZE];
+    size_t request_len;
+    char *pending;                  // Rest of a response the socket did not take
+    size_t pending_len;
+    size_t pending_sent;
+};
+
+// Figures a worker keeps to itself, copied by metrics_publish()
+struct metrics_worker {
+    _Alignas(64) _Atomic uint64_t buffer_in_use;
+    _Atomic uint64_t buffer_cached;
+    _Atomic uint64_t log_dropped;
+};
+
+// One slot per worker plus one for the log drops of exited workers
+static struct metrics_worker *slots;
+static int slot_count;
+
+static int listen_fd = -1;
+static time_t started;
+static struct metrics_client clients[METRICS_MAX_CLIENTS];
+
+// Rendered exposition, kept between scrapes
+static char *page;
+static size_t page_len;
+static size_t page_cap;
+static uint64_t page_rendered_at;
+static int page_truncated;
+
+static const double quantiles[LATENCY_QUANTILES] = { 0.5, 0.9, 0.99, 0.999 };
+static const char *quantile_labels[LATENCY_QUANTILES] = { "0.5", "0.9", "0.99", "0.999" };
+
+// Append formatted text to the page, growing it when needed
+static void emit(const char *format, ...) {
+    for (;;) {
+        va_list args;
+        va_start(args, format);
+        int n = vsnprintf(page ? page + page_len : NULL, page_cap - page_len, format, args);
+        va_end(args);
+        if (n < 0) {
+            return;
+        }
+        if (page_len + (size_t)n < page_cap) {
+            page_len += n;
+            return;
+        }
+
+        size_t cap = page_cap ? page_cap * 2 : 16384;
+        while (cap <= page_len + (size_t)n) {
+            cap *= 2;
+        }
+        char *grown = realloc(page, cap);
+        if (!grown) {
+            page_truncated = 1;
+            return;
+        }
+        page = grown;
+        page_cap = cap;
+    }
+}
+
+// Label value with \, " and newlines escaped
+static const char *label(const char *value, char *buffer, size_t size) {
+    size_t pos = 0;
+    for (; *value && pos + 2 < size; value++) {
+        if (*value == '\\' || *value == '"') {
+            buffer[pos++] = '\\';
+            buffer[pos++] = *value;
+        } else if (*value == '\n') {
+            buffer[pos++] = '\\';
+            buffer[pos++] = 'n';
+        } else {
+            buffer[pos++] = *value;
+        }
+    }
+    buffer[pos] = '\0';
+    return buffer;
+}
+
+// Sum of one field over all workers, this process alone before metrics_init()
+static uint64_t sum_slots(size_t offset, uint64_t local) {
+    if (!slots) {
+        return local;
+    }
+    uint64_t sum = 0;
+    for (int i = 0; i <= slot_count; i++) {
+        sum += atomic_load_explicit((_Atomic uint64_t *)((char *)&slots[i] + offset), memory_order_relaxed);
+    }
+    return sum;
+}
+
+// Samples of a summary in seconds, the family header is written by the caller
+static void emit_summary(const char *name, const char *labels, const struct latency_histogram *hist) {
+    const char *sep = labels[0] ? "," : "";
+    for (int q = 0; q < LATENCY_QUANTILES; q++) {
+        emit("%s{%s%squantile=\"%s\"} %.9f\n", name, labels, sep, quantile_labels[q],
+             latency_value_at(hist, quantiles[q]) / 1e9);
+    }
+    emit("%s_sum%s%s%s %.9f\n", name, labels[0] ? "{" : "", labels, labels[0] ? "}" : "",
+         hist->sum / 1e9);
+    emit("%s_count%s%s%s %llu\n", name, labels[0] ? "{" : "", labels, labels[0] ? "}" : "",
+         (unsigned long long)hist->count);
+}
+
+// Family of per-type request latency summaries for one phase
+static void emit_request_latency(const char *name, const char *help, int phase) {
+    emit("# TYPE %s summary\n# UNIT %s seconds\n# HELP %s %s\n", name, name, name, help);
+    static struct latency_histogram hist;
+    for (uint16_t type = 0; type < LATENCY_TYPES; type++) {
+        latency_histogram_of(type, phase, &hist);
+        if (hist.count > 0) {
+            char labels[64];
+            snprintf(labels, sizeof(labels), "type=\"%s\"", tlv_type_name(type));
+            emit_summary(name, labels, &hist);
+        }
+    }
+}
+
+static void render(void) {
+    static struct latency_histogram loop;
+    char name[2 * MAX_BANK_NAME + 1];
+    page_len = 0;
+    page_truncated = 0;
+
+    emit("# TYPE networkexam_start_time_seconds gauge\n"
+         "# UNIT networkexam_start_time_seconds seconds\n"
+         "# HELP networkexam_start_time_seconds Unix time the server started.\n"
+         "networkexam_start_time_seconds %lld\n", (long long)started);
+
+    emit("# TYPE networkexam_connections gauge\n"
+         "# HELP networkexam_connections Open client connections.\n"
+         "networkexam_connections %lld\n",
+         (long long)stats_read(server_counters, STATS_ACTIVE_CONNECTIONS));
+    emit("# TYPE networkexam_logged_in_users gauge\n"
+         "# HELP networkexam_logged_in_users Nicknames held by open connections.\n"
+         "networkexam_logged_in_users %u\n", nick_registry_count(server_nicks));
+    emit("# TYPE networkexam_connections_accepted counter\n"
+         "# HELP networkexam_connections_accepted Client connections accepted.\n"
+         "networkexam_connections_accepted_total %llu\n",
+         (unsigned long long)stats_read(server_counters, STATS_TOTAL_CONNECTIONS));
+    emit("# TYPE networkexam_received_bytes counter\n"
+         "# UNIT networkexam_received_bytes bytes\n"
+         "# HELP networkexam_received_bytes Bytes received from clients.\n"
+         "networkexam_received_bytes_total %llu\n",
+         (unsigned long long)stats_read(server_counters, STATS_BYTES_IN));
+    emit("# TYPE networkexam_sent_bytes counter\n"
+         "# UNIT networkexam_sent_bytes bytes\n"
+         "# HELP networkexam_sent_bytes Bytes of responses sent to clients.\n"
+         "networkexam_sent_bytes_total %llu\n",
+         (unsigned long long)stats_read(server_counters, STATS_BYTES_OUT));
+
+    if (prefork_workers() > 0) {
+        emit("# TYPE networkexam_workers gauge\n"
+             "# HELP networkexam_workers Pre-forked worker processes.\n"
+             "networkexam_workers %d\n", prefork_workers());
+        emit("# TYPE networkexam_worker_restarts counter\n"
+             "# HELP networkexam_worker_restarts Workers restarted after they exited.\n"
+             "networkexam_worker_restarts_total %llu\n", (unsigned long long)prefork_restarts());
+        emit("# TYPE networkexam_shared_memory_bytes gauge\n"
+             "# UNIT networkexam_shared_memory_bytes bytes\n"
+             "# HELP networkexam_shared_memory_bytes Shared arena handed out to rankings and statistics.\n"
+             "networkexam_shared_memory_bytes %zu\n", shared_arena_used());
+    }
+
+    emit("# TYPE networkexam_connection_buffer_bytes gauge\n"
+         "# UNIT networkexam_connection_buffer_bytes bytes\n"
+         "# HELP networkexam_connection_buffer_bytes Pooled buffers of partial frames and queued output.\n"
+         "networkexam_connection_buffer_bytes{state=\"in_use\"} %llu\n"
+         "networkexam_connection_buffer_bytes{state=\"cached\"} %llu\n",
+         (unsigned long long)sum_slots(offsetof(struct metrics_worker, buffer_in_use), buffer_pool_in_use()),
+         (unsigned long long)sum_slots(offsetof(struct metrics_worker, buffer_cached), buffer_pool_cached()));
+
+    // Per-core throughput: requests handled by each event loop and the CPU it is pinned to
+    emit("# TYPE networkexam_reactor_requests counter\n"
+         "# HELP networkexam_reactor_requests Messages handled by each event loop.\n");
+    for (int r = 0; r < cpu_placement_reactors(); r++) {
+        emit("networkexam_reactor_requests_total{reactor=\"%d\"} %llu\n", r,
+             (unsigned long long)cpu_placement_requests(r));
+    }
+    if (cpu_placement_cpu(0) >= 0) {
+        emit("# TYPE networkexam_reactor_cpu gauge\n"
+             "# HELP networkexam_reactor_cpu CPU each event loop is pinned to.\n");
+        for (int r = 0; r < cpu_placement_reactors(); r++) {
+            emit("networkexam_reactor_cpu{reactor=\"%d\"} %d\n", r, cpu_placement_cpu(r));
+        }
+    }
+
+    emit("# TYPE networkexam_log_dropped counter\n"
+         "# HELP networkexam_log_dropped Log entries dropped because a log ring was full.\n"
+         "networkexam_log_dropped_total %llu\n",
+         (unsigned long long)sum_slots(offsetof(struct metrics_worker, log_dropped), async_log_dropped()));
+
+    emit("# TYPE networkexam_requests counter\n"
+         "# HELP networkexam_requests Messages received, by type.\n");
+    for (uint16_t type = 0; type < LATENCY_TYPES; type++) {
+        uint64_t count = latency_request_count(type);
+        if (count > 0) {
+            emit("networkexam_requests_total{type=\"%s\"} %llu\n", tlv_type_name(type),
+                 (unsigned long long)count);
+        }
+    }
+    emit_request_latency("networkexam_request_handle_seconds",
+                         "Message received until its response was ready.", LATENCY_PHASE_HANDLE);
+    emit_request_latency("networkexam_request_flush_seconds",
+                         "Response ready until its last byte was sent.", LATENCY_PHASE_FLUSH);
+
+    emit("# TYPE networkexam_loop_iteration_seconds summary\n"
+         "# UNIT networkexam_loop_iteration_seconds seconds\n"
+         "# HELP networkexam_loop_iteration_seconds Time to handle the events of one epoll_wait().\n");
+    latency_loop_histogram(&loop);
+    emit_summary("networkexam_loop_iteration_seconds", "", &loop);
+
+    emit("# TYPE networkexam_bank info\n"
+         "# HELP networkexam_bank Loaded question banks and the checksum of their file.\n");
+    for (int i = 0; i < bank_count(); i++) {
+        struct question_bank *bank = bank_at(i);
+        emit("networkexam_bank_info{bank=\"%s\",version=\"%016llx\"} 1\n",
+             label(bank->name, name, sizeof(name)), (unsigned long long)bank->db.version);
+    }
+    emit("# TYPE networkexam_bank_questions gauge\n"
+         "# HELP networkexam_bank_questions Questions in the bank.\n");
+    for (int i = 0; i < bank_count(); i++) {
+        struct question_bank *bank = bank_at(i);
+        emit("networkexam_bank_questions{bank=\"%s\"} %d\n",
+             label(bank->name, name, sizeof(name)), bank->db.count);
+    }
+    emit("# TYPE networkexam_ranked_players gauge\n"
+         "# HELP networkexam_ranked_players Players with a finished test in the ranking.\n");
+    for (int i = 0; i < bank_count(); i++) {
+        struct question_bank *bank = bank_at(i);
+        emit("networkexam_ranked_players{bank=\"%s\"} %u\n",
+             label(bank->name, name, sizeof(name)), leaderboard_count(&bank->leaderboard));
+    }
+    emit("# TYPE networkexam_tests_completed counter\n"
+         "# HELP networkexam_tests_completed Knowledge tests finished.\n");
+    for (int i = 0; i < bank_count(); i++) {
+        struct question_bank *bank = bank_at(i);
+        emit("networkexam_tests_completed_total{bank=\"%s\"} %llu\n", label(bank->name, name, sizeof(name)),
+             (unsigned long long)stats_read(&bank->stats, STATS_TESTS_COMPLETED));
+    }
+    emit("# TYPE networkexam_questions_asked counter\n"
+         "# HELP networkexam_questions_asked Questions sent to clients.\n");
+    for (int i = 0; i < bank_count(); i++) {
+        struct question_bank *bank = bank_at(i);
+        emit("networkexam_questions_asked_total{bank=\"%s\"} %llu\n", label(bank->name, name, sizeof(name)),
+             (unsigned long long)stats_read(&bank->stats, STATS_QUESTIONS_ASKED));
+    }
+
+    emit("# EOF\n");
+    page_rendered_at = latency_now();
+}
+
+static void close_client(int epollfd, struct metrics_client *client) {
+    epoll_ctl(epollfd, EPOLL_CTL_DEL, client->fd, NULL);
+    close(client->fd);
+    free(client->pending);
+    client->pending = NULL;
+    client->fd = -1;
+}
+
+static struct metrics_client *find_client(int fd) {
+    for (int i = 0; i < METRICS_MAX_CLIENTS; i++) {
+        if (clients[i].fd == fd) {
+            return &clients[i];
+        }
+    }
+    return NULL;
+}
+
+// Send what the socket takes; keep a copy of the rest for EPOLLOUT
+static void respond(int epollfd, struct metrics_client *client, const char *status,
+                    const char *content_type, const char *body, size_t body_len) {
+    char header[256];
+    int header_len = snprintf(header, sizeof(header),
+                              "HTTP/1.0 %s\r\n"
+                              "Content-Type: %s\r\n"
+                              "Content-Length: %zu\r\n"
+                              "Connection: close\r\n\r\n", status, content_type, body_len);
+
+    struct iovec iov[2] = {
+        { .iov_base = header, .iov_len = (size_t)header_len },
+        { .iov_base = (void *)body, .iov_len = body_len },
+    };
+    struct msghdr msg = { .msg_iov = iov, .msg_iovlen = 2 };
+    ssize_t sent = sendmsg(client->fd, &msg, MSG_NOSIGNAL);
+    if (sent < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            close_client(epollfd, client);
+            return;
+        }
+        sent = 0;
+    }
+
+    size_t total = (size_t)header_len + body_len;
+    if ((size_t)sent == total) {
+        close_client(epollfd, client);
+        return;
+    }
+
+    // Slow scraper: the shared page may be re-rendered before it catches up
+    client->pending = malloc(total - sent);
+    if (!client->pending) {
+        close_client(epollfd, client);
+        return;
+    }
+    if ((size_t)sent < (size_t)header_len) {
+        memcpy(client->pending, header + sent, header_len - sent);
+        memcpy(client->pending + header_len - sent, body, body_len);
+    } else {
+        memcpy(client->pending, body + (sent - header_len), total - sent);
+    }
+    client->pending_len = total - sent;
+    client->pending_sent = 0;
+
+    struct epoll_event ev = { .events = EPOLLOUT | EPOLLRDHUP, .data.fd = client->fd };
+    epoll_ctl(epollfd, EPOLL_CTL_MOD, client->fd, &ev);
+}
+
+static void serve_request(int epollfd, struct metrics_client *client) {
+    if (strncmp(client->request, "GET /metrics ", 13) != 0 &&
+        strncmp(client->request, "GET /metrics?", 13) != 0) {
+        static const char not_found[] = "Only /metrics is served here.\n";
+        respond(epollfd, client, "404 Not Found", "text/plain", not_found, sizeof(not_found) - 1);
+        return;
+    }
+
+    if (page_rendered_at == 0 || latency_now() - page_rendered_at > METRICS_MAX_AGE_MS * 1000000ull) {
+        render();
+        if (page_truncated) {
+            async_log(LOG_WARNING, "Metrics exposition truncated: out of memory");
+        }
+    }
+    respond(epollfd, client, "200 OK", "application/openmetrics-text; version=1.0.0; charset=utf-8",
+            page, page_len);
+}
+
+static void accept_clients(int epollfd) {
+    for (;;) {
+        int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                async_log(LOG_WARNING, "Metrics accept: %s", strerror(errno));
+            }
+            return;
+        }
+
+        // Free slot, or make room by dropping the oldest scrape
+        struct metrics_client *client = find_client(-1);
+        if (!client) {
+            client = &clients[0];
+            for (int i = 1; i < METRICS_MAX_CLIENTS; i++) {
+                if (clients[i].accepted_at < client->accepted_at) {
+                    client = &clients[i];
+                }
+            }
+            close_client(epollfd, client);
+        }
+
+        struct epoll_event ev = { .events = EPOLLIN | EPOLLRDHUP, .data.fd = fd };
+        if (epoll_ctl(epollfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            close(fd);
+            continue;
+        }
+        client->fd = fd;
+        client->accepted_at = latency_now();
+        client->request_len = 0;
+    }
+}
+
+int metrics_init(int workers) {
+    slots = shared_aligned_alloc((workers + 1) * sizeof(*slots));
+    if (!slots) {
+        return -1;
+    }
+    memset(slots, 0, (workers + 1) * sizeof(*slots));
+    slot_count = workers;
+    return 0;
+}
+
+void metrics_publish(int worker) {
+    if (!slots) {
+        return;
+    }
+    struct metrics_worker *slot = &slots[worker % slot_count];
+    atomic_store_explicit(&slot->buffer_in_use, buffer_pool_in_use(), memory_order_relaxed);
+    atomic_store_explicit(&slot->buffer_cached, buffer_pool_cached(), memory_order_relaxed);
+    atomic_store_explicit(&slot->log_dropped, async_log_dropped(), memory_order_relaxed);
+}
+
+void metrics_worker_exited(int worker) {
+    if (!slots) {
+        return;
+    }
+    struct metrics_worker *slot = &slots[worker % slot_count];
+    uint64_t dropped = atomic_exchange_explicit(&slot->log_dropped, 0, memory_order_relaxed);
+    atomic_fetch_add_explicit(&slots[slot_count].log_dropped, dropped, memory_order_relaxed);
+    atomic_store_explicit(&slot->buffer_in_use, 0, memory_order_relaxed);
+    atomic_store_explicit(&slot->buffer_cached, 0, memory_order_relaxed);
+}
+
+int metrics_start(int epollfd, uint16_t port, time_t start_time) {
+    for (int i = 0; i < METRICS_MAX_CLIENTS; i++) {
+        clients[i].fd = -1;
+    }
+    started = start_time;
+
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    int yes = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+    // Monitoring stays on this host
+    struct sockaddr_in addr = {0};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 16) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    struct epoll_event ev = { .events = EPOLLIN, .data.fd = fd };
+    if (epoll_ctl(epollfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        close(fd);
+        return -1;
+    }
+    listen_fd = fd;
+    return fd;
+}
+
+int metrics_handle_event(int epollfd, int fd, uint32_t events) {
+    if (listen_fd < 0) {
+        return 0;
+    }
+    if (fd == listen_fd) {
+        accept_clients(epollfd);
+        return 1;
+    }
+
+    struct metrics_client *client = find_client(fd);
+    if (!client) {
+        return 0;
+    }
+
+    if (client->pending) {
+        if (events & (EPOLLERR | EPOLLHUP)) {
+            close_client(epollfd, client);
+            return 1;
+        }
+        ssize_t sent = send(fd, client->pending + client->pending_sent,
+                            client->pending_len - client->pending_sent, MSG_NOSIGNAL);
+        if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+            close_client(epollfd, client);
+        } else if (sent > 0 && (client->pending_sent += sent) == client->pending_len) {
+            close_client(epollfd, client);
+        }
+        return 1;
+    }
+
+    // Read the request header; only its first line matters
+    ssize_t n = recv(fd, client->request + client->request_len,
+                     sizeof(client->request) - 1 - client->request_len, 0);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return 1;
+    }
+    if (n <= 0) {
+        close_client(epollfd, client);
+        return 1;
+    }
+    client->request_len += n;
+    client->request[client->request_len] = '\0';
+
+    if (strstr(client->request, "\r\n\r\n") || strstr(client->request, "\n\n")) {
+        serve_request(epollfd, client);
+    } else if (client->request_len == sizeof(client->request) - 1) {
+        static const char too_long[] = "Request header too long.\n";
+        respond(epollfd, client, "431 Request Header Fields Too Large", "text/plain",
+                too_long, sizeof(too_long) - 1);
+    }
+    return 1;
+}
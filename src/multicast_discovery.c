@@ -1,8 +1,25 @@
 #define _GNU_SOURCE
 #include "multicast_discovery.h"
+#include "tlv.h"
 #include <sys/types.h>
 #include <sys/ioctl.h>
 #include <net/if.h>
+#include <ifaddrs.h>
+#include <poll.h>
+#include <time.h>
+
+// Groups announced to and listened on, see discovery_configure()
+static char discovery_groups[DISCOVERY_MAX_GROUPS][INET6_ADDRSTRLEN] = { DISCOVERY_GROUP_V4, DISCOVERY_GROUP_V6 };
+static int discovery_group_count = 2;
+static unsigned int discovery_ifindex = 0;
+
+// A group on one interface; every announcement goes to each target
+struct discovery_target {
+    struct sockaddr_storage group;
+    socklen_t len;
+    unsigned int ifindex;
+    char address[INET6_ADDRSTRLEN];     // Announced to it: the interface's own, "" for the server's
+};
 
 int snd_udp_socket(const char *serv, int port, SA **saptr, socklen_t *lenp)
 {
@@ -66,7 +83,27 @@ int mcast_join(int sockfd, const SA *grp, socklen_t grplen __attribute__((unused
     // Network interface info: name, IP
 	struct ifreq ifreq;  
 
-    // Check if the address is IPv4, because this function only supports it
+	if ( grp->sa_family == AF_INET6 ) {
+		// IPV6_JOIN_GROUP takes the interface by index, 0 lets the kernel choose
+		struct ipv6_mreq mreq6;
+		memcpy(&mreq6.ipv6mr_multiaddr,
+			   &((const struct sockaddr_in6 *) grp)->sin6_addr,
+			   sizeof(struct in6_addr));
+		if (ifindex > 0) {
+			mreq6.ipv6mr_interface = ifindex;
+		} else if (ifname != NULL) {
+			if ( (mreq6.ipv6mr_interface = if_nametoindex(ifname)) == 0) {
+				errno = ENXIO;
+				return(-1);
+			}
+		} else {
+			mreq6.ipv6mr_interface = 0;
+		}
+		return(setsockopt(sockfd, IPPROTO_IPV6, IPV6_JOIN_GROUP,
+						  &mreq6, sizeof(mreq6)));
+	}
+
+    // Otherwise only IPv4 is supported
 	if ( grp->sa_family != AF_INET ) {
 		errno = EAFNOSUPPORT;
 		return -1;
@@ -108,6 +145,32 @@ int mcast_join(int sockfd, const SA *grp, socklen_t grplen __attribute__((unused
 					  &mreq, sizeof(mreq)));
 }
 
+int mcast_set_if(int sockfd, const char *ifname, unsigned int ifindex)
+{
+	if (ifindex == 0 && ifname != NULL && (ifindex = if_nametoindex(ifname)) == 0) {
+		errno = ENXIO;
+		return(-1);
+	}
+
+	switch (sockfd_to_family(sockfd)) {
+	case AF_INET: {
+		struct ip_mreqn mreqn;
+		memset(&mreqn, 0, sizeof(mreqn));
+		mreqn.imr_ifindex = ifindex;
+		return(setsockopt(sockfd, IPPROTO_IP, IP_MULTICAST_IF,
+						  &mreqn, sizeof(mreqn)));
+	}
+
+	case AF_INET6:
+		return(setsockopt(sockfd, IPPROTO_IPV6, IPV6_MULTICAST_IF,
+						  &ifindex, sizeof(ifindex)));
+
+	default:
+		errno = EAFNOSUPPORT;
+		return(-1);
+	}
+}
+
 int sockfd_to_family(int sockfd)
 {
 	struct sockaddr_storage ss;
@@ -130,7 +193,6 @@ int mcast_set_loop(int sockfd, int onoff)
 						  &flag, sizeof(flag)));
 	}
 
-#ifdef	IPV6
 	case AF_INET6: {
 		unsigned int flag;
 
@@ -138,7 +200,6 @@ int mcast_set_loop(int sockfd, int onoff)
 		return(setsockopt(sockfd, IPPROTO_IPV6, IPV6_MULTICAST_LOOP,
 						  &flag, sizeof(flag)));
 	}
-#endif
 
 	default:
 		errno = EAFNOSUPPORT;
@@ -146,89 +207,839 @@ int mcast_set_loop(int sockfd, int onoff)
 	}
 }
 
+static void put16(uint8_t *p, uint16_t v) {
+    p[0] = v >> 8;
+    p[1] = v;
+}
+
+static void put32(uint8_t *p, uint32_t v) {
+    put16(p, v >> 16);
+    put16(p + 2, v);
+}
+
+static void put64(uint8_t *p, uint64_t v) {
+    put32(p, v >> 32);
+    put32(p + 4, v);
+}
+
+static uint16_t get16(const uint8_t *p) {
+    return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+static uint32_t get32(const uint8_t *p) {
+    return (uint32_t)get16(p) << 16 | get16(p + 2);
+}
+
+static uint64_t get64(const uint8_t *p) {
+    return (uint64_t)get32(p) << 32 | get32(p + 4);
+}
+
+ssize_t discovery_encode(uint8_t *buffer, size_t size, const struct discovery_info *info) {
+    if (size < DISCOVERY_V1_SIZE) {
+        return -1;
+    }
+
+    // IPv4 goes out IPv4-mapped, receivers print it dotted again
+    struct in6_addr addr;
+    struct in_addr addr4;
+    if (inet_pton(AF_INET6, info->ip, &addr) != 1) {
+        if (inet_pton(AF_INET, info->ip, &addr4) != 1) {
+            return -1;
+        }
+        memset(&addr, 0, sizeof(addr));
+        addr.s6_addr[10] = 0xff;
+        addr.s6_addr[11] = 0xff;
+        memcpy(&addr.s6_addr[12], &addr4, sizeof(addr4));
+    }
+
+    put16(buffer, DISCOVERY_MAGIC);
+    buffer[2] = DISCOVERY_VERSION;
+    buffer[3] = 0;
+    put64(buffer + 4, info->server_id);
+    put16(buffer + 12, info->port);
+    memcpy(buffer + 14, &addr, sizeof(addr));
+    put32(buffer + 30, info->connections);
+    put32(buffer + 34, info->max_connections);
+    put32(buffer + 38, info->loop_latency_us);
+    put64(buffer + 42, info->bank_version);
+    return DISCOVERY_V1_SIZE;
+}
+
+// "SERVER:ip:port" of servers from before the binary announcement
+static int decode_legacy(const uint8_t *buffer, size_t length, struct discovery_info *info) {
+    const char *prefix = "SERVER:";
+    size_t prefix_len = strlen(prefix);
+    char line[MAXLINE];
+    if (length <= prefix_len || length >= sizeof(line) || memcmp(buffer, prefix, prefix_len) != 0) {
+        return -1;
+    }
+    memcpy(line, buffer, length);
+    line[length] = '\0';
+
+    // Strip trailing newline/carriage return
+    char *p = line + length - 1;
+    while (p >= line && (*p == '\n' || *p == '\r')) { *p = '\0'; --p; }
+
+    // Handle IPv4 and IPv6 addresses: the last ':' separates the port
+    char *last_colon = strrchr(line, ':');
+    size_t ip_len = (size_t)(last_colon - (line + prefix_len));
+    if (last_colon < line + prefix_len || ip_len == 0 || ip_len >= INET6_ADDRSTRLEN) {
+        return -1;
+    }
+    int port = atoi(last_colon + 1);
+    if (port <= 0 || port > 65535) {
+        return -1;
+    }
+
+    memset(info, 0, sizeof(*info));
+    memcpy(info->ip, line + prefix_len, ip_len);
+    info->ip[ip_len] = '\0';
+    info->port = (uint16_t)port;
+    return 0;
+}
+
+int discovery_decode(const uint8_t *buffer, size_t length, struct discovery_info *info) {
+    if (length < 2 || get16(buffer) != DISCOVERY_MAGIC) {
+        return decode_legacy(buffer, length, info);
+    }
+    // Newer versions append fields: read the ones of version 1
+    if (length < DISCOVERY_V1_SIZE || buffer[2] < 1) {
+        return -1;
+    }
+
+    memset(info, 0, sizeof(*info));
+    info->version = buffer[2];
+    info->server_id = get64(buffer + 4);
+    info->port = get16(buffer + 12);
+
+    struct in6_addr addr;
+    memcpy(&addr, buffer + 14, sizeof(addr));
+    const char *ok = IN6_IS_ADDR_V4MAPPED(&addr) ?
+                     inet_ntop(AF_INET, &addr.s6_addr[12], info->ip, sizeof(info->ip)) :
+                     inet_ntop(AF_INET6, &addr, info->ip, sizeof(info->ip));
+    if (ok == NULL || info->port == 0) {
+        return -1;
+    }
+
+    info->connections = get32(buffer + 30);
+    info->max_connections = get32(buffer + 34);
+    info->loop_latency_us = get32(buffer + 38);
+    info->bank_version = get64(buffer + 42);
+    return 0;
+}
+
+// Group at the discovery port; -1 if group is not a multicast address
+static int group_address(const char *group, struct sockaddr_storage *addr, socklen_t *len) {
+    struct sockaddr_in6 *addr6 = (struct sockaddr_in6 *)addr;
+    struct sockaddr_in *addr4 = (struct sockaddr_in *)addr;
+    memset(addr, 0, sizeof(*addr));
+    if (inet_pton(AF_INET6, group, &addr6->sin6_addr) == 1) {
+        addr6->sin6_family = AF_INET6;
+        addr6->sin6_port = htons(DISCOVERY_PORT);
+        *len = sizeof(*addr6);
+        return IN6_IS_ADDR_MULTICAST(&addr6->sin6_addr) ? 0 : -1;
+    }
+    if (inet_pton(AF_INET, group, &addr4->sin_addr) == 1) {
+        addr4->sin_family = AF_INET;
+        addr4->sin_port = htons(DISCOVERY_PORT);
+        *len = sizeof(*addr4);
+        return IN_MULTICAST(ntohl(addr4->sin_addr.s_addr)) ? 0 : -1;
+    }
+    return -1;
+}
+
+int discovery_configure(const char *groups, const char *ifname) {
+    char parsed[DISCOVERY_MAX_GROUPS][INET6_ADDRSTRLEN];
+    int count = 0;
+    if (groups) {
+        char list[DISCOVERY_MAX_GROUPS * INET6_ADDRSTRLEN];
+        if (strlen(groups) >= sizeof(list)) {
+            errno = EINVAL;
+            return -1;
+        }
+        strcpy(list, groups);
+        char *save;
+        for (char *group = strtok_r(list, ",", &save); group; group = strtok_r(NULL, ",", &save)) {
+            struct sockaddr_storage addr;
+            socklen_t len;
+            if (count == DISCOVERY_MAX_GROUPS || strlen(group) >= INET6_ADDRSTRLEN ||
+                group_address(group, &addr, &len) < 0) {
+                errno = EINVAL;
+                return -1;
+            }
+            strcpy(parsed[count++], group);
+        }
+        if (count == 0) {
+            errno = EINVAL;
+            return -1;
+        }
+    }
+
+    unsigned int ifindex = 0;
+    if (ifname && *ifname && (ifindex = if_nametoindex(ifname)) == 0) {
+        errno = ENODEV;
+        return -1;
+    }
+
+    if (groups) {
+        memcpy(discovery_groups, parsed, sizeof(parsed));
+        discovery_group_count = count;
+    }
+    discovery_ifindex = ifindex;
+    return 0;
+}
+
+// The configured interface, else every up multicast interface with an address of the family
+static int multicast_interfaces(int family, unsigned int *indexes, int max) {
+    if (discovery_ifindex > 0) {
+        indexes[0] = discovery_ifindex;
+        return 1;
+    }
+
+    int count = 0;
+    struct ifaddrs *list;
+    if (getifaddrs(&list) == 0) {
+        for (struct ifaddrs *ifa = list; ifa != NULL; ifa = ifa->ifa_next) {
+            if (ifa->ifa_addr == NULL || ifa->ifa_addr->sa_family != family ||
+                (ifa->ifa_flags & (IFF_UP | IFF_MULTICAST)) != (IFF_UP | IFF_MULTICAST)) {
+                continue;
+            }
+            unsigned int index = if_nametoindex(ifa->ifa_name);
+            int known = 0;
+            for (int i = 0; i < count; i++) {
+                known |= indexes[i] == index;
+            }
+            if (index > 0 && !known && count < max) {
+                indexes[count++] = index;
+            }
+        }
+        freeifaddrs(list);
+    }
+
+    // None found: let the kernel route it
+    if (count == 0) {
+        indexes[count++] = 0;
+    }
+    return count;
+}
+
+// Address of the family on an interface, a global IPv6 one before a link-local one; "" if none
+static void interface_address(int family, unsigned int ifindex, char *address) {
+    address[0] = '\0';
+    struct ifaddrs *list;
+    if (ifindex == 0 || getifaddrs(&list) < 0) {
+        return;
+    }
+    for (struct ifaddrs *ifa = list; ifa != NULL; ifa = ifa->ifa_next) {
+        if (ifa->ifa_addr == NULL || ifa->ifa_addr->sa_family != family ||
+            if_nametoindex(ifa->ifa_name) != ifindex) {
+            continue;
+        }
+        if (family == AF_INET) {
+            inet_ntop(AF_INET, &((struct sockaddr_in *)ifa->ifa_addr)->sin_addr, address, INET6_ADDRSTRLEN);
+            break;
+        }
+        // A link-local address only works with the scope the receiver gets from the datagram
+        const struct in6_addr *addr6 = &((struct sockaddr_in6 *)ifa->ifa_addr)->sin6_addr;
+        if (!IN6_IS_ADDR_LINKLOCAL(addr6) || address[0] == '\0') {
+            inet_ntop(AF_INET6, addr6, address, INET6_ADDRSTRLEN);
+        }
+        if (!IN6_IS_ADDR_LINKLOCAL(addr6)) {
+            break;
+        }
+    }
+    freeifaddrs(list);
+}
+
+// Every configured group on each of its interfaces
+static int discovery_targets(struct discovery_target *targets, int max) {
+    int count = 0;
+    for (int g = 0; g < discovery_group_count; g++) {
+        struct sockaddr_storage group;
+        socklen_t len;
+        if (group_address(discovery_groups[g], &group, &len) < 0) {
+            continue;
+        }
+        unsigned int indexes[DISCOVERY_MAX_INTERFACES];
+        int interfaces = multicast_interfaces(group.ss_family, indexes, DISCOVERY_MAX_INTERFACES);
+        for (int i = 0; i < interfaces && count < max; i++) {
+            targets[count].group = group;
+            targets[count].len = len;
+            targets[count].ifindex = indexes[i];
+            interface_address(group.ss_family, indexes[i], targets[count].address);
+            count++;
+        }
+    }
+    return count;
+}
+
+// Sends out of the target's interface, named per datagram so one socket serves them all
+static ssize_t send_to_target(int fd, const void *data, size_t length, const struct discovery_target *target) {
+    struct iovec iov = { .iov_base = (void *)data, .iov_len = length };
+    union {
+        char buf[CMSG_SPACE(sizeof(struct in6_pktinfo))];
+        struct cmsghdr align;
+    } control;
+    struct msghdr msg = {
+        .msg_name = (void *)&target->group,
+        .msg_namelen = target->len,
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+    };
+
+    if (target->ifindex > 0) {
+        memset(&control, 0, sizeof(control));
+        msg.msg_control = control.buf;
+        struct cmsghdr *cmsg = (struct cmsghdr *)control.buf;
+        if (target->group.ss_family == AF_INET6) {
+            struct in6_pktinfo info = { .ipi6_ifindex = target->ifindex };
+            cmsg->cmsg_level = IPPROTO_IPV6;
+            cmsg->cmsg_type = IPV6_PKTINFO;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(info));
+            memcpy(CMSG_DATA(cmsg), &info, sizeof(info));
+            msg.msg_controllen = CMSG_SPACE(sizeof(info));
+        } else {
+            struct in_pktinfo info = { .ipi_ifindex = (int)target->ifindex };
+            cmsg->cmsg_level = IPPROTO_IP;
+            cmsg->cmsg_type = IP_PKTINFO;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(info));
+            memcpy(CMSG_DATA(cmsg), &info, sizeof(info));
+            msg.msg_controllen = CMSG_SPACE(sizeof(info));
+        }
+    }
+    return sendmsg(fd, &msg, MSG_NOSIGNAL);
+}
+
+// Socket sending to the family's groups, looped back so local clients hear it too
+static int open_sender(int family) {
+    int fd = socket(family, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        syslog(LOG_ERR, "discovery socket error : %s\n", strerror(errno));
+        return -1;
+    }
+    mcast_set_loop(fd, 1);
+    if (family == AF_INET6) {
+        const int hops = DISCOVERY_HOPS;
+        setsockopt(fd, IPPROTO_IPV6, IPV6_MULTICAST_HOPS, &hops, sizeof(hops));
+    }
+    return fd;
+}
+
+static int64_t monotonic_us(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+// Bound to the discovery port and joined to the family's groups; -1 if it has none
+static int open_receiver(int family) {
+    struct discovery_target targets[DISCOVERY_MAX_GROUPS * DISCOVERY_MAX_INTERFACES];
+    int target_count = discovery_targets(targets, DISCOVERY_MAX_GROUPS * DISCOVERY_MAX_INTERFACES);
+    int fd = -1;
+    int joined = 0;
+    for (int i = 0; i < target_count; i++) {
+        if (targets[i].group.ss_family != family) {
+            continue;
+        }
+        if (fd < 0) {
+            if ( (fd = socket(family, SOCK_DGRAM | SOCK_CLOEXEC, 0)) < 0) {
+                return -1;
+            }
+            // Allows multiple sockets to bind to the same port simultaneously
+            const int on = 1, off = 0;
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+            // Only the joined groups, and each family on its own socket
+            struct sockaddr_storage any;
+            socklen_t len;
+            memset(&any, 0, sizeof(any));
+            if (family == AF_INET6) {
+                setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &on, sizeof(on));
+                setsockopt(fd, IPPROTO_IPV6, IPV6_MULTICAST_ALL, &off, sizeof(off));
+                ((struct sockaddr_in6 *)&any)->sin6_family = AF_INET6;
+                ((struct sockaddr_in6 *)&any)->sin6_port = htons(DISCOVERY_PORT);
+                len = sizeof(struct sockaddr_in6);
+            } else {
+                setsockopt(fd, IPPROTO_IP, IP_MULTICAST_ALL, &off, sizeof(off));
+                ((struct sockaddr_in *)&any)->sin_family = AF_INET;
+                ((struct sockaddr_in *)&any)->sin_port = htons(DISCOVERY_PORT);
+                len = sizeof(struct sockaddr_in);
+            }
+            if (bind(fd, (SA *)&any, len) < 0) {
+                close(fd);
+                return -1;
+            }
+        }
+        if (mcast_join(fd, (SA *)&targets[i].group, targets[i].len, NULL, targets[i].ifindex) == 0) {
+            joined++;
+        }
+    }
+
+    if (fd >= 0 && joined == 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// A receiver per family that has groups, for announcements, and a socket per
+// family that sends DISCOVER_REQUEST and gets the answers; returns how many
+// sockets (up to 4), -1 if no group could be joined
+static int open_discovery_sockets(struct pollfd *pfds) {
+    int count = 0;
+    const int families[] = { AF_INET6, AF_INET };
+    for (int i = 0; i < 2; i++) {
+        int fd = open_receiver(families[i]);
+        if (fd >= 0) {
+            pfds[count].fd = fd;
+            pfds[count].events = POLLIN;
+            count++;
+        }
+    }
+    if (count == 0) {
+        return -1;
+    }
+
+    // Ask every server instead of waiting for its next announcement
+    struct discovery_target targets[DISCOVERY_MAX_GROUPS * DISCOVERY_MAX_INTERFACES];
+    int target_count = discovery_targets(targets, DISCOVERY_MAX_GROUPS * DISCOVERY_MAX_INTERFACES);
+    uint8_t request[TLV_HEADER_SIZE];
+    ssize_t len = tlv_create_discover_request(request);
+    for (int i = 0; i < 2; i++) {
+        int fd = -1;
+        for (int t = 0; t < target_count; t++) {
+            if (targets[t].group.ss_family != families[i]) {
+                continue;
+            }
+            if (fd < 0 && (fd = open_sender(families[i])) < 0) {
+                break;
+            }
+            send_to_target(fd, request, (size_t)len, &targets[t]);
+        }
+        if (fd >= 0) {
+            pfds[count].fd = fd;
+            pfds[count].events = POLLIN;
+            count++;
+        }
+    }
+    return count;
+}
+
+static void close_discovery_sockets(struct pollfd *pfds, int count) {
+    for (int i = 0; i < count; i++) {
+        close(pfds[i].fd);
+    }
+}
+
+// Where a datagram came from, and the interface it came in on for link-local addresses
+static void set_source(struct discovery_info *info, const struct sockaddr_storage *from) {
+    if (from->ss_family == AF_INET6) {
+        const struct sockaddr_in6 *from6 = (const struct sockaddr_in6 *)from;
+        const struct in6_addr *addr = &from6->sin6_addr;
+        info->scope_id = from6->sin6_scope_id;
+        if (IN6_IS_ADDR_V4MAPPED(addr)) {
+            inet_ntop(AF_INET, &addr->s6_addr[12], info->source, sizeof(info->source));
+        } else {
+            inet_ntop(AF_INET6, addr, info->source, sizeof(info->source));
+        }
+    } else if (from->ss_family == AF_INET) {
+        inet_ntop(AF_INET, &((const struct sockaddr_in *)from)->sin_addr, info->source, sizeof(info->source));
+    }
+}
+
+// Next announcement or answer on any socket; 1 when found, 0 on timeout, -1 on error
+static int next_announcement(struct pollfd *pfds, int count, int timeout_ms, struct discovery_info *found) {
+    int ready = poll(pfds, count, timeout_ms);
+    if (ready <= 0) {
+        return ready < 0 && errno != EINTR ? -1 : 0;
+    }
+    uint8_t datagram[MAXLINE];
+    for (int i = 0; i < count; i++) {
+        if (!(pfds[i].revents & POLLIN)) {
+            continue;
+        }
+        struct sockaddr_storage from;
+        socklen_t fromlen = sizeof(from);
+        ssize_t n = recvfrom(pfds[i].fd, datagram, sizeof(datagram), MSG_DONTWAIT, (SA *)&from, &fromlen);
+        if (n <= 0) {
+            continue;
+        }
+
+        // An answer carries the announcement as its value
+        uint16_t type, length;
+        int decoded;
+        if (n >= TLV_HEADER_SIZE && tlv_parse_header(datagram, &type, &length) == 0 &&
+            type == TLV_DISCOVER_RESPONSE && length <= n - TLV_HEADER_SIZE) {
+            decoded = discovery_decode(datagram + TLV_HEADER_SIZE, length, found);
+        } else {
+            decoded = discovery_decode(datagram, (size_t)n, found);
+        }
+        if (decoded == 0) {
+            set_source(found, &from);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Requesters waiting for the next batch of answers, each answered from the socket it asked on
+struct discovery_reply {
+    struct sockaddr_storage addr;
+    socklen_t len;
+    int fd;
+};
+
+static struct discovery_reply pending[DISCOVERY_MAX_PENDING];
+static int pending_count = 0;
+static double reply_tokens = DISCOVERY_REPLY_RATE;
+static int64_t tokens_refilled = 0;
+
+// Queue the requesters of every DISCOVER_REQUEST waiting on fd, within the rate limit
+static void receive_requests(int fd, int64_t now) {
+    struct mmsghdr msgs[DISCOVERY_BATCH];
+    struct iovec iov[DISCOVERY_BATCH];
+    struct sockaddr_storage from[DISCOVERY_BATCH];
+    uint8_t data[DISCOVERY_BATCH][TLV_HEADER_SIZE];     // Requests have no value, longer datagrams are cut
+
+    // A second's worth of answers at most, refilled as time passes
+    reply_tokens += (double)(now - tokens_refilled) * DISCOVERY_REPLY_RATE / 1000000;
+    if (reply_tokens > DISCOVERY_REPLY_RATE) {
+        reply_tokens = DISCOVERY_REPLY_RATE;
+    }
+    tokens_refilled = now;
+
+    int received;
+    do {
+        for (int i = 0; i < DISCOVERY_BATCH; i++) {
+            iov[i].iov_base = data[i];
+            iov[i].iov_len = sizeof(data[i]);
+            memset(&msgs[i].msg_hdr, 0, sizeof(msgs[i].msg_hdr));
+            msgs[i].msg_hdr.msg_name = &from[i];
+            msgs[i].msg_hdr.msg_namelen = sizeof(from[i]);
+            msgs[i].msg_hdr.msg_iov = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        received = recvmmsg(fd, msgs, DISCOVERY_BATCH, MSG_DONTWAIT, NULL);
+
+        for (int i = 0; i < received; i++) {
+            uint16_t type, length;
+            if (msgs[i].msg_len < TLV_HEADER_SIZE || tlv_parse_header(data[i], &type, &length) < 0 ||
+                type != TLV_DISCOVER_REQUEST) {
+                continue;
+            }
+            // One answer per requester, however many groups and interfaces it asked on
+            int known = 0;
+            for (int p = 0; p < pending_count && !known; p++) {
+                known = pending[p].len == msgs[i].msg_hdr.msg_namelen &&
+                        memcmp(&pending[p].addr, &from[i], pending[p].len) == 0;
+            }
+            if (known || pending_count == DISCOVERY_MAX_PENDING || reply_tokens < 1) {
+                continue;
+            }
+            reply_tokens -= 1;
+            pending[pending_count].addr = from[i];
+            pending[pending_count].len = msgs[i].msg_hdr.msg_namelen;
+            pending[pending_count].fd = fd;
+            pending_count++;
+        }
+    } while (received == DISCOVERY_BATCH);
+}
+
+// Send the answer to every queued requester, DISCOVERY_BATCH per sendmmsg()
+static void answer_requests(const uint8_t *answer, size_t length) {
+    struct mmsghdr msgs[DISCOVERY_BATCH];
+    struct iovec iov = { .iov_base = (void *)answer, .iov_len = length };
+
+    int sent = 0;
+    while (sent < pending_count) {
+        // A run of requesters that asked on the same socket
+        int fd = pending[sent].fd;
+        int batch = 0;
+        while (batch < DISCOVERY_BATCH && sent + batch < pending_count && pending[sent + batch].fd == fd) {
+            memset(&msgs[batch].msg_hdr, 0, sizeof(msgs[batch].msg_hdr));
+            msgs[batch].msg_hdr.msg_name = &pending[sent + batch].addr;
+            msgs[batch].msg_hdr.msg_namelen = pending[sent + batch].len;
+            msgs[batch].msg_hdr.msg_iov = &iov;
+            msgs[batch].msg_hdr.msg_iovlen = 1;
+            batch++;
+        }
+        int n = sendmmsg(fd, msgs, batch, MSG_DONTWAIT | MSG_NOSIGNAL);
+        // Skip an answer the socket refused, the requester still hears the announcement
+        sent += n > 0 ? n : 1;
+    }
+    pending_count = 0;
+}
+
 // Every thread function must accept a void*
 void* discovery_announce(void* arg) {
     // Unpacking the argument
     server_info_t *info = (server_info_t*)arg;
     
-    // Creating a UDP multicast socket
-    SA *sadest;
-    socklen_t salen;
-    int sendfd = snd_udp_socket("239.0.0.1", 9999, &sadest, &salen);
+    // One socket per family, one target per group and interface
+    struct discovery_target targets[DISCOVERY_MAX_GROUPS * DISCOVERY_MAX_INTERFACES];
+    int target_count = discovery_targets(targets, DISCOVERY_MAX_GROUPS * DISCOVERY_MAX_INTERFACES);
+    int sendfd4 = -1, sendfd6 = -1;
+    for (int i = 0; i < target_count; i++) {
+        if (targets[i].group.ss_family == AF_INET6 && sendfd6 < 0) {
+            sendfd6 = open_sender(AF_INET6);
+        } else if (targets[i].group.ss_family == AF_INET && sendfd4 < 0) {
+            sendfd4 = open_sender(AF_INET);
+        }
+    }
+
+    // DISCOVER_REQUEST arrives on the groups and is answered by unicast
+    struct pollfd receivers[2];
+    int receiver_count = 0;
+    const int families[] = { AF_INET6, AF_INET };
+    for (int i = 0; i < 2; i++) {
+        int fd = open_receiver(families[i]);
+        if (fd >= 0) {
+            receivers[receiver_count].fd = fd;
+            receivers[receiver_count].events = POLLIN;
+            receiver_count++;
+        }
+    }
     
-    // Infinite loop of announcements every 5 seconds
-    char announcement[MAXLINE];
+    struct discovery_info announced;
+    memset(&announced, 0, sizeof(announced));
+    strncpy(announced.ip, info->ip, sizeof(announced.ip) - 1);
+    announced.port = (uint16_t)info->port;
+    announced.server_id = info->server_id;
+
+    // Servers answering the same request spread their answers over the delay
+    tokens_refilled = monotonic_us();
+    unsigned int seed = (unsigned int)(info->server_id ^ (uint64_t)tokens_refilled);
+    int64_t announce_at = tokens_refilled;
+    int64_t answer_at = 0;
+
+    // Announcements every DISCOVERY_INTERVAL, answers in between, with the load at the time of sending
+    uint8_t announcement[MAXLINE];
+    uint8_t interface_announcement[MAXLINE];
+    uint8_t answer[MAXLINE];
     while(1) {
-	 snprintf(announcement, sizeof(announcement), 
-		   "SERVER:%s:%d", info->ip, info->port);
-        
-	 sendto(sendfd, announcement, strlen(announcement), 0, 
-		 sadest, salen);
-        
-        sleep(5);
+        int64_t now = monotonic_us();
+        if (now >= announce_at || (answer_at > 0 && now >= answer_at)) {
+            if (info->load) {
+                info->load(&announced);
+            }
+            ssize_t len = discovery_encode(announcement, sizeof(announcement), &announced);
+
+            if (now >= announce_at) {
+                // Each interface announces its own address of the group's family
+                struct discovery_info own = announced;
+                for (int i = 0; len > 0 && i < target_count; i++) {
+                    int fd = targets[i].group.ss_family == AF_INET6 ? sendfd6 : sendfd4;
+                    if (fd < 0) {
+                        continue;
+                    }
+                    uint8_t *datagram = announcement;
+                    ssize_t datagram_len = len;
+                    if (targets[i].address[0] != '\0') {
+                        strcpy(own.ip, targets[i].address);
+                        datagram = interface_announcement;
+                        datagram_len = discovery_encode(interface_announcement, sizeof(interface_announcement), &own);
+                    }
+                    if (datagram_len > 0) {
+                        send_to_target(fd, datagram, (size_t)datagram_len, &targets[i]);
+                    }
+                }
+                announce_at = now + (int64_t)DISCOVERY_INTERVAL * 1000000;
+            }
+            if (answer_at > 0 && now >= answer_at) {
+                if (len > 0) {
+                    answer_requests(answer, (size_t)tlv_create_discover_response(answer, announcement, (uint16_t)len));
+                }
+                pending_count = 0;
+                answer_at = 0;
+            }
+        }
+
+        int64_t wake = answer_at > 0 && answer_at < announce_at ? answer_at : announce_at;
+        int timeout_ms = (int)((wake - now + 999) / 1000);
+        if (poll(receivers, receiver_count, timeout_ms) <= 0) {
+            continue;
+        }
+        now = monotonic_us();
+        for (int i = 0; i < receiver_count; i++) {
+            if (receivers[i].revents & POLLIN) {
+                receive_requests(receivers[i].fd, now);
+            }
+        }
+        // The first request of a batch sets when the whole batch is answered
+        if (pending_count > 0 && answer_at == 0) {
+            answer_at = now + rand_r(&seed) % (DISCOVERY_REPLY_DELAY_MS * 1000 + 1);
+        }
     }
 }
 
-void discover_server(char *server_ip, int *server_port) {
-    // // Creating a UDP multicast socket
-    SA *sarecv;
-    socklen_t salen;
-    int recvfd = snd_udp_socket("239.0.0.1", 9999, &sarecv, &salen);
-    
-    // Allows multiple sockets to bind to the same port simultaneously
-    const int on = 1;
-    setsockopt(recvfd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
-    
-    bind(recvfd, sarecv, salen);
+// The same server, by id; legacy servers have none and are told apart by address
+static int same_server(const struct discovery_info *a, const struct discovery_info *b) {
+    if (a->version > 0 && b->version > 0) {
+        return a->server_id == b->server_id;
+    }
+    return a->version == b->version && a->port == b->port && strcmp(a->ip, b->ip) == 0;
+}
 
-    // Join multicast group
-    mcast_join(recvfd, sarecv, salen, NULL, 0);
-    
-	// Wait for the announcement
-	char line[MAXLINE];
-	ssize_t n = recvfrom(recvfd, line, MAXLINE - 1, 0, NULL, NULL);
-	if (n <= 0) {
-		server_ip[0] = '\0';
-		*server_port = 0;
-		close(recvfd);
-		return;
-	}
-	line[n] = '\0';
-
-	// Strip trailing newline/carriage return
-	char *p = line + n - 1;
-	while (p >= line && (*p == '\n' || *p == '\r')) { *p = '\0'; --p; }
-
-	// Robust parse: handle IPv4 and IPv6 addresses. Use last ':' as separator
-	const char *prefix = "SERVER:";
-	if (strncmp(line, prefix, strlen(prefix)) != 0) {
-		server_ip[0] = '\0';
-		*server_port = 0;
-		close(recvfd);
-		return;
-	}
+int discover_servers(struct discovery_info *servers, int max_servers, int window_ms) {
+    struct pollfd pfds[4];
+    int sockets = open_discovery_sockets(pfds);
+    if (sockets < 0) {
+        return -1;
+    }
 
-	char *last_colon = strrchr(line, ':');
-	if (!last_colon) {
-		server_ip[0] = '\0';
-		*server_port = 0;
-		close(recvfd);
-		return;
-	}
+    int count = 0;
+    int64_t deadline = monotonic_us() + (int64_t)window_ms * 1000;
+    for (;;) {
+        int64_t left_us = deadline - monotonic_us();
+        if (left_us <= 0) {
+            break;
+        }
+        struct discovery_info found;
+        int rc = next_announcement(pfds, sockets, (int)((left_us + 999) / 1000), &found);
+        if (rc < 0) {
+            close_discovery_sockets(pfds, sockets);
+            return -1;
+        }
+        if (rc == 0) {
+            continue;
+        }
 
-	// Parse port
-	*server_port = atoi(last_colon + 1);
+        // A server heard again, possibly on the other family: keep its latest load
+        int i = 0;
+        while (i < count && !same_server(&servers[i], &found)) {
+            i++;
+        }
+        if (i < count) {
+            servers[i] = found;
+        } else if (count < max_servers) {
+            servers[count++] = found;
+        }
+    }
 
-	// Copy IP between prefix and last_colon
-	size_t ip_len = (size_t)(last_colon - (line + strlen(prefix)));
-	if (ip_len >= INET6_ADDRSTRLEN) ip_len = INET6_ADDRSTRLEN - 1;
-	memcpy(server_ip, line + strlen(prefix), ip_len);
-	server_ip[ip_len] = '\0';
-    
-    close(recvfd);
+    close_discovery_sockets(pfds, sockets);
+    return count;
 }
 
-int start_discovery_service(const char *ip, int port) {
+// TCP address of an announced server, IPv4 as IPv4-mapped IPv6
+static int server_address(const struct discovery_info *info, const char *ip, struct sockaddr_in6 *addr) {
+    struct in_addr addr4;
+    memset(addr, 0, sizeof(*addr));
+    addr->sin6_family = AF_INET6;
+    addr->sin6_port = htons(info->port);
+    if (inet_pton(AF_INET6, ip, &addr->sin6_addr) == 1) {
+        if (IN6_IS_ADDR_LINKLOCAL(&addr->sin6_addr)) {
+            addr->sin6_scope_id = info->scope_id;
+        }
+        return 0;
+    }
+    if (inet_pton(AF_INET, ip, &addr4) != 1) {
+        return -1;
+    }
+    addr->sin6_addr.s6_addr[10] = 0xff;
+    addr->sin6_addr.s6_addr[11] = 0xff;
+    memcpy(&addr->sin6_addr.s6_addr[12], &addr4, sizeof(addr4));
+    return 0;
+}
+
+// Connect to every server at once, at the announced address and where the
+// announcement came from; rtt_us is the time the handshake took, 0 if both failed.
+// An announced address that cannot be reached (another network, NAT) is replaced
+static void probe_servers(struct discovery_info *servers, int count, int timeout_ms) {
+    int probes = 2 * count;         // Announced addresses, then sources
+    struct pollfd pfds[probes];
+    int64_t started[probes];
+    uint32_t rtt[probes];
+    int pending = 0;
+
+    for (int p = 0; p < probes; p++) {
+        struct discovery_info *server = &servers[p % count];
+        const char *ip = p < count ? server->ip : server->source;
+        struct sockaddr_in6 addr;
+        rtt[p] = 0;
+        pfds[p].fd = -1;
+        pfds[p].events = POLLOUT;
+        if ((p >= count && (ip[0] == '\0' || strcmp(ip, server->ip) == 0)) ||
+            server_address(server, ip, &addr) < 0) {
+            continue;
+        }
+        int fd = socket(AF_INET6, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        if (fd < 0) {
+            continue;
+        }
+        started[p] = monotonic_us();
+        if (connect(fd, (SA *)&addr, sizeof(addr)) < 0 && errno != EINPROGRESS) {
+            close(fd);
+            continue;
+        }
+        pfds[p].fd = fd;
+        pending++;
+    }
+
+    int64_t deadline = monotonic_us() + (int64_t)timeout_ms * 1000;
+    while (pending > 0) {
+        int64_t left_us = deadline - monotonic_us();
+        if (left_us <= 0 || poll(pfds, probes, (int)((left_us + 999) / 1000)) < 0) {
+            break;
+        }
+        int64_t now = monotonic_us();
+        for (int p = 0; p < probes; p++) {
+            if (pfds[p].fd < 0 || pfds[p].revents == 0) {
+                continue;
+            }
+            int err = 0;
+            socklen_t len = sizeof(err);
+            getsockopt(pfds[p].fd, SOL_SOCKET, SO_ERROR, &err, &len);
+            if (err == 0) {
+                int64_t elapsed = now - started[p];
+                rtt[p] = elapsed > 0 ? (uint32_t)elapsed : 1;
+            }
+            close(pfds[p].fd);
+            pfds[p].fd = -1;
+            pending--;
+        }
+    }
+    for (int p = 0; p < probes; p++) {
+        if (pfds[p].fd >= 0) {
+            close(pfds[p].fd);
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        servers[i].rtt_us = rtt[i];
+        if (rtt[i] == 0 && rtt[count + i] > 0) {
+            strcpy(servers[i].ip, servers[i].source);
+            servers[i].rtt_us = rtt[count + i];
+        }
+    }
+}
+
+// Expected cost of a server: its RTT, its loop time, and how full it is
+static double server_cost(const struct discovery_info *info) {
+    double load = info->max_connections > 0 ? (double)info->connections / info->max_connections : 0;
+    return info->rtt_us + info->loop_latency_us + load * DISCOVERY_FULL_COST_US;
+}
+
+static int compare_cost(const void *a, const void *b) {
+    double ca = server_cost(a);
+    double cb = server_cost(b);
+    return ca < cb ? -1 : ca > cb;
+}
+
+int discovery_rank(struct discovery_info *servers, int count, int probe_timeout_ms) {
+    probe_servers(servers, count, probe_timeout_ms);
+
+    // Unreachable servers are dropped
+    int reachable = 0;
+    for (int i = 0; i < count; i++) {
+        if (servers[i].rtt_us > 0) {
+            servers[reachable++] = servers[i];
+        }
+    }
+    qsort(servers, reachable, sizeof(*servers), compare_cost);
+    return reachable;
+}
+
+int start_discovery_service(const char *ip, int port, discovery_load_fn load) {
     // The structure contains the IP address and port
 	static server_info_t server_info;
 	/* Use INET6_ADDRSTRLEN to fit IPv6 and IPv4-mapped IPv6 strings */
@@ -241,6 +1052,18 @@ int start_discovery_service(const char *ip, int port) {
     
     server_info.ip = ip_copy;
     server_info.port = port;
+    server_info.load = load;
+
+    // FNV-1a of host name and port: the same server keeps its id across restarts
+    char host[256] = "";
+    gethostname(host, sizeof(host) - 1);
+    uint64_t id = 0xcbf29ce484222325ULL;
+    for (const char *c = host; *c; c++) {
+        id = (id ^ (uint8_t)*c) * 0x100000001b3ULL;
+    }
+    id = (id ^ (uint8_t)(port >> 8)) * 0x100000001b3ULL;
+    id = (id ^ (uint8_t)port) * 0x100000001b3ULL;
+    server_info.server_id = id;
     
     // Creating a thread discovery
     if (pthread_create(&discovery_thread, NULL, discovery_announce, &server_info) != 0) {
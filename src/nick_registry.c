@@ -0,0 +1,188 @@
+#include "nick_registry.h"
+#include "shared_arena.h"
+#include <stdlib.h>
+#include <string.h>
+
+struct nick_registry *server_nicks;
+
+#define SHARD_BITS  4   // log2(NICK_REGISTRY_SHARDS)
+
+_Static_assert(NICK_REGISTRY_SHARDS == 1 << SHARD_BITS, "SHARD_BITS must match NICK_REGISTRY_SHARDS");
+
+// FNV-1a over the part of the nick the server keeps; writes the key to key
+static uint32_t nick_key(const char *nick, char key[MAX_NICK_LENGTH]) {
+    uint32_t hash = 2166136261u;
+    size_t len = 0;
+    while (len < MAX_NICK_LENGTH - 1 && nick[len] != '\0') {
+        key[len] = nick[len];
+        hash = (hash ^ (uint8_t)nick[len]) * 16777619u;
+        len++;
+    }
+    memset(key + len, 0, MAX_NICK_LENGTH - len);
+    return hash;
+}
+
+static struct nick_shard *shard_of(struct nick_registry *registry, uint32_t hash) {
+    return &registry->shards[hash >> (32 - SHARD_BITS)];
+}
+
+// Slot holding the key, or the free slot ending its probe sequence
+static struct nick_slot *shard_find(struct nick_shard *shard, uint32_t hash, const char *key) {
+    uint32_t i = hash & shard->mask;
+    for (;;) {
+        struct nick_slot *slot = &shard->slots[i];
+        if (slot->owner < 0 ||
+            (slot->hash == hash && memcmp(slot->nick, key, MAX_NICK_LENGTH) == 0)) {
+            return slot;
+        }
+        i = (i + 1) & shard->mask;
+    }
+}
+
+static struct nick_slot *slots_alloc(uint32_t count) {
+    struct nick_slot *slots = shared_malloc(count * sizeof(*slots));
+    if (slots) {
+        for (uint32_t i = 0; i < count; i++) {
+            slots[i].owner = -1;
+        }
+    }
+    return slots;
+}
+
+// Double the slots of a shard, rehashing every entry
+static int shard_grow(struct nick_shard *shard) {
+    uint32_t old_count = shard->mask + 1;
+    struct nick_slot *old = shard->slots;
+    struct nick_slot *slots = slots_alloc(old_count * 2);
+    if (!slots) {
+        return -1;
+    }
+
+    shard->slots = slots;
+    shard->mask = old_count * 2 - 1;
+    for (uint32_t i = 0; i < old_count; i++) {
+        if (old[i].owner >= 0) {
+            *shard_find(shard, old[i].hash, old[i].nick) = old[i];
+        }
+    }
+    shared_free(old);
+    return 0;
+}
+
+int nick_registry_init(struct nick_registry *registry) {
+    for (int s = 0; s < NICK_REGISTRY_SHARDS; s++) {
+        struct nick_shard *shard = &registry->shards[s];
+        shard->slots = slots_alloc(NICK_REGISTRY_MIN_SLOTS);
+        if (!shard->slots) {
+            while (--s >= 0) {
+                shared_free(registry->shards[s].slots);
+            }
+            return -1;
+        }
+        shard->mask = NICK_REGISTRY_MIN_SLOTS - 1;
+        shard->count = 0;
+        shared_mutex_init(&shard->mutex);
+    }
+    return 0;
+}
+
+int nick_registry_claim(struct nick_registry *registry, const char *nick, int owner) {
+    char key[MAX_NICK_LENGTH];
+    uint32_t hash = nick_key(nick, key);
+    struct nick_shard *shard = shard_of(registry, hash);
+    int result = 0;
+
+    shared_mutex_lock(&shard->mutex);
+    struct nick_slot *slot = shard_find(shard, hash, key);
+    if (slot->owner >= 0) {
+        result = slot->owner == owner ? 0 : 1;
+    } else if ((shard->count + 1) * 2 > shard->mask + 1 && shard_grow(shard) < 0) {
+        // Keep the load factor at most 1/2, probe sequences stay short
+        result = -1;
+    } else {
+        slot = shard_find(shard, hash, key);
+        slot->hash = hash;
+        slot->owner = owner;
+        memcpy(slot->nick, key, MAX_NICK_LENGTH);
+        shard->count++;
+    }
+    pthread_mutex_unlock(&shard->mutex);
+    return result;
+}
+
+// Empty a used slot (shard mutex held)
+static void shard_remove(struct nick_shard *shard, uint32_t hole) {
+    // Backward shift: move later entries of the cluster into the hole
+    // unless that would put them before their home slot
+    uint32_t i = hole;
+    for (;;) {
+        i = (i + 1) & shard->mask;
+        struct nick_slot *next = &shard->slots[i];
+        if (next->owner < 0) {
+            break;
+        }
+        uint32_t home = next->hash & shard->mask;
+        if (((i - home) & shard->mask) >= ((i - hole) & shard->mask)) {
+            shard->slots[hole] = *next;
+            hole = i;
+        }
+    }
+    shard->slots[hole].owner = -1;
+    shard->count--;
+}
+
+void nick_registry_release(struct nick_registry *registry, const char *nick, int owner) {
+    char key[MAX_NICK_LENGTH];
+    uint32_t hash = nick_key(nick, key);
+    struct nick_shard *shard = shard_of(registry, hash);
+
+    shared_mutex_lock(&shard->mutex);
+    struct nick_slot *slot = shard_find(shard, hash, key);
+    if (slot->owner >= 0 && slot->owner == owner) {
+        shard_remove(shard, (uint32_t)(slot - shard->slots));
+    }
+    pthread_mutex_unlock(&shard->mutex);
+}
+
+uint32_t nick_registry_release_group(struct nick_registry *registry, int group) {
+    uint32_t released = 0;
+    for (int s = 0; s < NICK_REGISTRY_SHARDS; s++) {
+        struct nick_shard *shard = &registry->shards[s];
+        shared_mutex_lock(&shard->mutex);
+        uint32_t i = 0;
+        while (i <= shard->mask) {
+            struct nick_slot *slot = &shard->slots[i];
+            if (slot->owner >= 0 && NICK_OWNER_GROUP(slot->owner) == group) {
+                // The shift may move another entry into this slot, look again
+                shard_remove(shard, i);
+                released++;
+            } else {
+                i++;
+            }
+        }
+        pthread_mutex_unlock(&shard->mutex);
+    }
+    return released;
+}
+
+int nick_registry_owner(struct nick_registry *registry, const char *nick) {
+    char key[MAX_NICK_LENGTH];
+    uint32_t hash = nick_key(nick, key);
+    struct nick_shard *shard = shard_of(registry, hash);
+
+    shared_mutex_lock(&shard->mutex);
+    int owner = shard_find(shard, hash, key)->owner;
+    pthread_mutex_unlock(&shard->mutex);
+    return owner < 0 ? -1 : owner;
+}
+
+uint32_t nick_registry_count(struct nick_registry *registry) {
+    uint32_t count = 0;
+    for (int s = 0; s < NICK_REGISTRY_SHARDS; s++) {
+        struct nick_shard *shard = &registry->shards[s];
+        shared_mutex_lock(&shard->mutex);
+        count += shard->count;
+        pthread_mutex_unlock(&shard->mutex);
+    }
+    return count;
+}
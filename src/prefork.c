@@ -0,0 +1,179 @@
+#define _GNU_SOURCE  // prctl() options
+#include "prefork.h"
+#include "async_log.h"
+#include "shared_arena.h"
+#include <errno.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Read by every process (the metrics exporter lives in a worker)
+struct prefork_state {
+    int workers;
+    pid_t pids[PREFORK_MAX_WORKERS];
+    _Atomic uint64_t restarts;
+};
+
+static struct prefork_state *state = NULL;
+static volatile sig_atomic_t stopping = 0;
+
+static void request_stop(int signo) {
+    (void)signo;
+    stopping = 1;
+}
+
+// Fork one worker; returns 0 in the worker, the pid in the master, -1 on error
+static pid_t fork_worker(int worker) {
+    pid_t master = getpid();
+    pid_t pid = fork();
+    if (pid != 0) {
+        if (pid > 0) {
+            state->pids[worker] = pid;
+        }
+        return pid;
+    }
+
+    // The master's stop handler is not the worker's
+    signal(SIGTERM, SIG_DFL);
+    signal(SIGINT, SIG_DFL);
+    prctl(PR_SET_PDEATHSIG, SIGTERM);
+    if (getppid() != master) {
+        _exit(0);  // The master died before prctl()
+    }
+    return 0;
+}
+
+static int find_worker(pid_t pid) {
+    for (int i = 0; i < state->workers; i++) {
+        if (state->pids[i] == pid) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Stop every worker and run the last housekeeping round
+static void stop_workers(void (*housekeeping)(int final)) {
+    for (int i = 0; i < state->workers; i++) {
+        if (state->pids[i] > 0) {
+            kill(state->pids[i], SIGTERM);
+        }
+    }
+    while (wait(NULL) > 0 || errno == EINTR) {
+    }
+
+    // Last round for what the workers queued before they stopped, unless a
+    // dead worker may have left it torn: the restarted server replays the log
+    if (housekeeping && !shared_arena_poisoned()) {
+        housekeeping(1);
+    }
+}
+
+static void shutdown_workers(void (*housekeeping)(int final)) {
+    stop_workers(housekeeping);
+    async_log(LOG_NOTICE, "Master stopped with its workers");
+    exit(EXIT_SUCCESS);
+}
+
+int prefork_start(int workers, void (*housekeeping)(int final), void (*worker_exited)(int worker)) {
+    if (workers < 1 || workers > PREFORK_MAX_WORKERS) {
+        return -1;
+    }
+    state = shared_calloc(1, sizeof(*state));
+    if (!state) {
+        return -1;
+    }
+    state->workers = workers;
+
+    struct sigaction stop_action;
+    memset(&stop_action, 0, sizeof(stop_action));
+    stop_action.sa_handler = request_stop;
+    sigaction(SIGTERM, &stop_action, NULL);
+    sigaction(SIGINT, &stop_action, NULL);
+
+    int started = 0;
+    for (int i = 0; i < workers; i++) {
+        pid_t pid = fork_worker(i);
+        if (pid == 0) {
+            return i;
+        }
+        if (pid < 0) {
+            async_log(LOG_ERR, "Cannot fork worker %d: %s", i, strerror(errno));
+        } else {
+            started++;
+        }
+    }
+    if (started == 0) {
+        return -1;
+    }
+    async_log(LOG_NOTICE, "Master %d supervising %d workers", (int)getpid(), started);
+
+    for (;;) {
+        if (stopping) {
+            shutdown_workers(housekeeping);
+        }
+
+        if (housekeeping) {
+            housekeeping(0);
+        } else {
+            sleep(1);
+        }
+
+        // Reap workers that exited and start their replacements
+        int status;
+        pid_t pid;
+        while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+            int worker = find_worker(pid);
+            if (worker < 0) {
+                continue;
+            }
+            state->pids[worker] = 0;
+            if (WIFSIGNALED(status)) {
+                async_log(LOG_ERR, "Worker %d (pid %d) killed by signal %d",
+                          worker, (int)pid, WTERMSIG(status));
+            } else {
+                async_log(LOG_ERR, "Worker %d (pid %d) exited with status %d",
+                          worker, (int)pid, WEXITSTATUS(status));
+            }
+            if (worker_exited) {
+                worker_exited(worker);
+            }
+        }
+
+        // Restarting workers would not repair what the dead one left half updated
+        if (shared_arena_poisoned()) {
+            async_log(LOG_CRIT, "A worker died holding a shared lock, restarting the server");
+            stop_workers(housekeeping);
+            return PREFORK_RESTART;
+        }
+
+        // Empty slots: just reaped, or a fork that failed earlier
+        for (int i = 0; i < state->workers && !stopping; i++) {
+            if (state->pids[i] != 0) {
+                continue;
+            }
+            pid = fork_worker(i);
+            if (pid == 0) {
+                return i;
+            }
+            if (pid < 0) {
+                async_log(LOG_ERR, "Cannot restart worker %d: %s", i, strerror(errno));
+            } else {
+                atomic_fetch_add_explicit(&state->restarts, 1, memory_order_relaxed);
+                async_log(LOG_NOTICE, "Worker %d restarted as pid %d", i, (int)pid);
+            }
+        }
+    }
+}
+
+uint64_t prefork_restarts(void) {
+    return state ? atomic_load_explicit(&state->restarts, memory_order_relaxed) : 0;
+}
+
+int prefork_workers(void) {
+    return state ? state->workers : 0;
+}
@@ -0,0 +1,243 @@
+#include "question_bank.h"
+#include "async_log.h"
+#include "shared_arena.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+
+// Banks sorted by name; pointers stay valid because each bank is allocated separately
+static struct question_bank **banks = NULL;
+static int banks_count = 0;
+static int banks_capacity = 0;
+static pthread_mutex_t banks_mutex = PTHREAD_MUTEX_INITIALIZER;   // Guards loading only
+
+// bsearch() comparator: name key against a bank pointer
+static int compare_bank_name(const void *key, const void *elem) {
+    const struct question_bank *bank = *(const struct question_bank * const *)elem;
+    return strcmp((const char *)key, bank->name);
+}
+
+// Release a bank that failed to load or register; windows below ready are
+// initialized, the leaderboard too if ready is past RANKING_WINDOW_ALL
+static void bank_free(struct question_bank *bank, int ready) {
+    for (int w = RANKING_WINDOW_ALL + 1; w < ready; w++) {
+        ranking_window_destroy(&bank->windows[w]);
+    }
+    if (ready > RANKING_WINDOW_ALL) {
+        leaderboard_destroy(&bank->leaderboard);
+    }
+    selector_store_destroy(&bank->selectors);
+    shared_free(bank->question_stats);
+    quiz_free_questions(&bank->db);
+    shared_free(bank);
+}
+
+// Parse a question file into a bank that is not registered yet
+static struct question_bank *bank_create(const char *name, const char *filepath) {
+    // Cache line aligned for the statistics shards, shared by pre-forked workers
+    struct question_bank *bank = shared_aligned_alloc(sizeof(*bank));
+    if (!bank) {
+        return NULL;
+    }
+    memset(bank, 0, sizeof(*bank));
+
+    if (quiz_load_questions(&bank->db, filepath) < 0) {
+        shared_free(bank);
+        return NULL;
+    }
+    selector_store_init(&bank->selectors, bank->db.count);
+
+    bank->question_stats = question_stats_alloc(bank->db.count);
+    if (!bank->question_stats) {
+        bank_free(bank, RANKING_WINDOW_ALL);
+        return NULL;
+    }
+
+    if (leaderboard_init(&bank->leaderboard) < 0) {
+        bank_free(bank, RANKING_WINDOW_ALL);
+        return NULL;
+    }
+
+    time_t now = time(NULL);
+    for (int w = RANKING_WINDOW_ALL + 1; w < RANKING_WINDOWS; w++) {
+        if (ranking_window_init(&bank->windows[w], w, now) < 0) {
+            bank_free(bank, w);
+            return NULL;
+        }
+    }
+
+    strncpy(bank->name, name, MAX_BANK_NAME - 1);
+    bank->name[MAX_BANK_NAME - 1] = '\0';
+    stats_init(&bank->stats);
+    return bank;
+}
+
+// Add a bank to the sorted array; 1 if the name is taken, -1 if memory ran out
+static int bank_register(struct question_bank *bank) {
+    pthread_mutex_lock(&banks_mutex);
+    if (bsearch(bank->name, banks, banks_count, sizeof(*banks), compare_bank_name) != NULL) {
+        pthread_mutex_unlock(&banks_mutex);
+        return 1;
+    }
+    if (banks_count == banks_capacity) {
+        int cap = banks_capacity ? banks_capacity * 2 : 8;
+        struct question_bank **grown = realloc(banks, cap * sizeof(*banks));
+        if (!grown) {
+            pthread_mutex_unlock(&banks_mutex);
+            return -1;
+        }
+        banks = grown;
+        banks_capacity = cap;
+    }
+
+    // Keep the array sorted for bank_find()
+    int pos = banks_count;
+    while (pos > 0 && strcmp(banks[pos - 1]->name, bank->name) > 0) {
+        banks[pos] = banks[pos - 1];
+        pos--;
+    }
+    banks[pos] = bank;
+    banks_count++;
+    pthread_mutex_unlock(&banks_mutex);
+    return 0;
+}
+
+int bank_load_file(const char *name, const char *filepath) {
+    if (name[0] == '\0') {
+        async_log(LOG_WARNING, "Empty question bank name in %s", filepath);
+        return -1;
+    }
+
+    struct question_bank *bank = bank_create(name, filepath);
+    if (!bank) {
+        return -1;
+    }
+    int registered = bank_register(bank);
+    if (registered != 0) {
+        async_log(LOG_WARNING, registered > 0 ? "Duplicate question bank name '%s' in %s"
+                                              : "Out of memory registering question bank '%s' from %s",
+                  name, filepath);
+        bank_free(bank, RANKING_WINDOWS);
+        return -1;
+    }
+
+    async_log(LOG_INFO, "Question bank '%s': %d questions", bank->name, bank->db.count);
+    return 0;
+}
+
+// Files of a directory, parsed by several threads
+struct bank_job {
+    char name[MAX_BANK_NAME];
+    char path[4096];
+};
+
+struct bank_jobs {
+    struct bank_job *jobs;
+    int count;
+    _Atomic int next;               // Next job to take
+    _Atomic int loaded;
+};
+
+static void *bank_load_worker(void *arg) {
+    struct bank_jobs *work = arg;
+    int i;
+    while ((i = atomic_fetch_add(&work->next, 1)) < work->count) {
+        if (bank_load_file(work->jobs[i].name, work->jobs[i].path) == 0) {
+            atomic_fetch_add(&work->loaded, 1);
+        }
+    }
+    return NULL;
+}
+
+int bank_load_directory(const char *dirpath) {
+    DIR *dir = opendir(dirpath);
+    if (!dir) {
+        async_log(LOG_ERR, "Failed to open question bank directory: %s", dirpath);
+        return -1;
+    }
+
+    struct bank_jobs work = { NULL, 0, 0, 0 };
+    int capacity = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        size_t len = strlen(entry->d_name);
+        const char *suffix = ".json";
+        size_t suffix_len = strlen(suffix);
+        if (len <= suffix_len || strcmp(entry->d_name + len - suffix_len, suffix) != 0) {
+            continue;
+        }
+        if (len - suffix_len >= MAX_BANK_NAME) {
+            async_log(LOG_WARNING, "Skipping %s: bank name too long", entry->d_name);
+            continue;
+        }
+
+        if (work.count == capacity) {
+            capacity = capacity ? capacity * 2 : 16;
+            struct bank_job *grown = realloc(work.jobs, capacity * sizeof(*grown));
+            if (!grown) {
+                async_log(LOG_ERR, "Out of memory listing %s", dirpath);
+                break;
+            }
+            work.jobs = grown;
+        }
+        struct bank_job *job = &work.jobs[work.count++];
+        memcpy(job->name, entry->d_name, len - suffix_len);
+        job->name[len - suffix_len] = '\0';
+        snprintf(job->path, sizeof(job->path), "%s/%s", dirpath, entry->d_name);
+    }
+    closedir(dir);
+
+    // Parsing dominates startup: one thread per core, the caller being one of them
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    int threads = work.count < BANK_LOAD_THREADS ? work.count : BANK_LOAD_THREADS;
+    if (cores > 0 && threads > cores) {
+        threads = (int)cores;
+    }
+    pthread_t tids[BANK_LOAD_THREADS];
+    int started = 0;
+    while (started < threads - 1 && pthread_create(&tids[started], NULL, bank_load_worker, &work) == 0) {
+        started++;
+    }
+    bank_load_worker(&work);
+    for (int i = 0; i < started; i++) {
+        pthread_join(tids[i], NULL);
+    }
+
+    free(work.jobs);
+    return atomic_load(&work.loaded);
+}
+
+struct question_bank *bank_find(const char *name) {
+    if (name == NULL || name[0] == '\0') {
+        return bank_default();
+    }
+
+    struct question_bank **found = bsearch(name, banks, banks_count, sizeof(*banks), compare_bank_name);
+    return found ? *found : NULL;
+}
+
+struct leaderboard *bank_leaderboard(struct question_bank *bank, int window, time_t now) {
+    if (window == RANKING_WINDOW_ALL) {
+        return &bank->leaderboard;
+    }
+    if (window < 0 || window >= RANKING_WINDOWS) {
+        return NULL;
+    }
+    return ranking_window_board(&bank->windows[window], window, now);
+}
+
+struct question_bank *bank_default(void) {
+    return banks_count > 0 ? banks[0] : NULL;
+}
+
+int bank_count(void) {
+    return banks_count;
+}
+
+struct question_bank *bank_at(int index) {
+    return (index >= 0 && index < banks_count) ? banks[index] : NULL;
+}
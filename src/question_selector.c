@@ -0,0 +1,270 @@
+#include "question_selector.h"
+#include "shared_arena.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Draw weight for each level: missed questions first, mastered ones rarely
+static const uint32_t level_weights[SELECTOR_LEVELS] = { 8, 16, 8, 4, 2, 1, 1, 1 };
+
+static int get_level(const QuestionSelector *sel, int i) {
+    uint8_t byte = sel->levels[i >> 1];
+    return (i & 1) ? (byte >> 4) : (byte & 0x0F);
+}
+
+static void put_level(QuestionSelector *sel, int i, int level) {
+    uint8_t *byte = &sel->levels[i >> 1];
+    if (i & 1) {
+        *byte = (uint8_t)((*byte & 0x0F) | (level << 4));
+    } else {
+        *byte = (uint8_t)((*byte & 0xF0) | level);
+    }
+}
+
+static int is_cooling(const QuestionSelector *sel, int i) {
+    return (sel->cooling[i >> 6] >> (i & 63)) & 1;
+}
+
+static uint32_t weight_of(const QuestionSelector *sel, int i) {
+    return is_cooling(sel, i) ? 0 : level_weights[get_level(sel, i)];
+}
+
+// Add delta to the block containing question i (unsigned wrap handles negatives)
+static void tree_add(QuestionSelector *sel, int i, uint32_t delta) {
+    for (int b = i / SELECTOR_BLOCK + 1; b <= sel->num_blocks; b += b & -b) {
+        sel->tree[b] += delta;
+    }
+    sel->total += delta;
+}
+
+// Change level and cooldown flag of question i, keeping the tree in sync
+static void set_state(QuestionSelector *sel, int i, int level, int cooling) {
+    uint32_t before = weight_of(sel, i);
+
+    put_level(sel, i, level);
+    if (cooling) {
+        sel->cooling[i >> 6] |= (uint64_t)1 << (i & 63);
+    } else {
+        sel->cooling[i >> 6] &= ~((uint64_t)1 << (i & 63));
+    }
+
+    uint32_t after = weight_of(sel, i);
+    if (after != before) {
+        tree_add(sel, i, after - before);
+    }
+}
+
+// Take the oldest question off cooldown
+static void release_oldest(QuestionSelector *sel) {
+    int slot = sel->cooldown_pos;
+    int i = sel->cooldown[slot];
+    if (i >= 0) {
+        set_state(sel, i, get_level(sel, i), 0);
+        sel->cooldown[slot] = -1;
+    }
+    sel->cooldown_pos = (slot + 1) % SELECTOR_COOLDOWN;
+}
+
+int selector_init(QuestionSelector *sel, int num_questions) {
+    memset(sel, 0, sizeof(*sel));
+    if (num_questions < 0) {
+        return -1;
+    }
+
+    sel->num_questions = num_questions;
+    sel->num_blocks = (num_questions + SELECTOR_BLOCK - 1) / SELECTOR_BLOCK;
+    sel->levels = shared_calloc((num_questions + 1) / 2 + 1, 1);
+    sel->cooling = shared_calloc((num_questions + 63) / 64 + 1, sizeof(uint64_t));
+    sel->tree = shared_calloc(sel->num_blocks + 1, sizeof(uint32_t));
+    if (!sel->levels || !sel->cooling || !sel->tree) {
+        selector_free(sel);
+        return -1;
+    }
+
+    for (int k = 0; k < SELECTOR_COOLDOWN; k++) {
+        sel->cooldown[k] = -1;
+    }
+
+    // Every question starts unseen; build the tree bottom-up in O(n)
+    for (int b = 1; b <= sel->num_blocks; b++) {
+        int first = (b - 1) * SELECTOR_BLOCK;
+        int in_block = num_questions - first < SELECTOR_BLOCK ? num_questions - first : SELECTOR_BLOCK;
+        sel->tree[b] += (uint32_t)in_block * level_weights[0];
+        sel->total += (uint32_t)in_block * level_weights[0];
+
+        int parent = b + (b & -b);
+        if (parent <= sel->num_blocks) {
+            sel->tree[parent] += sel->tree[b];
+        }
+    }
+
+    return 0;
+}
+
+void selector_free(QuestionSelector *sel) {
+    shared_free(sel->levels);
+    shared_free(sel->cooling);
+    shared_free(sel->tree);
+    memset(sel, 0, sizeof(*sel));
+}
+
+int selector_next(QuestionSelector *sel) {
+    if (sel->num_questions == 0) {
+        return -1;
+    }
+
+    // Small banks can have every question on cooldown
+    while (sel->total == 0) {
+        release_oldest(sel);
+    }
+
+    uint32_t r = (uint32_t)rand() % sel->total;
+
+    // Descend the Fenwick tree to the block holding the r-th unit of weight
+    int pos = 0;
+    int step = 1;
+    while (step * 2 <= sel->num_blocks) {
+        step *= 2;
+    }
+    for (; step > 0; step >>= 1) {
+        if (pos + step <= sel->num_blocks && sel->tree[pos + step] <= r) {
+            pos += step;
+            r -= sel->tree[pos];
+        }
+    }
+
+    // Scan the block for the question itself
+    int first = pos * SELECTOR_BLOCK;
+    int last = first + SELECTOR_BLOCK < sel->num_questions ? first + SELECTOR_BLOCK : sel->num_questions;
+    int index = last - 1;
+    for (int i = first; i < last; i++) {
+        uint32_t w = weight_of(sel, i);
+        if (r < w) {
+            index = i;
+            break;
+        }
+        r -= w;
+    }
+
+    // Hold the question back for the next few draws
+    release_oldest(sel);
+    sel->cooldown[(sel->cooldown_pos + SELECTOR_COOLDOWN - 1) % SELECTOR_COOLDOWN] = index;
+    set_state(sel, index, get_level(sel, index), 1);
+
+    return index;
+}
+
+void selector_record(QuestionSelector *sel, int index, int correct) {
+    if (index < 0 || index >= sel->num_questions) {
+        return;
+    }
+
+    int level = get_level(sel, index);
+    if (!correct) {
+        level = 1;
+    } else if (level == 0) {
+        level = 3;  // Known at first sight
+    } else if (level < SELECTOR_LEVELS - 1) {
+        level++;
+    }
+
+    set_state(sel, index, level, is_cooling(sel, index));
+}
+
+static uint32_t hash_nick(const char *nick) {
+    uint32_t h = 2166136261u;  // FNV-1a
+    while (*nick) {
+        h ^= (unsigned char)*nick++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// Slot holding the nick, or the empty slot where it would go
+static uint32_t find_slot(const SelectorStore *store, const char *nick) {
+    uint32_t mask = store->slot_count - 1;
+    uint32_t slot = hash_nick(nick) & mask;
+    while (store->slots[slot] && strcmp(store->slots[slot]->nick, nick) != 0) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+// Double the nick table; players are never removed, so no tombstones are needed
+static int grow_slots(SelectorStore *store) {
+    uint32_t old_count = store->slot_count;
+    SelectorEntry **old = store->slots;
+    SelectorEntry **grown = shared_calloc(old_count ? old_count * 2 : 64, sizeof(*grown));
+    if (!grown) {
+        return -1;
+    }
+
+    store->slots = grown;
+    store->slot_count = old_count ? old_count * 2 : 64;
+    for (uint32_t i = 0; i < old_count; i++) {
+        if (old[i]) {
+            store->slots[find_slot(store, old[i]->nick)] = old[i];
+        }
+    }
+    shared_free(old);
+    return 0;
+}
+
+// State of a player, NULL if they have none; the store lock is held
+static SelectorEntry *find_entry(const SelectorStore *store, const char *nick) {
+    return store->slot_count ? store->slots[find_slot(store, nick)] : NULL;
+}
+
+void selector_store_init(SelectorStore *store, int num_questions) {
+    memset(store, 0, sizeof(*store));
+    store->num_questions = num_questions;
+    shared_mutex_init(&store->mutex);
+}
+
+void selector_store_destroy(SelectorStore *store) {
+    for (uint32_t i = 0; i < store->slot_count; i++) {
+        if (store->slots[i]) {
+            selector_free(&store->slots[i]->sel);
+            shared_free(store->slots[i]);
+        }
+    }
+    shared_free(store->slots);
+    pthread_mutex_destroy(&store->mutex);
+}
+
+int selector_store_next(SelectorStore *store, const char *nick) {
+    if (nick[0] == '\0') {
+        return -1;
+    }
+
+    shared_mutex_lock(&store->mutex);
+    SelectorEntry *entry = find_entry(store, nick);
+    if (!entry) {
+        if ((store->count + 1) * 2 > store->slot_count && grow_slots(store) < 0) {
+            pthread_mutex_unlock(&store->mutex);
+            return -1;
+        }
+        entry = shared_malloc(sizeof(*entry));
+        if (!entry || selector_init(&entry->sel, store->num_questions) < 0) {
+            shared_free(entry);
+            pthread_mutex_unlock(&store->mutex);
+            return -1;
+        }
+        strncpy(entry->nick, nick, sizeof(entry->nick) - 1);
+        entry->nick[sizeof(entry->nick) - 1] = '\0';
+        store->slots[find_slot(store, entry->nick)] = entry;
+        store->count++;
+    }
+
+    int index = selector_next(&entry->sel);
+    pthread_mutex_unlock(&store->mutex);
+    return index;
+}
+
+void selector_store_record(SelectorStore *store, const char *nick, int index, int correct) {
+    shared_mutex_lock(&store->mutex);
+    SelectorEntry *entry = find_entry(store, nick);
+    if (entry) {
+        selector_record(&entry->sel, index, correct);
+    }
+    pthread_mutex_unlock(&store->mutex);
+}
@@ -0,0 +1,118 @@
+#include "question_stats.h"
+#include "question_bank.h"
+#include "shared_arena.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Single writer: a plain load and store, no locked read-modify-write.
+// Pre-forked workers share the counters and need the locked add.
+#define BUMP(counter, delta) \
+    do { \
+        if (shared_arena_active()) { \
+            atomic_fetch_add_explicit(&(counter), (delta), memory_order_relaxed); \
+        } else { \
+            atomic_store_explicit(&(counter), \
+                                  atomic_load_explicit(&(counter), memory_order_relaxed) + (delta), \
+                                  memory_order_relaxed); \
+        } \
+    } while (0)
+
+#define LOAD(counter) atomic_load_explicit(&(counter), memory_order_relaxed)
+
+struct question_counters *question_stats_alloc(int count) {
+    size_t size = (size_t)(count > 0 ? count : 1) * sizeof(struct question_counters);
+    struct question_counters *counters = shared_aligned_alloc(size);
+    if (counters) {
+        memset(counters, 0, size);
+    }
+    return counters;
+}
+
+void question_stats_asked(struct question_counters *counters) {
+    BUMP(counters->asked, 1);
+}
+
+void question_stats_answered(struct question_counters *counters, int answer_index, uint64_t response_ns) {
+    if (answer_index < 0 || answer_index >= MAX_ANSWERS_PER_Q) {
+        return;
+    }
+    BUMP(counters->chosen[answer_index], 1);
+    BUMP(counters->response_us, response_ns / 1000);
+}
+
+void question_stats_read(struct question_counters *counters, const Question *question,
+                         struct question_summary *out) {
+    memset(out, 0, sizeof(*out));
+    out->id = (uint32_t)question->id;
+    out->num_answers = (uint8_t)question->num_odpowiedzi;
+    out->correct_answer = (uint8_t)(question->poprawna - 1);
+    out->asked = LOAD(counters->asked);
+
+    uint64_t answered = 0;
+    for (int a = 0; a < MAX_ANSWERS_PER_Q; a++) {
+        out->chosen[a] = LOAD(counters->chosen[a]);
+        answered += out->chosen[a];
+    }
+    if (answered > 0) {
+        out->mean_response_ms = (uint32_t)(LOAD(counters->response_us) / answered / 1000);
+    }
+}
+
+uint64_t question_stats_total(void) {
+    uint64_t total = 0;
+    for (int b = 0; b < bank_count(); b++) {
+        struct question_bank *bank = bank_at(b);
+        for (int i = 0; i < bank->db.count; i++) {
+            struct question_counters *c = &bank->question_stats[i];
+            total += LOAD(c->asked);
+            for (int a = 0; a < MAX_ANSWERS_PER_Q; a++) {
+                total += LOAD(c->chosen[a]);
+            }
+        }
+    }
+    return total;
+}
+
+long question_stats_dump(const char *path) {
+    char tmp_path[4096 + 8];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    FILE *file = fopen(tmp_path, "we");
+    if (!file) {
+        return -1;
+    }
+
+    fprintf(file, "bank,question_id,asked,answered,correct,correct_rate,mean_response_ms,"
+                  "chosen_1,chosen_2,chosen_3,chosen_4\n");
+
+    long written = 0;
+    for (int b = 0; b < bank_count(); b++) {
+        struct question_bank *bank = bank_at(b);
+        for (int i = 0; i < bank->db.count; i++) {
+            struct question_summary s;
+            question_stats_read(&bank->question_stats[i], &bank->db.questions[i], &s);
+
+            uint32_t answered = 0;
+            for (int a = 0; a < MAX_ANSWERS_PER_Q; a++) {
+                answered += s.chosen[a];
+            }
+            uint32_t correct = s.correct_answer < MAX_ANSWERS_PER_Q ? s.chosen[s.correct_answer] : 0;
+
+            fprintf(file, "%s,%u,%u,%u,%u,%.3f,%u,%u,%u,%u,%u\n",
+                    bank->name, s.id, s.asked, answered, correct,
+                    answered ? (double)correct / answered : 0.0, s.mean_response_ms,
+                    s.chosen[0], s.chosen[1], s.chosen[2], s.chosen[3]);
+            written++;
+        }
+    }
+
+    int failed = fflush(file) != 0 || ferror(file);
+    failed |= fclose(file) != 0;
+    if (failed || rename(tmp_path, path) < 0) {
+        unlink(tmp_path);
+        return -1;
+    }
+    return written;
+}
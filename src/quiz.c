@@ -1,15 +1,41 @@
 #include "quiz.h"
+#include "async_log.h"
+#include "text_validate.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
-#include <syslog.h>
+#include <strings.h>
+#include <ctype.h>
+
+// Get the ID of a tag, registering it on first use
+static int quiz_intern_tag(QuizDatabase *db, const char *name) {
+    char lower[MAX_TAG_NAME];
+    size_t len = strlen(name);
+    if (len == 0 || len >= MAX_TAG_NAME || text_validate_utf8(name, len) < 0) {
+        return -1;
+    }
+    for (size_t i = 0; i <= len; i++) {
+        lower[i] = tolower((unsigned char)name[i]);
+    }
+
+    int id = quiz_find_tag(db, lower);
+    if (id >= 0) {
+        return id;
+    }
+    if (db->tag_count >= MAX_TAGS) {
+        async_log(LOG_WARNING, "Too many tags, ignoring '%s'", name);
+        return -1;
+    }
+    strcpy(db->tag_names[db->tag_count], lower);
+    return db->tag_count++;
+}
 
 // Load questions from JSON file
 int quiz_load_questions(QuizDatabase *db, const char *filepath) {
     FILE *fp = fopen(filepath, "r");
     if (!fp) {
-        syslog(LOG_ERR, "Failed to open questions file: %s", filepath);
+        async_log(LOG_ERR, "Failed to open questions file: %s", filepath);
         return -1;
     }
 
@@ -36,26 +62,39 @@ int quiz_load_questions(QuizDatabase *db, const char *filepath) {
 
     // Using the CJSON library to convert JSON text into an object tree
     // The first element of the array is an object containing the fields id, question, answers, correct
+    // Bank version for monitoring: any edit of the file changes it
+    db->version = 14695981039346656037ull;  // FNV-1a
+    for (long i = 0; i < fsize; i++) {
+        db->version ^= (unsigned char)json_str[i];
+        db->version *= 1099511628211ull;
+    }
+
     cJSON *root = cJSON_Parse(json_str);
     free(json_str);
 
     if (!root) {
-        syslog(LOG_ERR, "JSON parse error");
+        async_log(LOG_ERR, "JSON parse error");
         return -1;
     }
 
     // Validation - root should be array
     if (!cJSON_IsArray(root)) {
-        syslog(LOG_ERR, "JSON root is not an array");
+        async_log(LOG_ERR, "JSON root is not an array");
         cJSON_Delete(root);
         return -1;
     }
 
-    db->count = 0;
+    quiz_free_questions(db);
     int array_size = cJSON_GetArraySize(root);
+    db->questions = calloc(array_size > 0 ? array_size : 1, sizeof(Question));
+    if (!db->questions) {
+        cJSON_Delete(root);
+        return -1;
+    }
 
-    for (int i = 0; i < array_size && db->count < MAX_QUESTIONS; i++) {
-        cJSON *item = cJSON_GetArrayItem(root, i);
+    // cJSON arrays are linked lists: walk them, indexing would rescan from the head
+    cJSON *item;
+    cJSON_ArrayForEach(item, root) {
         if (!cJSON_IsObject(item)) continue;
 
         // Pointer in the questions array where the new question is saved
@@ -89,17 +128,60 @@ int quiz_load_questions(QuizDatabase *db, const char *filepath) {
             }
         }
 
+        // Everything sent to clients must be UTF-8, also where a long text was cut
+        int valid = text_validate_utf8(q->pytanie, strlen(q->pytanie));
+        for (int j = 0; j < q->num_odpowiedzi && valid == 0; j++) {
+            valid = text_validate_utf8(q->odpowiedzi[j], strlen(q->odpowiedzi[j]));
+        }
+        if (valid < 0) {
+            async_log(LOG_WARNING, "Skipping question %d in %s: text is not valid UTF-8", q->id, filepath);
+            continue;
+        }
+
         // Parse correct answer
         cJSON *poprawna_json = cJSON_GetObjectItem(item, "poprawna");
         if (!cJSON_IsNumber(poprawna_json)) continue;
         q->poprawna = poprawna_json->valueint;
 
+        // Parse optional tags and index the question under each of them
+        q->num_tags = 0;
+        cJSON *tags_json = cJSON_GetObjectItem(item, "tags");
+        if (cJSON_IsArray(tags_json)) {
+            int tag_count = cJSON_GetArraySize(tags_json);
+            for (int j = 0; j < tag_count && q->num_tags < MAX_TAGS_PER_Q; j++) {
+                cJSON *tag = cJSON_GetArrayItem(tags_json, j);
+                if (!cJSON_IsString(tag)) continue;
+
+                int tag_id = quiz_intern_tag(db, tag->valuestring);
+                if (tag_id < 0) continue;
+                q->tags[q->num_tags++] = tag_id;
+                roaring_add(&db->tag_index[tag_id], db->count);
+            }
+        }
+
+        // Index the words of the question and its answers
+        int indexed = search_index_add(&db->search, db->count, q->pytanie);
+        for (int j = 0; j < q->num_odpowiedzi && indexed == 0; j++) {
+            indexed = search_index_add(&db->search, db->count, q->odpowiedzi[j]);
+        }
+        if (indexed < 0) {
+            async_log(LOG_ERR, "Out of memory while indexing %s", filepath);
+            cJSON_Delete(root);
+            quiz_free_questions(db);
+            return -1;
+        }
+
         // Index increment
         db->count++;
     }
 
     cJSON_Delete(root);
-    syslog(LOG_INFO, "Loaded %d questions from %s", db->count, filepath);
+    if (search_index_finalize(&db->search) < 0) {
+        async_log(LOG_ERR, "Out of memory while indexing %s", filepath);
+        quiz_free_questions(db);
+        return -1;
+    }
+    async_log(LOG_INFO, "Loaded %d questions with %d tags from %s", db->count, db->tag_count, filepath);
     
     // Seed random for quiz_get_random_question
     srand(time(NULL));
@@ -107,6 +189,18 @@ int quiz_load_questions(QuizDatabase *db, const char *filepath) {
     return 0;
 }
 
+// Release questions, tag index and search index
+void quiz_free_questions(QuizDatabase *db) {
+    free(db->questions);
+    db->questions = NULL;
+    db->count = 0;
+    for (int t = 0; t < MAX_TAGS; t++) {
+        roaring_free(&db->tag_index[t]);
+    }
+    db->tag_count = 0;
+    search_index_free(&db->search);
+}
+
 // Get random question
 Question* quiz_get_random_question(QuizDatabase *db) {
     if (db->count == 0) {
@@ -116,6 +210,86 @@ Question* quiz_get_random_question(QuizDatabase *db) {
     return &db->questions[index];
 }
 
+// Find tag ID by name
+int quiz_find_tag(const QuizDatabase *db, const char *name) {
+    for (int t = 0; t < db->tag_count; t++) {
+        if (strcasecmp(db->tag_names[t], name) == 0) {
+            return t;
+        }
+    }
+    return -1;
+}
+
+// Get random question matching a tag filter
+Question* quiz_get_random_tagged_question(QuizDatabase *db, int match_all,
+                                          const int *tag_ids, int num_tags) {
+    if (num_tags <= 0) {
+        return NULL;
+    }
+
+    // Intersections are cheapest when they start from the smallest bitmap
+    int order[MAX_TAGS_PER_Q * 2];
+    if (num_tags > (int)(sizeof(order) / sizeof(order[0]))) {
+        num_tags = sizeof(order) / sizeof(order[0]);
+    }
+    for (int i = 0; i < num_tags; i++) {
+        order[i] = tag_ids[i];
+    }
+    for (int i = 1; i < num_tags; i++) {
+        int key = order[i];
+        uint32_t key_card = roaring_cardinality(&db->tag_index[key]);
+        int j = i - 1;
+        while (j >= 0 && roaring_cardinality(&db->tag_index[order[j]]) > key_card) {
+            order[j + 1] = order[j];
+            j--;
+        }
+        order[j + 1] = key;
+    }
+
+    RoaringBitmap result, scratch;
+    roaring_init(&result);
+    roaring_init(&scratch);
+
+    int rc = roaring_copy(&db->tag_index[order[0]], &result);
+    for (int i = 1; i < num_tags && rc == 0; i++) {
+        if (match_all && result.count == 0) {
+            break;
+        }
+        rc = match_all ? roaring_and(&result, &db->tag_index[order[i]], &scratch)
+                       : roaring_or(&result, &db->tag_index[order[i]], &scratch);
+        RoaringBitmap tmp = result;
+        result = scratch;
+        scratch = tmp;
+    }
+
+    Question *q = NULL;
+    uint32_t card = roaring_cardinality(&result);
+    uint32_t index;
+    if (rc == 0 && card > 0 && roaring_select(&result, (uint32_t)rand() % card, &index) == 0
+        && index < (uint32_t)db->count) {
+        q = &db->questions[index];
+    }
+
+    roaring_free(&result);
+    roaring_free(&scratch);
+    return q;
+}
+
+// Find questions containing every word of a query
+int quiz_search_questions(const QuizDatabase *db, const char *query, int *ids, int max_ids) {
+    uint32_t docs[MAX_SEARCH_RESULTS];
+
+    if (max_ids > MAX_SEARCH_RESULTS) {
+        max_ids = MAX_SEARCH_RESULTS;
+    }
+
+    int found = search_index_query(&db->search, query, docs, max_ids);
+    for (int i = 0; i < found; i++) {
+        ids[i] = db->questions[docs[i]].id;
+    }
+    return found;
+}
+
 // Get question by ID
 Question* quiz_get_question_by_id(QuizDatabase *db, int id) {
     for (int i = 0; i < db->count; i++) {
@@ -0,0 +1,342 @@
+#define _GNU_SOURCE  // SCHED_IDLE
+#include "ranking_window.h"
+#include "async_log.h"
+#include "shared_arena.h"
+#include "tlv.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Term start dates, sorted by month and day
+static int term_months[RANKING_WINDOW_MAX_TERMS] = { 10, 2 };
+static int term_days[RANKING_WINDOW_MAX_TERMS] = { 1, 20 };
+static int term_count = 2;
+
+struct retired_board {
+    struct leaderboard *board;
+    time_t retired_at;
+};
+
+struct janitor_state {
+    pthread_mutex_t mutex;
+    pthread_cond_t wake;
+    int running;                        // Ended boards are queued, not freed by the reactor
+    int grace;                          // Seconds a retired board stays allocated
+
+    struct ranking_window **windows;    // Every initialized window, to refill next
+    int window_count, window_capacity;
+
+    struct retired_board *retired;      // Boards of ended windows, to free
+    int retired_count, retired_capacity;
+};
+
+static struct janitor_state local_janitor = {
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .wake = PTHREAD_COND_INITIALIZER,
+};
+
+// In the shared arena once workers may be pre-forked, local_janitor otherwise
+static struct janitor_state *janitor = &local_janitor;
+
+int ranking_window_set_terms(const char *spec) {
+    int months[RANKING_WINDOW_MAX_TERMS], days[RANKING_WINDOW_MAX_TERMS];
+    int count = 0;
+
+    const char *p = spec;
+    while (*p) {
+        int month, day, used;
+        if (count == RANKING_WINDOW_MAX_TERMS || sscanf(p, "%2d-%2d%n", &month, &day, &used) != 2 ||
+            month < 1 || month > 12 || day < 1 || day > 31) {
+            return -1;
+        }
+        p += used;
+        if (*p == ',') {
+            p++;
+        } else if (*p != '\0') {
+            return -1;
+        }
+
+        // Insertion sort, the list is tiny
+        int pos = count++;
+        while (pos > 0 && months[pos - 1] * 32 + days[pos - 1] > month * 32 + day) {
+            months[pos] = months[pos - 1];
+            days[pos] = days[pos - 1];
+            pos--;
+        }
+        months[pos] = month;
+        days[pos] = day;
+    }
+    if (count == 0) {
+        return -1;
+    }
+
+    memcpy(term_months, months, sizeof(months));
+    memcpy(term_days, days, sizeof(days));
+    term_count = count;
+    return 0;
+}
+
+// Local midnight of a date; mktime() normalizes day overflow and finds the DST offset
+static time_t local_midnight(int year, int month, int day) {
+    struct tm tm = { 0 };
+    tm.tm_year = year;
+    tm.tm_mon = month;
+    tm.tm_mday = day;
+    tm.tm_isdst = -1;
+    return mktime(&tm);
+}
+
+// Window of a kind that contains now
+static void window_bounds(int window, time_t now, time_t *start, time_t *end) {
+    struct tm tm;
+    localtime_r(&now, &tm);
+
+    if (window == RANKING_WINDOW_DAY) {
+        *start = local_midnight(tm.tm_year, tm.tm_mon, tm.tm_mday);
+        *end = local_midnight(tm.tm_year, tm.tm_mon, tm.tm_mday + 1);
+    } else if (window == RANKING_WINDOW_WEEK) {
+        int since_monday = (tm.tm_wday + 6) % 7;
+        *start = local_midnight(tm.tm_year, tm.tm_mon, tm.tm_mday - since_monday);
+        *end = local_midnight(tm.tm_year, tm.tm_mon, tm.tm_mday - since_monday + 7);
+    } else {
+        // Last term start up to now and the first one after it, over three years
+        *start = 0;
+        *end = 0;
+        for (int year = tm.tm_year - 1; year <= tm.tm_year + 1; year++) {
+            for (int i = 0; i < term_count; i++) {
+                time_t t = local_midnight(year, term_months[i] - 1, term_days[i]);
+                if (t <= now && t > *start) {
+                    *start = t;
+                } else if (t > now && (*end == 0 || t < *end)) {
+                    *end = t;
+                }
+            }
+        }
+    }
+}
+
+static struct leaderboard *board_create(void) {
+    struct leaderboard *board = shared_malloc(sizeof(*board));
+    if (board && leaderboard_init(board) < 0) {
+        shared_free(board);
+        board = NULL;
+    }
+    return board;
+}
+
+static void board_free(struct leaderboard *board) {
+    leaderboard_destroy(board);
+    shared_free(board);
+}
+
+// Move the janitor to the shared arena before the first window is registered.
+// The master services it; a worker may still read a board it just retired,
+// so boards are freed only after a grace period.
+static int janitor_share(void) {
+    static pthread_mutex_t share_mutex = PTHREAD_MUTEX_INITIALIZER;  // Banks load in parallel
+    pthread_mutex_lock(&share_mutex);
+    if (janitor != &local_janitor || !shared_arena_active()) {
+        pthread_mutex_unlock(&share_mutex);
+        return 0;
+    }
+    struct janitor_state *shared = shared_calloc(1, sizeof(*shared));
+    if (!shared || shared_mutex_init(&shared->mutex) != 0 || shared_cond_init(&shared->wake) != 0) {
+        pthread_mutex_unlock(&share_mutex);
+        shared_free(shared);
+        return -1;
+    }
+    shared->running = 1;
+    shared->grace = RANKING_WINDOW_GRACE;
+    janitor = shared;
+    pthread_mutex_unlock(&share_mutex);
+    return 0;
+}
+
+int ranking_window_init(struct ranking_window *w, int window, time_t now) {
+    if (janitor_share() < 0) {
+        return -1;
+    }
+
+    memset(w, 0, sizeof(*w));
+    struct leaderboard *current = board_create();
+    w->next = board_create();
+    if (!current || !w->next) {
+        if (current) board_free(current);
+        if (w->next) board_free(w->next);
+        return -1;
+    }
+    time_t start, end;
+    window_bounds(window, now, &start, &end);
+    atomic_init(&w->current, current);
+    atomic_init(&w->start, start);
+    atomic_init(&w->end, end);
+
+    shared_mutex_lock(&janitor->mutex);
+    if (janitor->window_count == janitor->window_capacity) {
+        int cap = janitor->window_capacity ? janitor->window_capacity * 2 : 16;
+        struct ranking_window **grown = shared_realloc(janitor->windows, cap * sizeof(*grown));
+        if (!grown) {
+            pthread_mutex_unlock(&janitor->mutex);
+            board_free(current);
+            board_free(w->next);
+            return -1;
+        }
+        janitor->windows = grown;
+        janitor->window_capacity = cap;
+    }
+    janitor->windows[janitor->window_count++] = w;
+    pthread_mutex_unlock(&janitor->mutex);
+    return 0;
+}
+
+void ranking_window_destroy(struct ranking_window *w) {
+    shared_mutex_lock(&janitor->mutex);
+    for (int i = 0; i < janitor->window_count; i++) {
+        if (janitor->windows[i] == w) {
+            janitor->windows[i] = janitor->windows[--janitor->window_count];
+            break;
+        }
+    }
+    struct leaderboard *next = w->next;
+    w->next = NULL;
+    pthread_mutex_unlock(&janitor->mutex);
+
+    if (next) {
+        board_free(next);
+    }
+    board_free(atomic_load_explicit(&w->current, memory_order_relaxed));
+    atomic_store_explicit(&w->current, NULL, memory_order_relaxed);
+}
+
+struct leaderboard *ranking_window_board(struct ranking_window *w, int window, time_t now) {
+    // end is published last, so a board read after it belongs to that window
+    time_t end = atomic_load_explicit(&w->end, memory_order_acquire);
+    if (now >= atomic_load_explicit(&w->start, memory_order_relaxed) && now < end) {
+        return atomic_load_explicit(&w->current, memory_order_relaxed);
+    }
+
+    // Rollover: take the prepared board, unless another worker rolled over meanwhile
+    shared_mutex_lock(&janitor->mutex);
+    if (now >= atomic_load_explicit(&w->start, memory_order_relaxed) &&
+        now < atomic_load_explicit(&w->end, memory_order_relaxed)) {
+        pthread_mutex_unlock(&janitor->mutex);
+        return atomic_load_explicit(&w->current, memory_order_relaxed);
+    }
+    struct leaderboard *fresh = w->next;
+    w->next = NULL;
+
+    // Without a prepared board the work happens here, rarely
+    if (!fresh) {
+        fresh = board_create();
+        if (!fresh) {
+            // Keep the old results rather than lose the window
+            pthread_mutex_unlock(&janitor->mutex);
+            async_log(LOG_ERR, "Ranking window rollover failed: out of memory");
+            return atomic_load_explicit(&w->current, memory_order_relaxed);
+        }
+    }
+
+    // The janitor frees the old board and prepares the next one
+    time_t start;
+    window_bounds(window, now, &start, &end);
+    struct leaderboard *old = atomic_load_explicit(&w->current, memory_order_relaxed);
+    atomic_store_explicit(&w->current, fresh, memory_order_relaxed);
+    atomic_store_explicit(&w->start, start, memory_order_relaxed);
+    atomic_store_explicit(&w->end, end, memory_order_release);
+
+    if (janitor->running && janitor->retired_count == janitor->retired_capacity) {
+        int cap = janitor->retired_capacity ? janitor->retired_capacity * 2 : 16;
+        struct retired_board *grown = shared_realloc(janitor->retired, cap * sizeof(*grown));
+        if (grown) {
+            janitor->retired = grown;
+            janitor->retired_capacity = cap;
+        }
+    }
+    int queued = janitor->running && janitor->retired_count < janitor->retired_capacity;
+    if (queued) {
+        janitor->retired[janitor->retired_count++] = (struct retired_board){ old, now };
+    }
+    pthread_cond_signal(&janitor->wake);
+    pthread_mutex_unlock(&janitor->mutex);
+
+    if (!queued) {
+        board_free(old);
+    }
+    return fresh;
+}
+
+// Free retired boards past their grace period and refill next boards (mutex held).
+// Returns the number of boards still waiting for their grace period to end.
+static int janitor_step(void) {
+    // Free ended windows outside the lock; the oldest are at the front
+    time_t now = time(NULL);
+    while (janitor->retired_count > 0 && now - janitor->retired[0].retired_at >= janitor->grace) {
+        struct leaderboard *board = janitor->retired[0].board;
+        janitor->retired_count--;
+        memmove(&janitor->retired[0], &janitor->retired[1],
+                janitor->retired_count * sizeof(janitor->retired[0]));
+        pthread_mutex_unlock(&janitor->mutex);
+        board_free(board);
+        shared_mutex_lock(&janitor->mutex);
+    }
+
+    // Prepare the next board of windows that used theirs
+    for (int i = 0; i < janitor->window_count; i++) {
+        if (janitor->windows[i]->next != NULL) {
+            continue;
+        }
+        pthread_mutex_unlock(&janitor->mutex);
+        struct leaderboard *board = board_create();
+        shared_mutex_lock(&janitor->mutex);
+        if (!board) {
+            break;
+        }
+        // Windows may have been unregistered meanwhile, moving the last one to i
+        if (i < janitor->window_count && janitor->windows[i]->next == NULL) {
+            janitor->windows[i]->next = board;
+        } else {
+            board_free(board);
+        }
+    }
+    return janitor->retired_count;
+}
+
+static void *janitor_thread(void *arg) {
+    (void)arg;
+
+    // Freeing a board is never urgent: run only when the event loop leaves the CPU idle
+    struct sched_param param = { .sched_priority = 0 };
+    pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+
+    shared_mutex_lock(&janitor->mutex);
+    for (;;) {
+        // Sleep until woken, or until the oldest retired board's grace period ends
+        struct timespec deadline = { 0, 0 };
+        if (janitor_step() > 0) {
+            deadline.tv_sec = janitor->retired[0].retired_at + janitor->grace;
+        }
+        shared_cond_wait(&janitor->wake, &janitor->mutex, deadline.tv_sec ? &deadline : NULL);
+    }
+    return NULL;
+}
+
+int ranking_window_start(void) {
+    pthread_t tid;
+    shared_mutex_lock(&janitor->mutex);
+    if (pthread_create(&tid, NULL, janitor_thread, NULL) != 0) {
+        pthread_mutex_unlock(&janitor->mutex);
+        return -1;
+    }
+    pthread_detach(tid);
+    janitor->running = 1;
+    pthread_mutex_unlock(&janitor->mutex);
+    return 0;
+}
+
+void ranking_window_service(void) {
+    shared_mutex_lock(&janitor->mutex);
+    janitor_step();
+    pthread_mutex_unlock(&janitor->mutex);
+}
@@ -0,0 +1,417 @@
+#include "roaring_bitmap.h"
+#include <stdlib.h>
+#include <string.h>
+
+static void container_free(RoaringContainer *c) {
+    free(c->array);
+    free(c->words);
+    c->array = NULL;
+    c->words = NULL;
+}
+
+// Convert a full array container into a bitmap container
+static int container_to_bitmap(RoaringContainer *c) {
+    uint64_t *words = calloc(ROARING_BITMAP_WORDS, sizeof(uint64_t));
+    if (!words) {
+        return -1;
+    }
+    for (uint32_t i = 0; i < c->cardinality; i++) {
+        words[c->array[i] >> 6] |= (uint64_t)1 << (c->array[i] & 63);
+    }
+    free(c->array);
+    c->array = NULL;
+    c->capacity = 0;
+    c->words = words;
+    c->is_bitmap = 1;
+    return 0;
+}
+
+// Convert a sparse bitmap container into an array container
+static int container_to_array(RoaringContainer *c) {
+    uint16_t *array = malloc((c->cardinality ? c->cardinality : 1) * sizeof(uint16_t));
+    if (!array) {
+        return -1;
+    }
+    uint32_t n = 0;
+    for (int w = 0; w < ROARING_BITMAP_WORDS; w++) {
+        uint64_t bits = c->words[w];
+        while (bits) {
+            array[n++] = (uint16_t)(w * 64 + __builtin_ctzll(bits));
+            bits &= bits - 1;
+        }
+    }
+    free(c->words);
+    c->words = NULL;
+    c->array = array;
+    c->capacity = c->cardinality ? c->cardinality : 1;
+    c->is_bitmap = 0;
+    return 0;
+}
+
+// Binary search for a container key; returns index or -(insertion point) - 1
+static int find_container(const RoaringBitmap *bm, uint16_t key) {
+    int lo = 0, hi = bm->count - 1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        if (bm->containers[mid].key == key) return mid;
+        if (bm->containers[mid].key < key) lo = mid + 1;
+        else hi = mid - 1;
+    }
+    return -(lo + 1);
+}
+
+// Append an empty container (keys must be appended in increasing order)
+static RoaringContainer *append_container(RoaringBitmap *bm, uint16_t key) {
+    if (bm->count == bm->capacity) {
+        int cap = bm->capacity ? bm->capacity * 2 : 4;
+        RoaringContainer *grown = realloc(bm->containers, cap * sizeof(RoaringContainer));
+        if (!grown) {
+            return NULL;
+        }
+        bm->containers = grown;
+        bm->capacity = cap;
+    }
+    RoaringContainer *c = &bm->containers[bm->count++];
+    memset(c, 0, sizeof(*c));
+    c->key = key;
+    return c;
+}
+
+void roaring_init(RoaringBitmap *bm) {
+    memset(bm, 0, sizeof(*bm));
+}
+
+void roaring_free(RoaringBitmap *bm) {
+    for (int i = 0; i < bm->count; i++) {
+        container_free(&bm->containers[i]);
+    }
+    free(bm->containers);
+    memset(bm, 0, sizeof(*bm));
+}
+
+int roaring_add(RoaringBitmap *bm, uint32_t value) {
+    uint16_t key = value >> 16;
+    uint16_t low = value & 0xFFFF;
+
+    int idx = find_container(bm, key);
+    if (idx < 0) {
+        // New container, keep containers sorted by key
+        int at = -idx - 1;
+        if (!append_container(bm, key)) {
+            return -1;
+        }
+        RoaringContainer fresh = bm->containers[bm->count - 1];
+        memmove(&bm->containers[at + 1], &bm->containers[at],
+                (bm->count - 1 - at) * sizeof(RoaringContainer));
+        bm->containers[at] = fresh;
+        idx = at;
+    }
+
+    RoaringContainer *c = &bm->containers[idx];
+    if (c->is_bitmap) {
+        uint64_t bit = (uint64_t)1 << (low & 63);
+        if (!(c->words[low >> 6] & bit)) {
+            c->words[low >> 6] |= bit;
+            c->cardinality++;
+        }
+        return 0;
+    }
+
+    // Sorted insert into the array; appending in order is the common case
+    uint32_t pos = c->cardinality;
+    if (pos > 0 && c->array[pos - 1] >= low) {
+        uint32_t lo = 0, hi = c->cardinality;
+        while (lo < hi) {
+            uint32_t mid = (lo + hi) / 2;
+            if (c->array[mid] < low) lo = mid + 1;
+            else hi = mid;
+        }
+        if (lo < c->cardinality && c->array[lo] == low) {
+            return 0;
+        }
+        pos = lo;
+    }
+
+    if (c->cardinality == ROARING_ARRAY_MAX) {
+        if (container_to_bitmap(c) < 0) {
+            return -1;
+        }
+        c->words[low >> 6] |= (uint64_t)1 << (low & 63);
+        c->cardinality++;
+        return 0;
+    }
+
+    if (c->cardinality == c->capacity) {
+        uint32_t cap = c->capacity ? c->capacity * 2 : 4;
+        if (cap > ROARING_ARRAY_MAX) cap = ROARING_ARRAY_MAX;
+        uint16_t *grown = realloc(c->array, cap * sizeof(uint16_t));
+        if (!grown) {
+            return -1;
+        }
+        c->array = grown;
+        c->capacity = cap;
+    }
+
+    memmove(&c->array[pos + 1], &c->array[pos], (c->cardinality - pos) * sizeof(uint16_t));
+    c->array[pos] = low;
+    c->cardinality++;
+    return 0;
+}
+
+int roaring_contains(const RoaringBitmap *bm, uint32_t value) {
+    int idx = find_container(bm, value >> 16);
+    if (idx < 0) {
+        return 0;
+    }
+
+    const RoaringContainer *c = &bm->containers[idx];
+    uint16_t low = value & 0xFFFF;
+    if (c->is_bitmap) {
+        return (c->words[low >> 6] >> (low & 63)) & 1;
+    }
+
+    uint32_t lo = 0, hi = c->cardinality;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (c->array[mid] < low) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo < c->cardinality && c->array[lo] == low;
+}
+
+uint32_t roaring_cardinality(const RoaringBitmap *bm) {
+    uint32_t total = 0;
+    for (int i = 0; i < bm->count; i++) {
+        total += bm->containers[i].cardinality;
+    }
+    return total;
+}
+
+// Intersect two containers with the same key into out (appended to result)
+static int container_and(const RoaringContainer *a, const RoaringContainer *b, RoaringBitmap *out) {
+    // Let a be the array container when there is one
+    if (a->is_bitmap && !b->is_bitmap) {
+        const RoaringContainer *t = a; a = b; b = t;
+    }
+
+    if (a->is_bitmap) {
+        // bitmap AND bitmap
+        uint32_t card = 0;
+        for (int w = 0; w < ROARING_BITMAP_WORDS; w++) {
+            card += __builtin_popcountll(a->words[w] & b->words[w]);
+        }
+        if (card == 0) {
+            return 0;
+        }
+        RoaringContainer *c = append_container(out, a->key);
+        if (!c) return -1;
+        c->words = malloc(ROARING_BITMAP_WORDS * sizeof(uint64_t));
+        if (!c->words) return -1;
+        for (int w = 0; w < ROARING_BITMAP_WORDS; w++) {
+            c->words[w] = a->words[w] & b->words[w];
+        }
+        c->is_bitmap = 1;
+        c->cardinality = card;
+        return card <= ROARING_ARRAY_MAX ? container_to_array(c) : 0;
+    }
+
+    uint32_t max = a->cardinality < b->cardinality ? a->cardinality : b->cardinality;
+    uint16_t *array = malloc((max ? max : 1) * sizeof(uint16_t));
+    if (!array) return -1;
+
+    uint32_t n = 0;
+    if (b->is_bitmap) {
+        // array AND bitmap: probe every array value
+        for (uint32_t i = 0; i < a->cardinality; i++) {
+            uint16_t v = a->array[i];
+            if ((b->words[v >> 6] >> (v & 63)) & 1) {
+                array[n++] = v;
+            }
+        }
+    } else {
+        // array AND array: merge
+        uint32_t i = 0, j = 0;
+        while (i < a->cardinality && j < b->cardinality) {
+            if (a->array[i] < b->array[j]) i++;
+            else if (a->array[i] > b->array[j]) j++;
+            else { array[n++] = a->array[i]; i++; j++; }
+        }
+    }
+
+    if (n == 0) {
+        free(array);
+        return 0;
+    }
+    RoaringContainer *c = append_container(out, a->key);
+    if (!c) {
+        free(array);
+        return -1;
+    }
+    c->array = array;
+    c->capacity = max ? max : 1;
+    c->cardinality = n;
+    return 0;
+}
+
+// Copy a container into the result
+static int container_copy(const RoaringContainer *src, RoaringBitmap *out) {
+    RoaringContainer *c = append_container(out, src->key);
+    if (!c) return -1;
+    c->is_bitmap = src->is_bitmap;
+    c->cardinality = src->cardinality;
+    if (src->is_bitmap) {
+        c->words = malloc(ROARING_BITMAP_WORDS * sizeof(uint64_t));
+        if (!c->words) return -1;
+        memcpy(c->words, src->words, ROARING_BITMAP_WORDS * sizeof(uint64_t));
+    } else {
+        c->capacity = src->cardinality ? src->cardinality : 1;
+        c->array = malloc(c->capacity * sizeof(uint16_t));
+        if (!c->array) return -1;
+        memcpy(c->array, src->array, src->cardinality * sizeof(uint16_t));
+    }
+    return 0;
+}
+
+// Union of two containers with the same key (appended to result)
+static int container_or(const RoaringContainer *a, const RoaringContainer *b, RoaringBitmap *out) {
+    if (!a->is_bitmap && !b->is_bitmap && a->cardinality + b->cardinality <= ROARING_ARRAY_MAX) {
+        // array OR array: merge
+        uint32_t max = a->cardinality + b->cardinality;
+        uint16_t *array = malloc((max ? max : 1) * sizeof(uint16_t));
+        if (!array) return -1;
+
+        uint32_t i = 0, j = 0, n = 0;
+        while (i < a->cardinality || j < b->cardinality) {
+            if (j >= b->cardinality || (i < a->cardinality && a->array[i] < b->array[j])) {
+                array[n++] = a->array[i++];
+            } else if (i >= a->cardinality || b->array[j] < a->array[i]) {
+                array[n++] = b->array[j++];
+            } else {
+                array[n++] = a->array[i];
+                i++; j++;
+            }
+        }
+
+        RoaringContainer *c = append_container(out, a->key);
+        if (!c) {
+            free(array);
+            return -1;
+        }
+        c->array = array;
+        c->capacity = max ? max : 1;
+        c->cardinality = n;
+        return 0;
+    }
+
+    // Anything else produces a bitmap
+    RoaringContainer *c = append_container(out, a->key);
+    if (!c) return -1;
+    c->words = calloc(ROARING_BITMAP_WORDS, sizeof(uint64_t));
+    if (!c->words) return -1;
+    c->is_bitmap = 1;
+
+    const RoaringContainer *parts[2] = { a, b };
+    for (int p = 0; p < 2; p++) {
+        if (parts[p]->is_bitmap) {
+            for (int w = 0; w < ROARING_BITMAP_WORDS; w++) {
+                c->words[w] |= parts[p]->words[w];
+            }
+        } else {
+            for (uint32_t i = 0; i < parts[p]->cardinality; i++) {
+                uint16_t v = parts[p]->array[i];
+                c->words[v >> 6] |= (uint64_t)1 << (v & 63);
+            }
+        }
+    }
+
+    uint32_t card = 0;
+    for (int w = 0; w < ROARING_BITMAP_WORDS; w++) {
+        card += __builtin_popcountll(c->words[w]);
+    }
+    c->cardinality = card;
+    return card <= ROARING_ARRAY_MAX ? container_to_array(c) : 0;
+}
+
+int roaring_and(const RoaringBitmap *a, const RoaringBitmap *b, RoaringBitmap *out) {
+    roaring_free(out);
+
+    int i = 0, j = 0;
+    while (i < a->count && j < b->count) {
+        uint16_t ka = a->containers[i].key;
+        uint16_t kb = b->containers[j].key;
+        if (ka < kb) {
+            i++;
+        } else if (ka > kb) {
+            j++;
+        } else {
+            if (container_and(&a->containers[i], &b->containers[j], out) < 0) {
+                return -1;
+            }
+            i++;
+            j++;
+        }
+    }
+    return 0;
+}
+
+int roaring_or(const RoaringBitmap *a, const RoaringBitmap *b, RoaringBitmap *out) {
+    roaring_free(out);
+
+    int i = 0, j = 0;
+    while (i < a->count || j < b->count) {
+        int rc;
+        if (j >= b->count || (i < a->count && a->containers[i].key < b->containers[j].key)) {
+            rc = container_copy(&a->containers[i++], out);
+        } else if (i >= a->count || b->containers[j].key < a->containers[i].key) {
+            rc = container_copy(&b->containers[j++], out);
+        } else {
+            rc = container_or(&a->containers[i++], &b->containers[j++], out);
+        }
+        if (rc < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int roaring_copy(const RoaringBitmap *src, RoaringBitmap *dst) {
+    roaring_free(dst);
+    for (int i = 0; i < src->count; i++) {
+        if (container_copy(&src->containers[i], dst) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int roaring_select(const RoaringBitmap *bm, uint32_t rank, uint32_t *value) {
+    for (int i = 0; i < bm->count; i++) {
+        const RoaringContainer *c = &bm->containers[i];
+        if (rank >= c->cardinality) {
+            rank -= c->cardinality;
+            continue;
+        }
+
+        uint32_t high = (uint32_t)c->key << 16;
+        if (!c->is_bitmap) {
+            *value = high | c->array[rank];
+            return 0;
+        }
+
+        // Skip whole words by popcount, then clear low bits inside the word
+        for (int w = 0; w < ROARING_BITMAP_WORDS; w++) {
+            uint32_t bits_in_word = __builtin_popcountll(c->words[w]);
+            if (rank >= bits_in_word) {
+                rank -= bits_in_word;
+                continue;
+            }
+            uint64_t bits = c->words[w];
+            while (rank--) {
+                bits &= bits - 1;
+            }
+            *value = high | (uint32_t)(w * 64 + __builtin_ctzll(bits));
+            return 0;
+        }
+    }
+    return -1;
+}
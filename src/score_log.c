@@ -0,0 +1,961 @@
+#include "score_log.h"
+#include "async_log.h"
+#include "question_bank.h"
+#include "question_stats.h"
+#include "shared_arena.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+ * File formats (host byte order, the files never leave the machine):
+ *
+ * scores.wal   u32 magic, u32 version, u64 generation, then records:
+ *              u32 crc, u8 type, u8 bank_len, u8 nick_len, u8 score,
+ *              u32 time_seconds, bank, nick
+ *              The CRC covers the record after the crc field. Counter
+ *              records (RECORD_QUESTIONS) have no nick and carry the
+ *              value in the time field.
+ *
+ * scores.snap  u32 magic, u32 version, u64 generation, u32 bank_count,
+ *              then per bank: name, u32 tests_completed, u32 questions_asked,
+ *              u32 total_score, u8 best_score, u32 best_time, best_player,
+ *              u32 entry_count, entries (nick, u8 score, u32 time) in rank
+ *              order; strings are u8 length + bytes. A CRC32 of everything
+ *              before it ends the file.
+ */
+
+#define WAL_MAGIC           0x4C415751  // "QWAL"
+#define SNAP_MAGIC          0x504E5351  // "QSNP"
+#define FORMAT_VERSION      1
+#define WAL_HEADER_SIZE     16
+#define RECORD_HEADER_SIZE  12
+#define RECORD_SCORE        1   // Finished test
+#define RECORD_QUESTIONS    2   // Questions asked so far in a bank (in time_seconds)
+#define REPLAY_WINDOW       16  // Records whose hash lookups are prefetched together
+
+// Best result of one player, as seen by the log
+struct shadow_entry {
+    char nick[MAX_NICK_LENGTH];
+    uint8_t score;
+    uint32_t time_seconds;
+    uint64_t arrival;               // Breaks ties like the leaderboard
+};
+
+// State of one bank rebuilt from the log, owned by the writer thread
+struct shadow_bank {
+    char name[MAX_BANK_NAME];
+    struct server_stats stats;
+    struct shadow_entry *entries;
+    uint32_t count, capacity;
+    uint32_t *slots;                // Nick -> entry index + 1, open addressing
+    uint32_t slot_count;
+};
+
+// Producer side: records queued by the event loop(s) for the writer
+struct score_queue {
+    pthread_mutex_t mutex;
+    pthread_cond_t wake;            // Signals the writer
+    pthread_cond_t flushed;         // Signals score_log_flush()
+    uint8_t *pending;
+    size_t pending_len, pending_cap;
+    uint64_t queued, written;       // Events queued / durable
+    uint64_t dropped;
+};
+
+static struct score_queue local_queue = {
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .wake = PTHREAD_COND_INITIALIZER,
+    .flushed = PTHREAD_COND_INITIALIZER,
+};
+
+static struct {
+    char wal_path[PATH_MAX];
+    char snap_path[PATH_MAX];
+    char stats_path[PATH_MAX];      // Question statistics dump
+    char dir[PATH_MAX];
+    int fd;
+    uint64_t generation;            // Generation of the open log
+    int rotate;                     // A snapshot covers the open log, nothing more goes into it
+    off_t valid_length;             // Log bytes that passed the CRC check
+    int started;
+
+    // In the shared arena when workers are pre-forked, local_queue otherwise
+    struct score_queue *queue;
+
+    // Writer side
+    uint8_t *batch;                 // Swapped with the pending buffer
+    size_t batch_cap;
+    size_t unwritten;               // Event bytes at the start of batch whose write failed
+    uint64_t unwritten_last;        // Events they cover
+    struct shadow_bank *banks;
+    int bank_count;
+    uint64_t arrivals;
+    uint64_t events_since_snapshot;
+    time_t last_snapshot;
+    uint64_t stats_dumped;          // question_stats_total() at the last dump
+    time_t last_stats_dump;
+} score_log = {
+    .fd = -1,
+    .queue = &local_queue,
+};
+
+static uint32_t crc_table[256];
+
+static void crc32_init(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) {
+            c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        }
+        crc_table[i] = c;
+    }
+}
+
+static uint32_t crc32_update(uint32_t crc, const void *data, size_t len) {
+    const uint8_t *p = data;
+    crc = ~crc;
+    while (len--) {
+        crc = crc_table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+static uint32_t hash_nick(const char *nick) {
+    uint32_t h = 2166136261u;  // FNV-1a
+    while (*nick) {
+        h ^= (unsigned char)*nick++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static struct shadow_bank *shadow_find(const char *name, int create) {
+    for (int i = 0; i < score_log.bank_count; i++) {
+        if (strcmp(score_log.banks[i].name, name) == 0) {
+            return &score_log.banks[i];
+        }
+    }
+    if (!create) {
+        return NULL;
+    }
+
+    struct shadow_bank *grown = realloc(score_log.banks, (score_log.bank_count + 1) * sizeof(*grown));
+    if (!grown) {
+        return NULL;
+    }
+    score_log.banks = grown;
+
+    struct shadow_bank *bank = &score_log.banks[score_log.bank_count++];
+    memset(bank, 0, sizeof(*bank));
+    strncpy(bank->name, name, MAX_BANK_NAME - 1);
+    strcpy(bank->stats.best_player, "N/A");
+    return bank;
+}
+
+static uint32_t *shadow_slot(struct shadow_bank *bank, const char *nick) {
+    uint32_t mask = bank->slot_count - 1;
+    uint32_t slot = hash_nick(nick) & mask;
+    while (bank->slots[slot] && strcmp(bank->entries[bank->slots[slot] - 1].nick, nick) != 0) {
+        slot = (slot + 1) & mask;
+    }
+    return &bank->slots[slot];
+}
+
+static int shadow_reserve(struct shadow_bank *bank) {
+    if (bank->count == bank->capacity) {
+        uint32_t cap = bank->capacity ? bank->capacity * 2 : 1024;
+        struct shadow_entry *grown = realloc(bank->entries, cap * sizeof(*grown));
+        if (!grown) return -1;
+        bank->entries = grown;
+        bank->capacity = cap;
+    }
+
+    if ((bank->count + 1) * 2 > bank->slot_count) {
+        uint32_t count = bank->slot_count ? bank->slot_count * 2 : 2048;
+        uint32_t *slots = calloc(count, sizeof(uint32_t));
+        if (!slots) return -1;
+        free(bank->slots);
+        bank->slots = slots;
+        bank->slot_count = count;
+        for (uint32_t i = 0; i < bank->count; i++) {
+            *shadow_slot(bank, bank->entries[i].nick) = i + 1;
+        }
+    }
+    return 0;
+}
+
+// Keep the player's best result (an equal one keeps its earlier place)
+static int shadow_set_best(struct shadow_bank *bank, const char *nick, uint8_t score, uint32_t time_seconds) {
+    if (shadow_reserve(bank) < 0) {
+        return -1;
+    }
+
+    uint32_t *slot = shadow_slot(bank, nick);
+    struct shadow_entry *entry;
+    if (*slot) {
+        entry = &bank->entries[*slot - 1];
+        if (score < entry->score || (score == entry->score && time_seconds >= entry->time_seconds)) {
+            return 0;
+        }
+    } else {
+        entry = &bank->entries[bank->count++];
+        *slot = bank->count;
+        strncpy(entry->nick, nick, MAX_NICK_LENGTH - 1);
+        entry->nick[MAX_NICK_LENGTH - 1] = '\0';
+    }
+    entry->score = score;
+    entry->time_seconds = time_seconds;
+    entry->arrival = score_log.arrivals++;
+    return 0;
+}
+
+// Same bookkeeping as the server does for a finished test
+static int shadow_apply(struct shadow_bank *bank, const char *nick, uint8_t score, uint32_t time_seconds) {
+    if (shadow_set_best(bank, nick, score, time_seconds) < 0) {
+        return -1;
+    }
+
+    bank->stats.tests_completed++;
+    bank->stats.total_score += score;
+    if (score > bank->stats.best_score ||
+        (score == bank->stats.best_score && (bank->stats.best_time == 0 || time_seconds < bank->stats.best_time))) {
+        bank->stats.best_score = score;
+        bank->stats.best_time = time_seconds;
+        strncpy(bank->stats.best_player, nick, MAX_NICK_LENGTH - 1);
+        bank->stats.best_player[MAX_NICK_LENGTH - 1] = '\0';
+    }
+    return 0;
+}
+
+// One decoded log record
+struct replay_record {
+    uint8_t type;
+    uint8_t score;
+    uint32_t value;
+    size_t length;
+    char bank[MAX_BANK_NAME];
+    char nick[MAX_NICK_LENGTH];
+};
+
+// Decode and check one record; returns its length, 0 if it is torn or corrupt
+static size_t decode_record(const uint8_t *rec, size_t avail, struct replay_record *out) {
+    if (avail < RECORD_HEADER_SIZE) {
+        return 0;
+    }
+    uint8_t bank_len = rec[5], nick_len = rec[6];
+    size_t rec_len = RECORD_HEADER_SIZE + bank_len + nick_len;
+    if (avail < rec_len || (rec[4] != RECORD_SCORE && rec[4] != RECORD_QUESTIONS) ||
+        bank_len >= MAX_BANK_NAME || nick_len >= MAX_NICK_LENGTH) {
+        return 0;
+    }
+
+    uint32_t crc;
+    memcpy(&crc, rec, 4);
+    if (crc32_update(0, rec + 4, rec_len - 4) != crc) {
+        return 0;
+    }
+
+    out->type = rec[4];
+    out->score = rec[7];
+    out->length = rec_len;
+    memcpy(&out->value, rec + 8, 4);
+    memcpy(out->bank, rec + RECORD_HEADER_SIZE, bank_len);
+    out->bank[bank_len] = '\0';
+    memcpy(out->nick, rec + RECORD_HEADER_SIZE + bank_len, nick_len);
+    out->nick[nick_len] = '\0';
+    return rec_len;
+}
+
+// Apply complete, valid records; returns the number of bytes consumed
+static size_t replay_records(const uint8_t *data, size_t len, uint64_t *events) {
+    struct replay_record window[REPLAY_WINDOW];
+    size_t pos = 0;
+
+    for (;;) {
+        // Decode a window of records and prefetch their hash slots...
+        int n = 0;
+        size_t end = pos;
+        while (n < REPLAY_WINDOW) {
+            struct replay_record *r = &window[n];
+            size_t rec_len = decode_record(data + end, len - end, r);
+            if (rec_len == 0) {
+                break;
+            }
+            end += rec_len;
+            struct shadow_bank *shadow = shadow_find(r->bank, 0);
+            if (shadow && shadow->slot_count > 0 && r->type == RECORD_SCORE) {
+                __builtin_prefetch(&shadow->slots[hash_nick(r->nick) & (shadow->slot_count - 1)]);
+            }
+            n++;
+        }
+        if (n == 0) {
+            return pos;
+        }
+
+        // ...then the entries they point to, so applying them hits the cache
+        for (int i = 0; i < n; i++) {
+            struct shadow_bank *shadow = shadow_find(window[i].bank, 0);
+            if (shadow && shadow->slot_count > 0 && window[i].type == RECORD_SCORE) {
+                uint32_t index = shadow->slots[hash_nick(window[i].nick) & (shadow->slot_count - 1)];
+                if (index) {
+                    __builtin_prefetch(&shadow->entries[index - 1]);
+                }
+            }
+        }
+
+        for (int i = 0; i < n; i++) {
+            struct replay_record *r = &window[i];
+            struct shadow_bank *shadow = shadow_find(r->bank, 1);
+            if (!shadow) {
+                async_log(LOG_ERR, "Out of memory while replaying scores");
+                return pos;
+            }
+            if (r->type == RECORD_QUESTIONS) {
+                shadow->stats.questions_asked = r->value;
+            } else if (shadow_apply(shadow, r->nick, r->score, r->value) < 0) {
+                async_log(LOG_ERR, "Out of memory while replaying scores");
+                return pos;
+            } else {
+                (*events)++;
+            }
+            pos += r->length;
+        }
+    }
+}
+
+// Sort key of the leaderboard: score desc, time asc, arrival asc
+static int compare_entries(const void *a, const void *b) {
+    const struct shadow_entry *x = a, *y = b;
+    if (x->score != y->score) return x->score > y->score ? -1 : 1;
+    if (x->time_seconds != y->time_seconds) return x->time_seconds < y->time_seconds ? -1 : 1;
+    return (x->arrival > y->arrival) - (x->arrival < y->arrival);
+}
+
+// Put the entries in rank order and re-point the nick table at them
+static void shadow_sort(struct shadow_bank *bank) {
+    qsort(bank->entries, bank->count, sizeof(*bank->entries), compare_entries);
+    if (bank->slot_count > 0) {
+        memset(bank->slots, 0, bank->slot_count * sizeof(uint32_t));
+    }
+    for (uint32_t i = 0; i < bank->count; i++) {
+        *shadow_slot(bank, bank->entries[i].nick) = i + 1;
+    }
+}
+
+// Sequential reader of the snapshot with a running CRC
+struct snap_reader {
+    const uint8_t *data;
+    size_t len, pos;
+    int error;
+};
+
+static void snap_read(struct snap_reader *r, void *out, size_t n) {
+    if (r->error || r->len - r->pos < n) {
+        r->error = 1;
+        memset(out, 0, n);
+        return;
+    }
+    memcpy(out, r->data + r->pos, n);
+    r->pos += n;
+}
+
+static void snap_read_string(struct snap_reader *r, char *out, size_t size) {
+    uint8_t n = 0;
+    snap_read(r, &n, 1);
+    if (n >= size) {
+        r->error = 1;
+        n = 0;
+    }
+    snap_read(r, out, n);
+    out[n] = '\0';
+}
+
+static int load_snapshot(uint64_t *generation) {
+    int fd = open(score_log.snap_path, O_RDONLY);
+    if (fd < 0) {
+        return errno == ENOENT ? 0 : -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size < 24) {
+        close(fd);
+        return -1;
+    }
+    uint8_t *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return -1;
+    }
+
+    struct snap_reader r = { data, st.st_size - 4, 0, 0 };
+    uint32_t crc, magic, version, bank_count;
+    memcpy(&crc, data + st.st_size - 4, 4);
+    if (crc32_update(0, data, st.st_size - 4) != crc) {
+        munmap(data, st.st_size);
+        return -1;
+    }
+
+    snap_read(&r, &magic, 4);
+    snap_read(&r, &version, 4);
+    snap_read(&r, generation, 8);
+    snap_read(&r, &bank_count, 4);
+    if (magic != SNAP_MAGIC || version != FORMAT_VERSION) {
+        r.error = 1;
+    }
+
+    for (uint32_t b = 0; b < bank_count && !r.error; b++) {
+        char name[MAX_BANK_NAME];
+        snap_read_string(&r, name, sizeof(name));
+        struct shadow_bank *bank = shadow_find(name, 1);
+        if (!bank) {
+            r.error = 1;
+            break;
+        }
+
+        snap_read(&r, &bank->stats.tests_completed, 4);
+        snap_read(&r, &bank->stats.questions_asked, 4);
+        snap_read(&r, &bank->stats.total_score, 4);
+        snap_read(&r, &bank->stats.best_score, 1);
+        snap_read(&r, &bank->stats.best_time, 4);
+        snap_read_string(&r, bank->stats.best_player, sizeof(bank->stats.best_player));
+
+        uint32_t count = 0;
+        snap_read(&r, &count, 4);
+        for (uint32_t i = 0; i < count && !r.error; i++) {
+            char nick[MAX_NICK_LENGTH];
+            uint8_t score;
+            uint32_t time_seconds;
+            snap_read_string(&r, nick, sizeof(nick));
+            snap_read(&r, &score, 1);
+            snap_read(&r, &time_seconds, 4);
+            if (!r.error && shadow_set_best(bank, nick, score, time_seconds) < 0) {
+                r.error = 1;
+            }
+        }
+    }
+
+    munmap(data, st.st_size);
+    return r.error ? -1 : 0;
+}
+
+// Replay the log; returns events applied, -1 if the log is unusable
+static long replay_log(uint64_t snapshot_generation) {
+    int fd = open(score_log.wal_path, O_RDONLY);
+    if (fd < 0) {
+        score_log.generation = snapshot_generation + 1;
+        return errno == ENOENT ? 0 : -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return -1;
+    }
+    if (st.st_size < WAL_HEADER_SIZE) {
+        close(fd);
+        score_log.generation = snapshot_generation + 1;
+        return 0;  // Crashed while creating it
+    }
+
+    uint8_t *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return -1;
+    }
+
+    uint32_t magic, version;
+    uint64_t generation;
+    memcpy(&magic, data, 4);
+    memcpy(&version, data + 4, 4);
+    memcpy(&generation, data + 8, 8);
+    if (magic != WAL_MAGIC || version != FORMAT_VERSION) {
+        munmap(data, st.st_size);
+        return -1;
+    }
+
+    uint64_t events = 0;
+    score_log.generation = generation;
+    score_log.valid_length = st.st_size;
+    if (generation <= snapshot_generation) {
+        // Already folded into the snapshot; start the next generation
+        score_log.generation = snapshot_generation + 1;
+        score_log.valid_length = 0;
+    } else {
+        madvise(data, st.st_size, MADV_SEQUENTIAL);
+        size_t used = replay_records(data + WAL_HEADER_SIZE, st.st_size - WAL_HEADER_SIZE, &events);
+        score_log.valid_length = WAL_HEADER_SIZE + used;
+        if (score_log.valid_length != st.st_size) {
+            async_log(LOG_WARNING, "Score log: discarding %ld bytes of torn or corrupt tail",
+                   (long)(st.st_size - score_log.valid_length));
+        }
+    }
+
+    munmap(data, st.st_size);
+    return (long)events;
+}
+
+// Hand the recovered state over to the loaded banks
+static int restore_banks(void) {
+    for (int b = 0; b < score_log.bank_count; b++) {
+        struct shadow_bank *shadow = &score_log.banks[b];
+        struct question_bank *bank = bank_find(shadow->name);
+        if (!bank) {
+            async_log(LOG_NOTICE, "Score log: keeping %u results of unloaded bank '%s'",
+                   shadow->count, shadow->name);
+            continue;
+        }
+
+        shadow_sort(shadow);
+
+        struct score_entry *entries = malloc((shadow->count ? shadow->count : 1) * sizeof(*entries));
+        if (!entries) {
+            return -1;
+        }
+        for (uint32_t i = 0; i < shadow->count; i++) {
+            memcpy(entries[i].nick, shadow->entries[i].nick, sizeof(entries[i].nick));
+            entries[i].score = shadow->entries[i].score;
+            entries[i].time_seconds = shadow->entries[i].time_seconds;
+        }
+        int rc = leaderboard_load(&bank->leaderboard, entries, shadow->count);
+        free(entries);
+        if (rc < 0) {
+            return -1;
+        }
+
+        stats_restore(&bank->stats, &shadow->stats);
+    }
+    return 0;
+}
+
+long score_log_recover(const char *dir) {
+    crc32_init();
+    snprintf(score_log.dir, sizeof(score_log.dir), "%s", dir);
+    snprintf(score_log.wal_path, sizeof(score_log.wal_path), "%s/scores.wal", dir);
+    snprintf(score_log.snap_path, sizeof(score_log.snap_path), "%s/scores.snap", dir);
+    snprintf(score_log.stats_path, sizeof(score_log.stats_path), "%s/" QUESTION_STATS_FILE, dir);
+
+    uint64_t snapshot_generation = 0;
+    if (load_snapshot(&snapshot_generation) < 0) {
+        async_log(LOG_ERR, "Score log: unreadable snapshot %s", score_log.snap_path);
+        return -1;
+    }
+
+    long events = replay_log(snapshot_generation);
+    if (events < 0) {
+        async_log(LOG_ERR, "Score log: unreadable log %s", score_log.wal_path);
+        return -1;
+    }
+
+    if (restore_banks() < 0) {
+        async_log(LOG_ERR, "Score log: out of memory while restoring rankings");
+        return -1;
+    }
+
+    score_log.events_since_snapshot = events;
+    score_log.last_snapshot = time(NULL);
+    return events;
+}
+
+// Encode one record, returns its length
+static size_t encode_record(uint8_t *rec, uint8_t type, const char *bank, const char *nick,
+                            uint8_t score, uint32_t value) {
+    size_t bank_len = strnlen(bank, MAX_BANK_NAME - 1);
+    size_t nick_len = strnlen(nick, MAX_NICK_LENGTH - 1);
+    size_t rec_len = RECORD_HEADER_SIZE + bank_len + nick_len;
+
+    rec[4] = type;
+    rec[5] = bank_len;
+    rec[6] = nick_len;
+    rec[7] = score;
+    memcpy(rec + 8, &value, 4);
+    memcpy(rec + RECORD_HEADER_SIZE, bank, bank_len);
+    memcpy(rec + RECORD_HEADER_SIZE + bank_len, nick, nick_len);
+    uint32_t crc = crc32_update(0, rec + 4, rec_len - 4);
+    memcpy(rec, &crc, 4);
+    return rec_len;
+}
+
+static int write_all(int fd, const uint8_t *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int fsync_dir(void) {
+    int fd = open(score_log.dir, O_RDONLY | O_DIRECTORY);
+    if (fd < 0) {
+        return -1;
+    }
+    int rc = fsync(fd);
+    close(fd);
+    return rc;
+}
+
+// Create an empty log of the given generation and atomically put it in place
+static int create_log(uint64_t generation) {
+    char tmp_path[PATH_MAX + 8];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", score_log.wal_path);
+
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+
+    uint8_t header[WAL_HEADER_SIZE];
+    uint32_t magic = WAL_MAGIC, version = FORMAT_VERSION;
+    memcpy(header, &magic, 4);
+    memcpy(header + 4, &version, 4);
+    memcpy(header + 8, &generation, 8);
+    if (write_all(fd, header, sizeof(header)) < 0 || fdatasync(fd) < 0 ||
+        rename(tmp_path, score_log.wal_path) < 0) {
+        close(fd);
+        unlink(tmp_path);
+        return -1;
+    }
+    // Until the rename is durable a crash may bring back the previous log
+    if (fsync_dir() < 0) {
+        close(fd);
+        return -1;
+    }
+
+    if (score_log.fd >= 0) {
+        close(score_log.fd);
+    }
+    score_log.fd = fd;
+    score_log.generation = generation;
+    return 0;
+}
+
+// Put the log of the next generation in place after a snapshot
+static int rotate_log(void) {
+    if (fsync_dir() < 0 || create_log(score_log.generation + 1) < 0) {
+        return -1;
+    }
+    score_log.rotate = 0;
+    return 0;
+}
+
+// Buffered snapshot writer with a running CRC
+struct snap_writer {
+    FILE *file;
+    uint32_t crc;
+};
+
+static void snap_write(struct snap_writer *w, const void *data, size_t n) {
+    w->crc = crc32_update(w->crc, data, n);
+    fwrite(data, 1, n, w->file);
+}
+
+static void snap_write_string(struct snap_writer *w, const char *s) {
+    uint8_t n = strlen(s);
+    snap_write(w, &n, 1);
+    snap_write(w, s, n);
+}
+
+// Write the state covering the current log generation, then start the next one
+static int write_snapshot(void) {
+    char tmp_path[PATH_MAX + 8];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", score_log.snap_path);
+
+    FILE *file = fopen(tmp_path, "we");
+    if (!file) {
+        return -1;
+    }
+    setvbuf(file, NULL, _IOFBF, 1 << 20);
+
+    struct snap_writer w = { file, 0 };
+    uint32_t magic = SNAP_MAGIC, version = FORMAT_VERSION, bank_count = score_log.bank_count;
+    snap_write(&w, &magic, 4);
+    snap_write(&w, &version, 4);
+    snap_write(&w, &score_log.generation, 8);
+    snap_write(&w, &bank_count, 4);
+
+    for (int b = 0; b < score_log.bank_count; b++) {
+        struct shadow_bank *bank = &score_log.banks[b];
+
+        shadow_sort(bank);
+
+        snap_write_string(&w, bank->name);
+        snap_write(&w, &bank->stats.tests_completed, 4);
+        snap_write(&w, &bank->stats.questions_asked, 4);
+        snap_write(&w, &bank->stats.total_score, 4);
+        snap_write(&w, &bank->stats.best_score, 1);
+        snap_write(&w, &bank->stats.best_time, 4);
+        snap_write_string(&w, bank->stats.best_player);
+        snap_write(&w, &bank->count, 4);
+        for (uint32_t i = 0; i < bank->count; i++) {
+            snap_write_string(&w, bank->entries[i].nick);
+            snap_write(&w, &bank->entries[i].score, 1);
+            snap_write(&w, &bank->entries[i].time_seconds, 4);
+        }
+    }
+
+    uint32_t crc = w.crc;
+    fwrite(&crc, 4, 1, file);
+    int failed = fflush(file) != 0 || ferror(file) || fdatasync(fileno(file)) < 0;
+    failed |= fclose(file) != 0;
+    if (failed || rename(tmp_path, score_log.snap_path) < 0) {
+        unlink(tmp_path);
+        return -1;
+    }
+
+    // The snapshot now covers this generation; a crash from here on skips the old log
+    score_log.rotate = 1;
+    return rotate_log();
+}
+
+static uint64_t shadow_entries(void) {
+    uint64_t total = 0;
+    for (int b = 0; b < score_log.bank_count; b++) {
+        total += score_log.banks[b].count;
+    }
+    return total;
+}
+
+// Append a counter record for every bank whose question counter moved
+static size_t log_counters(uint8_t **batch, size_t *batch_cap, size_t batch_len) {
+    size_t needed = batch_len + bank_count() * (RECORD_HEADER_SIZE + MAX_BANK_NAME);
+    if (needed > *batch_cap) {
+        uint8_t *grown = shared_realloc(*batch, needed);
+        if (!grown) {
+            return batch_len;
+        }
+        *batch = grown;
+        *batch_cap = needed;
+    }
+
+    for (int i = 0; i < bank_count(); i++) {
+        struct question_bank *live = bank_at(i);
+        uint32_t asked = (uint32_t)stats_read(&live->stats, STATS_QUESTIONS_ASKED);
+
+        struct shadow_bank *shadow = shadow_find(live->name, 1);
+        if (shadow && shadow->stats.questions_asked != asked) {
+            batch_len += encode_record(*batch + batch_len, RECORD_QUESTIONS, live->name, "", 0, asked);
+        }
+    }
+    return batch_len;
+}
+
+void score_log_run_once(int wait) {
+    struct score_queue *queue = score_log.queue;
+
+    // Wake for new events, or every second to log the question counters
+    shared_mutex_lock(&queue->mutex);
+    if (wait && queue->pending_len == 0) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += 1;
+        shared_cond_wait(&queue->wake, &queue->mutex, &deadline);
+    }
+    if (shared_arena_poisoned()) {
+        // A worker died inside the queue; the restarted server replays the log
+        pthread_mutex_unlock(&queue->mutex);
+        return;
+    }
+
+    // Take everything queued so far: one write and one fsync for the batch
+    size_t batch_len;
+    uint64_t batch_last;
+    if (score_log.unwritten == 0) {
+        uint8_t *tmp = score_log.batch;
+        size_t tmp_cap = score_log.batch_cap;
+        score_log.batch = queue->pending;
+        score_log.batch_cap = queue->pending_cap;
+        batch_len = queue->pending_len;
+        batch_last = queue->queued;
+        queue->pending = tmp;
+        queue->pending_cap = tmp_cap;
+        queue->pending_len = 0;
+    } else {
+        // Retry a failed batch, with the events queued since behind it when they fit
+        batch_len = score_log.unwritten;
+        batch_last = score_log.unwritten_last;
+        size_t needed = batch_len + queue->pending_len;
+        uint8_t *grown = needed > score_log.batch_cap ? shared_realloc(score_log.batch, needed) : score_log.batch;
+        if (grown) {
+            score_log.batch = grown;
+            score_log.batch_cap = needed > score_log.batch_cap ? needed : score_log.batch_cap;
+            memcpy(score_log.batch + batch_len, queue->pending, queue->pending_len);
+            batch_len = needed;
+            batch_last = queue->queued;
+            queue->pending_len = 0;
+        }
+    }
+    pthread_mutex_unlock(&queue->mutex);
+
+    size_t events_len = batch_len;
+    int durable = 1;
+    batch_len = log_counters(&score_log.batch, &score_log.batch_cap, batch_len);
+    if (batch_len > 0 && score_log.rotate && rotate_log() < 0) {
+        // Events appended to the covered log would be skipped at recovery
+        async_log(LOG_ERR, "Score log rotation failed, retrying: %s", strerror(errno));
+        score_log.unwritten = events_len;
+        score_log.unwritten_last = batch_last;
+        durable = 0;
+    } else if (batch_len > 0) {
+        off_t start = lseek(score_log.fd, 0, SEEK_CUR);
+        if (write_all(score_log.fd, score_log.batch, batch_len) < 0 || fdatasync(score_log.fd) < 0) {
+            int err = errno;
+            // Cut the torn batch off, so the retry follows the last durable record
+            if (start < 0 || ftruncate(score_log.fd, start) < 0 || lseek(score_log.fd, start, SEEK_SET) < 0) {
+                async_log(LOG_ERR, "Score log truncate failed: %s", strerror(errno));
+            }
+            async_log(LOG_ERR, "Score log write failed, retrying: %s", strerror(err));
+            // Counter records are dropped, the next round logs them again
+            score_log.unwritten = events_len;
+            score_log.unwritten_last = batch_last;
+            durable = 0;
+        } else {
+            score_log.unwritten = 0;
+
+            uint64_t events = 0;
+            replay_records(score_log.batch, batch_len, &events);
+            score_log.events_since_snapshot += events;
+        }
+    }
+
+    if (durable) {
+        shared_mutex_lock(&queue->mutex);
+        queue->written = batch_last;
+        pthread_cond_broadcast(&queue->flushed);
+        pthread_mutex_unlock(&queue->mutex);
+    }
+
+    // Snapshot when the log outgrows it, so replay stays proportional to the state
+    if (durable && !score_log.rotate &&
+        ((score_log.events_since_snapshot >= SCORE_LOG_SNAPSHOT_EVENTS &&
+          score_log.events_since_snapshot >= shadow_entries()) ||
+         (score_log.events_since_snapshot > 0 &&
+          time(NULL) - score_log.last_snapshot >= SCORE_LOG_SNAPSHOT_INTERVAL))) {
+        if (write_snapshot() < 0) {
+            async_log(LOG_ERR, "Score snapshot failed: %s", strerror(errno));
+        } else {
+            async_log(LOG_INFO, "Score snapshot written, log generation %llu",
+                   (unsigned long long)score_log.generation);
+            score_log.events_since_snapshot = 0;
+        }
+        score_log.last_snapshot = time(NULL);
+    }
+
+    // Answer statistics for exam authors, rewritten only when questions were answered
+    if (time(NULL) - score_log.last_stats_dump >= QUESTION_STATS_DUMP_INTERVAL) {
+        uint64_t total = question_stats_total();
+        if (total != score_log.stats_dumped) {
+            if (question_stats_dump(score_log.stats_path) < 0) {
+                async_log(LOG_ERR, "Question statistics dump failed: %s", strerror(errno));
+            } else {
+                score_log.stats_dumped = total;
+            }
+        }
+        score_log.last_stats_dump = time(NULL);
+    }
+}
+
+static void *writer_thread(void *arg) {
+    (void)arg;
+    for (;;) {
+        score_log_run_once(1);
+    }
+    return NULL;
+}
+
+int score_log_open(void) {
+    if (score_log.valid_length >= WAL_HEADER_SIZE) {
+        // Continue the recovered log after its last valid record
+        score_log.fd = open(score_log.wal_path, O_WRONLY | O_CLOEXEC);
+        if (score_log.fd < 0 || ftruncate(score_log.fd, score_log.valid_length) < 0 ||
+            lseek(score_log.fd, 0, SEEK_END) < 0) {
+            async_log(LOG_ERR, "Cannot open score log %s: %s", score_log.wal_path, strerror(errno));
+            return -1;
+        }
+    } else if (create_log(score_log.generation) < 0) {
+        async_log(LOG_ERR, "Cannot create score log %s: %s", score_log.wal_path, strerror(errno));
+        return -1;
+    }
+
+    // Pre-forked workers queue into shared memory for the writer in the master
+    if (shared_arena_active()) {
+        struct score_queue *queue = shared_calloc(1, sizeof(*queue));
+        if (!queue || shared_mutex_init(&queue->mutex) != 0 ||
+            shared_cond_init(&queue->wake) != 0 || shared_cond_init(&queue->flushed) != 0) {
+            async_log(LOG_ERR, "Cannot allocate the shared score queue");
+            return -1;
+        }
+        score_log.queue = queue;
+    }
+
+    score_log.started = 1;
+    return 0;
+}
+
+int score_log_start(void) {
+    if (score_log_open() < 0) {
+        return -1;
+    }
+
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, writer_thread, NULL) != 0) {
+        score_log.started = 0;
+        return -1;
+    }
+    pthread_detach(tid);
+    return 0;
+}
+
+void score_log_append(const char *bank, const char *nick, uint8_t score, uint32_t time_seconds) {
+    if (!score_log.started) {
+        return;
+    }
+
+    uint8_t rec[RECORD_HEADER_SIZE + MAX_BANK_NAME + MAX_NICK_LENGTH];
+    size_t rec_len = encode_record(rec, RECORD_SCORE, bank, nick, score, time_seconds);
+
+    struct score_queue *queue = score_log.queue;
+    shared_mutex_lock(&queue->mutex);
+    if (queue->pending_len + rec_len > queue->pending_cap) {
+        size_t cap = queue->pending_cap ? queue->pending_cap * 2 : 64 * 1024;
+        uint8_t *grown = cap <= SCORE_LOG_MAX_PENDING ? shared_realloc(queue->pending, cap) : NULL;
+        if (!grown) {
+            // The disk cannot keep up; never stall the reactor
+            if (queue->dropped++ % 10000 == 0) {
+                async_log(LOG_ERR, "Score log queue full, dropped %llu events",
+                       (unsigned long long)queue->dropped);
+            }
+            pthread_mutex_unlock(&queue->mutex);
+            return;
+        }
+        queue->pending = grown;
+        queue->pending_cap = cap;
+    }
+    memcpy(queue->pending + queue->pending_len, rec, rec_len);
+    queue->pending_len += rec_len;
+    queue->queued++;
+    pthread_cond_signal(&queue->wake);
+    pthread_mutex_unlock(&queue->mutex);
+}
+
+void score_log_flush(void) {
+    struct score_queue *queue = score_log.queue;
+    shared_mutex_lock(&queue->mutex);
+    uint64_t target = queue->queued;
+    while (score_log.started && queue->written < target) {
+        shared_cond_wait(&queue->flushed, &queue->mutex, NULL);
+    }
+    pthread_mutex_unlock(&queue->mutex);
+}
@@ -0,0 +1,439 @@
+#include "search_index.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define NO_DOC  UINT32_MAX
+
+// Fold a two-byte UTF-8 Polish letter to ASCII, 0 if it is not one
+static char fold_polish(unsigned char lead, unsigned char cont) {
+    if (lead == 0xC3) {
+        if (cont == 0xB3 || cont == 0x93) return 'o';   // ó Ó
+    } else if (lead == 0xC4) {
+        switch (cont) {
+            case 0x84: case 0x85: return 'a';           // Ą ą
+            case 0x86: case 0x87: return 'c';           // Ć ć
+            case 0x98: case 0x99: return 'e';           // Ę ę
+        }
+    } else if (lead == 0xC5) {
+        switch (cont) {
+            case 0x81: case 0x82: return 'l';           // Ł ł
+            case 0x83: case 0x84: return 'n';           // Ń ń
+            case 0x9A: case 0x9B: return 's';           // Ś ś
+            case 0xB9: case 0xBA: return 'z';           // Ź ź
+            case 0xBB: case 0xBC: return 'z';           // Ż ż
+        }
+    }
+    return 0;
+}
+
+static int is_term_byte(unsigned char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c >= 0x80;
+}
+
+size_t search_next_term(const char **text, char *term) {
+    const unsigned char *p = (const unsigned char *)*text;
+    size_t len = 0;
+
+    while (*p && !is_term_byte(*p)) {
+        p++;
+    }
+
+    while (*p && is_term_byte(*p)) {
+        char c;
+        if (*p >= 0x80 && p[1] != '\0' && (c = fold_polish(p[0], p[1])) != 0) {
+            p += 2;
+        } else if (*p >= 'A' && *p <= 'Z') {
+            c = (char)(*p++ - 'A' + 'a');
+        } else {
+            c = (char)*p++;  // Other UTF-8 bytes are kept as they are
+        }
+        if (len < SEARCH_MAX_TERM) {
+            term[len++] = c;
+        }
+    }
+
+    // Drop the inflected ending: maska, maskę and maski all become "mask"
+    if (len >= SEARCH_STEM_MIN && strchr("aeiouy", term[len - 1]) != NULL) {
+        len--;
+    }
+
+    term[len] = '\0';
+    *text = (const char *)p;
+    return len;
+}
+
+static uint32_t hash_term(const char *term) {
+    uint32_t h = 2166136261u;  // FNV-1a
+    while (*term) {
+        h ^= (unsigned char)*term++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// Slot holding the term, or the empty slot where it would go
+static uint32_t find_slot(const SearchIndex *idx, const char *term) {
+    uint32_t mask = idx->slot_count - 1;
+    uint32_t slot = hash_term(term) & mask;
+    while (idx->slots[slot] >= 0 &&
+           strcmp(idx->strings + idx->terms[idx->slots[slot]].name, term) != 0) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+static int grow_slots(SearchIndex *idx) {
+    uint32_t count = idx->slot_count ? idx->slot_count * 2 : 1024;
+    int32_t *slots = malloc(count * sizeof(int32_t));
+    if (!slots) {
+        return -1;
+    }
+    memset(slots, 0xFF, count * sizeof(int32_t));
+
+    free(idx->slots);
+    idx->slots = slots;
+    idx->slot_count = count;
+    for (uint32_t t = 0; t < idx->term_count; t++) {
+        idx->slots[find_slot(idx, idx->strings + idx->terms[t].name)] = (int32_t)t;
+    }
+    return 0;
+}
+
+// Look up a term, creating it during the build phase
+static SearchTerm *get_term(SearchIndex *idx, const char *term, int create) {
+    if (idx->slot_count == 0) {
+        if (!create || grow_slots(idx) < 0) return NULL;
+    }
+
+    uint32_t slot = find_slot(idx, term);
+    if (idx->slots[slot] >= 0) {
+        return &idx->terms[idx->slots[slot]];
+    }
+    if (!create) {
+        return NULL;
+    }
+
+    // Keep the table at most half full
+    if ((idx->term_count + 1) * 2 > idx->slot_count) {
+        if (grow_slots(idx) < 0) return NULL;
+        slot = find_slot(idx, term);
+    }
+
+    if (idx->term_count == idx->term_capacity) {
+        uint32_t cap = idx->term_capacity ? idx->term_capacity * 2 : 256;
+        SearchTerm *grown = realloc(idx->terms, cap * sizeof(SearchTerm));
+        if (!grown) return NULL;
+        idx->terms = grown;
+        idx->term_capacity = cap;
+    }
+
+    size_t term_len = strlen(term) + 1;
+    if (idx->strings_len + term_len > idx->strings_cap) {
+        size_t cap = idx->strings_cap ? idx->strings_cap * 2 : 4096;
+        while (cap < idx->strings_len + term_len) cap *= 2;
+        char *grown = realloc(idx->strings, cap);
+        if (!grown) return NULL;
+        idx->strings = grown;
+        idx->strings_cap = cap;
+    }
+    memcpy(idx->strings + idx->strings_len, term, term_len);
+
+    SearchTerm *t = &idx->terms[idx->term_count];
+    memset(t, 0, sizeof(*t));
+    t->name = (uint32_t)idx->strings_len;
+    t->last_doc = NO_DOC;
+    idx->strings_len += term_len;
+    idx->slots[slot] = (int32_t)idx->term_count++;
+    return t;
+}
+
+void search_index_init(SearchIndex *idx) {
+    memset(idx, 0, sizeof(*idx));
+}
+
+void search_index_free(SearchIndex *idx) {
+    free(idx->terms);
+    free(idx->slots);
+    free(idx->strings);
+    free(idx->postings);
+    free(idx->block_first);
+    free(idx->block_offset);
+    free(idx->build_docs);
+    free(idx->build_terms);
+    memset(idx, 0, sizeof(*idx));
+}
+
+int search_index_add(SearchIndex *idx, uint32_t doc, const char *text) {
+    char term[SEARCH_MAX_TERM + 1];
+    size_t len;
+
+    while ((len = search_next_term(&text, term)) > 0) {
+        if (len < SEARCH_MIN_TERM) {
+            continue;
+        }
+
+        SearchTerm *t = get_term(idx, term, 1);
+        if (!t) {
+            return -1;
+        }
+        if (t->last_doc == doc) {
+            continue;  // Already listed for this document
+        }
+
+        if (idx->build_len == idx->build_cap) {
+            size_t cap = idx->build_cap ? idx->build_cap * 2 : 4096;
+            uint32_t *docs = realloc(idx->build_docs, cap * sizeof(uint32_t));
+            if (!docs) return -1;
+            idx->build_docs = docs;
+            uint32_t *terms = realloc(idx->build_terms, cap * sizeof(uint32_t));
+            if (!terms) return -1;
+            idx->build_terms = terms;
+            idx->build_cap = cap;
+        }
+
+        idx->build_docs[idx->build_len] = doc;
+        idx->build_terms[idx->build_len] = (uint32_t)(t - idx->terms);
+        idx->build_len++;
+        t->last_doc = doc;
+        t->doc_count++;
+    }
+
+    return 0;
+}
+
+static int put_varint(SearchIndex *idx, size_t *cap, uint32_t value) {
+    if (idx->postings_len + 5 > *cap) {
+        size_t grown_cap = *cap ? *cap * 2 : 4096;
+        uint8_t *grown = realloc(idx->postings, grown_cap);
+        if (!grown) return -1;
+        idx->postings = grown;
+        *cap = grown_cap;
+    }
+    while (value >= 0x80) {
+        idx->postings[idx->postings_len++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    idx->postings[idx->postings_len++] = (uint8_t)value;
+    return 0;
+}
+
+int search_index_finalize(SearchIndex *idx) {
+    uint32_t total_blocks = 0;
+    for (uint32_t t = 0; t < idx->term_count; t++) {
+        total_blocks += (idx->terms[t].doc_count + SEARCH_BLOCK_SIZE - 1) / SEARCH_BLOCK_SIZE;
+    }
+
+    // Group the pairs by term; documents were added in order, so every list comes out sorted
+    uint32_t *start = malloc((idx->term_count + 1) * sizeof(uint32_t));
+    uint32_t *sorted = malloc((idx->build_len ? idx->build_len : 1) * sizeof(uint32_t));
+    idx->block_first = malloc((total_blocks ? total_blocks : 1) * sizeof(uint32_t));
+    idx->block_offset = malloc((total_blocks ? total_blocks : 1) * sizeof(uint32_t));
+    if (!start || !sorted || !idx->block_first || !idx->block_offset) {
+        free(start);
+        free(sorted);
+        return -1;
+    }
+
+    uint32_t offset = 0;
+    for (uint32_t t = 0; t < idx->term_count; t++) {
+        start[t] = offset;
+        offset += idx->terms[t].doc_count;
+    }
+    for (size_t i = 0; i < idx->build_len; i++) {
+        sorted[start[idx->build_terms[i]]++] = idx->build_docs[i];
+    }
+
+    size_t cap = 0;
+    const uint32_t *docs = sorted;
+    idx->block_count = 0;
+    for (uint32_t t = 0; t < idx->term_count; t++) {
+        SearchTerm *term = &idx->terms[t];
+        term->first_block = idx->block_count;
+        term->num_blocks = 0;
+
+        // First document of a block goes to the skip table, the rest as deltas
+        for (uint32_t i = 0; i < term->doc_count; i++) {
+            if (i % SEARCH_BLOCK_SIZE == 0) {
+                idx->block_first[idx->block_count] = docs[i];
+                idx->block_offset[idx->block_count] = (uint32_t)idx->postings_len;
+                idx->block_count++;
+                term->num_blocks++;
+            } else if (put_varint(idx, &cap, docs[i] - docs[i - 1]) < 0) {
+                free(start);
+                free(sorted);
+                return -1;
+            }
+        }
+        docs += term->doc_count;
+    }
+
+    free(start);
+    free(sorted);
+    free(idx->build_docs);
+    free(idx->build_terms);
+    idx->build_docs = NULL;
+    idx->build_terms = NULL;
+    idx->build_len = 0;
+    idx->build_cap = 0;
+    return 0;
+}
+
+// Position in one posting list during a query
+typedef struct {
+    const SearchTerm *term;
+    uint32_t block;                     // Block currently open
+    uint32_t count;                     // Documents in the open block
+    uint32_t decoded;                   // Documents decoded so far
+    uint32_t pos;                       // Current document within the block
+    const uint8_t *next;                // Next delta to decode
+    uint32_t docs[SEARCH_BLOCK_SIZE];
+} PostingCursor;
+
+static void open_block(const SearchIndex *idx, PostingCursor *c, uint32_t block) {
+    const SearchTerm *t = c->term;
+    uint32_t global = t->first_block + block;
+
+    c->block = block;
+    c->count = (block == t->num_blocks - 1) ? t->doc_count - block * SEARCH_BLOCK_SIZE : SEARCH_BLOCK_SIZE;
+    c->decoded = 1;
+    c->pos = 0;
+    c->next = idx->postings + idx->block_offset[global];
+    c->docs[0] = idx->block_first[global];
+}
+
+// Blocks are decoded lazily, only as far as the documents a seek needs
+static void decode_until(PostingCursor *c, uint32_t target) {
+    const uint8_t *p = c->next;
+    while (c->decoded < c->count && c->docs[c->decoded - 1] < target) {
+        uint32_t delta = 0;
+        int shift = 0;
+        while (*p & 0x80) {
+            delta |= (uint32_t)(*p++ & 0x7F) << shift;
+            shift += 7;
+        }
+        delta |= (uint32_t)*p++ << shift;
+        c->docs[c->decoded] = c->docs[c->decoded - 1] + delta;
+        c->decoded++;
+    }
+    c->next = p;
+}
+
+// Move the cursor to the first document >= target
+static uint32_t cursor_seek(const SearchIndex *idx, PostingCursor *c, uint32_t target) {
+    const SearchTerm *t = c->term;
+    const uint32_t *first = idx->block_first + t->first_block;
+
+    // Gallop over the skip table when the target lies beyond this block
+    if (c->block + 1 < t->num_blocks && first[c->block + 1] <= target) {
+        uint32_t lo = c->block + 1, step = 1;
+        while (lo + step < t->num_blocks && first[lo + step] <= target) {
+            lo += step;
+            step *= 2;
+        }
+        uint32_t hi = lo + step < t->num_blocks ? lo + step : t->num_blocks;
+        while (hi - lo > 1) {
+            uint32_t mid = lo + (hi - lo) / 2;
+            if (first[mid] <= target) lo = mid;
+            else hi = mid;
+        }
+        open_block(idx, c, lo);
+    }
+
+    // Gallop inside the decoded part of the block
+    decode_until(c, target);
+    if (c->pos < c->decoded && c->docs[c->pos] < target) {
+        uint32_t lo = c->pos, step = 1;
+        while (lo + step < c->decoded && c->docs[lo + step] < target) {
+            lo += step;
+            step *= 2;
+        }
+        uint32_t hi = lo + step < c->decoded ? lo + step : c->decoded;
+        while (hi - lo > 1) {
+            uint32_t mid = lo + (hi - lo) / 2;
+            if (c->docs[mid] < target) lo = mid;
+            else hi = mid;
+        }
+        c->pos = hi;
+    }
+
+    if (c->pos < c->decoded) {
+        return c->docs[c->pos];
+    }
+
+    // Ran off the block: the next block starts after the target
+    if (c->block + 1 < t->num_blocks) {
+        open_block(idx, c, c->block + 1);
+        return c->docs[0];
+    }
+    return NO_DOC;
+}
+
+int search_index_query(const SearchIndex *idx, const char *query, uint32_t *docs, int max_docs) {
+    PostingCursor cursors[SEARCH_MAX_QUERY_TERMS];
+    int num_cursors = 0;
+    int missing = 0;
+    char term[SEARCH_MAX_TERM + 1];
+    size_t len;
+
+    while ((len = search_next_term(&query, term)) > 0 && num_cursors < SEARCH_MAX_QUERY_TERMS) {
+        if (len < SEARCH_MIN_TERM) {
+            continue;
+        }
+
+        const SearchTerm *t = idx->slot_count ? get_term((SearchIndex *)idx, term, 0) : NULL;
+        if (!t) {
+            missing = 1;
+            continue;
+        }
+
+        int duplicate = 0;
+        for (int i = 0; i < num_cursors; i++) {
+            duplicate |= cursors[i].term == t;
+        }
+        if (!duplicate) {
+            cursors[num_cursors++].term = t;
+        }
+    }
+
+    if (num_cursors == 0) {
+        return missing ? 0 : -1;
+    }
+    if (missing) {
+        return 0;  // A term no document has matches nothing
+    }
+
+    // Rarest term drives the intersection
+    for (int i = 1; i < num_cursors; i++) {
+        const SearchTerm *key = cursors[i].term;
+        int j = i - 1;
+        while (j >= 0 && cursors[j].term->doc_count > key->doc_count) {
+            cursors[j + 1].term = cursors[j].term;
+            j--;
+        }
+        cursors[j + 1].term = key;
+    }
+    for (int i = 0; i < num_cursors; i++) {
+        open_block(idx, &cursors[i], 0);
+    }
+
+    int found = 0;
+    uint32_t candidate = cursors[0].docs[0];
+    while (candidate != NO_DOC && found < max_docs) {
+        // Leapfrog: every list must reach the candidate, else it moves forward
+        uint32_t next = candidate;
+        for (int i = 1; i < num_cursors && next == candidate; i++) {
+            next = cursor_seek(idx, &cursors[i], candidate);
+        }
+
+        if (next == candidate) {
+            docs[found++] = candidate;
+            next = candidate + 1;
+        }
+        if (next == NO_DOC) {
+            break;
+        }
+        candidate = cursor_seek(idx, &cursors[0], next);
+    }
+
+    return found;
+}
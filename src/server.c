@@ -10,145 +10,1108 @@
 #include <stdio.h>
 #include <errno.h>
 #include <signal.h>
+#include <time.h>
+#include <limits.h>
+#include <stdatomic.h>
 #include "tlv.h"
+#include "async_log.h"
 #include "server_utils.h"
 #include "server_types.h"
 #include "multicast_discovery.h"
 #include "sock_options.h"
 #include "deamon_init.h"
 #include "quiz.h"
+#include "question_selector.h"
+#include "question_bank.h"
+#include "ranking_window.h"
+#include "score_log.h"
+#include "latency.h"
+#include "metrics.h"
+#include "nick_registry.h"
+#include "text_validate.h"
+#include "shared_arena.h"
+#include "prefork.h"
+#include "cpu_placement.h"
+#include "connection.h"
+#include <sys/resource.h>
 
 #define SA struct sockaddr
-#define MAXEVENTS   2000
+#define MAXEVENTS   2000        // Events taken per epoll_wait()
+#define FD_RESERVE  64          // Descriptors besides clients: listeners, epoll, log, metrics
 #define MAXLINE     1024
-#define LISTENQ     4
+#define LISTENQ     SOMAXCONN   // Clients queue here while the banks load
+#define INIT_PHASES 8
 
-// Structure containing the following: tructures: id, question, answers, answer_number, correct answer; counter
-QuizDatabase quiz_db;
+// Connection nicknames mapping (fd -> nick), allocated by the reactor on its NUMA node
+static char (*connection_nicks)[MAX_NICK_LENGTH];
 
-// Global rankings array: nick, score, time
-struct score_entry rankings[MAX_RANKINGS];
-int rankings_count = 0;
-// Mutual exclusion, prevents racing
-pthread_mutex_t rankings_mutex = PTHREAD_MUTEX_INITIALIZER;
+// Quiz sessions mapping (fd -> running totals kept by the server), allocated like the nicks
+static struct quiz_session *sessions;
 
-// Connection nicknames mapping (fd -> nick)
-char connection_nicks[MAXEVENTS][MAX_NICK_LENGTH];
+// Server statistics (connections; test statistics are kept per bank)
+time_t server_start_time;
 
-// Server statistics
-struct server_stats stats = {0};
-pthread_mutex_t stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+// Client descriptors are below this; sizes the fd-indexed tables
+static int max_fds = 0;
 
-int main(int argc, char **argv)
+// TCP port clients connect to
+static uint16_t server_port;
+
+// Monotonic ns when the messages being handled were received
+static uint64_t message_received_at;
+
+// Working directory at start, relative paths in the arguments refer to it
+static char start_dir[PATH_MAX];
+
+// Index of this worker process, 0 when not pre-forked
+static int worker_id = 0;
+
+// Open connections of each worker, in the shared arena when pre-forked
+static _Atomic int64_t *worker_connections = NULL;
+
+// The master of pre-forked workers writes the score log itself
+static int master_writes_scores = 0;
+
+// Startup timeline: milliseconds from the start of main() to the end of each phase
+static struct timespec init_started;
+static struct {
+    const char *name;
+    double ms;
+} init_timeline[INIT_PHASES];
+static int init_phases = 0;
+
+// Question files tried when no bank directory is given
+static const char *questions_paths[] = {
+    "resources/questions.json",               // When run from project root
+    "../resources/questions.json",            // When run from build/
+    "/usr/share/networkexam/questions.json",  // System install
+    NULL
+};
+
+// Banks are parsed on their own thread while the listener is set up
+struct bank_loader {
+    const char *banks_dir;
+    int loaded;
+    double ms;                  // Time spent parsing
+};
+
+// Out of descriptors the listener stays readable: stop watching it until a client
+// leaves; other workers take the queued connections
+static void pause_accepting(int epollfd, int listenfd, int activeconns, const char *reason)
 {
-    int                     listenfd, connfd;
-    int                     epollfd, currfd;
-    int                     nready, activeconns = 0;
-    uint16_t                port;
-    socklen_t               len;
-    char                    str[INET6_ADDRSTRLEN + 1];
-    struct sockaddr_in6     servaddr, cliaddr;
-    struct epoll_event      events[MAXEVENTS], ev;
+    epoll_ctl(epollfd, EPOLL_CTL_DEL, listenfd, NULL);
+    async_log(LOG_WARNING, "Not accepting at %d connections: %s", activeconns, reason);
+}
 
-    if ( argc == 2 ) {
-        port = atoi(argv[1]);
+// Raise the descriptor limit for clients (to the hard limit unless given) and return it
+static int raise_fd_limit(long connections)
+{
+    struct rlimit limit;
+    if ( getrlimit(RLIMIT_NOFILE, &limit) < 0 ) {
+        return -1;
+    }
+    if ( connections > 0 ) {
+        limit.rlim_cur = (rlim_t)connections + FD_RESERVE;
+        if ( limit.rlim_max != RLIM_INFINITY && limit.rlim_max < limit.rlim_cur ) {
+            limit.rlim_max = limit.rlim_cur;  // Root only
+        }
     } else {
-        printf("Enter port number: ");
-        scanf("%hu", &port);
+        limit.rlim_cur = limit.rlim_max;
     }
+    // Nick owners keep the fd in their low bits
+    if ( limit.rlim_cur > (rlim_t)1 << NICK_OWNER_FD_BITS ) {
+        limit.rlim_cur = (rlim_t)1 << NICK_OWNER_FD_BITS;
+    }
+    if ( setrlimit(RLIMIT_NOFILE, &limit) < 0 ) {
+        fprintf(stderr, "WARNING: cannot raise the descriptor limit to %llu: %s\n",
+                (unsigned long long)limit.rlim_cur, strerror(errno));
+        getrlimit(RLIMIT_NOFILE, &limit);
+    }
+    return (int)limit.rlim_cur;
+}
 
-    if ( (listenfd = socket(AF_INET6, SOCK_STREAM, 0)) < 0 ) {
-        int serr = errno;
-        fprintf(stderr, "socket error: %s\n", strerror(serr));
-        return 1;
+// Bind and listen on the port; several SO_REUSEPORT listeners form a group
+static int open_listener(uint16_t port, int reuseport)
+{
+    struct sockaddr_in6 servaddr;
+    int listenfd = socket(AF_INET6, SOCK_STREAM, 0);
+    if ( listenfd < 0 ) {
+        fprintf(stderr, "socket error: %s\n", strerror(errno));
+        return -1;
     }
 
     if ( set_socket_options(listenfd) == -1 ) {
         perror("set_socket_options\n");
     }
-    
+    int yes = 1;
+    if ( reuseport && setsockopt(listenfd, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(yes)) < 0 ) {
+        fprintf(stderr, "setsockopt SO_REUSEPORT error: %s\n", strerror(errno));
+        close(listenfd);
+        return -1;
+    }
+
     memset(&servaddr, 0, sizeof(servaddr));
     servaddr.sin6_family = AF_INET6;
     servaddr.sin6_addr = in6addr_any;
     servaddr.sin6_port = htons(port);
 
     if ( bind(listenfd, (SA*)&servaddr, sizeof(servaddr)) < 0 ) {
-        int serr = errno;
-        fprintf(stderr, "bind error: %s\n", strerror(serr));
-        return 1;
+        fprintf(stderr, "bind error: %s\n", strerror(errno));
+        close(listenfd);
+        return -1;
     }
 
     if ( listen(listenfd, LISTENQ) < 0 ) {
-        int serr = errno;
-        fprintf(stderr, "listen error: %s\n", strerror(serr));
+        fprintf(stderr, "listen error: %s\n", strerror(errno));
+        close(listenfd);
+        return -1;
+    }
+    return listenfd;
+}
+
+// Forget per-connection quiz state when the client goes away
+static void release_session(int fd)
+{
+    memset(&sessions[fd], 0, sizeof(sessions[fd]));
+}
+
+// Give the nickname of a connection back to the registry
+static void release_nick(int fd)
+{
+    nick_registry_release(server_nicks, connection_nicks[fd], NICK_OWNER(worker_id, fd));
+    connection_nicks[fd][0] = '\0';
+}
+
+// Count a connection opened (1) or closed (-1)
+static void count_connection(int delta)
+{
+    stats_add(server_counters, STATS_ACTIVE_CONNECTIONS, delta);
+    if (worker_connections) {
+        atomic_fetch_add_explicit(&worker_connections[worker_id], delta, memory_order_relaxed);
+    }
+}
+
+// Bank picked at login, or the default bank for clients that did not pick one
+static struct question_bank *session_bank(int fd)
+{
+    return sessions[fd].bank ? sessions[fd].bank : bank_default();
+}
+
+// Training questions come from the player's adaptive selector in the bank;
+// clients that did not log in get plain random ones
+static Question *next_training_question(int fd, struct question_bank *bank)
+{
+    int index = selector_store_next(&bank->selectors, connection_nicks[fd]);
+    return index < 0 ? quiz_get_random_question(&bank->db) : &bank->db.questions[index];
+}
+
+// Tell the client why its request could not be served
+static void send_error(int fd, uint8_t code, const char *message)
+{
+    uint8_t response[256];
+    ssize_t resp_len = tlv_create_error(response, code, message);
+    if (resp_len > 0) {
+        latency_send(fd, response, resp_len);
+    }
+}
+
+// Admin requests are only served to connections from this host
+static int peer_is_local(int fd)
+{
+    struct sockaddr_in6 peer;
+    socklen_t len = sizeof(peer);
+    if (getpeername(fd, (struct sockaddr *)&peer, &len) < 0 || peer.sin6_family != AF_INET6) {
+        return 0;
+    }
+    if (IN6_IS_ADDR_LOOPBACK(&peer.sin6_addr)) {
         return 1;
     }
+    // IPv4 client on the dual-stack socket: ::ffff:127.x.x.x
+    return IN6_IS_ADDR_V4MAPPED(&peer.sin6_addr) && peer.sin6_addr.s6_addr[12] == 127;
+}
 
-    // Load quiz questions
-    const char *questions_paths[] = {
-        "resources/questions.json",               // When run from project root
-        "../resources/questions.json",            // When run from build/
-        "/usr/share/networkexam/questions.json",  // System install
-        NULL
-    };
-    
-    int questions_loaded = 0;
-    for (int i = 0; questions_paths[i] != NULL; i++) {
-        if (quiz_load_questions(&quiz_db, questions_paths[i]) == 0) {
-            questions_loaded = 1;
-            break;
+// Seconds elapsed on the monotonic clock since start
+static uint32_t elapsed_seconds_since(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t)(now.tv_sec - start->tv_sec);
+}
+
+// Milliseconds elapsed on the monotonic clock since start
+static double elapsed_ms_since(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1e3 + (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+// Mark the end of a startup phase
+static void init_phase(const char *name)
+{
+    if (init_phases < INIT_PHASES) {
+        init_timeline[init_phases].name = name;
+        init_timeline[init_phases].ms = elapsed_ms_since(&init_started);
+        init_phases++;
+    }
+}
+
+// One log line with every phase, once the log is running
+static void log_init_timeline(void)
+{
+    char line[512];
+    size_t used = 0;
+    for (int i = 0; i < init_phases && used < sizeof(line); i++) {
+        used += snprintf(line + used, sizeof(line) - used, "%s%s %.1f",
+                         i > 0 ? ", " : "", init_timeline[i].name, init_timeline[i].ms);
+    }
+    async_log(LOG_INFO, "Startup timeline (ms since start): %s", init_phases > 0 ? line : "none");
+}
+
+static void *load_banks(void *arg)
+{
+    struct bank_loader *loader = arg;
+    struct timespec started;
+    clock_gettime(CLOCK_MONOTONIC, &started);
+
+    if (loader->banks_dir != NULL) {
+        loader->loaded = bank_load_directory(loader->banks_dir);
+    } else {
+        // The bundled bank, from the first path that has it
+        for (int i = 0; questions_paths[i] != NULL; i++) {
+            if (bank_load_file("questions", questions_paths[i]) == 0) {
+                loader->loaded = 1;
+                break;
+            }
         }
     }
-    
-    if (!questions_loaded) {
+    loader->ms = elapsed_ms_since(&started);
+    return NULL;
+}
+
+// Add a finished test to the bank's rankings and update its statistics
+static void server_record_score(struct question_bank *bank, const char *nick,
+                                uint8_t score, uint32_t time_seconds)
+{
+    score_log_append(bank->name, nick, score, time_seconds);
+    if (leaderboard_insert(&bank->leaderboard, nick, score, time_seconds) >= 0) {
+        async_log(LOG_INFO, "Saved score for %s in %s: %d/%d in %d seconds",
+               nick, bank->name, score, TEST_QUESTION_COUNT, time_seconds);
+    }
+
+    // Today, this week and this term rank the same result among their own players
+    time_t now = time(NULL);
+    for (int w = RANKING_WINDOW_ALL + 1; w < RANKING_WINDOWS; w++) {
+        leaderboard_insert(bank_leaderboard(bank, w, now), nick, score, time_seconds);
+    }
+
+    // Update statistics
+    stats_add(&bank->stats, STATS_TESTS_COMPLETED, 1);
+    stats_add(&bank->stats, STATS_TOTAL_SCORE, score);
+    stats_offer_best(&bank->stats, score, time_seconds, nick);
+}
+
+// Housekeeping of the pre-fork master between reaping workers
+static void master_housekeeping(int final)
+{
+    if (master_writes_scores) {
+        score_log_run_once(!final);
+    } else if (!final) {
+        sleep(1);
+    }
+    if (!final) {
+        ranking_window_service();
+    }
+}
+
+// Load figures of the discovery announcements, for the whole server
+static void discovery_load(struct discovery_info *info)
+{
+    int64_t open = (int64_t)stats_read(server_counters, STATS_ACTIVE_CONNECTIONS);
+    info->connections = open > 0 ? (uint32_t)open : 0;
+    info->max_connections = (uint32_t)(max_fds - FD_RESERVE) * (uint32_t)cpu_placement_reactors();
+    // Of this event loop only; workers share the accept queue, so their loops look alike
+    info->loop_latency_us = (uint32_t)(latency_loop_average() / 1000);
+    struct question_bank *bank = bank_default();
+    info->bank_version = bank ? bank->db.version : 0;
+}
+
+// Start over in a fresh image that rebuilds the shared state from the banks and
+// the score log; the listener is handed over the way a service manager does it
+static void restart_server(char **argv, int listenfd)
+{
+    char pid[16];
+    char exe[PATH_MAX];
+    ssize_t len = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+    if ( len < 0 ) {
+        return;
+    }
+    exe[len] = '\0';   // Its own name, not "exe", for ps and pkill
+
+    if ( listenfd != LISTEN_FDS_START && dup2(listenfd, LISTEN_FDS_START) < 0 ) {
+        return;
+    }
+    snprintf(pid, sizeof(pid), "%d", (int)getpid());
+    setenv("LISTEN_PID", pid, 1);
+    setenv("LISTEN_FDS", "1", 1);
+    // The dropped privileges may not reach it; absolute paths in argv still work
+    if ( chdir(start_dir) < 0 ) {
+        syslog(LOG_WARNING, "Restarting in /, cannot enter %s: %s", start_dir, strerror(errno));
+    }
+    execv(exe, argv);
+}
+
+// A worker exited: its connections are gone, and so are their nicks
+static void worker_exited(int worker)
+{
+    int64_t open = atomic_exchange_explicit(&worker_connections[worker], 0, memory_order_relaxed);
+    stats_add(server_counters, STATS_ACTIVE_CONNECTIONS, -open);
+    metrics_worker_exited(worker);
+    uint32_t released = nick_registry_release_group(server_nicks, worker);
+    async_log(LOG_NOTICE, "Worker %d dropped %lld connections, released %u nicks",
+              worker, (long long)open, released);
+}
+
+// SIGUSR1 logs more, SIGUSR2 logs less
+static void change_log_level(int signo)
+{
+    async_log_set_level(async_log_level() + (signo == SIGUSR1 ? 1 : -1));
+}
+
+// Serve one complete message of a client
+static void handle_message(int fd, uint16_t type, const uint8_t *value, uint16_t value_len)
+{
+    latency_begin(type, message_received_at);
+    cpu_placement_count_request(worker_id);
+
+    if ( type == TLV_LOGIN_REQUEST ) {
+        // The client may pick a question bank after the nickname
+        char bank_name[MAX_BANK_NAME_LENGTH];
+        struct question_bank *bank = NULL;
+        if (tlv_parse_login_bank(value, value_len,
+                                 bank_name, sizeof(bank_name)) < 0 ||
+            (bank = bank_find(bank_name)) == NULL) {
+            async_log(LOG_NOTICE, "Unknown question bank '%s' from fd %d", bank_name, fd);
+            uint8_t response[256];
+            ssize_t resp_len = tlv_create_login_response(response, LOGIN_ERROR_UNKNOWN_BANK,
+                                                         "Unknown question bank");
+            if (resp_len > 0) {
+                latency_send(fd, response, resp_len);
+            }
+            return;
+        }
+
+        char nick[MAX_NICK_LENGTH];
+        if (server_handle_login(fd, NICK_OWNER(worker_id, fd), value, nick) == 0) {
+            // A second login under another name frees the first one
+            if (connection_nicks[fd][0] != '\0' &&
+                strcmp(connection_nicks[fd], nick) != 0) {
+                release_nick(fd);
+            }
+
+            // Save nick for this connection
+            strncpy(connection_nicks[fd], nick, MAX_NICK_LENGTH - 1);
+            connection_nicks[fd][MAX_NICK_LENGTH - 1] = '\0';
+
+            // A test in progress belongs to the previous bank
+            if (sessions[fd].bank != bank) {
+                release_session(fd);
+                sessions[fd].bank = bank;
+            }
+        }
+    } else if ( type == TLV_REQUEST_QUESTION ) {
+        // Parse request
+        uint8_t mode, question_index;
+        if (tlv_parse_request_question(value, &mode, &question_index) < 0) {
+            async_log(LOG_ERR, "Failed to parse REQUEST_QUESTION from fd %d", fd);
+            return;
+        }
+        
+        struct question_bank *bank = session_bank(fd);
+
+        // Optional tag filter follows mode and question_index
+        uint8_t filter_op, num_tags;
+        char tags[MAX_FILTER_TAGS][MAX_TAG_LENGTH];
+        if (tlv_parse_question_filter(value, value_len,
+                                      &filter_op, tags, &num_tags) < 0) {
+            async_log(LOG_ERR, "Invalid tag filter in REQUEST_QUESTION from fd %d", fd);
+            return;
+        }
+
+        Question *q;
+        if (bank == NULL) {
+            q = NULL;
+        } else if (filter_op != TAG_FILTER_NONE) {
+            // Unknown tags match nothing
+            int tag_ids[MAX_FILTER_TAGS];
+            int known = 0;
+            for (int t = 0; t < num_tags; t++) {
+                int id = quiz_find_tag(&bank->db, tags[t]);
+                if (id >= 0) {
+                    tag_ids[known++] = id;
+                }
+            }
+            int match_all = filter_op == TAG_FILTER_ALL;
+            q = (match_all && known < num_tags) ? NULL :
+                quiz_get_random_tagged_question(&bank->db, match_all, tag_ids, known);
+        } else {
+            // Training adapts to the user, tests draw uniformly
+            q = mode == MODE_RANDOM ? next_training_question(fd, bank)
+                                    : quiz_get_random_question(&bank->db);
+        }
+        if (!q) {
+            async_log(LOG_NOTICE, "No matching questions for fd %d", fd);
+            send_error(fd, ERROR_NO_QUESTIONS,
+                       filter_op != TAG_FILTER_NONE ? "No questions match the tag filter"
+                                                    : "No questions available");
+            return;
+        }
+        
+        // Prepare answers as array of pointers
+        const char *answers[MAX_ANSWERS_PER_Q];
+        for (int i = 0; i < q->num_odpowiedzi; i++) {
+            answers[i] = q->odpowiedzi[i];
+        }
+        
+        // Create QUESTION_DATA message
+        uint8_t response[4096];
+        ssize_t resp_len = tlv_create_question_data(response, q->id, q->pytanie, 
+                                                     answers, q->num_odpowiedzi);
+        if (resp_len > 0) {
+            latency_send(fd, response, resp_len);
+
+            // Remember what was asked, a test starts with its first question
+            struct quiz_session *sess = &sessions[fd];
+            if (mode == MODE_TEST && (question_index == 0 || !sess->test_active)) {
+                sess->test_active = true;
+                sess->test_answered = 0;
+                sess->test_correct = 0;
+                clock_gettime(CLOCK_MONOTONIC, &sess->test_start);
+            }
+            sess->has_pending = true;
+            sess->pending_mode = mode;
+            sess->pending_question = q->id;
+            sess->pending_index = (uint32_t)(q - bank->db.questions);
+            sess->pending_sent = message_received_at;
+            
+            // Update statistics
+            stats_add(&bank->stats, STATS_QUESTIONS_ASKED, 1);
+            question_stats_asked(&bank->question_stats[sess->pending_index]);
+        }
+    } else if ( type == TLV_ANSWER_SUBMIT ) {
+        // Parse answer
+        uint32_t question_id;
+        uint8_t answer_id;
+        if (value_len < 5 || tlv_parse_answer_submit(value, &question_id, &answer_id) < 0) {
+            async_log(LOG_ERR, "Failed to parse ANSWER_SUBMIT from fd %d", fd);
+            return;
+        }
+        
+        // Find question
+        struct question_bank *bank = session_bank(fd);
+        Question *q = bank && question_id <= INT_MAX ? quiz_get_question_by_id(&bank->db, (int)question_id) : NULL;
+        if (!q) {
+            async_log(LOG_ERR, "Question %u not found for fd %d", question_id, fd);
+            return;
+        }
+        
+        // Only the question that was actually sent counts, once
+        struct quiz_session *sess = &sessions[fd];
+        int counted = sess->has_pending && sess->pending_question == question_id;
+        int in_test = counted && sess->pending_mode == MODE_TEST && sess->test_active;
+        if (counted) {
+            // The ID may be shared by several questions, the position is not
+            q = &bank->db.questions[sess->pending_index];
+            sess->has_pending = false;
+            question_stats_answered(&bank->question_stats[sess->pending_index], answer_id,
+                                    message_received_at - sess->pending_sent);
+        }
+
+        // Check answer
+        int is_correct = quiz_check_answer(q, answer_id);
+        uint8_t correct_answer_id = q->poprawna - 1;
+
+        uint8_t answered, correct;
+        if (in_test) {
+            sess->test_answered++;
+            sess->test_correct += is_correct ? 1 : 0;
+            answered = sess->test_answered;
+            correct = sess->test_correct;
+        } else {
+            if (counted) {
+                selector_store_record(&bank->selectors, connection_nicks[fd],
+                                      (int)(q - bank->db.questions), is_correct);
+            }
+            if (counted && sess->training_answered < UINT8_MAX) {
+                sess->training_answered++;
+                sess->training_correct += is_correct ? 1 : 0;
+            }
+            answered = sess->training_answered;
+            correct = sess->training_correct;
+        }
+        
+        // Create ANSWER_RESULT message
+        uint8_t response[4096];
+        ssize_t resp_len = tlv_create_answer_result(response, question_id, 
+                                                     is_correct, correct_answer_id,
+                                                     in_test ? 1 : 0, answered, correct);
+        if (resp_len > 0) {
+            latency_send(fd, response, resp_len);
+        }
+
+        // Last answer of the test finalizes the ranking entry
+        if (in_test && sess->test_answered >= TEST_QUESTION_COUNT) {
+            sess->test_active = false;
+            if (connection_nicks[fd][0] != '\0') {
+                server_record_score(bank, connection_nicks[fd], sess->test_correct,
+                                    elapsed_seconds_since(&sess->test_start));
+            }
+        }
+    } else if ( type == TLV_SUBMIT_SCORE ) {
+        // Scores are computed from ANSWER_SUBMIT, self-reported ones are ignored
+        async_log(LOG_NOTICE, "Ignoring client-reported SUBMIT_SCORE from fd %d", fd);
+    } else if ( type == TLV_REQUEST_RANKING ) {
+        uint8_t mode, limit, window;
+        uint32_t offset;
+        char nick[MAX_NICK_LENGTH];
+        if (tlv_parse_request_ranking(value, value_len, &mode, &offset,
+                                      &limit, nick, sizeof(nick), &window) < 0) {
+            async_log(LOG_WARNING, "Malformed REQUEST_RANKING from fd %d", fd);
+            return;
+        }
+
+        struct question_bank *bank = session_bank(fd);
+        if (!bank) {
+            send_error(fd, ERROR_NO_QUESTIONS, "No question bank loaded");
+            return;
+        }
+        struct leaderboard *board = bank_leaderboard(bank, window, time(NULL));
+        if (!board) {
+            send_error(fd, ERROR_INVALID_QUERY, "Unknown ranking window");
+            return;
+        }
+
+        if (mode == RANKING_TOP) {
+            // Send the cached ranking frame of the client's bank
+            uint8_t response[LEADERBOARD_FRAME_SIZE];
+            size_t resp_len = leaderboard_copy_frame(board, response);
+            if (resp_len > 0) {
+                latency_send(fd, response, resp_len);
+                async_log(LOG_INFO, "Sent ranking data to fd %d", fd);
+            }
+            return;
+        }
+        if (mode != RANKING_OFFSET && mode != RANKING_AROUND) {
+            send_error(fd, ERROR_INVALID_QUERY, "Unknown ranking mode");
+            return;
+        }
+
+        // One page, located by rank in the leaderboard; the work is bounded by the page size
+        if (limit == 0 || limit > MAX_RANKING_PAGE) {
+            limit = MAX_RANKING_PAGE;
+        }
+        struct score_entry entries[MAX_RANKING_PAGE];
+        uint32_t first_rank, total, count;
+        if (mode == RANKING_OFFSET) {
+            count = leaderboard_page(board, offset, limit, entries, &total);
+            first_rank = count > 0 ? offset + 1 : 0;
+        } else {
+            if (nick[0] == '\0') {
+                strncpy(nick, connection_nicks[fd], sizeof(nick) - 1);
+                nick[sizeof(nick) - 1] = '\0';
+            }
+            count = leaderboard_around(board, nick, limit, entries,
+                                       &first_rank, &total);
+        }
+
+        char nicks[MAX_RANKING_PAGE][MAX_NICK_LENGTH];
+        uint8_t scores[MAX_RANKING_PAGE];
+        uint32_t times[MAX_RANKING_PAGE];
+        for (uint32_t i = 0; i < count; i++) {
+            strncpy(nicks[i], entries[i].nick, MAX_NICK_LENGTH - 1);
+            nicks[i][MAX_NICK_LENGTH - 1] = '\0';
+            scores[i] = entries[i].score;
+            times[i] = entries[i].time_seconds;
+        }
+
+        uint8_t response[TLV_HEADER_SIZE + 9 + MAX_RANKING_PAGE * (1 + MAX_NICK_LENGTH + 1 + 4)];
+        ssize_t resp_len = tlv_create_ranking_page(response, first_rank, total, count,
+                                                   nicks, scores, times);
+        if (resp_len > 0) {
+            latency_send(fd, response, resp_len);
+        }
+    } else if ( type == TLV_REQUEST_RANK ) {
+        // Rank of a player (the requester by default) in the client's bank
+        char nick[MAX_NICK_LENGTH];
+        if (tlv_parse_request_rank(value, value_len, nick, sizeof(nick)) < 0) {
+            async_log(LOG_WARNING, "Malformed REQUEST_RANK from fd %d", fd);
+            return;
+        }
+        if (nick[0] == '\0') {
+            strncpy(nick, connection_nicks[fd], sizeof(nick) - 1);
+            nick[sizeof(nick) - 1] = '\0';
+        }
+
+        struct question_bank *bank = session_bank(fd);
+        struct score_entry best = {0};
+        uint32_t total = 0;
+        uint32_t rank = bank ? leaderboard_rank(&bank->leaderboard, nick, &best, &total) : 0;
+
+        uint8_t response[64];
+        ssize_t resp_len = tlv_create_rank_data(response, rank, total, best.score,
+                                                best.time_seconds, nick);
+        if (resp_len > 0) {
+            latency_send(fd, response, resp_len);
+        }
+    } else if ( type == TLV_REQUEST_SERVER_INFO ) {
+        // Calculate server info; every value is read once, into locals
+        time_t current_time = time(NULL);
+        uint32_t uptime = (uint32_t)difftime(current_time, server_start_time);
+        struct server_stats server_info = {0};
+        stats_collect(server_counters, &server_info);
+
+        // Test statistics come from the client's bank
+        struct question_bank *bank = session_bank(fd);
+        struct server_stats bank_stats = {0};
+        int num_questions = 0;
+        strcpy(bank_stats.best_player, "N/A");
+        if (bank) {
+            stats_collect(&bank->stats, &bank_stats);
+            num_questions = bank->db.count;
+        }
+        uint8_t avg_score = bank_stats.tests_completed > 0 ? 
+                           (bank_stats.total_score / bank_stats.tests_completed) : 0;
+        
+        // Create SERVER_INFO_DATA message
+        uint8_t response[4096];
+        ssize_t resp_len = tlv_create_server_info_data(response, uptime,
+                                                        server_info.active_connections,
+                                                        server_info.total_connections,
+                                                        num_questions,
+                                                        bank_stats.tests_completed,
+                                                        bank_stats.questions_asked,
+                                                        avg_score,
+                                                        bank_stats.best_score,
+                                                        bank_stats.best_time,
+                                                        bank_stats.best_player,
+                                                        server_port);
+        if (resp_len > 0) {
+            latency_send(fd, response, resp_len);
+            async_log(LOG_INFO, "Sent server info to fd %d", fd);
+        }
+    } else if ( type == TLV_REQUEST_LATENCY ) {
+        // Latency percentiles per message type, for operators on this host
+        if (!peer_is_local(fd)) {
+            send_error(fd, ERROR_NOT_PERMITTED, "Latency statistics are only served locally");
+            return;
+        }
+
+        struct latency_summary summaries[MAX_LATENCY_SUMMARIES];
+        int count = latency_summarize(summaries, MAX_LATENCY_SUMMARIES);
+
+        uint8_t response[TLV_HEADER_SIZE + 1 + MAX_LATENCY_SUMMARIES * (2 + 1 + 8 + (LATENCY_QUANTILES + 1) * 8)];
+        ssize_t resp_len = tlv_create_latency_data(response, (uint8_t)count, summaries);
+        if (resp_len > 0) {
+            latency_send(fd, response, resp_len);
+        }
+    } else if ( type == TLV_REQUEST_QUESTION_STATS ) {
+        // Answer statistics of a bank's questions, for exam authors on this host
+        if (!peer_is_local(fd)) {
+            send_error(fd, ERROR_NOT_PERMITTED, "Question statistics are only served locally");
+            return;
+        }
+
+        uint32_t offset;
+        uint8_t limit;
+        char bank_name[MAX_BANK_NAME_LENGTH];
+        if (tlv_parse_request_question_stats(value, value_len, &offset,
+                                             &limit, bank_name, sizeof(bank_name)) < 0) {
+            send_error(fd, ERROR_INVALID_QUERY, "Malformed question statistics request");
+            return;
+        }
+
+        struct question_bank *bank = bank_name[0] ? bank_find(bank_name) : session_bank(fd);
+        if (!bank) {
+            send_error(fd, ERROR_NO_QUESTIONS, "Unknown question bank");
+            return;
+        }
+
+        struct question_summary summaries[MAX_QUESTION_STATS_PAGE];
+        int count = 0;
+        for (uint32_t i = offset; i < (uint32_t)bank->db.count && count < limit; i++) {
+            question_stats_read(&bank->question_stats[i], &bank->db.questions[i], &summaries[count++]);
+        }
+
+        uint8_t response[TLV_HEADER_SIZE + 9 + MAX_QUESTION_STATS_PAGE * (4 + 1 + 1 + 4 + 4 + MAX_ANSWERS * 4)];
+        ssize_t resp_len = tlv_create_question_stats(response, (uint32_t)bank->db.count, offset,
+                                                     (uint8_t)count, summaries);
+        if (resp_len > 0) {
+            latency_send(fd, response, resp_len);
+        }
+    } else if ( type == TLV_SEARCH_QUESTIONS ) {
+        // Find questions of the client's bank containing every query word
+        char query[MAX_SEARCH_QUERY_LENGTH + 1];
+        uint16_t max_results;
+        if (tlv_parse_search_questions(value, value_len, query, sizeof(query), &max_results) < 0) {
+            send_error(fd, ERROR_INVALID_QUERY, "Malformed search request");
+            return;
+        }
+
+        struct question_bank *bank = session_bank(fd);
+        int ids[MAX_SEARCH_IDS];
+        int max_ids = max_results < MAX_SEARCH_IDS ? max_results : MAX_SEARCH_IDS;
+        int found = bank ? quiz_search_questions(&bank->db, query, ids, max_ids) : 0;
+        if (found < 0) {
+            send_error(fd, ERROR_INVALID_QUERY, "Search query has no words");
+            return;
+        }
+
+        uint8_t response[4096];
+        ssize_t resp_len = tlv_create_search_results(response, ids, found);
+        if (resp_len > 0) {
+            latency_send(fd, response, resp_len);
+            async_log(LOG_INFO, "Search '%s' from fd %d: %d questions", query, fd, found);
+        }
+    } else {
+        async_log(LOG_WARNING, "Unexpected message type: 0x%04X\n", type);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int                     listenfd, connfd;
+    int                     epollfd, currfd;
+    int                     nready, activeconns = 0;
+    int                     opt;
+    uint16_t                port;
+    socklen_t               len;
+    char                    str[INET6_ADDRSTRLEN + 1];
+    const char              *banks_dir = NULL;
+    const char              *data_dir = NULL;
+    const char              *log_file = NULL;
+    char                    log_path[PATH_MAX];
+    int                     metrics_port = 0;
+    int                     workers = 0;
+    int                     steer = 0;
+    const char              *discovery_groups = NULL;
+    const char              *discovery_interface = NULL;
+    long                    max_connections = 0;
+    int                     listeners[PREFORK_MAX_WORKERS];
+    int                     nlisteners = 0;
+    char                    data_path[PATH_MAX];
+    struct sockaddr_in6     cliaddr;
+    struct epoll_event      events[MAXEVENTS], ev;
+    struct bank_loader      loader = { NULL, 0, 0 };
+    pthread_t               loader_thread;
+    int                     loader_started;
+    int                     accepted_any = 0;
+    uint32_t                listen_events;
+    int                     accept_paused_at = -1;
+
+    clock_gettime(CLOCK_MONOTONIC, &init_started);
+    if ( getcwd(start_dir, sizeof(start_dir)) == NULL ) {
+        strcpy(start_dir, "/");
+    }
+
+    while ( (opt = getopt(argc, argv, "b:c:d:g:i:l:m:n:st:w:")) != -1 ) {
+        switch (opt) {
+            case 'b':
+                // Directory with one JSON file per question bank
+                banks_dir = optarg;
+                break;
+            case 'c':
+                // CPUs of the event loops, helper threads run elsewhere
+                if ( cpu_placement_parse(optarg) < 0 ) {
+                    fprintf(stderr, "invalid CPU list '%s', expected allowed CPUs like 0,2-5\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'd':
+                // Directory for the score log and snapshots
+                data_dir = optarg;
+                break;
+            case 'g':
+                // Discovery groups, IPv4 and IPv6, announced on together
+                discovery_groups = optarg;
+                break;
+            case 'i':
+                // Interface for discovery instead of all multicast interfaces
+                discovery_interface = optarg;
+                break;
+            case 'l':
+                // Log file instead of syslog
+                log_file = optarg;
+                break;
+            case 'm':
+                // Local port for the OpenMetrics exporter
+                metrics_port = atoi(optarg);
+                break;
+            case 'n':
+                // Client connections per process; the descriptor limit is raised to match
+                max_connections = atol(optarg);
+                if ( max_connections < 1 || max_connections > (1L << NICK_OWNER_FD_BITS) - FD_RESERVE ) {
+                    fprintf(stderr, "invalid connection limit '%s', expected 1 to %ld\n", optarg,
+                            (1L << NICK_OWNER_FD_BITS) - FD_RESERVE);
+                    return 1;
+                }
+                break;
+            case 's':
+                // Each worker accepts the connections received on its CPU
+                steer = 1;
+                break;
+            case 't':
+                // Term start dates for the term ranking, before the banks are loaded
+                if ( ranking_window_set_terms(optarg) < 0 ) {
+                    fprintf(stderr, "invalid term start dates '%s', expected MM-DD[,MM-DD...]\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'w':
+                // Pre-forked worker processes, 0 for a single process
+                workers = atoi(optarg);
+                if ( workers < 0 || workers > PREFORK_MAX_WORKERS ) {
+                    fprintf(stderr, "invalid worker count '%s', expected 0 to %d\n", optarg, PREFORK_MAX_WORKERS);
+                    return 1;
+                }
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-b banks_dir] [-c cpus] [-d data_dir] [-g groups] [-i interface] [-l log_file] [-m metrics_port] "
+                                "[-n max_connections] [-s] [-t term_starts] [-w workers] [port]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    if ( (discovery_groups || discovery_interface) &&
+         discovery_configure(discovery_groups, discovery_interface) < 0 ) {
+        fprintf(stderr, "invalid discovery %s: %s\n", errno == ENODEV ? "interface" : "groups",
+                errno == ENODEV ? discovery_interface : discovery_groups);
+        return 1;
+    }
+
+    // Descriptors are raised while still root, daemon_init() drops privileges
+    max_fds = raise_fd_limit(max_connections);
+    if ( max_fds < 0 ) {
+        fprintf(stderr, "descriptor limit: %s\n", strerror(errno));
+        return 1;
+    }
+
+    // Everything the workers share is allocated from here on: banks, rankings, statistics
+    if ( workers > 0 ) {
+        if ( shared_arena_init(SHARED_ARENA_SIZE) < 0 ) {
+            fprintf(stderr, "shared memory: %s\n", strerror(errno));
+            return 1;
+        }
+        worker_connections = shared_calloc(workers, sizeof(*worker_connections));
+        if ( worker_connections == NULL ) {
+            fprintf(stderr, "shared memory: out of memory\n");
+            return 1;
+        }
+    }
+    if ( cpu_placement_init(workers > 0 ? workers : 1) < 0 ) {
+        fprintf(stderr, "reactor counters: out of memory\n");
+        return 1;
+    }
+    if ( latency_init(workers > 0 ? workers : 1) < 0 || metrics_init(workers > 0 ? workers : 1) < 0 ) {
+        fprintf(stderr, "latency tables: out of memory\n");
+        return 1;
+    }
+
+    // Parse the question banks while the listener is set up
+    loader.banks_dir = banks_dir;
+    loader_started = pthread_create(&loader_thread, NULL, load_banks, &loader) == 0;
+    if ( !loader_started ) {
+        load_banks(&loader);
+    }
+
+    // A service manager may hand over a bound socket that already queues clients
+    listenfd = inherited_listener(&port);
+    if ( listenfd >= 0 ) {
+        printf("Using listening socket from the service manager, port %hu\n", port);
+        if ( steer ) {
+            fprintf(stderr, "WARNING: -s ignored, the service manager's socket is shared by all workers\n");
+        }
+        listeners[nlisteners++] = listenfd;
+    } else {
+        if ( optind < argc ) {
+            port = atoi(argv[optind]);
+        } else {
+            printf("Enter port number: ");
+            scanf("%hu", &port);
+        }
+
+        // Steering needs one listener per worker, in worker order
+        if ( steer && (workers == 0 || cpu_placement_cpu(0) < 0) ) {
+            fprintf(stderr, "WARNING: -s ignored, it needs -w and -c\n");
+            steer = 0;
+        }
+        do {
+            if ( (listenfd = open_listener(port, steer)) < 0 ) {
+                return 1;
+            }
+            listeners[nlisteners++] = listenfd;
+        } while ( steer && nlisteners < workers );
+        listenfd = listeners[0];
+
+        if ( steer && cpu_placement_steer(listeners, nlisteners) < 0 ) {
+            fprintf(stderr, "WARNING: cannot steer connections by CPU: %s\n", strerror(errno));
+        }
+    }
+    server_port = port;
+    init_phase("listener");
+
+    if ( loader_started ) {
+        pthread_join(loader_thread, NULL);
+    }
+    init_phase("banks");
+
+    if ( banks_dir != NULL && loader.loaded <= 0 ) {
+        fprintf(stderr, "WARNING: No question banks loaded from %s\n", banks_dir);
+    }
+    if ( bank_count() == 0 ) {
         fprintf(stderr, "WARNING: Failed to load questions from any path - quiz will not work!\n");
     }
 
+    // Restore rankings and statistics; the daemon changes directory, so resolve the path first
+    if ( data_dir != NULL ) {
+        if ( realpath(data_dir, data_path) == NULL ) {
+            fprintf(stderr, "data directory %s: %s\n", data_dir, strerror(errno));
+            return 1;
+        }
+        long replayed = score_log_recover(data_path);
+        if ( replayed < 0 ) {
+            fprintf(stderr, "Failed to recover scores from %s\n", data_path);
+            return 1;
+        }
+        printf("Recovered scores from %s (%ld logged events)\n", data_path, replayed);
+        init_phase("scores");
+    }
+
+    // The log file is opened after the daemon changed directory
+    if ( log_file != NULL ) {
+        if ( log_file[0] == '/' ) {
+            snprintf(log_path, sizeof(log_path), "%s", log_file);
+        } else if ( getcwd(log_path, sizeof(log_path)) == NULL ||
+                    strlen(log_path) + 1 + strlen(log_file) >= sizeof(log_path) ) {
+            fprintf(stderr, "log file %s: path too long\n", log_file);
+            return 1;
+        } else {
+            strcat(log_path, "/");
+            strcat(log_path, log_file);
+        }
+    }
+
     // Initialize server statistics
-    stats.start_time = time(NULL);
-    stats.total_connections = 0;
-    stats.active_connections = 0;
-    stats.tests_completed = 0;
-    stats.questions_asked = 0;
-    stats.total_score = 0;
-    stats.best_score = 0;
-    stats.best_time = 0;
-    strcpy(stats.best_player, "N/A");
+    server_start_time = time(NULL);
+    server_counters = shared_aligned_alloc(sizeof(*server_counters));
+    server_nicks = shared_aligned_alloc(sizeof(*server_nicks));
+    if ( server_counters == NULL || server_nicks == NULL ) {
+        fprintf(stderr, "server statistics: out of memory\n");
+        return 1;
+    }
+    stats_init(server_counters);
+    if ( nick_registry_init(server_nicks) < 0 ) {
+        fprintf(stderr, "nick registry: out of memory\n");
+        return 1;
+    }
 
     printf("Server initialized\n");
 
     // Demonization of the process
-    if ( daemon_init(argv[0], LOG_LOCAL0, 1000, listenfd) < 0 ) {
+    if ( daemon_init_keep(argv[0], LOG_LOCAL0, 1000, listeners, nlisteners) < 0 ) {
         fprintf(stderr, "daemon_init failed\n");
         exit(EXIT_FAILURE);
     }
+    init_phase("daemon");
 
-    syslog(LOG_NOTICE, "Program started by User %d\n", getuid());
-    syslog(LOG_INFO, "Loaded %d quiz questions", quiz_db.count);
+    // The master keeps the score log and the window janitor, workers serve clients
+    if ( workers > 0 ) {
+        if ( data_dir != NULL ) {
+            if ( score_log_open() == 0 ) {
+                master_writes_scores = 1;
+            } else {
+                syslog(LOG_ERR, "Score persistence disabled: cannot write to %s", data_path);
+            }
+        }
+        worker_id = prefork_start(workers, master_housekeeping, worker_exited);
+        if ( worker_id == PREFORK_RESTART ) {
+            restart_server(argv, listenfd);
+            syslog(LOG_ERR, "Cannot restart the server: %s", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        if ( worker_id < 0 ) {
+            syslog(LOG_ERR, "Cannot start %d workers", workers);
+            exit(EXIT_FAILURE);
+        }
+        // A worker's threads take their own statistics shards and latency tables
+        stats_set_first_shard(worker_id);
+        latency_set_worker(worker_id);
+        if ( nlisteners > 1 ) {
+            listenfd = listeners[worker_id];
+        }
+    }
+
+    // Threads started from here on stay off the reactor CPUs
+    if ( cpu_placement_pin_helpers() < 0 ) {
+        syslog(LOG_WARNING, "Cannot move helper threads off the reactor CPUs");
+    }
+
+    // From here on the request path only records log entries, a thread writes them
+    if ( async_log_start(log_file != NULL ? log_path : NULL) < 0 ) {
+        syslog(LOG_ERR, "Asynchronous logging disabled: %s", log_file != NULL ? log_path : "no thread");
+    }
+    struct sigaction level_action;
+    memset(&level_action, 0, sizeof(level_action));
+    level_action.sa_handler = change_log_level;
+    level_action.sa_flags = SA_RESTART;
+    sigaction(SIGUSR1, &level_action, NULL);
+    sigaction(SIGUSR2, &level_action, NULL);
+
+    async_log(LOG_NOTICE, "Program started by User %d\n", getuid());
+
+    // Scores are logged by a background thread, started after the fork
+    if ( workers == 0 && data_dir != NULL && score_log_start() < 0 ) {
+        async_log(LOG_ERR, "Score persistence disabled: cannot write to %s", data_path);
+    }
+    // Window rankings are rolled over by swapping in boards this thread prepares
+    if ( workers == 0 && ranking_window_start() < 0 ) {
+        async_log(LOG_WARNING, "Ranking window janitor not started, rollovers run in the event loop");
+    }
+    for (int i = 0; i < bank_count(); i++) {
+        async_log(LOG_INFO, "Loaded %d quiz questions in bank '%s'",
+               bank_at(i)->db.count, bank_at(i)->name);
+    }
+    async_log(LOG_INFO, "Text validation: %s", text_validate_impl());
 
 
     // Setting the socket to non-blocking mode, required by epoll
     if ( set_nonblocking(listenfd) < 0 ) {
         int serr = errno;
-        syslog(LOG_ERR, "set_nonblocking: %s\n", strerror(serr));
+        async_log(LOG_ERR, "set_nonblocking: %s\n", strerror(serr));
     }
 
     // Creating epoll instances
     if ( (epollfd = epoll_create1(EPOLL_CLOEXEC)) == -1 ) {
         int serr = errno;
-        syslog(LOG_ERR, "epoll_create1() error: %s", strerror(serr));
+        async_log(LOG_ERR, "epoll_create1() error: %s", strerror(serr));
         return -1;
     }
 
-    // Waiting for accept, ready to read
-    ev.events = EPOLLIN;
+    // Waiting for accept, ready to read; one worker is woken per connection on a shared listener
+    listen_events = workers > 0 && nlisteners == 1 ? EPOLLIN | EPOLLEXCLUSIVE : EPOLLIN;
+    ev.events = listen_events;
     // When epoll returns an event, it's shows which descriptor it was related to
     ev.data.fd = listenfd;
 
     // Setting listenfd to wait for an event
     if ( epoll_ctl(epollfd, EPOLL_CTL_ADD, listenfd, &ev) == -1 ) {
         int serr = errno;
-        syslog(LOG_ERR, "listen error: %s\n", strerror(serr));
+        async_log(LOG_ERR, "listen error: %s\n", strerror(serr));
+    }
+
+    // Monitoring endpoint, served by this event loop (of the first worker)
+    if ( worker_id == 0 && metrics_port > 0 && metrics_start(epollfd, metrics_port, server_start_time) < 0 ) {
+        int serr = errno;
+        async_log(LOG_WARNING, "Metrics exporter disabled, port %d: %s", metrics_port, strerror(serr));
     }
 
     // Get local IP address for discovery
@@ -156,19 +1119,40 @@ int main(int argc, char **argv)
     
     if ( local_ip == NULL ) {
         local_ip = "127.0.0.1";
-        syslog(LOG_WARNING, "Warning: Could not detect local IP, using localhost\n");
+        async_log(LOG_WARNING, "Warning: Could not detect local IP, using localhost\n");
         
     } else {
-        syslog(LOG_INFO, "Detected local IP: %s\n", local_ip);
+        async_log(LOG_INFO, "Detected local IP: %s\n", local_ip);
     }
     
-    // Start discovery announcement service
-    if ( start_discovery_service(local_ip, port) < 0 ) {
+    // Start discovery announcement service, once per server
+    if ( worker_id == 0 && start_discovery_service(local_ip, port, discovery_load) < 0 ) {
         int serr = errno;
-        syslog(LOG_WARNING, "Failed to start discovery service: %s", strerror(serr));
+        async_log(LOG_WARNING, "Failed to start discovery service: %s", strerror(serr));
     }
     
-    syslog(LOG_NOTICE, "Server listening on port %d\n", port);
+    if ( workers > 0 ) {
+        async_log(LOG_NOTICE, "Worker %d listening on port %d\n", worker_id, port);
+    } else {
+        async_log(LOG_NOTICE, "Server listening on port %d\n", port);
+    }
+
+    // The event loop runs on its own CPU, its tables on that CPU's node
+    cpu_placement_pin_reactor(worker_id);
+    connection_nicks = calloc(max_fds, sizeof(*connection_nicks));
+    sessions = calloc(max_fds, sizeof(*sessions));
+    if ( connection_nicks == NULL || sessions == NULL || connection_table_init(epollfd, max_fds) < 0 ) {
+        async_log(LOG_ERR, "Connection tables: out of memory");
+        async_log_flush();
+        return 1;
+    }
+
+    // Where startup time went; the banks were parsed next to the listener setup
+    init_phase("ready");
+    if ( worker_id == 0 ) {
+        log_init_timeline();
+        async_log(LOG_INFO, "Parsed %d question banks in %.1f ms", bank_count(), loader.ms);
+    }
 
 
     for (;;) {
@@ -176,30 +1160,57 @@ int main(int argc, char **argv)
         // Waiting for an event on a previously added descriptor
         if ( (nready = epoll_wait(epollfd, events, MAXEVENTS, -1)) == -1 ) {
             int serr = errno;
-            syslog(LOG_ERR, "epoll_wait error: %s\n", strerror(serr));
+            if ( serr == EINTR ) {
+                continue;  // A log level signal, epoll_wait() is never restarted
+            }
+            async_log(LOG_ERR, "epoll_wait error: %s\n", strerror(serr));
+            async_log_flush();
             return 1;
         }
+        uint64_t loop_started = latency_now();
 
         // Check all clients for data
         for (int i = 0; i < nready; i++) {
             currfd = events[i].data.fd;
 
+            // Scrapes of the metrics port
+            if ( metrics_handle_event(epollfd, currfd, events[i].events) ) {
+                continue;
+            }
+
             if ( currfd == listenfd ) {
                 // Accept loop
                 while (1) {
+                    if ( activeconns >= max_fds - FD_RESERVE ) {
+                        pause_accepting(epollfd, listenfd, activeconns, "descriptor limit reached");
+                        accept_paused_at = activeconns;
+                        break;
+                    }
                     len = sizeof(cliaddr);
                     connfd = accept(listenfd, (SA*)&cliaddr, &len);
                     if (connfd < 0) {
                         if (errno == EAGAIN || errno == EWOULDBLOCK)
                             break; // no more incoming connections
                         int serr = errno;
-                        syslog(LOG_ERR, "accept error: %s\n", strerror(serr));
+                        if (serr == EMFILE || serr == ENFILE) {
+                            pause_accepting(epollfd, listenfd, activeconns, strerror(serr));
+                            accept_paused_at = activeconns;
+                            break;
+                        }
+                        async_log(LOG_ERR, "accept error: %s\n", strerror(serr));
                         break;
                     }
 
+                    // Per-connection tables are indexed by fd
+                    if ( connfd >= max_fds ) {
+                        async_log(LOG_WARNING, "Rejecting fd %d: connection table full", connfd);
+                        close(connfd);
+                        continue;
+                    }
+
                     if ( set_nonblocking(connfd) < 0 ) {
                         int serr = errno;
-                        syslog(LOG_ERR, "set_nonblocking: %s\n", strerror(serr));
+                        async_log(LOG_ERR, "set_nonblocking: %s\n", strerror(serr));
                     }
 
                     memset(&str, 0, sizeof(str));
@@ -209,262 +1220,111 @@ int main(int argc, char **argv)
                     ev.events = EPOLLIN | EPOLLRDHUP | EPOLLERR;
                     ev.data.fd = connfd;
                     if ( (epoll_ctl(epollfd, EPOLL_CTL_ADD, connfd, &ev)) == -1 ) {
-                        syslog(LOG_ERR, "epoll_ctl adding new connection error");
+                        async_log(LOG_ERR, "epoll_ctl adding new connection error");
                         close(connfd);
                         continue;
                     }
+                    release_session(connfd);
                     activeconns++;
+                    if ( !accepted_any ) {
+                        accepted_any = 1;
+                        async_log(LOG_INFO, "First connection accepted %.1f ms after start",
+                                  elapsed_ms_since(&init_started));
+                    }
                     
                     // Update statistics
-                    pthread_mutex_lock(&stats_mutex);
-                    stats.total_connections++;
-                    stats.active_connections = activeconns;
-                    pthread_mutex_unlock(&stats_mutex);
+                    stats_add(server_counters, STATS_TOTAL_CONNECTIONS, 1);
+                    count_connection(1);
                 }
                 continue;
             }
 
+            // Waiting output of a client that read slowly
+            if ( events[i].events & EPOLLOUT ) {
+                if ( connection_flush(currfd) < 0 ) {
+                    events[i].events |= EPOLLERR;
+                }
+            }
+
             // Handle client socket events
             if (events[i].events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)) {
                 // error or hangup on the socket
                 if (connection_nicks[currfd][0] != '\0') {
-                    syslog(LOG_INFO, "User %s disconnected (fd=%d)", connection_nicks[currfd], currfd);
-                    connection_nicks[currfd][0] = '\0';  // Clear nickname
+                    async_log(LOG_INFO, "User %s disconnected (fd=%d)", connection_nicks[currfd], currfd);
+                    release_nick(currfd);
                 } else {
-                    syslog(LOG_INFO, "Client disconnected (fd=%d)", currfd);
+                    async_log(LOG_INFO, "Client disconnected (fd=%d)", currfd);
                 }
+                release_session(currfd);
+                connection_release(currfd);
                 close(currfd);
                 activeconns--;
-                
-                // Update statistics
-                pthread_mutex_lock(&stats_mutex);
-                stats.active_connections = activeconns;
-                pthread_mutex_unlock(&stats_mutex);
+                count_connection(-1);
+                continue;
+            }
+            if ( !(events[i].events & EPOLLIN) ) {
                 continue;
             }
 
-            // Receive TLV message from client
-            uint8_t buffer[4096];
-            ssize_t received = recv(currfd, buffer, sizeof(buffer), 0);
+            // Receive TLV messages from client; each complete one is handled right away
+            uint8_t buffer[CONNECTION_SCRATCH_SIZE + CONNECTION_FRAME_SLACK];
+            message_received_at = latency_now();
+            ssize_t received = connection_receive(currfd, buffer, handle_message);
+            if ( received > 0 ) {
+                stats_add(server_counters, STATS_BYTES_IN, received);
+            }
             if ( received < 0 ) {
                 if (errno == EAGAIN || errno == EWOULDBLOCK) {
                     // no data right now
                     continue;
                 }
-                syslog(LOG_ERR, "recv\n");
+                int serr = errno;
+                if (serr == EPROTO) {
+                    async_log(LOG_ERR, "Invalid TLV header from fd %d\n", currfd);
+                } else {
+                    async_log(LOG_ERR, "recv from fd %d: %s\n", currfd, strerror(serr));
+                }
                 if (connection_nicks[currfd][0] != '\0') {
-                    syslog(LOG_INFO, "User %s disconnected due to recv error (fd=%d)", connection_nicks[currfd], currfd);
-                    connection_nicks[currfd][0] = '\0';  // Clear nickname
+                    async_log(LOG_INFO, "User %s disconnected due to %s (fd=%d)", connection_nicks[currfd],
+                              serr == EPROTO ? "invalid TLV" : "recv error", currfd);
+                    release_nick(currfd);
                 }
+                release_session(currfd);
+                connection_release(currfd);
                 close(currfd);
                 activeconns--;
+                count_connection(-1);
                 continue;
             }
             if ( received == 0 ) {
                 // connection closed by peer
                 if (connection_nicks[currfd][0] != '\0') {
-                    syslog(LOG_INFO, "User %s disconnected (fd=%d)", connection_nicks[currfd], currfd);
-                    connection_nicks[currfd][0] = '\0';  // Clear nickname
+                    async_log(LOG_INFO, "User %s disconnected (fd=%d)", connection_nicks[currfd], currfd);
+                    release_nick(currfd);
                 } else {
-                    syslog(LOG_INFO, "Client disconnected (fd=%d)", currfd);
-                }
-                close(currfd);
-                activeconns--;
-                continue;
-            }
-
-            // Parse TLV header
-            uint16_t type, length;
-            if ( received < TLV_HEADER_SIZE || tlv_parse_header(buffer, &type, &length) < 0 ) {
-                syslog(LOG_ERR, "Invalid or incomplete TLV header from fd %d\n", currfd);
-                if (connection_nicks[currfd][0] != '\0') {
-                    syslog(LOG_INFO, "User %s disconnected due to invalid TLV (fd=%d)", connection_nicks[currfd], currfd);
-                    connection_nicks[currfd][0] = '\0';  // Clear nickname
+                    async_log(LOG_INFO, "Client disconnected (fd=%d)", currfd);
                 }
+                release_session(currfd);
+                connection_release(currfd);
                 close(currfd);
                 activeconns--;
+                count_connection(-1);
                 continue;
             }
+        }
 
-            // Handle different message types
-            if ( type == TLV_LOGIN_REQUEST ) {
-                char nick[MAX_NICK_LENGTH];
-                if (server_handle_login(currfd, buffer + TLV_HEADER_SIZE, nick) == 0) {
-                    // Save nick for this connection
-                    strncpy(connection_nicks[currfd], nick, MAX_NICK_LENGTH - 1);
-                    connection_nicks[currfd][MAX_NICK_LENGTH - 1] = '\0';
-                }
-            } else if ( type == TLV_REQUEST_QUESTION ) {
-                // Parse request
-                uint8_t mode, question_index;
-                if (tlv_parse_request_question(buffer + TLV_HEADER_SIZE, &mode, &question_index) < 0) {
-                    syslog(LOG_ERR, "Failed to parse REQUEST_QUESTION from fd %d", currfd);
-                    continue;
-                }
-                
-                // Get random question
-                Question *q = quiz_get_random_question(&quiz_db);
-                if (!q) {
-                    syslog(LOG_ERR, "No questions available for fd %d", currfd);
-                    continue;
-                }
-                
-                // Prepare answers as array of pointers
-                const char *answers[MAX_ANSWERS_PER_Q];
-                for (int i = 0; i < q->num_odpowiedzi; i++) {
-                    answers[i] = q->odpowiedzi[i];
-                }
-                
-                // Create QUESTION_DATA message
-                uint8_t response[4096];
-                ssize_t resp_len = tlv_create_question_data(response, q->id, q->pytanie, 
-                                                             answers, q->num_odpowiedzi);
-                if (resp_len > 0) {
-                    send(currfd, response, resp_len, 0);
-                    
-                    // Update statistics
-                    pthread_mutex_lock(&stats_mutex);
-                    stats.questions_asked++;
-                    pthread_mutex_unlock(&stats_mutex);
-                }
-            } else if ( type == TLV_ANSWER_SUBMIT ) {
-                // Parse answer
-                uint16_t question_id;
-                uint8_t answer_id;
-                if (tlv_parse_answer_submit(buffer + TLV_HEADER_SIZE, &question_id, &answer_id) < 0) {
-                    syslog(LOG_ERR, "Failed to parse ANSWER_SUBMIT from fd %d", currfd);
-                    continue;
-                }
-                
-                // Find question
-                Question *q = quiz_get_question_by_id(&quiz_db, question_id);
-                if (!q) {
-                    syslog(LOG_ERR, "Question %d not found for fd %d", question_id, currfd);
-                    continue;
-                }
-                
-                // Check answer
-                int is_correct = quiz_check_answer(q, answer_id);
-                uint8_t correct_answer_id = q->poprawna - 1;
-                
-                // Create ANSWER_RESULT message
-                uint8_t response[4096];
-                ssize_t resp_len = tlv_create_answer_result(response, question_id, 
-                                                             is_correct, correct_answer_id,
-                                                             0, 1, is_correct ? 1 : 0);
-                if (resp_len > 0) {
-                    send(currfd, response, resp_len, 0);
-                }
-            } else if ( type == TLV_SUBMIT_SCORE ) {
-                // Parse score submission
-                uint8_t score;
-                uint32_t time_seconds;
-                if (tlv_parse_submit_score(buffer + TLV_HEADER_SIZE, &score, &time_seconds) < 0) {
-                    syslog(LOG_ERR, "Failed to parse SUBMIT_SCORE from fd %d", currfd);
-                    continue;
-                }
-                
-                // Get nickname for this connection
-                if (connection_nicks[currfd][0] != '\0') {
-                    // Add to rankings
-                    pthread_mutex_lock(&rankings_mutex);
-                    if (rankings_count < MAX_RANKINGS) {
-                        strncpy(rankings[rankings_count].nick, connection_nicks[currfd], 32);
-                        rankings[rankings_count].score = score;
-                        rankings[rankings_count].time_seconds = time_seconds;
-                        rankings_count++;
-                        syslog(LOG_INFO, "Saved score for %s: %d/10 in %d seconds", 
-                               connection_nicks[currfd], score, time_seconds);
-                    }
-                    pthread_mutex_unlock(&rankings_mutex);
-                    
-                    // Update statistics
-                    pthread_mutex_lock(&stats_mutex);
-                    stats.tests_completed++;
-                    stats.total_score += score;
-                    
-                    // Update best score
-                    if (score > stats.best_score || 
-                        (score == stats.best_score && (stats.best_time == 0 || time_seconds < stats.best_time))) {
-                        stats.best_score = score;
-                        stats.best_time = time_seconds;
-                        strncpy(stats.best_player, connection_nicks[currfd], 32);
-                    }
-                    pthread_mutex_unlock(&stats_mutex);
-                }
-            } else if ( type == TLV_REQUEST_RANKING ) {
-                // Send ranking data
-                pthread_mutex_lock(&rankings_mutex);
-                
-                char nicks[MAX_RANKINGS][MAX_NICK_LENGTH];
-                uint8_t scores[MAX_RANKINGS];
-                uint32_t times[MAX_RANKINGS];
-                
-                // Sort by score (descending), then by time (ascending)
-                struct score_entry sorted[MAX_RANKINGS];
-                memcpy(sorted, rankings, rankings_count * sizeof(struct score_entry));
-                
-                for (int i = 0; i < rankings_count - 1; i++) {
-                    for (int j = 0; j < rankings_count - i - 1; j++) {
-                        if (sorted[j].score < sorted[j+1].score || 
-                            (sorted[j].score == sorted[j+1].score && sorted[j].time_seconds > sorted[j+1].time_seconds)) {
-                            struct score_entry temp = sorted[j];
-                            sorted[j] = sorted[j+1];
-                            sorted[j+1] = temp;
-                        }
-                    }
-                }
-                
-                // Copy to arrays (max 10 entries)
-                int count = rankings_count > 10 ? 10 : rankings_count;
-                for (int i = 0; i < count; i++) {
-                    strncpy(nicks[i], sorted[i].nick, MAX_NICK_LENGTH);
-                    scores[i] = sorted[i].score;
-                    times[i] = sorted[i].time_seconds;
-                }
-                
-                pthread_mutex_unlock(&rankings_mutex);
-                
-                // Create RANKING_DATA message
-                uint8_t response[4096];
-                ssize_t resp_len = tlv_create_ranking_data(response, count, nicks, scores, times);
-                if (resp_len > 0) {
-                    send(currfd, response, resp_len, 0);
-                    syslog(LOG_INFO, "Sent ranking data to fd %d", currfd);
-                }
-            } else if ( type == TLV_REQUEST_SERVER_INFO ) {
-                // Calculate server info
-                pthread_mutex_lock(&stats_mutex);
-                
-                time_t current_time = time(NULL);
-                uint32_t uptime = (uint32_t)difftime(current_time, stats.start_time);
-                uint8_t avg_score = stats.tests_completed > 0 ? 
-                                   (stats.total_score / stats.tests_completed) : 0;
-                
-                pthread_mutex_unlock(&stats_mutex);
-                
-                // Create SERVER_INFO_DATA message
-                uint8_t response[4096];
-                ssize_t resp_len = tlv_create_server_info_data(response, uptime,
-                                                                stats.active_connections,
-                                                                stats.total_connections,
-                                                                quiz_db.count,
-                                                                stats.tests_completed,
-                                                                stats.questions_asked,
-                                                                avg_score,
-                                                                stats.best_score,
-                                                                stats.best_time,
-                                                                stats.best_player,
-                                                                port);
-                if (resp_len > 0) {
-                    send(currfd, response, resp_len, 0);
-                    syslog(LOG_INFO, "Sent server info to fd %d", currfd);
-                }
-            } else {
-                syslog(LOG_WARNING, "Unexpected message type: 0x%04X\n", type);
+        // A descriptor was freed since accepting stopped
+        if ( accept_paused_at >= 0 && activeconns < accept_paused_at ) {
+            ev.events = listen_events;
+            ev.data.fd = listenfd;
+            if ( epoll_ctl(epollfd, EPOLL_CTL_ADD, listenfd, &ev) == 0 ) {
+                accept_paused_at = -1;
+                async_log(LOG_NOTICE, "Accepting again at %d connections", activeconns);
             }
         }
 
+        latency_record_loop(latency_now() - loop_started);
+        metrics_publish(worker_id);
     }
 
     return 0;
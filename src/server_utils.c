@@ -1,9 +1,8 @@
 #include "server_utils.h"
-
-// active_nicks[0]  → "Alice\0"    (33 byte)
-// active_nicks[0][0] = 'A'
-static char active_nicks[MAX_ACTIVE_NICKS][MAX_NICK_LENGTH + 1];
-static int active_count = 0;
+#include "async_log.h"
+#include "latency.h"
+#include "nick_registry.h"
+#include "text_validate.h"
 
 // Validate nickname (length and characters)
 int server_validate_nick(const char *nick) {
@@ -14,12 +13,9 @@ int server_validate_nick(const char *nick) {
         return -1;
     }
     
-    // Check allowed characters: a-z, A-Z, 0-9, _, -
-    for (size_t i = 0; i < len; i++) {
-        char c = nick[i];
-        if ( !isalnum(c) && c != '_' && c != '-' ) {
-            return -1;
-        }
+    // Check allowed characters: a-z, A-Z, 0-9, _, - (independent of the locale)
+    if ( text_validate_nick(nick, len) < 0 ) {
+        return -1;
     }
     
     return 0;
@@ -27,59 +23,54 @@ int server_validate_nick(const char *nick) {
 
 // Check if nickname is already taken
 int server_is_nick_taken(const char *nick) {
-    for (int i = 0; i < active_count; i++) {
-        if ( strcmp(active_nicks[i], nick) == 0 ) {
-            return 1;  // Taken
-        }
-    }
-    return 0;  // Available
+    return nick_registry_owner(server_nicks, nick) >= 0;
 }
 
 // Handle LOGIN_REQUEST from client
-int server_handle_login(int connfd, const uint8_t *buffer, char *nick_out) {
+int server_handle_login(int connfd, int owner, const uint8_t *buffer, char *nick_out) {
     uint8_t response_buffer[BUFFER_SIZE];
     char nick[64];
     
     // Parse login request
     if ( tlv_parse_login_request(buffer, nick, sizeof(nick)) < 0 ) {
         // Inform the client about incorrect format
-        syslog(LOG_NOTICE, "Failed to parse login request\n");
+        async_log(LOG_NOTICE, "Failed to parse login request\n");
         ssize_t len = tlv_create_login_response(response_buffer, LOGIN_ERROR_INVALID,
                                                 "Invalid request format");
-        send(connfd, response_buffer, len, 0);
+        latency_send(connfd, response_buffer, len);
         return -1;
     }
     
-    syslog(LOG_INFO, "Login attempt: '%s'\n", nick);
+    async_log(LOG_INFO, "Login attempt: '%s'\n", nick);
     
     // Validate nickname
     if ( server_validate_nick(nick) < 0 ) {
         // Inform the client about incorrect length and characters
-        syslog(LOG_ERR, "Invalid nickname: '%s'\n", nick);
+        async_log(LOG_ERR, "Invalid nickname: '%s'\n", nick);
         ssize_t len = tlv_create_login_response(response_buffer, LOGIN_ERROR_INVALID,
                                                 "Invalid nickname format");
-        send(connfd, response_buffer, len, 0);
+        latency_send(connfd, response_buffer, len);
         return -1;
     }
     
-    // Check if nickname is taken
-    if ( server_is_nick_taken(nick) ) {
-        syslog(LOG_NOTICE, "Nickname already taken: '%s'\n", nick);
-        ssize_t len = tlv_create_login_response(response_buffer, LOGIN_ERROR_NICK_TAKEN,
-                                                "Nickname already in use");
-        send(connfd, response_buffer, len, 0);
+    // Claim the nickname for this connection, released when it closes
+    int claimed = nick_registry_claim(server_nicks, nick, owner);
+    if ( claimed != 0 ) {
+        ssize_t len;
+        if ( claimed > 0 ) {
+            async_log(LOG_NOTICE, "Nickname already taken: '%s'\n", nick);
+            len = tlv_create_login_response(response_buffer, LOGIN_ERROR_NICK_TAKEN,
+                                            "Nickname already in use");
+        } else {
+            async_log(LOG_ERR, "No memory to register nickname '%s'\n", nick);
+            len = tlv_create_login_response(response_buffer, LOGIN_ERROR_INVALID,
+                                            "Login failed, try again");
+        }
+        latency_send(connfd, response_buffer, len);
         return -1;
     }
     
-    // Success - add to active list, increase the nick counter
-    if ( active_count < MAX_ACTIVE_NICKS ) {
-        strcpy(active_nicks[active_count], nick);
-        active_count++;
-    } else {
-        syslog(LOG_WARNING, "Warning: Active nicks list full (%d)\n", MAX_ACTIVE_NICKS);
-    }
-    
-    syslog(LOG_INFO, "✓ User '%s' logged in successfully\n", nick);
+    async_log(LOG_INFO, "✓ User '%s' logged in successfully\n", nick);
     
     // Copy nick to output parameter
     if (nick_out) {
@@ -89,7 +80,7 @@ int server_handle_login(int connfd, const uint8_t *buffer, char *nick_out) {
     
     ssize_t len = tlv_create_login_response(response_buffer, LOGIN_SUCCESS,
                                             "Login successful!");
-    send(connfd, response_buffer, len, 0);
+    latency_send(connfd, response_buffer, len);
     
     return 0;
 }
@@ -101,7 +92,7 @@ char* get_local_ip() {
     
     // Getting the interface list
     if ( getifaddrs(&ifaddr) == -1 ) {
-        syslog(LOG_WARNING, "getifaddrs");
+        async_log(LOG_WARNING, "getifaddrs");
         return NULL;
     }
     
@@ -0,0 +1,221 @@
+#define _GNU_SOURCE  // MAP_ANONYMOUS, MAP_NORESERVE
+#include "shared_arena.h"
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define BLOCK_HEADER    16              // Keeps the payload 64-byte aligned
+#define BLOCK_MAGIC     0x5348415245444142ULL
+#define MIN_BLOCK       64              // Size of class 0, classes double
+#define CLASSES         40
+
+struct block_header {
+    uint64_t size_class;
+    uint64_t magic;
+};
+
+struct arena_header {
+    pthread_mutex_t mutex;
+    size_t size;                        // Bytes mapped
+    size_t top;                         // Offset of the first never used byte
+    size_t free_lists[CLASSES];         // Offset of the first free block per class, 0 = none
+    _Atomic int poisoned;               // A process died holding a shared lock
+};
+
+// Set before the workers are forked, identical in every process
+static struct arena_header *arena = NULL;
+
+_Static_assert(sizeof(struct block_header) == BLOCK_HEADER, "block header size");
+
+int shared_arena_init(size_t size) {
+    void *base = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED) {
+        return -1;
+    }
+
+    struct arena_header *header = base;
+    memset(header, 0, sizeof(*header));
+    header->size = size;
+
+    // Blocks start 16 bytes before a cache line; their sizes are multiples of 64
+    size_t top = sizeof(*header) + BLOCK_HEADER;
+    top = (top + SHARED_ARENA_ALIGN - 1) / SHARED_ARENA_ALIGN * SHARED_ARENA_ALIGN;
+    header->top = top - BLOCK_HEADER;
+
+    arena = header;
+    if (shared_mutex_init(&header->mutex) != 0) {
+        arena = NULL;
+        munmap(base, size);
+        return -1;
+    }
+    return 0;
+}
+
+int shared_arena_active(void) {
+    return arena != NULL;
+}
+
+int shared_arena_poisoned(void) {
+    return arena && atomic_load_explicit(&arena->poisoned, memory_order_relaxed);
+}
+
+size_t shared_arena_used(void) {
+    return arena ? arena->top : 0;
+}
+
+static int in_arena(const void *ptr) {
+    return arena && (const char *)ptr > (const char *)arena &&
+           (const char *)ptr < (const char *)arena + arena->size;
+}
+
+void *shared_malloc(size_t size) {
+    if (!arena) {
+        return malloc(size);
+    }
+    if (size > arena->size) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    int size_class = 0;
+    while (((size_t)MIN_BLOCK << size_class) < size + BLOCK_HEADER) {
+        size_class++;
+    }
+    size_t block_size = (size_t)MIN_BLOCK << size_class;
+
+    char *base = (char *)arena;
+    struct block_header *block = NULL;
+    shared_mutex_lock(&arena->mutex);
+    if (arena->free_lists[size_class] != 0) {
+        block = (struct block_header *)(base + arena->free_lists[size_class]);
+        memcpy(&arena->free_lists[size_class], block + 1, sizeof(size_t));
+    } else if (arena->size - arena->top >= block_size) {
+        block = (struct block_header *)(base + arena->top);
+        arena->top += block_size;
+    }
+    pthread_mutex_unlock(&arena->mutex);
+
+    if (!block) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    block->size_class = size_class;
+    block->magic = BLOCK_MAGIC;
+    return block + 1;
+}
+
+void *shared_aligned_alloc(size_t size) {
+    if (!arena) {
+        // aligned_alloc() wants a multiple of the alignment
+        size_t rounded = (size + SHARED_ARENA_ALIGN - 1) / SHARED_ARENA_ALIGN * SHARED_ARENA_ALIGN;
+        return aligned_alloc(SHARED_ARENA_ALIGN, rounded ? rounded : SHARED_ARENA_ALIGN);
+    }
+    return shared_malloc(size);
+}
+
+void *shared_calloc(size_t count, size_t size) {
+    if (size != 0 && count > SIZE_MAX / size) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    void *ptr = shared_malloc(count * size);
+    if (ptr) {
+        memset(ptr, 0, count * size);
+    }
+    return ptr;
+}
+
+void *shared_realloc(void *ptr, size_t size) {
+    if (!ptr) {
+        return shared_malloc(size);
+    }
+    if (!in_arena(ptr)) {
+        return realloc(ptr, size);
+    }
+
+    struct block_header *block = (struct block_header *)ptr - 1;
+    size_t capacity = ((size_t)MIN_BLOCK << block->size_class) - BLOCK_HEADER;
+    if (size <= capacity) {
+        return ptr;
+    }
+    void *grown = shared_malloc(size);
+    if (grown) {
+        memcpy(grown, ptr, capacity);
+        shared_free(ptr);
+    }
+    return grown;
+}
+
+void shared_free(void *ptr) {
+    if (!ptr) {
+        return;
+    }
+    if (!in_arena(ptr)) {
+        free(ptr);
+        return;
+    }
+
+    struct block_header *block = (struct block_header *)ptr - 1;
+    if (block->magic != BLOCK_MAGIC) {
+        abort();  // Double free or a pointer into the middle of a block
+    }
+    block->magic = 0;
+
+    size_t offset = (size_t)((char *)block - (char *)arena);
+    shared_mutex_lock(&arena->mutex);
+    memcpy(ptr, &arena->free_lists[block->size_class], sizeof(size_t));
+    arena->free_lists[block->size_class] = offset;
+    pthread_mutex_unlock(&arena->mutex);
+}
+
+int shared_mutex_init(pthread_mutex_t *mutex) {
+    if (!arena) {
+        return pthread_mutex_init(mutex, NULL);
+    }
+
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    int err = pthread_mutex_init(mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+    return err;
+}
+
+int shared_cond_init(pthread_cond_t *cond) {
+    if (!arena) {
+        return pthread_cond_init(cond, NULL);
+    }
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    int err = pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+    return err;
+}
+
+// The owner died between lock and unlock: whatever it guarded may be half updated
+static void take_over(pthread_mutex_t *mutex) {
+    pthread_mutex_consistent(mutex);
+    if (arena) {
+        atomic_store_explicit(&arena->poisoned, 1, memory_order_relaxed);
+    }
+}
+
+void shared_mutex_lock(pthread_mutex_t *mutex) {
+    if (pthread_mutex_lock(mutex) == EOWNERDEAD) {
+        take_over(mutex);
+    }
+}
+
+void shared_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex, const struct timespec *deadline) {
+    int err = deadline ? pthread_cond_timedwait(cond, mutex, deadline) : pthread_cond_wait(cond, mutex);
+    if (err == EOWNERDEAD) {
+        take_over(mutex);
+    }
+}
@@ -1,4 +1,6 @@
 #include "sock_options.h"
+#include <stdlib.h>
+#include <unistd.h>
 
 int set_socket_options(int listenfd) {
     // Disable IPV6_V6ONLY to allow IPv4 connections on IPv6 socket
@@ -31,4 +33,38 @@ int set_nonblocking(int fd) {
     int flags = fcntl(fd, F_GETFL, 0);
     if (flags == -1) return -1;
     return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
-}
\ No newline at end of file
+}
+int inherited_listener(uint16_t *port) {
+    const char *pid = getenv("LISTEN_PID");
+    const char *fds = getenv("LISTEN_FDS");
+    if ( pid == NULL || fds == NULL || strtol(pid, NULL, 10) != (long)getpid() ) {
+        return -1;
+    }
+    long count = strtol(fds, NULL, 10);
+
+    // The sockets are ours; processes started later must not take them too
+    unsetenv("LISTEN_PID");
+    unsetenv("LISTEN_FDS");
+    unsetenv("LISTEN_FDNAMES");
+
+    if ( count < 1 ) {
+        return -1;
+    }
+    if ( count > 1 ) {
+        fprintf(stderr, "LISTEN_FDS=%ld: using the first socket only\n", count);
+    }
+
+    int fd = LISTEN_FDS_START;
+    int listening = 0;
+    socklen_t optlen = sizeof(listening);
+    struct sockaddr_in6 addr;
+    socklen_t addrlen = sizeof(addr);
+    if ( getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, &listening, &optlen) < 0 || !listening ||
+         getsockname(fd, (struct sockaddr *)&addr, &addrlen) < 0 || addr.sin6_family != AF_INET6 ) {
+        fprintf(stderr, "LISTEN_FDS: fd %d is not a listening IPv6 socket\n", fd);
+        return -1;
+    }
+
+    *port = ntohs(addr.sin6_port);
+    return fd;
+}
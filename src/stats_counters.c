@@ -0,0 +1,144 @@
+#include "stats_counters.h"
+#include "shared_arena.h"
+#include <string.h>
+
+_Static_assert(sizeof(((struct stats_best *)0)->player) == sizeof(((struct server_stats *)0)->best_player),
+               "best player record must hold a whole nick");
+
+struct stats_counters *server_counters;
+
+static _Atomic unsigned next_shard = 0;
+static _Thread_local int thread_shard = -1;
+
+void stats_set_first_shard(unsigned first) {
+    atomic_store_explicit(&next_shard, first, memory_order_relaxed);
+    thread_shard = -1;
+}
+
+// Shard of the calling thread, handed out round robin on first use
+static int shard_index(void) {
+    if (thread_shard < 0) {
+        thread_shard = atomic_fetch_add_explicit(&next_shard, 1, memory_order_relaxed) % STATS_SHARDS;
+    }
+    return thread_shard;
+}
+
+// Is (score, time) better than the published (best_score, best_time)
+static int beats(uint8_t score, uint32_t time_seconds, uint8_t best_score, uint32_t best_time) {
+    return score > best_score ||
+           (score == best_score && (best_time == 0 || time_seconds < best_time));
+}
+
+// Seqlock read of the best result
+static void read_best(struct stats_best *best, uint8_t *score, uint32_t *time_seconds, char *player) {
+    uint64_t result;
+    uint64_t words[4];
+    for (;;) {
+        uint32_t seq = atomic_load_explicit(&best->seq, memory_order_acquire);
+        if (seq & 1) {
+            continue;  // Writer active, it only copies a few words
+        }
+        result = atomic_load_explicit(&best->result, memory_order_relaxed);
+        for (int i = 0; i < 4; i++) {
+            words[i] = atomic_load_explicit(&best->player[i], memory_order_relaxed);
+        }
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&best->seq, memory_order_relaxed) == seq) {
+            break;
+        }
+    }
+
+    *score = (uint8_t)(result >> 32);
+    *time_seconds = (uint32_t)result;
+    if (player) {
+        memcpy(player, words, sizeof(words));
+        player[sizeof(words) - 1] = '\0';
+    }
+}
+
+// Seqlock write of the best result (writer mutex held)
+static void write_best(struct stats_best *best, uint8_t score, uint32_t time_seconds, const char *nick) {
+    uint64_t words[4] = {0};
+    strncpy((char *)words, nick, sizeof(words) - 1);
+
+    uint32_t seq = atomic_load_explicit(&best->seq, memory_order_relaxed);
+    atomic_store_explicit(&best->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    atomic_store_explicit(&best->result, (uint64_t)score << 32 | time_seconds, memory_order_relaxed);
+    for (int i = 0; i < 4; i++) {
+        atomic_store_explicit(&best->player[i], words[i], memory_order_relaxed);
+    }
+
+    atomic_store_explicit(&best->seq, seq + 2, memory_order_release);
+}
+
+void stats_init(struct stats_counters *counters) {
+    for (int s = 0; s < STATS_SHARDS; s++) {
+        for (int c = 0; c < STATS_COUNTERS; c++) {
+            atomic_init(&counters->shards[s].values[c], 0);
+        }
+    }
+    atomic_init(&counters->best.seq, 0);
+    shared_mutex_init(&counters->best.writer);
+    write_best(&counters->best, 0, 0, "N/A");
+}
+
+void stats_add(struct stats_counters *counters, enum stats_counter counter, int64_t delta) {
+    atomic_fetch_add_explicit(&counters->shards[shard_index()].values[counter],
+                              (uint64_t)delta, memory_order_relaxed);
+}
+
+uint64_t stats_read(struct stats_counters *counters, enum stats_counter counter) {
+    uint64_t sum = 0;
+    for (int s = 0; s < STATS_SHARDS; s++) {
+        sum += atomic_load_explicit(&counters->shards[s].values[counter], memory_order_relaxed);
+    }
+    return sum;
+}
+
+void stats_offer_best(struct stats_counters *counters, uint8_t score,
+                      uint32_t time_seconds, const char *nick) {
+    uint8_t best_score;
+    uint32_t best_time;
+
+    // Most results are not a new best; find that out without the mutex
+    read_best(&counters->best, &best_score, &best_time, NULL);
+    if (!beats(score, time_seconds, best_score, best_time)) {
+        return;
+    }
+
+    shared_mutex_lock(&counters->best.writer);
+    read_best(&counters->best, &best_score, &best_time, NULL);
+    if (beats(score, time_seconds, best_score, best_time)) {
+        write_best(&counters->best, score, time_seconds, nick);
+    }
+    pthread_mutex_unlock(&counters->best.writer);
+}
+
+void stats_collect(struct stats_counters *counters, struct server_stats *out) {
+    out->total_connections = (uint32_t)stats_read(counters, STATS_TOTAL_CONNECTIONS);
+    out->active_connections = (uint32_t)stats_read(counters, STATS_ACTIVE_CONNECTIONS);
+    out->tests_completed = (uint32_t)stats_read(counters, STATS_TESTS_COMPLETED);
+    out->questions_asked = (uint32_t)stats_read(counters, STATS_QUESTIONS_ASKED);
+    out->total_score = (uint32_t)stats_read(counters, STATS_TOTAL_SCORE);
+    read_best(&counters->best, &out->best_score, &out->best_time, out->best_player);
+}
+
+void stats_restore(struct stats_counters *counters, const struct server_stats *in) {
+    static const enum stats_counter restored[] = {
+        STATS_TESTS_COMPLETED, STATS_QUESTIONS_ASKED, STATS_TOTAL_SCORE
+    };
+    const uint32_t values[] = { in->tests_completed, in->questions_asked, in->total_score };
+
+    for (size_t i = 0; i < sizeof(restored) / sizeof(restored[0]); i++) {
+        for (int s = 0; s < STATS_SHARDS; s++) {
+            atomic_store_explicit(&counters->shards[s].values[restored[i]], 0, memory_order_relaxed);
+        }
+        atomic_store_explicit(&counters->shards[0].values[restored[i]], values[i], memory_order_relaxed);
+    }
+
+    shared_mutex_lock(&counters->best.writer);
+    write_best(&counters->best, in->best_score, in->best_time, in->best_player);
+    pthread_mutex_unlock(&counters->best.writer);
+}
@@ -0,0 +1,264 @@
+#include "text_validate.h"
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) && defined(__SSE2__)
+#define TEXT_VALIDATE_X86 1
+#include <immintrin.h>
+#endif
+
+// Check whole characters from pos until at least stop; returns the position
+// after the last one, SIZE_MAX if a character is malformed or cut off
+static size_t utf8_scalar_until(const uint8_t *s, size_t len, size_t pos, size_t stop) {
+    while (pos < stop) {
+        uint8_t c = s[pos];
+        if (c < 0x80) {
+            pos++;
+            continue;
+        }
+
+        size_t n;
+        uint32_t cp, min;
+        if ((c & 0xE0) == 0xC0) {
+            n = 2; cp = c & 0x1F; min = 0x80;
+        } else if ((c & 0xF0) == 0xE0) {
+            n = 3; cp = c & 0x0F; min = 0x800;
+        } else if ((c & 0xF8) == 0xF0) {
+            n = 4; cp = c & 0x07; min = 0x10000;
+        } else {
+            return SIZE_MAX;  // Continuation byte or 0xF8..0xFF as lead
+        }
+        if (len - pos < n) {
+            return SIZE_MAX;
+        }
+        for (size_t k = 1; k < n; k++) {
+            uint8_t cont = s[pos + k];
+            if ((cont & 0xC0) != 0x80) {
+                return SIZE_MAX;
+            }
+            cp = cp << 6 | (cont & 0x3F);
+        }
+        if (cp < min || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) {
+            return SIZE_MAX;
+        }
+        pos += n;
+    }
+    return pos;
+}
+
+#ifndef TEXT_VALIDATE_X86
+
+static int utf8_scalar(const uint8_t *s, size_t len) {
+    size_t pos = 0;
+    while (pos < len) {
+        // Skip ASCII a word at a time
+        uint64_t word;
+        while (pos + 8 <= len) {
+            memcpy(&word, s + pos, 8);
+            if (word & 0x8080808080808080ULL) {
+                break;
+            }
+            pos += 8;
+        }
+        size_t stop = pos + 8 < len ? pos + 8 : len;
+        pos = utf8_scalar_until(s, len, pos, stop);
+        if (pos == SIZE_MAX) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int nick_scalar(const char *nick, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        char c = nick[i];
+        if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+              c == '_' || c == '-')) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+#else
+
+// SSE2: skip 16-byte blocks of ASCII, check the rest of a block by character
+static int utf8_sse2(const uint8_t *s, size_t len) {
+    size_t pos = 0;
+    while (pos + 16 <= len) {
+        int high = _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)(s + pos)));
+        if (high == 0) {
+            pos += 16;
+            continue;
+        }
+        pos = utf8_scalar_until(s, len, pos + __builtin_ctz(high), pos + 16);
+        if (pos == SIZE_MAX) {
+            return -1;
+        }
+    }
+    return utf8_scalar_until(s, len, pos, len) == SIZE_MAX ? -1 : 0;
+}
+
+// Error classes of a byte pair (previous byte, byte), one bit each
+#define TOO_SHORT       (1 << 0)    // Lead byte followed by a non-continuation
+#define TOO_LONG        (1 << 1)    // ASCII followed by a continuation
+#define OVERLONG_3      (1 << 2)    // E0 80..9F
+#define TOO_LARGE       (1 << 3)    // F4 90..BF, F5..FF
+#define SURROGATE       (1 << 4)    // ED A0..BF
+#define OVERLONG_2      (1 << 5)    // C0..C1
+#define TOO_LARGE_1000  (1 << 6)    // F5..FF 80..8F
+#define OVERLONG_4      (1 << 6)    // F0 80..8F
+#define TWO_CONTS       (1 << 7)    // Two continuations in a row
+#define CARRY           (TOO_SHORT | TOO_LONG | TWO_CONTS)
+
+// Indexed by the high nibble of the previous byte
+static const uint8_t byte_1_high[16] = {
+    TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+    TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+    TOO_SHORT | OVERLONG_2,
+    TOO_SHORT,
+    TOO_SHORT | OVERLONG_3 | SURROGATE,
+    TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4,
+};
+
+// Indexed by the low nibble of the previous byte
+static const uint8_t byte_1_low[16] = {
+    CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+    CARRY | OVERLONG_2,
+    CARRY,
+    CARRY,
+    CARRY | TOO_LARGE,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+};
+
+// Indexed by the high nibble of the byte
+static const uint8_t byte_2_high[16] = {
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+};
+
+__attribute__((target("avx2")))
+static inline __m256i lookup_avx2(const uint8_t table[16], __m256i nibbles) {
+    __m256i t = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)table));
+    return _mm256_shuffle_epi8(t, nibbles);
+}
+
+// Nonzero bytes where block, preceded by prev, is not valid UTF-8
+__attribute__((target("avx2")))
+static inline __m256i utf8_block_avx2(__m256i block, __m256i prev) {
+    const __m256i low_nibble = _mm256_set1_epi8(0x0F);
+
+    // Bytes 1, 2 and 3 positions back, reaching into the previous block
+    __m256i carried = _mm256_permute2x128_si256(prev, block, 0x21);
+    __m256i prev1 = _mm256_alignr_epi8(block, carried, 15);
+    __m256i prev2 = _mm256_alignr_epi8(block, carried, 14);
+    __m256i prev3 = _mm256_alignr_epi8(block, carried, 13);
+
+    __m256i special = _mm256_and_si256(
+        _mm256_and_si256(
+            lookup_avx2(byte_1_high, _mm256_and_si256(_mm256_srli_epi16(prev1, 4), low_nibble)),
+            lookup_avx2(byte_1_low, _mm256_and_si256(prev1, low_nibble))),
+        lookup_avx2(byte_2_high, _mm256_and_si256(_mm256_srli_epi16(block, 4), low_nibble)));
+
+    // Third and fourth bytes of 3- and 4-byte characters must be continuations
+    __m256i third = _mm256_subs_epu8(prev2, _mm256_set1_epi8(0xE0 - 0x80));
+    __m256i fourth = _mm256_subs_epu8(prev3, _mm256_set1_epi8(0xF0 - 0x80));
+    __m256i must_continue = _mm256_and_si256(_mm256_or_si256(third, fourth),
+                                             _mm256_set1_epi8((char)0x80));
+    return _mm256_xor_si256(must_continue, special);
+}
+
+__attribute__((target("avx2")))
+static int utf8_avx2(const uint8_t *s, size_t len) {
+    __m256i prev = _mm256_setzero_si256();
+    __m256i error = _mm256_setzero_si256();
+
+    size_t pos = 0;
+    for (; pos + 32 <= len; pos += 32) {
+        __m256i block = _mm256_loadu_si256((const __m256i *)(s + pos));
+        error = _mm256_or_si256(error, utf8_block_avx2(block, prev));
+        prev = block;
+    }
+
+    // The rest is padded with NULs, which also fail a character cut off at the end
+    uint8_t tail[32] = { 0 };
+    memcpy(tail, s + pos, len - pos);
+    error = _mm256_or_si256(error, utf8_block_avx2(_mm256_loadu_si256((const __m256i *)tail), prev));
+
+    return _mm256_testz_si256(error, error) ? 0 : -1;
+}
+
+// Mask of the bytes of v outside a-z, A-Z, 0-9, '_', '-'
+static inline int nick_invalid_sse2(__m128i v) {
+    // Signed compares: bytes >= 0x80 are negative and fall outside every range
+    __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+                                  _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+    __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+    __m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                                  _mm_cmplt_epi8(lower, _mm_set1_epi8('z' + 1)));
+    __m128i punct = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('_')),
+                                 _mm_cmpeq_epi8(v, _mm_set1_epi8('-')));
+    __m128i valid = _mm_or_si128(_mm_or_si128(digit, alpha), punct);
+    return _mm_movemask_epi8(valid) ^ 0xFFFF;
+}
+
+static int nick_sse2(const char *nick, size_t len) {
+    size_t pos = 0;
+    for (; pos + 16 <= len; pos += 16) {
+        if (nick_invalid_sse2(_mm_loadu_si128((const __m128i *)(nick + pos)))) {
+            return -1;
+        }
+    }
+    if (pos < len) {
+        char tail[16];
+        memset(tail, 'a', sizeof(tail));
+        memcpy(tail, nick + pos, len - pos);
+        if (nick_invalid_sse2(_mm_loadu_si128((const __m128i *)tail))) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+#endif
+
+int text_validate_utf8(const void *data, size_t len) {
+#ifdef TEXT_VALIDATE_X86
+    if (__builtin_cpu_supports("avx2")) {
+        return utf8_avx2(data, len);
+    }
+    return utf8_sse2(data, len);
+#else
+    return utf8_scalar(data, len);
+#endif
+}
+
+int text_validate_nick(const char *nick, size_t len) {
+#ifdef TEXT_VALIDATE_X86
+    return nick_sse2(nick, len);
+#else
+    return nick_scalar(nick, len);
+#endif
+}
+
+const char *text_validate_impl(void) {
+#ifdef TEXT_VALIDATE_X86
+    return __builtin_cpu_supports("avx2") ? "avx2" : "sse2";
+#else
+    return "scalar";
+#endif
+}
@@ -1,4 +1,53 @@
 #include "tlv.h"
+#include "text_validate.h"
+
+// Copy a received string field, which must be well-formed UTF-8
+static int tlv_copy_text(char *dst, const uint8_t *src, size_t len) {
+    if (text_validate_utf8(src, len) < 0) {
+        return -1;
+    }
+    memcpy(dst, src, len);
+    dst[len] = '\0';
+    return 0;
+}
+
+// Copy a nickname to look up; it must use the characters allowed at login
+static int tlv_copy_nick(char *dst, const uint8_t *src, size_t len) {
+    if (text_validate_nick((const char *)src, len) < 0) {
+        return -1;
+    }
+    memcpy(dst, src, len);
+    dst[len] = '\0';
+    return 0;
+}
+
+// Name of a message type
+const char *tlv_type_name(uint16_t type) {
+    switch (type) {
+        case TLV_LOGIN_REQUEST:       return "LOGIN_REQUEST";
+        case TLV_LOGIN_RESPONSE:      return "LOGIN_RESPONSE";
+        case TLV_REQUEST_QUESTION:    return "REQUEST_QUESTION";
+        case TLV_QUESTION_DATA:       return "QUESTION_DATA";
+        case TLV_ANSWER_SUBMIT:       return "ANSWER_SUBMIT";
+        case TLV_ANSWER_RESULT:       return "ANSWER_RESULT";
+        case TLV_SUBMIT_SCORE:        return "SUBMIT_SCORE";
+        case TLV_REQUEST_RANKING:     return "REQUEST_RANKING";
+        case TLV_RANKING_DATA:        return "RANKING_DATA";
+        case TLV_REQUEST_SERVER_INFO: return "REQUEST_SERVER_INFO";
+        case TLV_SERVER_INFO_DATA:    return "SERVER_INFO_DATA";
+        case TLV_ERROR:               return "ERROR";
+        case TLV_SEARCH_QUESTIONS:    return "SEARCH_QUESTIONS";
+        case TLV_SEARCH_RESULTS:      return "SEARCH_RESULTS";
+        case TLV_REQUEST_RANK:        return "REQUEST_RANK";
+        case TLV_RANK_DATA:           return "RANK_DATA";
+        case TLV_RANKING_PAGE:        return "RANKING_PAGE";
+        case TLV_REQUEST_LATENCY:     return "REQUEST_LATENCY";
+        case TLV_LATENCY_DATA:        return "LATENCY_DATA";
+        case TLV_REQUEST_QUESTION_STATS: return "REQUEST_QUESTION_STATS";
+        case TLV_QUESTION_STATS:      return "QUESTION_STATS";
+        default:                      return "UNKNOWN";
+    }
+}
 
 // Create LOGIN_REQUEST message
 ssize_t tlv_create_login_request(uint8_t *buffer, const char *nick) {
@@ -20,6 +69,31 @@ ssize_t tlv_create_login_request(uint8_t *buffer, const char *nick) {
     return 4 + 1 + nick_len;  // header + length byte + nick
 }
 
+// Create LOGIN_REQUEST message with a question bank
+ssize_t tlv_create_login_request_bank(uint8_t *buffer, const char *nick, const char *bank) {
+    ssize_t len = tlv_create_login_request(buffer, nick);
+    if (len < 0) {
+        return -1;
+    }
+    
+    size_t bank_len = strlen(bank);
+    if (bank_len == 0) {
+        return len;
+    }
+    if (bank_len >= MAX_BANK_NAME_LENGTH) {
+        return -1;
+    }
+    
+    buffer[len] = bank_len;
+    memcpy(buffer + len + 1, bank, bank_len);
+    len += 1 + bank_len;
+    
+    struct tlv_header *header = (struct tlv_header *)buffer;
+    header->length = htons(len - 4);
+    
+    return len;
+}
+
 // Create LOGIN_RESPONSE message
 ssize_t tlv_create_login_response(uint8_t *buffer, uint8_t status, const char *message) {
     // Header access, buffer projection onto structure
@@ -54,8 +128,39 @@ ssize_t tlv_create_request_question(uint8_t *buffer, uint8_t mode, uint8_t quest
     return 6;  // header (4) + 2 bytes data
 }
 
+// Create REQUEST_QUESTION message with a tag filter
+ssize_t tlv_create_request_question_filtered(uint8_t *buffer, uint8_t mode, uint8_t question_index,
+                                             uint8_t filter_op, const char **tags, uint8_t num_tags) {
+    struct tlv_header *header = (struct tlv_header *)buffer;
+    
+    if (num_tags > MAX_FILTER_TAGS) {
+        return -1;
+    }
+    
+    size_t pos = 4;
+    buffer[pos++] = mode;
+    buffer[pos++] = question_index;
+    buffer[pos++] = filter_op;
+    buffer[pos++] = num_tags;
+    
+    for (int i = 0; i < num_tags; i++) {
+        size_t tag_len = strlen(tags[i]);
+        if (tag_len == 0 || tag_len >= MAX_TAG_LENGTH) {
+            return -1;
+        }
+        buffer[pos++] = tag_len;
+        memcpy(buffer + pos, tags[i], tag_len);
+        pos += tag_len;
+    }
+    
+    header->type = htons(TLV_REQUEST_QUESTION);
+    header->length = htons(pos - 4);
+    
+    return pos;
+}
+
 // Create QUESTION_DATA message
-ssize_t tlv_create_question_data(uint8_t *buffer, uint16_t question_id,
+ssize_t tlv_create_question_data(uint8_t *buffer, uint32_t question_id,
                                   const char *question_text,
                                   const char **answers, uint8_t num_answers) {
     struct tlv_header *header = (struct tlv_header *)buffer;
@@ -70,7 +175,7 @@ ssize_t tlv_create_question_data(uint8_t *buffer, uint16_t question_id,
     }
     
     // Calculate total length needed
-    uint16_t total_value_len = 2 + 1 + 2;  // question_id + num_answers + question_length
+    uint16_t total_value_len = 4 + 1 + 2;  // question_id + num_answers + question_length
     total_value_len += question_len;  // question text
     
     // Add answer lengths
@@ -89,10 +194,10 @@ ssize_t tlv_create_question_data(uint8_t *buffer, uint16_t question_id,
     // Write body
     size_t offset = 4;
     
-    // question_id (2 bytes)
-    uint16_t *qid = (uint16_t *)(buffer + offset);
-    *qid = htons(question_id);
-    offset += 2;
+    // question_id (4 bytes)
+    uint32_t qid = htonl(question_id);
+    memcpy(buffer + offset, &qid, 4);
+    offset += 4;
     
     // num_answers (1 byte)
     buffer[offset++] = num_answers;
@@ -127,38 +232,38 @@ ssize_t tlv_create_question_data(uint8_t *buffer, uint16_t question_id,
 }
 
 // Create ANSWER_SUBMIT message
-ssize_t tlv_create_answer_submit(uint8_t *buffer, uint16_t question_id, uint8_t answer_id) {
+ssize_t tlv_create_answer_submit(uint8_t *buffer, uint32_t question_id, uint8_t answer_id) {
     struct tlv_header *header = (struct tlv_header *)buffer;
     
     header->type = htons(TLV_ANSWER_SUBMIT);
-    header->length = htons(3);  // 2 bytes question_id + 1 byte answer_id
+    header->length = htons(5);  // 4 bytes question_id + 1 byte answer_id
     
-    uint16_t *qid = (uint16_t *)(buffer + 4);
-    *qid = htons(question_id);
-    buffer[6] = answer_id;
+    uint32_t qid = htonl(question_id);
+    memcpy(buffer + 4, &qid, 4);
+    buffer[8] = answer_id;
     
-    return 7;  // header (4) + 3 bytes data
+    return 9;  // header (4) + 5 bytes data
 }
 
 // Create ANSWER_RESULT message
-ssize_t tlv_create_answer_result(uint8_t *buffer, uint16_t question_id,
+ssize_t tlv_create_answer_result(uint8_t *buffer, uint32_t question_id,
                                   uint8_t is_correct, uint8_t correct_answer_id,
                                   uint8_t test_mode, uint8_t questions_answered,
                                   uint8_t correct_count) {
     struct tlv_header *header = (struct tlv_header *)buffer;
     
     header->type = htons(TLV_ANSWER_RESULT);
-    header->length = htons(7);  // 2 + 5 bytes
+    header->length = htons(9);  // 4 + 5 bytes
     
-    uint16_t *qid = (uint16_t *)(buffer + 4);
-    *qid = htons(question_id);
-    buffer[6] = is_correct;
-    buffer[7] = correct_answer_id;
-    buffer[8] = test_mode;
-    buffer[9] = questions_answered;
-    buffer[10] = correct_count;
+    uint32_t qid = htonl(question_id);
+    memcpy(buffer + 4, &qid, 4);
+    buffer[8] = is_correct;
+    buffer[9] = correct_answer_id;
+    buffer[10] = test_mode;
+    buffer[11] = questions_answered;
+    buffer[12] = correct_count;
     
-    return 11;  // header (4) + 7 bytes data
+    return 13;  // header (4) + 9 bytes data
 }
 
 // Parse TLV header
@@ -182,8 +287,31 @@ int tlv_parse_login_request(const uint8_t *buffer, char *nick, size_t nick_size)
     }
     
     // buffer +1 because it starts with the nickname lenght
-    memcpy(nick, buffer + 1, nick_len);
-    nick[nick_len] = '\0';
+    if (tlv_copy_text(nick, buffer + 1, nick_len) < 0) {
+        return -1;
+    }
+    
+    return 0;
+}
+
+// Parse question bank of LOGIN_REQUEST
+int tlv_parse_login_bank(const uint8_t *buffer, uint16_t length, char *bank, size_t bank_size) {
+    bank[0] = '\0';
+    
+    // The bank follows the nickname and is optional
+    size_t pos = 1 + (size_t)buffer[0];
+    if (length <= pos) {
+        return 0;
+    }
+    
+    uint8_t bank_len = buffer[pos++];
+    if (bank_len >= bank_size || bank_len >= MAX_BANK_NAME_LENGTH || pos + bank_len > length) {
+        return -1;
+    }
+    
+    if (tlv_copy_text(bank, buffer + pos, bank_len) < 0) {
+        return -1;
+    }
     
     return 0;
 }
@@ -198,8 +326,9 @@ int tlv_parse_login_response(const uint8_t *buffer, uint8_t *status,
         return -1;
     }
     
-    memcpy(message, buffer + 2, msg_len);
-    message[msg_len] = '\0';
+    if (tlv_copy_text(message, buffer + 2, msg_len) < 0) {
+        return -1;
+    }
     
     return 0;
 }
@@ -213,28 +342,70 @@ int tlv_parse_request_question(const uint8_t *buffer, uint8_t *mode,
     return 0;
 }
 
+// Parse tag filter of REQUEST_QUESTION
+int tlv_parse_question_filter(const uint8_t *buffer, uint16_t length, uint8_t *filter_op,
+                              char tags[][MAX_TAG_LENGTH], uint8_t *num_tags) {
+    *filter_op = TAG_FILTER_NONE;
+    *num_tags = 0;
+    
+    // Requests from older clients end after mode and question_index
+    if (length <= 2) {
+        return 0;
+    }
+    if (length < 4) {
+        return -1;
+    }
+    
+    size_t pos = 2;
+    uint8_t op = buffer[pos++];
+    uint8_t count = buffer[pos++];
+    if ((op != TAG_FILTER_ALL && op != TAG_FILTER_ANY) || count > MAX_FILTER_TAGS) {
+        return -1;
+    }
+    
+    for (int i = 0; i < count; i++) {
+        if (pos >= length) {
+            return -1;
+        }
+        uint8_t tag_len = buffer[pos++];
+        if (tag_len == 0 || tag_len >= MAX_TAG_LENGTH || pos + tag_len > length) {
+            return -1;
+        }
+        if (tlv_copy_text(tags[i], buffer + pos, tag_len) < 0) {
+            return -1;
+        }
+        pos += tag_len;
+    }
+    
+    *filter_op = count > 0 ? op : TAG_FILTER_NONE;
+    *num_tags = count;
+    return 0;
+}
+
 // Parse ANSWER_SUBMIT
-int tlv_parse_answer_submit(const uint8_t *buffer, uint16_t *question_id,
+int tlv_parse_answer_submit(const uint8_t *buffer, uint32_t *question_id,
                              uint8_t *answer_id) {
-    const uint16_t *qid = (const uint16_t *)buffer;
-    *question_id = ntohs(*qid);
-    *answer_id = buffer[2];
+    uint32_t qid;
+    memcpy(&qid, buffer, 4);
+    *question_id = ntohl(qid);
+    *answer_id = buffer[4];
     
     return 0;
 }
 
 // Parse ANSWER_RESULT
-int tlv_parse_answer_result(const uint8_t *buffer, uint16_t *question_id,
+int tlv_parse_answer_result(const uint8_t *buffer, uint32_t *question_id,
                              uint8_t *is_correct, uint8_t *correct_answer_id,
                              uint8_t *test_mode, uint8_t *questions_answered,
                              uint8_t *correct_count) {
-    const uint16_t *qid = (const uint16_t *)buffer;
-    *question_id = ntohs(*qid);
-    *is_correct = buffer[2];
-    *correct_answer_id = buffer[3];
-    *test_mode = buffer[4];
-    *questions_answered = buffer[5];
-    *correct_count = buffer[6];
+    uint32_t qid;
+    memcpy(&qid, buffer, 4);
+    *question_id = ntohl(qid);
+    *is_correct = buffer[4];
+    *correct_answer_id = buffer[5];
+    *test_mode = buffer[6];
+    *questions_answered = buffer[7];
+    *correct_count = buffer[8];
     
     return 0;
 }
@@ -272,6 +443,71 @@ ssize_t tlv_create_request_ranking(uint8_t *buffer) {
     return 4;
 }
 
+// Create REQUEST_RANKING message for one page of the ranking
+ssize_t tlv_create_request_ranking_page(uint8_t *buffer, uint8_t mode, uint32_t offset,
+                                        uint8_t limit, const char *nick, uint8_t window) {
+    struct tlv_header *header = (struct tlv_header *)buffer;
+    size_t nick_len = strlen(nick);
+
+    if (nick_len >= MAX_NICK_LENGTH) {
+        return -1;
+    }
+
+    size_t pos = 4;
+    buffer[pos++] = mode;
+    uint32_t offset_net = htonl(offset);
+    memcpy(buffer + pos, &offset_net, 4);
+    pos += 4;
+    buffer[pos++] = limit;
+    buffer[pos++] = nick_len;
+    memcpy(buffer + pos, nick, nick_len);
+    pos += nick_len;
+    buffer[pos++] = window;
+
+    header->type = htons(TLV_REQUEST_RANKING);
+    header->length = htons(pos - 4);
+
+    return pos;
+}
+
+// Parse REQUEST_RANKING message
+int tlv_parse_request_ranking(const uint8_t *buffer, size_t length, uint8_t *mode,
+                              uint32_t *offset, uint8_t *limit, char *nick, size_t nick_size,
+                              uint8_t *window) {
+    *mode = RANKING_TOP;
+    *offset = 0;
+    *limit = 0;
+    nick[0] = '\0';
+    *window = RANKING_WINDOW_ALL;
+    if (length == 0) {
+        return 0;  // Plain request for the top players
+    }
+    if (length < 7) {
+        return -1;
+    }
+
+    *mode = buffer[0];
+    uint32_t offset_net;
+    memcpy(&offset_net, buffer + 1, 4);
+    *offset = ntohl(offset_net);
+    *limit = buffer[5];
+
+    uint8_t nick_len = buffer[6];
+    if (nick_len >= nick_size || 7 + (size_t)nick_len > length) {
+        return -1;
+    }
+    if (tlv_copy_nick(nick, buffer + 7, nick_len) < 0) {
+        return -1;
+    }
+
+    // The window was added later and is optional
+    if (length > 7 + (size_t)nick_len) {
+        *window = buffer[7 + nick_len];
+    }
+
+    return 0;
+}
+
 // Create RANKING_DATA message
 ssize_t tlv_create_ranking_data(uint8_t *buffer, uint8_t count, 
                                  const char nicks[][MAX_NICK_LENGTH],
@@ -289,8 +525,8 @@ ssize_t tlv_create_ranking_data(uint8_t *buffer, uint8_t count,
         
         buffer[pos++] = scores[i];
         
-        uint32_t *time_ptr = (uint32_t *)(buffer + pos);
-        *time_ptr = htonl(times[i]);
+        uint32_t time_net = htonl(times[i]);
+        memcpy(buffer + pos, &time_net, 4);  // Entries are not 4-byte aligned
         pos += 4;
     }
     
@@ -312,14 +548,16 @@ int tlv_parse_ranking_data(const uint8_t *buffer, uint8_t *count,
         if (nick_len >= MAX_NICK_LENGTH) {
             return -1;
         }
-        memcpy(nicks[i], buffer + pos, nick_len);
-        nicks[i][nick_len] = '\0';
+        if (tlv_copy_text(nicks[i], buffer + pos, nick_len) < 0) {
+            return -1;
+        }
         pos += nick_len;
         
         scores[i] = buffer[pos++];
         
-        const uint32_t *time_ptr = (const uint32_t *)(buffer + pos);
-        times[i] = ntohl(*time_ptr);
+        uint32_t time_net;
+        memcpy(&time_net, buffer + pos, 4);
+        times[i] = ntohl(time_net);
         pos += 4;
     }
     
@@ -462,8 +700,9 @@ int tlv_parse_server_info_data(const uint8_t *buffer, uint32_t *uptime_seconds,
     if (player_len >= MAX_NICK_LENGTH) {
         return -1;
     }
-    memcpy(best_player, buffer + pos, player_len);
-    best_player[player_len] = '\0';
+    if (tlv_copy_text(best_player, buffer + pos, player_len) < 0) {
+        return -1;
+    }
     pos += player_len;
     
     // Port
@@ -473,3 +712,551 @@ int tlv_parse_server_info_data(const uint8_t *buffer, uint32_t *uptime_seconds,
     
     return 0;
 }
+
+// Create ERROR message
+ssize_t tlv_create_error(uint8_t *buffer, uint8_t code, const char *message) {
+    struct tlv_header *header = (struct tlv_header *)buffer;
+    size_t msg_len = strlen(message);
+    
+    if (msg_len > MAX_MESSAGE_LENGTH) {
+        return -1;
+    }
+    
+    header->type = htons(TLV_ERROR);
+    header->length = htons(2 + msg_len);  // 1 code + 1 length + message
+    
+    buffer[4] = code;
+    buffer[5] = msg_len;
+    memcpy(buffer + 6, message, msg_len);
+    
+    return 4 + 2 + msg_len;
+}
+
+// Parse ERROR message
+int tlv_parse_error(const uint8_t *buffer, uint8_t *code, char *message, size_t msg_size) {
+    *code = buffer[0];
+    uint8_t msg_len = buffer[1];
+    
+    if (msg_len >= msg_size || msg_len > MAX_MESSAGE_LENGTH) {
+        return -1;
+    }
+    
+    if (tlv_copy_text(message, buffer + 2, msg_len) < 0) {
+        return -1;
+    }
+    
+    return 0;
+}
+
+// Create SEARCH_QUESTIONS message
+ssize_t tlv_create_search_questions(uint8_t *buffer, const char *query, uint16_t max_results) {
+    struct tlv_header *header = (struct tlv_header *)buffer;
+    size_t query_len = strlen(query);
+
+    if (query_len > MAX_SEARCH_QUERY_LENGTH) {
+        return -1;
+    }
+
+    header->type = htons(TLV_SEARCH_QUESTIONS);
+    header->length = htons(3 + query_len);  // 2 max_results + 1 length + query
+
+    uint16_t max_net = htons(max_results);
+    memcpy(buffer + 4, &max_net, 2);
+    buffer[6] = query_len;
+    memcpy(buffer + 7, query, query_len);
+
+    return 4 + 3 + query_len;
+}
+
+// Parse SEARCH_QUESTIONS message
+int tlv_parse_search_questions(const uint8_t *buffer, size_t length, char *query,
+                               size_t query_size, uint16_t *max_results) {
+    if (length < 3) {
+        return -1;
+    }
+
+    uint16_t max_net;
+    memcpy(&max_net, buffer, 2);
+    *max_results = ntohs(max_net);
+
+    uint8_t query_len = buffer[2];
+    if (query_len > MAX_SEARCH_QUERY_LENGTH || query_len >= query_size || 3 + (size_t)query_len > length) {
+        return -1;
+    }
+
+    if (tlv_copy_text(query, buffer + 3, query_len) < 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+// Create SEARCH_RESULTS message
+ssize_t tlv_create_search_results(uint8_t *buffer, const int *ids, int count) {
+    struct tlv_header *header = (struct tlv_header *)buffer;
+
+    if (count < 0 || count > MAX_SEARCH_IDS) {
+        return -1;
+    }
+
+    size_t pos = 4;
+    uint16_t count_net = htons(count);
+    memcpy(buffer + pos, &count_net, 2);
+    pos += 2;
+
+    // 32-bit ids: banks hold more than 65535 questions
+    for (int i = 0; i < count; i++) {
+        uint32_t id_net = htonl((uint32_t)ids[i]);
+        memcpy(buffer + pos, &id_net, 4);
+        pos += 4;
+    }
+
+    header->type = htons(TLV_SEARCH_RESULTS);
+    header->length = htons(pos - 4);
+
+    return pos;
+}
+
+// Parse SEARCH_RESULTS message
+int tlv_parse_search_results(const uint8_t *buffer, size_t length, int *ids, int *count) {
+    if (length < 2) {
+        return -1;
+    }
+
+    uint16_t count_net;
+    memcpy(&count_net, buffer, 2);
+    *count = ntohs(count_net);
+
+    if (*count > MAX_SEARCH_IDS || 2 + (size_t)*count * 4 > length) {
+        return -1;
+    }
+
+    for (int i = 0; i < *count; i++) {
+        uint32_t id_net;
+        memcpy(&id_net, buffer + 2 + i * 4, 4);
+        ids[i] = (int)ntohl(id_net);
+    }
+
+    return 0;
+}
+
+// Create REQUEST_RANK message
+ssize_t tlv_create_request_rank(uint8_t *buffer, const char *nick) {
+    struct tlv_header *header = (struct tlv_header *)buffer;
+    size_t nick_len = strlen(nick);
+
+    if (nick_len >= MAX_NICK_LENGTH) {
+        return -1;
+    }
+
+    header->type = htons(TLV_REQUEST_RANK);
+    header->length = htons(1 + nick_len);
+
+    buffer[4] = nick_len;
+    memcpy(buffer + 5, nick, nick_len);
+
+    return 4 + 1 + nick_len;
+}
+
+// Parse REQUEST_RANK message
+int tlv_parse_request_rank(const uint8_t *buffer, size_t length, char *nick, size_t nick_size) {
+    nick[0] = '\0';
+    if (length == 0) {
+        return 0;  // No nick: rank of the requesting player
+    }
+
+    uint8_t nick_len = buffer[0];
+    if (nick_len >= nick_size || 1 + (size_t)nick_len > length) {
+        return -1;
+    }
+
+    if (tlv_copy_nick(nick, buffer + 1, nick_len) < 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+// Create RANK_DATA message
+ssize_t tlv_create_rank_data(uint8_t *buffer, uint32_t rank, uint32_t total,
+                             uint8_t score, uint32_t time_seconds, const char *nick) {
+    struct tlv_header *header = (struct tlv_header *)buffer;
+    size_t nick_len = strlen(nick);
+
+    if (nick_len >= MAX_NICK_LENGTH) {
+        return -1;
+    }
+
+    size_t pos = 4;
+    uint32_t rank_net = htonl(rank);
+    memcpy(buffer + pos, &rank_net, 4);
+    pos += 4;
+    uint32_t total_net = htonl(total);
+    memcpy(buffer + pos, &total_net, 4);
+    pos += 4;
+    buffer[pos++] = score;
+    uint32_t time_net = htonl(time_seconds);
+    memcpy(buffer + pos, &time_net, 4);
+    pos += 4;
+    buffer[pos++] = nick_len;
+    memcpy(buffer + pos, nick, nick_len);
+    pos += nick_len;
+
+    header->type = htons(TLV_RANK_DATA);
+    header->length = htons(pos - 4);
+
+    return pos;
+}
+
+// Parse RANK_DATA message
+int tlv_parse_rank_data(const uint8_t *buffer, size_t length, uint32_t *rank, uint32_t *total,
+                        uint8_t *score, uint32_t *time_seconds, char *nick, size_t nick_size) {
+    if (length < 14) {
+        return -1;
+    }
+
+    uint32_t value;
+    memcpy(&value, buffer, 4);
+    *rank = ntohl(value);
+    memcpy(&value, buffer + 4, 4);
+    *total = ntohl(value);
+    *score = buffer[8];
+    memcpy(&value, buffer + 9, 4);
+    *time_seconds = ntohl(value);
+
+    uint8_t nick_len = buffer[13];
+    if (nick_len >= nick_size || 14 + (size_t)nick_len > length) {
+        return -1;
+    }
+    if (tlv_copy_text(nick, buffer + 14, nick_len) < 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+// Create RANKING_PAGE message
+ssize_t tlv_create_ranking_page(uint8_t *buffer, uint32_t first_rank, uint32_t total,
+                                uint8_t count, const char nicks[][MAX_NICK_LENGTH],
+                                const uint8_t *scores, const uint32_t *times) {
+    struct tlv_header *header = (struct tlv_header *)buffer;
+
+    if (count > MAX_RANKING_PAGE) {
+        return -1;
+    }
+
+    size_t pos = 4;
+    uint32_t first_net = htonl(first_rank);
+    memcpy(buffer + pos, &first_net, 4);
+    pos += 4;
+    uint32_t total_net = htonl(total);
+    memcpy(buffer + pos, &total_net, 4);
+    pos += 4;
+    buffer[pos++] = count;
+
+    // Entries have the RANKING_DATA layout
+    for (int i = 0; i < count; i++) {
+        uint8_t nick_len = strlen(nicks[i]);
+        buffer[pos++] = nick_len;
+        memcpy(buffer + pos, nicks[i], nick_len);
+        pos += nick_len;
+
+        buffer[pos++] = scores[i];
+
+        uint32_t time_net = htonl(times[i]);
+        memcpy(buffer + pos, &time_net, 4);
+        pos += 4;
+    }
+
+    header->type = htons(TLV_RANKING_PAGE);
+    header->length = htons(pos - 4);
+
+    return pos;
+}
+
+// Parse RANKING_PAGE message
+int tlv_parse_ranking_page(const uint8_t *buffer, size_t length, uint32_t *first_rank,
+                           uint32_t *total, uint8_t *count, char nicks[][MAX_NICK_LENGTH],
+                           uint8_t *scores, uint32_t *times) {
+    if (length < 9) {
+        return -1;
+    }
+
+    uint32_t value;
+    memcpy(&value, buffer, 4);
+    *first_rank = ntohl(value);
+    memcpy(&value, buffer + 4, 4);
+    *total = ntohl(value);
+    *count = buffer[8];
+    if (*count > MAX_RANKING_PAGE) {
+        return -1;
+    }
+
+    size_t pos = 9;
+    for (int i = 0; i < *count; i++) {
+        if (pos + 1 > length) {
+            return -1;
+        }
+        uint8_t nick_len = buffer[pos++];
+        if (nick_len >= MAX_NICK_LENGTH || pos + nick_len + 5 > length) {
+            return -1;
+        }
+        if (tlv_copy_text(nicks[i], buffer + pos, nick_len) < 0) {
+            return -1;
+        }
+        pos += nick_len;
+
+        scores[i] = buffer[pos++];
+
+        memcpy(&value, buffer + pos, 4);
+        times[i] = ntohl(value);
+        pos += 4;
+    }
+
+    return 0;
+}
+
+// 64-bit values are sent as two 32-bit halves, high first
+static void put_u64(uint8_t *buffer, uint64_t value) {
+    uint32_t half = htonl((uint32_t)(value >> 32));
+    memcpy(buffer, &half, 4);
+    half = htonl((uint32_t)value);
+    memcpy(buffer + 4, &half, 4);
+}
+
+static uint64_t get_u64(const uint8_t *buffer) {
+    uint32_t high, low;
+    memcpy(&high, buffer, 4);
+    memcpy(&low, buffer + 4, 4);
+    return (uint64_t)ntohl(high) << 32 | ntohl(low);
+}
+
+// Create REQUEST_LATENCY message
+ssize_t tlv_create_request_latency(uint8_t *buffer) {
+    struct tlv_header *header = (struct tlv_header *)buffer;
+
+    header->type = htons(TLV_REQUEST_LATENCY);
+    header->length = htons(0);  // No payload
+
+    return 4;
+}
+
+// Create LATENCY_DATA message
+ssize_t tlv_create_latency_data(uint8_t *buffer, uint8_t count, const struct latency_summary *entries) {
+    struct tlv_header *header = (struct tlv_header *)buffer;
+
+    if (count > MAX_LATENCY_SUMMARIES) {
+        return -1;
+    }
+
+    size_t pos = 4;
+    buffer[pos++] = count;
+    for (int i = 0; i < count; i++) {
+        uint16_t type_net = htons(entries[i].type);
+        memcpy(buffer + pos, &type_net, 2);
+        pos += 2;
+        buffer[pos++] = entries[i].phase;
+        put_u64(buffer + pos, entries[i].count);
+        pos += 8;
+        for (int q = 0; q < LATENCY_QUANTILES; q++) {
+            put_u64(buffer + pos, entries[i].quantiles_ns[q]);
+            pos += 8;
+        }
+        put_u64(buffer + pos, entries[i].max_ns);
+        pos += 8;
+    }
+
+    header->type = htons(TLV_LATENCY_DATA);
+    header->length = htons(pos - 4);
+
+    return pos;
+}
+
+// Parse LATENCY_DATA message
+int tlv_parse_latency_data(const uint8_t *buffer, size_t length, uint8_t *count,
+                           struct latency_summary *entries) {
+    const size_t entry_size = 2 + 1 + 8 + (LATENCY_QUANTILES + 1) * 8;
+
+    if (length < 1) {
+        return -1;
+    }
+    *count = buffer[0];
+    if (*count > MAX_LATENCY_SUMMARIES || 1 + *count * entry_size > length) {
+        return -1;
+    }
+
+    size_t pos = 1;
+    for (int i = 0; i < *count; i++) {
+        uint16_t type_net;
+        memcpy(&type_net, buffer + pos, 2);
+        entries[i].type = ntohs(type_net);
+        pos += 2;
+        entries[i].phase = buffer[pos++];
+        entries[i].count = get_u64(buffer + pos);
+        pos += 8;
+        for (int q = 0; q < LATENCY_QUANTILES; q++) {
+            entries[i].quantiles_ns[q] = get_u64(buffer + pos);
+            pos += 8;
+        }
+        entries[i].max_ns = get_u64(buffer + pos);
+        pos += 8;
+    }
+
+    return 0;
+}
+
+// Create REQUEST_QUESTION_STATS message
+ssize_t tlv_create_request_question_stats(uint8_t *buffer, const char *bank,
+                                          uint32_t offset, uint8_t limit) {
+    struct tlv_header *header = (struct tlv_header *)buffer;
+    size_t bank_len = bank ? strlen(bank) : 0;
+
+    if (bank_len >= MAX_BANK_NAME_LENGTH || limit > MAX_QUESTION_STATS_PAGE) {
+        return -1;
+    }
+
+    uint32_t offset_net = htonl(offset);
+    memcpy(buffer + 4, &offset_net, 4);
+    buffer[8] = limit;
+    buffer[9] = (uint8_t)bank_len;
+    memcpy(buffer + 10, bank, bank_len);
+
+    header->type = htons(TLV_REQUEST_QUESTION_STATS);
+    header->length = htons(6 + bank_len);
+
+    return 10 + bank_len;
+}
+
+// Parse REQUEST_QUESTION_STATS message
+int tlv_parse_request_question_stats(const uint8_t *buffer, size_t length, uint32_t *offset,
+                                     uint8_t *limit, char *bank, size_t bank_size) {
+    if (length < 6) {
+        return -1;
+    }
+
+    uint32_t offset_net;
+    memcpy(&offset_net, buffer, 4);
+    *offset = ntohl(offset_net);
+    *limit = buffer[4];
+    if (*limit == 0 || *limit > MAX_QUESTION_STATS_PAGE) {
+        *limit = MAX_QUESTION_STATS_PAGE;
+    }
+
+    uint8_t bank_len = buffer[5];
+    if (bank_len >= bank_size || bank_len >= MAX_BANK_NAME_LENGTH || 6 + (size_t)bank_len > length) {
+        return -1;
+    }
+    if (tlv_copy_text(bank, buffer + 6, bank_len) < 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+// Create QUESTION_STATS message
+ssize_t tlv_create_question_stats(uint8_t *buffer, uint32_t total, uint32_t offset,
+                                  uint8_t count, const struct question_summary *entries) {
+    struct tlv_header *header = (struct tlv_header *)buffer;
+
+    if (count > MAX_QUESTION_STATS_PAGE) {
+        return -1;
+    }
+
+    size_t pos = 4;
+    uint32_t value32 = htonl(total);
+    memcpy(buffer + pos, &value32, 4);
+    pos += 4;
+    value32 = htonl(offset);
+    memcpy(buffer + pos, &value32, 4);
+    pos += 4;
+    buffer[pos++] = count;
+
+    for (int i = 0; i < count; i++) {
+        value32 = htonl(entries[i].id);
+        memcpy(buffer + pos, &value32, 4);
+        pos += 4;
+        buffer[pos++] = entries[i].num_answers;
+        buffer[pos++] = entries[i].correct_answer;
+
+        value32 = htonl(entries[i].asked);
+        memcpy(buffer + pos, &value32, 4);
+        pos += 4;
+        value32 = htonl(entries[i].mean_response_ms);
+        memcpy(buffer + pos, &value32, 4);
+        pos += 4;
+        for (int a = 0; a < MAX_ANSWERS; a++) {
+            value32 = htonl(entries[i].chosen[a]);
+            memcpy(buffer + pos, &value32, 4);
+            pos += 4;
+        }
+    }
+
+    header->type = htons(TLV_QUESTION_STATS);
+    header->length = htons(pos - 4);
+
+    return pos;
+}
+
+// Parse QUESTION_STATS message
+int tlv_parse_question_stats(const uint8_t *buffer, size_t length, uint32_t *total,
+                             uint32_t *offset, uint8_t *count, struct question_summary *entries) {
+    const size_t entry_size = 4 + 1 + 1 + 4 + 4 + MAX_ANSWERS * 4;
+
+    if (length < 9) {
+        return -1;
+    }
+
+    uint32_t value32;
+    memcpy(&value32, buffer, 4);
+    *total = ntohl(value32);
+    memcpy(&value32, buffer + 4, 4);
+    *offset = ntohl(value32);
+    *count = buffer[8];
+    if (*count > MAX_QUESTION_STATS_PAGE || 9 + *count * entry_size > length) {
+        return -1;
+    }
+
+    size_t pos = 9;
+    for (int i = 0; i < *count; i++) {
+        memcpy(&value32, buffer + pos, 4);
+        entries[i].id = ntohl(value32);
+        pos += 4;
+        entries[i].num_answers = buffer[pos++];
+        entries[i].correct_answer = buffer[pos++];
+
+        memcpy(&value32, buffer + pos, 4);
+        entries[i].asked = ntohl(value32);
+        pos += 4;
+        memcpy(&value32, buffer + pos, 4);
+        entries[i].mean_response_ms = ntohl(value32);
+        pos += 4;
+        for (int a = 0; a < MAX_ANSWERS; a++) {
+            memcpy(&value32, buffer + pos, 4);
+            entries[i].chosen[a] = ntohl(value32);
+            pos += 4;
+        }
+    }
+
+    return 0;
+}
+
+// Create DISCOVER_REQUEST message
+ssize_t tlv_create_discover_request(uint8_t *buffer) {
+    struct tlv_header *header = (struct tlv_header *)buffer;
+
+    header->type = htons(TLV_DISCOVER_REQUEST);
+    header->length = htons(0);  // No payload
+
+    return 4;
+}
+
+// Create DISCOVER_RESPONSE message
+ssize_t tlv_create_discover_response(uint8_t *buffer, const uint8_t *announcement, uint16_t length) {
+    struct tlv_header *header = (struct tlv_header *)buffer;
+
+    header->type = htons(TLV_DISCOVER_RESPONSE);
+    header->length = htons(length);
+    memcpy(buffer + 4, announcement, length);
+
+    return 4 + length;
+}